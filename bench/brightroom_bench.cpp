@@ -0,0 +1,497 @@
+#include <HalideBuffer.h>
+#include <HalideRuntime.h>
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "AdjustmentCompiler.h"
+#include "AdjustmentStack.h"
+#include "Catalog.h"
+#include "ColorMatrix.h"
+#include "Generators.h"
+#include "HalideRawPipeline.h"
+#include "PackedBayer.h"
+#include "RawLoader.h"
+#include "SyntheticRaw.h"
+#include "Telemetry.h"
+#include "TestJpeg.h"
+#include "ToneCurve.h"
+
+// Throughput of the pipeline stages on synthetic frames, with the float32 libraries. Every benchmark reports Mpix/s
+// and the bytes it reads and writes per pixel. Write JSON for comparing commits with
+//   brightroom_bench --benchmark_out=bench.json --benchmark_out_format=json
+
+namespace {
+
+struct FrameSize {
+    int width;
+    int height;
+};
+
+// 12, 24, 45 and 100 MP
+constexpr std::array<FrameSize, 4> kFrameSizes{{{4256, 2832}, {6000, 4000}, {8256, 5504}, {11648, 8736}}};
+constexpr std::array<unsigned, 4> kCfaPatterns{brightroom::testing::kRggb, brightroom::testing::kBggr,
+                                               brightroom::testing::kGrbg, brightroom::testing::kGbrg};
+constexpr std::array<const char*, 4> kCfaNames{"RGGB", "BGGR", "GRBG", "GBRG"};
+
+// A synthetic frame and its demosaiced intermediate. Frames of 100 MP take seconds to generate, so the last one is
+// kept for the following benchmarks with the same size and pattern.
+struct Frame {
+    std::unique_ptr<brightroom::testing::SyntheticRaw> raw;
+    Halide::Runtime::Buffer<float> demosaiced;
+    Halide::Runtime::Buffer<int> cblack{4};
+    int width = 0;
+    int height = 0;
+    const brightroom::GeneratorSet* generators = nullptr;
+};
+
+auto Preprocess(Frame& frame, int demosaic_index = 0) -> int {
+    auto& imgdata = frame.raw->Get().imgdata;
+    Halide::Runtime::Buffer<uint16_t> input(imgdata.rawdata.raw_image, frame.width, frame.height);
+    // Indexed like brightroom::Demosaic
+    const std::array preprocess{frame.generators->preprocess, frame.generators->preprocess_mhc,
+                                frame.generators->preprocess_rcd};
+    return preprocess[demosaic_index](input.raw_buffer(), static_cast<int>(imgdata.idata.filters),
+                                      static_cast<int>(imgdata.color.black), frame.cblack.raw_buffer(),
+                                      static_cast<int>(imgdata.color.maximum), frame.demosaiced.raw_buffer());
+}
+
+auto GetFrame(int size_index, int cfa_index) -> Frame& {
+    static Frame frame;
+    static int cached_size = -1;
+    static int cached_cfa = -1;
+    if (size_index != cached_size || cfa_index != cached_cfa) {
+        frame = Frame{};  // Release the previous frame first
+        const auto size = kFrameSizes[size_index];
+        frame.width = size.width;
+        frame.height = size.height;
+        frame.generators = &brightroom::Generators(brightroom::IntermediateFormat::kFloat32);
+        frame.raw = std::make_unique<brightroom::testing::SyntheticRaw>(size.width, size.height,
+                                                                         kCfaPatterns[cfa_index]);
+        frame.cblack.fill(0);
+        frame.demosaiced = Halide::Runtime::Buffer<float>::make_interleaved(size.width, size.height, 3);
+        Preprocess(frame);
+        cached_size = size_index;
+        cached_cfa = cfa_index;
+    }
+    return frame;
+}
+
+// White balance, the base exposure and the camera matrix of the frame, as Process folds them
+auto ColorMatrixBuffer(const Frame& frame) -> Halide::Runtime::Buffer<float> {
+    const auto matrix = brightroom::FoldColorMatrix(frame.raw->File(), brightroom::kBaseExposure);
+    Halide::Runtime::Buffer<float> buffer(4, 3);
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 3; j++) {
+            buffer(i, j) = matrix[i][j];
+        }
+    }
+    return buffer;
+}
+
+void SetThroughputCounters(benchmark::State& state, int64_t pixels, int64_t bytes) {
+    state.SetItemsProcessed(state.iterations() * pixels);
+    state.SetBytesProcessed(state.iterations() * bytes);
+    state.counters["Mpix/s"] =
+        benchmark::Counter(static_cast<double>(state.iterations() * pixels) / 1e6, benchmark::Counter::kIsRate);
+    state.counters["bytes/pixel"] = static_cast<double>(bytes) / static_cast<double>(pixels);
+}
+
+void SetLabel(benchmark::State& state, int size_index, int cfa_index) {
+    const auto size = kFrameSizes[size_index];
+    state.SetLabel(std::to_string(static_cast<int64_t>(size.width) * size.height / 1000000) + "MP " +
+                   kCfaNames[cfa_index]);
+}
+
+// Args: frame size index, CFA pattern index, Halide threads, demosaic engine index
+void BM_Preprocess(benchmark::State& state) {
+    const int size_index = static_cast<int>(state.range(0));
+    const int cfa_index = static_cast<int>(state.range(1));
+    brightroom::SetHalideThreadCount(static_cast<int>(state.range(2)));
+    const int demosaic_index = static_cast<int>(state.range(3));
+    auto& frame = GetFrame(size_index, cfa_index);
+
+    for (auto _ : state) {
+        if (Preprocess(frame, demosaic_index) != 0) {
+            state.SkipWithError("preprocess_raw_generator failed");
+            break;
+        }
+    }
+    const int64_t pixels = static_cast<int64_t>(frame.width) * frame.height;
+    SetThroughputCounters(state, pixels, pixels * sizeof(uint16_t) + frame.demosaiced.size_in_bytes());
+    SetLabel(state, size_index, cfa_index);
+}
+
+// Args: frame size index, CFA pattern index, Halide threads, tone curve lookup table (0 or 1), histogram (0 or 1),
+// tone mapping (0 or 1)
+void BM_Process(benchmark::State& state) {
+    const int size_index = static_cast<int>(state.range(0));
+    const int cfa_index = static_cast<int>(state.range(1));
+    brightroom::SetHalideThreadCount(static_cast<int>(state.range(2)));
+    const bool tone_curve_lut = state.range(3) != 0;
+    const bool compute_histogram = state.range(4) != 0;
+    const float key_value = state.range(5) != 0 ? 0.18f : 0.0f;
+    constexpr float kLogAverage = 0.25f;
+    auto& frame = GetFrame(size_index, cfa_index);
+
+    auto color_matrix = ColorMatrixBuffer(frame);
+    constexpr float kContrast = 1.5f;
+    Halide::Runtime::Buffer<float> tone_curve(brightroom::kToneCurveSize);
+    brightroom::BakeToneCurve(kContrast, {tone_curve.data(), static_cast<size_t>(brightroom::kToneCurveSize)});
+    auto output = Halide::Runtime::Buffer<uint8_t>::make_interleaved(frame.width, frame.height, 3);
+    Halide::Runtime::Buffer<uint32_t> histogram(brightroom::ImageStatistics::kBins, 4);
+
+    for (auto _ : state) {
+        const auto& generators = *frame.generators;
+        const int error =
+            tone_curve_lut
+                ? generators.process_lut(frame.demosaiced.raw_buffer(), color_matrix.raw_buffer(), 1.0f, 1,
+                                         compute_histogram, kLogAverage, key_value, tone_curve.raw_buffer(),
+                                         output.raw_buffer(), histogram.raw_buffer())
+                : generators.process(frame.demosaiced.raw_buffer(), color_matrix.raw_buffer(), 1.0f, 1,
+                                     compute_histogram, kLogAverage, key_value, kContrast, output.raw_buffer(),
+                                     histogram.raw_buffer());
+        if (error != 0) {
+            state.SkipWithError("process_raw_generator failed");
+            break;
+        }
+    }
+    const int64_t pixels = static_cast<int64_t>(frame.width) * frame.height;
+    SetThroughputCounters(state, pixels, frame.demosaiced.size_in_bytes() + output.size_in_bytes());
+    SetLabel(state, size_index, cfa_index);
+}
+
+// Args: frame size index, Halide threads, histogram (0 or 1). The display stage alone, from a linear sRGB frame,
+// which is all HalideRawPipeline reruns when only contrast or saturation change.
+void BM_ProcessDisplay(benchmark::State& state) {
+    const int size_index = static_cast<int>(state.range(0));
+    brightroom::SetHalideThreadCount(static_cast<int>(state.range(1)));
+    const bool compute_histogram = state.range(2) != 0;
+    auto& frame = GetFrame(size_index, 0);
+    const auto& generators = *frame.generators;
+
+    auto color_matrix = ColorMatrixBuffer(frame);
+    auto linear = Halide::Runtime::Buffer<float>::make_interleaved(frame.width, frame.height, 3);
+    if (generators.process_linear(frame.demosaiced.raw_buffer(), color_matrix.raw_buffer(), 1, 0.25f, 0.0f,
+                                  linear.raw_buffer()) != 0) {
+        state.SkipWithError("process_linear_generator failed");
+        return;
+    }
+    constexpr float kContrast = 1.5f;
+    Halide::Runtime::Buffer<float> tone_curve(brightroom::kToneCurveSize);
+    brightroom::BakeToneCurve(kContrast, {tone_curve.data(), static_cast<size_t>(brightroom::kToneCurveSize)});
+    auto output = Halide::Runtime::Buffer<uint8_t>::make_interleaved(frame.width, frame.height, 3);
+    Halide::Runtime::Buffer<uint32_t> histogram(brightroom::ImageStatistics::kBins, 4);
+
+    for (auto _ : state) {
+        if (generators.process_display_lut(linear.raw_buffer(), 1.2f, compute_histogram, tone_curve.raw_buffer(),
+                                           output.raw_buffer(), histogram.raw_buffer()) != 0) {
+            state.SkipWithError("process_display_lut_generator failed");
+            break;
+        }
+    }
+    const int64_t pixels = static_cast<int64_t>(frame.width) * frame.height;
+    SetThroughputCounters(state, pixels, linear.size_in_bytes() + output.size_in_bytes());
+    SetLabel(state, size_index, 0);
+}
+
+// Args: frame size index, stack. The analytic display stage against the adjustment stack that renders the same image,
+// compiled before timing. Both use every hardware thread, a stack pipeline keeps the thread pool of its own runtime.
+void BM_ProcessDisplayStack(benchmark::State& state) {
+    const int size_index = static_cast<int>(state.range(0));
+    const bool use_stack = state.range(1) != 0;
+    brightroom::SetHalideThreadCount(static_cast<int>(std::max(1u, std::thread::hardware_concurrency())));
+    auto& frame = GetFrame(size_index, 0);
+    const auto& generators = *frame.generators;
+
+    auto color_matrix = ColorMatrixBuffer(frame);
+    auto linear = Halide::Runtime::Buffer<float>::make_interleaved(frame.width, frame.height, 3);
+    if (generators.process_linear(frame.demosaiced.raw_buffer(), color_matrix.raw_buffer(), 1, 0.25f, 0.0f,
+                                  linear.raw_buffer()) != 0) {
+        state.SkipWithError("process_linear_generator failed");
+        return;
+    }
+    constexpr float kContrast = 1.5f;
+    constexpr float kSaturation = 1.2f;
+    const auto stack = *brightroom::ParseAdjustmentStack("gamma 2.2, contrast 1.5, saturation 1.2");
+    auto& compiler = brightroom::AdjustmentCompiler::Global();
+    if (use_stack && !compiler.Prepare(stack, 8)) {
+        state.SkipWithError("adjustment stack compile failed");
+        return;
+    }
+    auto output = Halide::Runtime::Buffer<uint8_t>::make_interleaved(frame.width, frame.height, 3);
+    Halide::Runtime::Buffer<uint32_t> histogram(brightroom::ImageStatistics::kBins, 4);
+
+    for (auto _ : state) {
+        const int error = use_stack ? compiler.Run(stack, linear.raw_buffer(), true, output.raw_buffer(),
+                                                   histogram.raw_buffer())
+                                    : generators.process_display(linear.raw_buffer(), kSaturation, true, kContrast,
+                                                                 output.raw_buffer(), histogram.raw_buffer());
+        if (error != 0) {
+            state.SkipWithError("display stage failed");
+            break;
+        }
+    }
+    const int64_t pixels = static_cast<int64_t>(frame.width) * frame.height;
+    SetThroughputCounters(state, pixels, linear.size_in_bytes() + output.size_in_bytes());
+    SetLabel(state, size_index, 0);
+}
+
+// Args: frame size index, Halide threads. The once-per-image log-average luminance that tone mapping reads, sampled
+// on a grid 256 columns wide as Preprocess does.
+void BM_LuminanceStatistics(benchmark::State& state) {
+    const int size_index = static_cast<int>(state.range(0));
+    brightroom::SetHalideThreadCount(static_cast<int>(state.range(1)));
+    auto& frame = GetFrame(size_index, 0);
+    Halide::Runtime::Buffer<float> wb_factors(3);
+    wb_factors.fill(1.0f);
+    auto log_average = Halide::Runtime::Buffer<float>::make_scalar();
+    const int downscale = std::max(1, frame.width / 256);
+
+    for (auto _ : state) {
+        if (frame.generators->luminance_statistics(frame.demosaiced.raw_buffer(), wb_factors.raw_buffer(), downscale,
+                                                   log_average.raw_buffer()) != 0) {
+            state.SkipWithError("luminance_statistics_generator failed");
+            break;
+        }
+    }
+    const int64_t pixels = static_cast<int64_t>(frame.width) * frame.height;
+    SetThroughputCounters(state, pixels, frame.demosaiced.size_in_bytes());
+    SetLabel(state, size_index, 0);
+}
+
+// Args: frame size index. Expands the packed 14-bit sensor data of a RawFile to the 16-bit samples the generators
+// read, on one thread. Preprocess does this on Halide's thread pool before every call.
+void BM_UnpackBayer(benchmark::State& state) {
+    const int size_index = static_cast<int>(state.range(0));
+    const auto& raw = GetFrame(size_index, 0).raw->File();
+    std::vector<uint16_t> unpacked(static_cast<size_t>(raw.width) * raw.height);
+
+    for (auto _ : state) {
+        brightroom::UnpackBayerRows(raw, 0, raw.height, unpacked.data(), raw.width);
+        benchmark::DoNotOptimize(unpacked.data());
+    }
+    const int64_t pixels = static_cast<int64_t>(raw.width) * raw.height;
+    SetThroughputCounters(state, pixels, static_cast<int64_t>(raw.packed->size()) + pixels * sizeof(uint16_t));
+    SetLabel(state, size_index, 0);
+}
+
+// Args: frame size index, display size divisor. The embedded preview is a full-size JPEG, decoding it is single
+// threaded and does not depend on the CFA pattern. A divisor above 1 decodes for a view that much smaller than the
+// frame, as opening an image does, which lets libjpeg scale in the IDCT.
+void BM_CreateThumbnail(benchmark::State& state) {
+    const auto size = kFrameSizes[state.range(0)];
+    const auto divisor = static_cast<int>(state.range(1));
+    brightroom::testing::SyntheticRaw raw(2, 2);
+    auto jpeg = brightroom::testing::EncodeJpeg(size.width, size.height);
+    const auto jpeg_size = static_cast<int64_t>(jpeg.size());
+    raw.SetThumbnail(std::move(jpeg), size.width, size.height);
+
+    int64_t decoded_size = 0;
+    for (auto _ : state) {
+        auto thumbnail = brightroom::CreateThumbnail(raw.Get(), size.width / divisor, size.height / divisor);
+        benchmark::DoNotOptimize(thumbnail.pixels->data());
+        decoded_size = static_cast<int64_t>(thumbnail.pixels->size());
+    }
+    // Rates are in preview pixels, so they compare across divisors
+    const int64_t pixels = static_cast<int64_t>(size.width) * size.height;
+    SetThroughputCounters(state, pixels, jpeg_size + decoded_size);
+    SetLabel(state, static_cast<int>(state.range(0)), 0);
+}
+
+// Args: worker threads. Rescans a folder tree of 10k RAW files that are all in the catalog already, which is one
+// directory walk and one stat per file. The tree is created in the temp directory and removed afterwards.
+void BM_CatalogRescan(benchmark::State& state) {
+    constexpr int kDirectories = 100;
+    constexpr int kFilesPerDirectory = 100;
+    const auto root = std::filesystem::temp_directory_path() / "brightroom_bench_catalog";
+    for (int d = 0; d < kDirectories; ++d) {
+        const auto directory = root / std::to_string(d);
+        std::filesystem::create_directories(directory);
+        for (int f = 0; f < kFilesPerDirectory; ++f) {
+            const auto file = directory / ("IMG_" + std::to_string(f) + ".CR2");
+            std::ofstream(file) << "raw";
+        }
+    }
+    const auto threads = static_cast<int>(state.range(0));
+    brightroom::Catalog catalog;
+    catalog.Scan({root}, threads);
+
+    for (auto _ : state) {
+        const auto report = catalog.Scan({root}, threads);
+        if (report.opened != 0) {
+            state.SkipWithError("rescan opened files");
+            break;
+        }
+    }
+    state.counters["files/s"] = benchmark::Counter(static_cast<double>(state.iterations()) * kDirectories *
+                                                       kFilesPerDirectory,
+                                                   benchmark::Counter::kIsRate);
+    std::error_code error;
+    std::filesystem::remove_all(root, error);
+}
+
+// Opens and unpacks a real RAW file the way BatchConverter's decode stage does. The file is read once beforehand,
+// so every iteration finds it in the page cache and the difference between the modes is the syscalls and the
+// copies on the way into LibRaw, not the disk.
+void BM_LoadRaw(benchmark::State& state, const std::filesystem::path& file, brightroom::RawInput input) {
+    brightroom::RawLoader loader{nullptr, input};
+    if (!loader.LoadRaw(file.string())) {
+        state.SkipWithError("LibRaw cannot read the file");
+        return;
+    }
+    for (auto _ : state) {
+        auto raw = loader.LoadRaw(file.string());
+        benchmark::DoNotOptimize(raw->packed);
+    }
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(std::filesystem::file_size(file)));
+}
+
+// From opening a real RAW file to its first displayed frame without a disk cache, as the viewer does: LoadRaw, the
+// binned preview and a quarter-size render of it
+void BM_OpenToFirstPixel(benchmark::State& state, const std::filesystem::path& file, brightroom::RawInput input) {
+    brightroom::RawLoader loader{nullptr, input};
+    brightroom::HalideRawPipeline pipeline;
+    const brightroom::Viewport viewport{{}, 4, false};
+    for (auto _ : state) {
+        auto raw = loader.LoadRaw(file.string());
+        if (!raw) {
+            state.SkipWithError("LibRaw cannot read the file");
+            break;
+        }
+        pipeline.Preprocess(*raw, brightroom::PreprocessMode::kPreview);
+        const auto frame = pipeline.Process(*raw, brightroom::Parameters{}, viewport);
+        if (!frame) {
+            state.SkipWithError("Process failed");
+            break;
+        }
+        benchmark::DoNotOptimize(frame->pixels);
+    }
+}
+
+// RAW samples to load, from $BRIGHTROOM_BENCH_RAW: files or directories separated by ':' (';' on Windows)
+auto SampleRawFiles() -> std::vector<std::filesystem::path> {
+    std::vector<std::filesystem::path> files;
+    const char* variable = std::getenv("BRIGHTROOM_BENCH_RAW");
+    if (!variable) {
+        return files;
+    }
+#ifdef _WIN32
+    constexpr char kSeparator = ';';
+#else
+    constexpr char kSeparator = ':';
+#endif
+    std::string list = variable;
+    for (size_t start = 0, end = 0; start <= list.size(); start = end + 1) {
+        end = std::min(list.find(kSeparator, start), list.size());
+        const std::filesystem::path path = list.substr(start, end - start);
+        std::error_code error;
+        if (std::filesystem::is_directory(path, error)) {
+            for (const auto& entry : std::filesystem::directory_iterator(path, error)) {
+                if (brightroom::IsRawFile(entry.path())) {
+                    files.push_back(entry.path());
+                }
+            }
+        } else if (!path.empty()) {
+            files.push_back(path);
+        }
+    }
+    return files;
+}
+
+// 1, 2, 4, ... up to all hardware threads
+auto ThreadCounts() -> std::vector<int64_t> {
+    const auto hardware_threads = static_cast<int64_t>(std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<int64_t> counts;
+    for (int64_t threads = 1; threads < hardware_threads; threads *= 2) {
+        counts.push_back(threads);
+    }
+    counts.push_back(hardware_threads);
+    return counts;
+}
+
+// Sizes vary slowest, so consecutive runs share the cached frame
+void RegisterBenchmarks() {
+    const std::vector<int64_t> sizes{0, 1, 2, 3};
+    const std::vector<int64_t> patterns{0, 1, 2, 3};
+    benchmark::RegisterBenchmark("Preprocess", BM_Preprocess)
+        ->ArgsProduct({sizes, patterns, ThreadCounts(), {0, 1, 2}})
+        ->ArgNames({"size", "cfa", "threads", "demosaic"})
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+    benchmark::RegisterBenchmark("Process", BM_Process)
+        ->ArgsProduct({sizes, patterns, ThreadCounts(), {0, 1}, {0, 1}, {0, 1}})
+        ->ArgNames({"size", "cfa", "threads", "lut", "histogram", "tone_mapping"})
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+    benchmark::RegisterBenchmark("ProcessDisplay", BM_ProcessDisplay)
+        ->ArgsProduct({sizes, ThreadCounts(), {0, 1}})
+        ->ArgNames({"size", "threads", "histogram"})
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+    benchmark::RegisterBenchmark("ProcessDisplayStack", BM_ProcessDisplayStack)
+        ->ArgsProduct({sizes, {0, 1}})
+        ->ArgNames({"size", "stack"})
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+    benchmark::RegisterBenchmark("LuminanceStatistics", BM_LuminanceStatistics)
+        ->ArgsProduct({sizes, ThreadCounts()})
+        ->ArgNames({"size", "threads"})
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+    benchmark::RegisterBenchmark("UnpackBayer", BM_UnpackBayer)
+        ->ArgsProduct({sizes})
+        ->ArgNames({"size"})
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+    benchmark::RegisterBenchmark("CreateThumbnail", BM_CreateThumbnail)
+        ->ArgsProduct({sizes, {1, 2, 4, 8}})
+        ->ArgNames({"size", "divisor"})
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+    for (const auto& file : SampleRawFiles()) {
+        for (auto [input, name] : {std::pair{brightroom::RawInput::kFile, "file"},
+                                   std::pair{brightroom::RawInput::kMapped, "mmap"}}) {
+            const auto benchmark_name = "LoadRaw/" + file.filename().string() + "/" + name;
+            benchmark::RegisterBenchmark(benchmark_name.c_str(),
+                                         [file, input](benchmark::State& state) { BM_LoadRaw(state, file, input); })
+                ->Unit(benchmark::kMillisecond)
+                ->UseRealTime();
+            const auto first_pixel_name = "OpenToFirstPixel/" + file.filename().string() + "/" + name;
+            benchmark::RegisterBenchmark(
+                first_pixel_name.c_str(),
+                [file, input](benchmark::State& state) { BM_OpenToFirstPixel(state, file, input); })
+                ->Unit(benchmark::kMillisecond)
+                ->UseRealTime();
+        }
+    }
+    benchmark::RegisterBenchmark("CatalogRescan", BM_CatalogRescan)
+        ->ArgsProduct({ThreadCounts()})
+        ->ArgNames({"threads"})
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    RegisterBenchmarks();
+#ifdef BRIGHTROOM_HALIDE_TARGETS
+    // The generators pick one of these at runtime, results are only comparable on the same CPU
+    benchmark::AddCustomContext("halide_targets", BRIGHTROOM_HALIDE_TARGETS);
+#endif
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
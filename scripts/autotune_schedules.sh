@@ -0,0 +1,59 @@
+#!/bin/bash
+# Regenerates the checked-in Halide schedules in src/pipeline/halide/schedules, one per generator.
+# Run it on the reference machine after changing a generator, then compare brightroom_bench results before and after
+# and commit the schedules together with the generator change.
+#
+# Usage: scripts/autotune_schedules.sh [build directory], or build the autotune_schedules target
+set -euo pipefail
+
+source_dir=$(cd "$(dirname "$0")/.." && pwd)
+build_dir=${1:-${source_dir}/build-autotune}
+schedule_dir=${source_dir}/src/pipeline/halide/schedules
+generators="preprocess_raw_generator preprocess_raw_mhc_generator preprocess_raw_rcd_generator preview_raw_generator
+    process_raw_generator process_raw_lut_generator process_raw_rgb16_generator process_linear_generator
+    process_display_generator process_display_lut_generator luminance_statistics_generator"
+
+# Search with a wide beam for this machine only, ignoring the schedules checked in now
+cmake -S "${source_dir}" -B "${build_dir}" -DCMAKE_BUILD_TYPE=Release -DBRIGHTROOM_HALIDE_AUTOTUNE=ON \
+    -DBRIGHTROOM_HALIDE_TARGETS=host
+
+# The float32 libraries carry the schedule names, the other intermediate formats reuse their schedules
+libraries=()
+for generator in ${generators}; do
+    libraries+=("${generator}")
+done
+cmake --build "${build_dir}" --parallel --target "${libraries[@]}"
+
+registry=${schedule_dir}/schedules.h
+{
+    echo "// Generated by scripts/autotune_schedules.sh from the *.schedule.h files in this directory, do not edit"
+    echo "#pragma once"
+    echo ""
+    echo "#include <Halide.h>"
+    echo "#include <string>"
+    for library in "${libraries[@]}"; do
+        echo "#include \"${library}.schedule.h\""
+    done
+    echo ""
+    echo "namespace brightroom {"
+    echo ""
+    echo "using ApplySchedule = void (*)(Halide::Pipeline pipeline, Halide::Target target);"
+    echo ""
+    echo "// The checked-in schedule of that name, nullptr if there is none"
+    echo "inline auto FindSchedule([[maybe_unused]] const std::string& name) -> ApplySchedule {"
+    for library in "${libraries[@]}"; do
+        echo "    if (name == \"${library}\") {"
+        echo "        return apply_schedule_${library};"
+        echo "    }"
+    done
+    echo "    return nullptr;"
+    echo "}"
+    echo ""
+    echo "}  // namespace brightroom"
+} > "${registry}.new"
+
+for library in "${libraries[@]}"; do
+    cp "${build_dir}/src/pipeline/${library}.schedule.h" "${schedule_dir}/"
+done
+mv "${registry}.new" "${registry}"
+echo "Wrote ${#libraries[@]} schedules to ${schedule_dir}"
@@ -0,0 +1,509 @@
+#include "Catalog.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <unordered_set>
+#include "RawLoader.h"
+#include "Tracy.hpp"
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+constexpr char kIndexMagic[4] = {'B', 'R', 'C', 'I'};
+// Version 2 stores image and thumbnail dimensions in 32 bits
+constexpr uint32_t kIndexVersion = 2;
+
+auto Key(const std::filesystem::path& path) -> std::string {
+    return path.generic_string();
+}
+
+auto Normalized(const std::filesystem::path& path) -> std::filesystem::path {
+    std::error_code error;
+    auto absolute = std::filesystem::absolute(path, error);
+    return (error ? path : absolute).lexically_normal();
+}
+
+// LibRaw's fixed-size strings are not always terminated
+template <size_t N>
+auto FieldString(const char (&field)[N]) -> std::string {
+    return std::string(field, strnlen(field, N));
+}
+
+// Directories still to be listed. Workers take one at a time and add the subdirectories they find; the walk is over
+// once the queue is empty and no worker is listing a directory that could add more.
+class DirectoryQueue {
+   public:
+    void Push(std::filesystem::path directory) {
+        std::lock_guard lock(_mutex);
+        _pending.push_back(std::move(directory));
+        _changed.notify_one();
+    }
+
+    auto Pop() -> std::optional<std::filesystem::path> {
+        std::unique_lock lock(_mutex);
+        _changed.wait(lock, [this] { return !_pending.empty() || _listing == 0; });
+        if (_pending.empty()) {
+            return std::nullopt;
+        }
+        auto directory = std::move(_pending.front());
+        _pending.pop_front();
+        ++_listing;
+        return directory;
+    }
+
+    // Called once the directory from Pop has been listed
+    void Done() {
+        std::lock_guard lock(_mutex);
+        if (--_listing == 0 && _pending.empty()) {
+            _changed.notify_all();
+        }
+    }
+
+   private:
+    std::mutex _mutex;
+    std::condition_variable _changed;
+    std::deque<std::filesystem::path> _pending;
+    int _listing = 0;
+};
+
+// Little-endian host layout, the index is a cache and not meant to move between machines
+class IndexWriter {
+   public:
+    template <typename T>
+    void Put(T value) {
+        const auto offset = _bytes.size();
+        _bytes.resize(offset + sizeof(T));
+        std::memcpy(_bytes.data() + offset, &value, sizeof(T));
+    }
+    void PutString(const std::string& value) {
+        Put(static_cast<uint32_t>(value.size()));
+        _bytes.append(value);
+    }
+    auto Bytes() const -> const std::string& { return _bytes; }
+
+   private:
+    std::string _bytes;
+};
+
+class IndexReader {
+   public:
+    explicit IndexReader(std::span<const char> bytes) : _bytes(bytes) {}
+
+    template <typename T>
+    auto Get() -> T {
+        T value{};
+        if (_offset + sizeof(T) > _bytes.size()) {
+            _valid = false;
+            return value;
+        }
+        std::memcpy(&value, _bytes.data() + _offset, sizeof(T));
+        _offset += sizeof(T);
+        return value;
+    }
+    auto GetString() -> std::string {
+        const auto size = Get<uint32_t>();
+        if (!_valid || _offset + size > _bytes.size()) {
+            _valid = false;
+            return {};
+        }
+        std::string value(_bytes.data() + _offset, size);
+        _offset += size;
+        return value;
+    }
+    auto Valid() const -> bool { return _valid; }
+    auto AtEnd() const -> bool { return _offset == _bytes.size(); }
+
+   private:
+    std::span<const char> _bytes;
+    size_t _offset = 0;
+    bool _valid = true;
+};
+
+// Directories, makes, models and lenses repeat across thousands of entries and are stored once
+class StringTable {
+   public:
+    auto Add(const std::string& value) -> uint32_t {
+        auto [it, inserted] = _indices.try_emplace(value, static_cast<uint32_t>(_strings.size()));
+        if (inserted) {
+            _strings.push_back(value);
+        }
+        return it->second;
+    }
+    auto Strings() const -> const std::vector<std::string>& { return _strings; }
+
+   private:
+    std::unordered_map<std::string, uint32_t> _indices;
+    std::vector<std::string> _strings;
+};
+
+}  // namespace
+
+namespace brightroom {
+
+auto CatalogEntryOf(const LibRaw& raw, const std::filesystem::path& path) -> CatalogEntry {
+    const auto& data = raw.imgdata;
+    CatalogEntry entry;
+    entry.path = path;
+    entry.readable = true;
+    entry.make = FieldString(data.idata.make);
+    entry.model = FieldString(data.idata.model);
+    entry.lens = FieldString(data.lens.Lens);
+    entry.iso = data.other.iso_speed;
+    entry.shutter = data.other.shutter;
+    entry.aperture = data.other.aperture;
+    entry.focal_length = data.other.focal_len;
+    entry.timestamp = static_cast<int64_t>(data.other.timestamp);
+    entry.width = data.sizes.width;
+    entry.height = data.sizes.height;
+    entry.raw_width = data.sizes.raw_width;
+    entry.raw_height = data.sizes.raw_height;
+    entry.flip = data.sizes.flip;
+    entry.filters = data.idata.filters;
+    entry.colors = data.idata.colors;
+    entry.bits = static_cast<int>(data.color.raw_bps);
+#if LIBRAW_COMPILE_CHECK_VERSION_NOTLESS(0, 21)
+    // The same preview unpack_thumb picks by default
+    const libraw_thumbnail_item_t* largest = nullptr;
+    for (int i = 0; i < data.thumbs_list.thumbcount; ++i) {
+        const auto& thumbnail = data.thumbs_list.thumblist[i];
+        if (!largest || thumbnail.twidth * thumbnail.theight > largest->twidth * largest->theight) {
+            largest = &thumbnail;
+        }
+    }
+    if (largest) {
+        entry.thumbnail_offset = static_cast<uint64_t>(largest->toffset);
+        entry.thumbnail_length = largest->tlength;
+        entry.thumbnail_width = largest->twidth;
+        entry.thumbnail_height = largest->theight;
+        entry.thumbnail_format = largest->tformat;
+    }
+#else
+    entry.thumbnail_length = data.thumbnail.tlength;
+    entry.thumbnail_width = data.thumbnail.twidth;
+    entry.thumbnail_height = data.thumbnail.theight;
+    entry.thumbnail_format = data.thumbnail.tformat;
+#endif
+    return entry;
+}
+
+auto Catalog::Scan(const std::vector<std::filesystem::path>& roots, int threads, std::stop_token stop_token)
+    -> ScanReport {
+    ZoneScoped;
+    const auto start = Clock::now();
+    if (threads <= 0) {
+        threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    }
+
+    std::vector<std::string> directory_roots;
+    std::vector<std::string> file_roots;
+    DirectoryQueue directories;
+    for (const auto& root : roots) {
+        const auto path = Normalized(root);
+        std::error_code error;
+        if (std::filesystem::is_directory(path, error)) {
+            directory_roots.push_back(Key(path) + "/");
+            directories.Push(path);
+        } else {
+            file_roots.push_back(Key(path));
+        }
+    }
+
+    std::atomic<size_t> opened{0};
+    std::atomic<size_t> unchanged{0};
+    // Unchanged files are taken from the catalog, which nothing modifies while the workers run
+    auto scan_file = [&](LibRaw& raw, const std::filesystem::path& path, uint64_t size,
+                         int64_t modified) -> CatalogEntry {
+        // The walk starts from normalized roots, so the paths it finds can be looked up as they are
+        const auto existing = _by_path.find(Key(path));
+        if (existing != _by_path.end() && _entries[existing->second].file_size == size &&
+            _entries[existing->second].modified == modified) {
+            unchanged.fetch_add(1);
+            return _entries[existing->second];
+        }
+        ZoneScopedN("open_file");
+        opened.fetch_add(1);
+        CatalogEntry entry;
+        if (raw.open_file(path.string().c_str()) == LIBRAW_SUCCESS) {
+            entry = CatalogEntryOf(raw, path);
+        }
+        raw.recycle();
+        entry.path = path;
+        entry.file_size = size;
+        entry.modified = modified;
+        return entry;
+    };
+
+    std::vector<std::vector<CatalogEntry>> found(threads + 1);
+    {
+        // Roots that name files directly are few, the calling thread handles them
+        LibRaw raw;
+        for (const auto& file : file_roots) {
+            std::error_code error;
+            const auto size = std::filesystem::file_size(file, error);
+            const auto modified = std::filesystem::last_write_time(file, error);
+            if (!error) {
+                found[threads].push_back(scan_file(raw, file, size, modified.time_since_epoch().count()));
+            }
+        }
+    }
+
+    std::vector<std::jthread> workers;
+    for (int i = 0; i < threads; ++i) {
+        workers.emplace_back([&, i] {
+            // One LibRaw per worker, reused for every file. Constructing one allocates several hundred KB.
+            auto raw = std::make_unique<LibRaw>();
+            auto& entries = found[i];
+            while (auto directory = directories.Pop()) {
+                ZoneScopedN("list_directory");
+                std::error_code error;
+                const auto options = std::filesystem::directory_options::skip_permission_denied;
+                for (std::filesystem::directory_iterator it(*directory, options, error), end; !error && it != end;
+                     it.increment(error)) {
+                    if (stop_token.stop_requested()) {
+                        break;
+                    }
+                    const auto& file = *it;
+                    std::error_code file_error;
+                    if (file.is_directory(file_error)) {
+                        if (!file.is_symlink(file_error)) {
+                            directories.Push(file.path());
+                        }
+                        continue;
+                    }
+                    if (!file.is_regular_file(file_error) || !IsRawFile(file.path())) {
+                        continue;
+                    }
+                    const auto size = file.file_size(file_error);
+                    const auto modified = file.last_write_time(file_error);
+                    if (!file_error) {
+                        entries.push_back(scan_file(*raw, file.path(), size, modified.time_since_epoch().count()));
+                    }
+                }
+                directories.Done();
+            }
+        });
+    }
+    workers.clear();
+
+    ScanReport report;
+    if (stop_token.stop_requested()) {
+        report.wall_time = Clock::now() - start;
+        return report;
+    }
+
+    // Entries outside the scanned roots stay, entries inside them are replaced by what the scan found
+    auto scanned = [&](const std::string& key) {
+        return std::find(file_roots.begin(), file_roots.end(), key) != file_roots.end() ||
+               std::any_of(directory_roots.begin(), directory_roots.end(),
+                           [&](const std::string& root) { return key.starts_with(root); });
+    };
+    std::vector<CatalogEntry> entries;
+    for (auto& worker_entries : found) {
+        report.files += worker_entries.size();
+        for (auto& entry : worker_entries) {
+            report.unreadable += entry.readable ? 0 : 1;
+            entries.push_back(std::move(entry));
+        }
+    }
+    const auto found_files = entries.size();
+    for (auto& entry : _entries) {
+        if (!scanned(Key(entry.path))) {
+            entries.push_back(std::move(entry));
+        }
+    }
+    std::unordered_set<std::string> seen;
+    for (size_t i = 0; i < found_files; ++i) {
+        seen.insert(Key(entries[i].path));
+    }
+    for (const auto& [key, index] : _by_path) {
+        report.removed += scanned(key) && !seen.contains(key) ? 1 : 0;
+    }
+    report.opened = opened.load();
+    report.unchanged = unchanged.load();
+    _entries = std::move(entries);
+    Rebuild();
+    report.wall_time = Clock::now() - start;
+    return report;
+}
+
+void Catalog::Update(CatalogEntry entry) {
+    entry.path = Normalized(entry.path);
+    if (auto existing = _by_path.find(Key(entry.path)); existing != _by_path.end()) {
+        _entries[existing->second] = std::move(entry);
+        return;
+    }
+    _by_path.emplace(Key(entry.path), _entries.size());
+    _entries.push_back(std::move(entry));
+}
+
+auto Catalog::Find(const std::filesystem::path& path) const -> const CatalogEntry* {
+    const auto existing = _by_path.find(Key(Normalized(path)));
+    return existing == _by_path.end() ? nullptr : &_entries[existing->second];
+}
+
+void Catalog::Rebuild() {
+    // Sorted by path, which groups each directory's files together in the index
+    std::vector<std::pair<std::string, size_t>> keys;
+    keys.reserve(_entries.size());
+    for (size_t i = 0; i < _entries.size(); ++i) {
+        keys.emplace_back(Key(_entries[i].path), i);
+    }
+    std::sort(keys.begin(), keys.end());
+    std::vector<CatalogEntry> entries;
+    entries.reserve(_entries.size());
+    _by_path.clear();
+    _by_path.reserve(keys.size());
+    for (auto& [key, index] : keys) {
+        _by_path.emplace(std::move(key), entries.size());
+        entries.push_back(std::move(_entries[index]));
+    }
+    _entries = std::move(entries);
+}
+
+auto Catalog::Save(const std::filesystem::path& index_file) const -> bool {
+    ZoneScoped;
+    StringTable strings;
+    IndexWriter entries;
+    for (const auto& entry : _entries) {
+        entries.Put(strings.Add(entry.path.parent_path().generic_string()));
+        entries.PutString(entry.path.filename().string());
+        entries.Put(entry.file_size);
+        entries.Put(entry.modified);
+        entries.Put(static_cast<uint8_t>(entry.readable));
+        if (!entry.readable) {
+            continue;
+        }
+        entries.Put(strings.Add(entry.make));
+        entries.Put(strings.Add(entry.model));
+        entries.Put(strings.Add(entry.lens));
+        entries.Put(entry.iso);
+        entries.Put(entry.shutter);
+        entries.Put(entry.aperture);
+        entries.Put(entry.focal_length);
+        entries.Put(entry.timestamp);
+        entries.Put(static_cast<uint32_t>(entry.width));
+        entries.Put(static_cast<uint32_t>(entry.height));
+        entries.Put(static_cast<uint32_t>(entry.raw_width));
+        entries.Put(static_cast<uint32_t>(entry.raw_height));
+        entries.Put(static_cast<int8_t>(entry.flip));
+        entries.Put(entry.filters);
+        entries.Put(static_cast<uint8_t>(entry.colors));
+        entries.Put(static_cast<uint8_t>(entry.bits));
+        entries.Put(entry.thumbnail_offset);
+        entries.Put(entry.thumbnail_length);
+        entries.Put(static_cast<uint32_t>(entry.thumbnail_width));
+        entries.Put(static_cast<uint32_t>(entry.thumbnail_height));
+        entries.Put(static_cast<uint8_t>(entry.thumbnail_format));
+    }
+
+    IndexWriter header;
+    for (char c : kIndexMagic) {
+        header.Put(c);
+    }
+    header.Put(kIndexVersion);
+    header.Put(static_cast<uint32_t>(strings.Strings().size()));
+    for (const auto& string : strings.Strings()) {
+        header.PutString(string);
+    }
+    header.Put(static_cast<uint32_t>(_entries.size()));
+
+    // Written under a temporary name and renamed, so a crash never leaves a truncated index
+    auto temporary = index_file;
+    temporary += ".tmp";
+    {
+        std::ofstream stream(temporary, std::ios::binary | std::ios::trunc);
+        stream.write(header.Bytes().data(), static_cast<std::streamsize>(header.Bytes().size()));
+        stream.write(entries.Bytes().data(), static_cast<std::streamsize>(entries.Bytes().size()));
+        if (!stream.flush()) {
+            return false;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary, index_file, error);
+    return !error;
+}
+
+auto Catalog::Load(const std::filesystem::path& index_file) -> bool {
+    ZoneScoped;
+    _entries.clear();
+    _by_path.clear();
+    std::ifstream stream(index_file, std::ios::binary | std::ios::ate);
+    if (!stream) {
+        return false;
+    }
+    std::vector<char> bytes(static_cast<size_t>(stream.tellg()));
+    stream.seekg(0);
+    if (!stream.read(bytes.data(), static_cast<std::streamsize>(bytes.size()))) {
+        return false;
+    }
+
+    IndexReader reader(bytes);
+    char magic[4];
+    for (char& c : magic) {
+        c = reader.Get<char>();
+    }
+    if (std::memcmp(magic, kIndexMagic, sizeof(magic)) != 0 || reader.Get<uint32_t>() != kIndexVersion) {
+        return false;
+    }
+    std::vector<std::string> strings(reader.Get<uint32_t>());
+    for (auto& string : strings) {
+        string = reader.GetString();
+    }
+    auto get_string = [&]() -> std::string {
+        const auto index = reader.Get<uint32_t>();
+        if (index >= strings.size()) {
+            return {};
+        }
+        return strings[index];
+    };
+
+    std::vector<CatalogEntry> entries(reader.Valid() ? reader.Get<uint32_t>() : 0);
+    for (auto& entry : entries) {
+        const auto directory = get_string();
+        entry.path = std::filesystem::path(directory) / reader.GetString();
+        entry.file_size = reader.Get<uint64_t>();
+        entry.modified = reader.Get<int64_t>();
+        entry.readable = reader.Get<uint8_t>() != 0;
+        if (!entry.readable) {
+            continue;
+        }
+        entry.make = get_string();
+        entry.model = get_string();
+        entry.lens = get_string();
+        entry.iso = reader.Get<float>();
+        entry.shutter = reader.Get<float>();
+        entry.aperture = reader.Get<float>();
+        entry.focal_length = reader.Get<float>();
+        entry.timestamp = reader.Get<int64_t>();
+        entry.width = static_cast<int>(reader.Get<uint32_t>());
+        entry.height = static_cast<int>(reader.Get<uint32_t>());
+        entry.raw_width = static_cast<int>(reader.Get<uint32_t>());
+        entry.raw_height = static_cast<int>(reader.Get<uint32_t>());
+        entry.flip = reader.Get<int8_t>();
+        entry.filters = reader.Get<uint32_t>();
+        entry.colors = reader.Get<uint8_t>();
+        entry.bits = reader.Get<uint8_t>();
+        entry.thumbnail_offset = reader.Get<uint64_t>();
+        entry.thumbnail_length = reader.Get<uint32_t>();
+        entry.thumbnail_width = static_cast<int>(reader.Get<uint32_t>());
+        entry.thumbnail_height = static_cast<int>(reader.Get<uint32_t>());
+        entry.thumbnail_format = reader.Get<uint8_t>();
+        if (!reader.Valid()) {
+            break;
+        }
+    }
+    if (!reader.Valid() || !reader.AtEnd()) {
+        return false;
+    }
+    _entries = std::move(entries);
+    Rebuild();
+    return true;
+}
+
+}  // namespace brightroom
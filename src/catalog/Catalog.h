@@ -0,0 +1,87 @@
+#pragma once
+
+#include <libraw/libraw.h>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <stop_token>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace brightroom {
+
+// What LibRaw reports about a RAW file after open_file, which parses the headers without unpacking anything
+struct CatalogEntry {
+    std::filesystem::path path;  // Absolute
+    uint64_t file_size = 0;
+    int64_t modified = 0;   // Last write time in file clock ticks, compared with file_size to detect changes
+    bool readable = false;  // LibRaw could open the file, everything below is only set if so
+
+    std::string make;
+    std::string model;
+    std::string lens;
+    float iso = 0.0f;
+    float shutter = 0.0f;  // Seconds
+    float aperture = 0.0f;
+    float focal_length = 0.0f;  // Millimetres
+    int64_t timestamp = 0;      // Capture time, seconds since the epoch
+
+    int width = 0;  // Visible area
+    int height = 0;
+    int raw_width = 0;  // Sensor area including masked pixels
+    int raw_height = 0;
+    int flip = 0;          // LibRaw orientation code
+    uint32_t filters = 0;  // CFA layout, 0 for non-Bayer sensors
+    int colors = 0;
+    int bits = 0;  // Bits per sensor sample
+
+    // Largest embedded preview, as a byte range of the file
+    uint64_t thumbnail_offset = 0;
+    uint32_t thumbnail_length = 0;
+    int thumbnail_width = 0;
+    int thumbnail_height = 0;
+    int thumbnail_format = 0;  // LibRaw_thumbnail_formats
+};
+
+// Fills an entry from a LibRaw instance that has opened path
+auto CatalogEntryOf(const LibRaw& raw, const std::filesystem::path& path) -> CatalogEntry;
+
+struct ScanReport {
+    std::size_t files = 0;      // RAW files found
+    std::size_t opened = 0;     // New or changed files that LibRaw read
+    std::size_t unchanged = 0;  // Files whose size and time matched the catalog
+    std::size_t unreadable = 0;
+    std::size_t removed = 0;  // Catalog entries whose file was gone
+    std::chrono::nanoseconds wall_time{0};
+};
+
+// Metadata of every RAW file under a set of directories, persisted as a compact binary index. Rescans only open
+// files that are new or changed since the last scan, so scanning an unchanged archive costs one directory walk and
+// one stat per file. Not thread safe, Scan parallelizes internally.
+class Catalog {
+   public:
+    // Walks the roots on threads workers, all hardware threads if 0. A root may also be a single file. Returns
+    // early with the catalog unchanged if stop is requested.
+    auto Scan(const std::vector<std::filesystem::path>& roots, int threads = 0, std::stop_token stop_token = {})
+        -> ScanReport;
+
+    // Adds or replaces the entry for entry.path
+    void Update(CatalogEntry entry);
+    auto Find(const std::filesystem::path& path) const -> const CatalogEntry*;
+    auto Entries() const -> const std::vector<CatalogEntry>& { return _entries; }
+
+    // Returns false if the file is missing or not a valid index, the catalog is then left empty
+    auto Load(const std::filesystem::path& index_file) -> bool;
+    auto Save(const std::filesystem::path& index_file) const -> bool;
+
+   private:
+    void Rebuild();
+
+    std::vector<CatalogEntry> _entries;
+    std::unordered_map<std::string, std::size_t> _by_path;  // Generic path string to index into _entries
+};
+
+}  // namespace brightroom
@@ -0,0 +1,253 @@
+#include "BatchConverter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <thread>
+#include "BoundedQueue.h"
+#include "HalideRawPipeline.h"
+#include "RawLoader.h"
+#include "Tracy.hpp"
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+struct DecodedFrame {
+    std::filesystem::path source;
+    std::filesystem::path target;
+    std::unique_ptr<brightroom::RawFile> raw;
+};
+
+// The output file of every source: its name with the extension of format in directory. Sources from different
+// directories, or with different RAW extensions, can share a name; the later ones get "-2", "-3", ... appended
+// instead of overwriting the earlier output. Names are compared ignoring case, as Windows and macOS do.
+auto OutputPaths(const std::vector<std::filesystem::path>& sources, const std::filesystem::path& directory,
+                 brightroom::ImageFormat format) -> std::vector<std::filesystem::path> {
+    const std::string extension = brightroom::FileExtension(format);
+    auto folded = [](std::string name) {
+        std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower(c); });
+        return name;
+    };
+    std::set<std::string> used;
+    std::vector<std::filesystem::path> targets;
+    for (const auto& source : sources) {
+        const auto stem = source.stem().string();
+        auto name = stem + extension;
+        for (int suffix = 2; !used.insert(folded(name)).second; ++suffix) {
+            name = stem + "-" + std::to_string(suffix) + extension;
+        }
+        targets.push_back(directory / name);
+    }
+    return targets;
+}
+
+// Busy time and item count of one stage, summed over its workers.
+class StageCounter {
+   public:
+    StageCounter(std::string name, int workers) : _name(std::move(name)), _workers(workers) {}
+
+    void Add(Clock::duration busy) {
+        _busy += std::chrono::duration_cast<std::chrono::nanoseconds>(busy).count();
+        ++_items;
+    }
+
+    auto Report() const -> brightroom::StageReport {
+        return {_name, _workers, _items.load(), std::chrono::nanoseconds(_busy.load())};
+    }
+
+   private:
+    std::string _name;
+    int _workers;
+    std::atomic<std::size_t> _items{0};
+    std::atomic<int64_t> _busy{0};
+};
+
+// Starts `count` threads running `body` and calls `on_done` once the last of them has finished.
+template <typename Body, typename Done>
+auto StartWorkers(int count, Body body, Done on_done) -> std::vector<std::jthread> {
+    auto remaining = std::make_shared<std::atomic<int>>(count);
+    std::vector<std::jthread> workers;
+    for (int i = 0; i < count; ++i) {
+        workers.emplace_back([body, on_done, remaining]() mutable {
+            body();
+            if (remaining->fetch_sub(1) == 1) {
+                on_done();
+            }
+        });
+    }
+    return workers;
+}
+
+}  // namespace
+
+namespace brightroom {
+
+BatchConverter::BatchConverter(BatchOptions options) : _options(std::move(options)) {
+    _options.decode_workers = std::max(1, _options.decode_workers);
+    _options.process_workers = std::max(1, _options.process_workers);
+}
+
+auto BatchConverter::Run() -> BatchReport {
+    const auto start = Clock::now();
+
+    const auto targets = OutputPaths(_options.inputs, _options.output_directory, _options.format);
+    BoundedQueue<std::size_t> pending(_options.inputs.size() + 1);
+    BoundedQueue<DecodedFrame> decoded(_options.queue_depth);
+    for (std::size_t i = 0; i < _options.inputs.size(); ++i) {
+        if (targets[i].stem() != _options.inputs[i].stem()) {
+            std::cout << _options.inputs[i] << " is written to " << targets[i]
+                      << ", another input has the same name" << "\n";
+        }
+        pending.Push(i);
+    }
+    pending.Close();
+
+    StageCounter decode_counter("decode", _options.decode_workers);
+    StageCounter process_counter("process", _options.process_workers);
+    std::atomic<std::size_t> converted{0};
+    std::atomic<std::size_t> failed{0};
+    std::mutex log_mutex;
+    auto log_failure = [&](const std::filesystem::path& source, const char* stage) {
+        failed.fetch_add(1);
+        std::lock_guard lock(log_mutex);
+        std::cerr << "Failed to " << stage << " " << source << "\n";
+    };
+
+    std::mutex telemetry_mutex;
+    std::vector<StageTiming> pipeline_stages;
+    auto add_telemetry = [&](std::string_view prefix, const PipelineTelemetry& telemetry) {
+        std::lock_guard lock(telemetry_mutex);
+        for (const auto& stage : telemetry.stages) {
+            auto name = std::string(prefix) + stage.name;
+            auto existing = std::find_if(pipeline_stages.begin(), pipeline_stages.end(),
+                                         [&](const auto& timing) { return timing.name == name; });
+            if (existing == pipeline_stages.end()) {
+                pipeline_stages.push_back({std::move(name), stage.duration});
+            } else {
+                existing->duration += stage.duration;
+            }
+        }
+    };
+
+    {
+        auto decoders = StartWorkers(
+            _options.decode_workers,
+            [&]() {
+                RawLoader loader{nullptr, _options.raw_input};
+                while (auto index = pending.Pop()) {
+                    ZoneScopedN("decode");
+                    const auto& source = _options.inputs[*index];
+                    const auto stage_start = Clock::now();
+                    auto raw = loader.LoadRaw(source.string());
+                    decode_counter.Add(Clock::now() - stage_start);
+                    if (!raw) {
+                        log_failure(source, "decode");
+                        continue;
+                    }
+                    decoded.Push({source, targets[*index], std::move(raw)});
+                }
+            },
+            [&]() { decoded.Close(); });
+
+        auto processors = StartWorkers(
+            _options.process_workers,
+            [&]() {
+                // The pipeline keeps per-image intermediates, so every worker needs its own instance
+                HalideRawPipeline pipeline(_options.intermediate_format, _options.tone_curve_mode);
+                pipeline.SetWorkingSetLimit(_options.max_working_set);
+                while (auto frame = decoded.Pop()) {
+                    ZoneScopedN("process");
+                    const auto stage_start = Clock::now();
+                    const bool tiled = pipeline.ExportsTiled(*frame->raw);
+                    if (tiled) {
+                        // Export demosaics the tiles itself, and must not render the previous frame's demosaic
+                        pipeline.SetImage(nullptr);
+                    } else {
+                        pipeline.Preprocess(*frame->raw, PreprocessMode::kFull, std::nullopt, _options.demosaic);
+                    }
+                    const bool written =
+                        pipeline.Export(*frame->raw, _options.parameters, _options.format, frame->target.string(),
+                                        _options.writer_options, _options.demosaic);
+                    frame->raw.reset();
+                    process_counter.Add(Clock::now() - stage_start);
+                    if (!tiled) {
+                        add_telemetry("preprocess/", pipeline.LastPreprocessTelemetry());
+                    }
+                    add_telemetry("process/", pipeline.LastProcessTelemetry());
+                    if (!written) {
+                        log_failure(frame->source, "convert");
+                        continue;
+                    }
+                    converted.fetch_add(1);
+                }
+            },
+            []() {});
+    }
+
+    BatchReport report;
+    report.converted = converted.load();
+    report.failed = failed.load();
+    report.wall_time = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start);
+    report.stages = {decode_counter.Report(), process_counter.Report()};
+    report.pipeline_stages = std::move(pipeline_stages);
+    report.buffer_pool = BufferPool::Global().Statistics();
+    BufferPool::Global().Trim();
+    return report;
+}
+
+auto CollectRawFiles(const std::vector<std::filesystem::path>& inputs) -> std::vector<std::filesystem::path> {
+    std::vector<std::filesystem::path> files;
+    for (const auto& input : inputs) {
+        std::error_code error;
+        if (!std::filesystem::is_directory(input, error)) {
+            files.push_back(input);
+            continue;
+        }
+        std::vector<std::filesystem::path> directory_files;
+        for (const auto& entry : std::filesystem::directory_iterator(input, error)) {
+            if (entry.is_regular_file(error) && IsRawFile(entry.path())) {
+                directory_files.push_back(entry.path());
+            }
+        }
+        std::sort(directory_files.begin(), directory_files.end());
+        files.insert(files.end(), directory_files.begin(), directory_files.end());
+    }
+    return files;
+}
+
+void PrintReport(const BatchReport& report) {
+    const double seconds = std::chrono::duration<double>(report.wall_time).count();
+    const double images_per_second = seconds > 0.0 ? static_cast<double>(report.converted) / seconds : 0.0;
+    std::printf("Converted %zu images (%zu failed) in %.2f s: %.2f images/s\n", report.converted, report.failed,
+                seconds, images_per_second);
+    std::printf("%-8s %8s %8s %12s %12s\n", "stage", "workers", "images", "busy [s]", "utilisation");
+    for (const auto& stage : report.stages) {
+        const double busy = std::chrono::duration<double>(stage.busy).count();
+        const double utilisation = seconds > 0.0 ? busy / (seconds * stage.workers) : 0.0;
+        std::printf("%-8s %8d %8zu %12.2f %11.1f%%\n", stage.name.c_str(), stage.workers, stage.items, busy,
+                    utilisation * 100.0);
+    }
+    if (!report.pipeline_stages.empty()) {
+        std::printf("%-20s %12s\n", "pipeline stage", "time [s]");
+        for (const auto& stage : report.pipeline_stages) {
+            std::printf("%-20s %12.3f\n", stage.name.c_str(), std::chrono::duration<double>(stage.duration).count());
+        }
+    }
+    const auto& pool = report.buffer_pool;
+    if (pool.allocations > 0) {
+        constexpr double kMiB = 1024.0 * 1024.0;
+        std::printf("Buffer pool: %zu allocations, %zu reused (%.1f%%), %zu from the system, peak %.1f MiB, "
+                    "%.1f MiB cached\n",
+                    pool.allocations, pool.reused, 100.0 * static_cast<double>(pool.reused) / pool.allocations,
+                    pool.system_allocations, pool.peak_bytes / kMiB, pool.bytes_cached / kMiB);
+    }
+}
+
+}  // namespace brightroom
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "BufferPool.h"
+#include "HalideRawPipeline.h"
+#include "IRawPipeline.h"
+#include "ImageWriter.h"
+#include "RawLoader.h"
+
+namespace brightroom {
+
+struct BatchOptions {
+    std::vector<std::filesystem::path> inputs;
+    std::filesystem::path output_directory = ".";
+    ImageFormat format = ImageFormat::kJpeg;
+    ImageWriterOptions writer_options{};
+    Parameters parameters{};
+    IntermediateFormat intermediate_format = IntermediateFormat::kFloat32;
+    ToneCurveMode tone_curve_mode = ToneCurveMode::kAnalytic;
+    Demosaic demosaic = Demosaic::kBilinear;
+    RawInput raw_input = RawInput::kFile;
+    // Bytes each process worker's export buffers may hold. A frame whose demosaic alone would exceed it, a 100 MP
+    // frame takes 1.2 GB in f32, is demosaiced and rendered in tiles straight from the sensor data instead.
+    std::size_t max_working_set = std::size_t{1} << 30;
+
+    // Worker threads per stage. Halide parallelizes each strip internally while the previous one is encoded on a
+    // thread of its own, so one process worker is usually enough; the single-threaded decode stage benefits from more.
+    int decode_workers = 2;
+    int process_workers = 1;
+    // Decoded frames allowed to wait for a process worker. Bounds the peak memory to roughly queue_depth + workers
+    // RAW files plus one demosaic, or max_working_set for a tiled one, and two output strips per process worker.
+    std::size_t queue_depth = 2;
+};
+
+struct StageReport {
+    std::string name;
+    int workers = 0;
+    std::size_t items = 0;
+    std::chrono::nanoseconds busy{0};
+};
+
+struct BatchReport {
+    std::size_t converted = 0;
+    std::size_t failed = 0;
+    std::chrono::nanoseconds wall_time{0};
+    std::vector<StageReport> stages;
+    // Summed pipeline telemetry of all images, "preprocess/" and "process/" stage names
+    std::vector<StageTiming> pipeline_stages;
+    // Allocations of pipeline buffers and Halide intermediates over the whole run
+    BufferPoolStatistics buffer_pool;
+};
+
+// Converts RAW files with two overlapping stages connected by a bounded queue:
+//   decode (LibRaw open + unpack into a RawFile) -> process (Preprocess + Export, which encodes the JPEG/TIFF strip
+//   by strip while it renders, or a tiled Export alone for frames above max_working_set).
+class BatchConverter {
+   public:
+    explicit BatchConverter(BatchOptions options);
+    auto Run() -> BatchReport;
+
+   private:
+    BatchOptions _options;
+};
+
+// Expands directories into the RAW files they contain, keeping plain files as they are.
+auto CollectRawFiles(const std::vector<std::filesystem::path>& inputs) -> std::vector<std::filesystem::path>;
+
+void PrintReport(const BatchReport& report);
+
+}  // namespace brightroom
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+namespace brightroom {
+
+// Blocking multi-producer/multi-consumer queue with a fixed capacity. Producers wait while the queue is full,
+// which is what keeps the number of frames in flight between two pipeline stages bounded.
+template <typename T>
+class BoundedQueue {
+   public:
+    explicit BoundedQueue(std::size_t capacity) : _capacity(capacity == 0 ? 1 : capacity) {}
+
+    // Returns false if the queue was closed before the item could be enqueued.
+    auto Push(T item) -> bool {
+        std::unique_lock lock(_mutex);
+        _not_full.wait(lock, [this] { return _closed || _items.size() < _capacity; });
+        if (_closed) {
+            return false;
+        }
+        _items.push_back(std::move(item));
+        _not_empty.notify_one();
+        return true;
+    }
+
+    // Returns std::nullopt once the queue is closed and drained.
+    auto Pop() -> std::optional<T> {
+        std::unique_lock lock(_mutex);
+        _not_empty.wait(lock, [this] { return _closed || !_items.empty(); });
+        if (_items.empty()) {
+            return std::nullopt;
+        }
+        T item = std::move(_items.front());
+        _items.pop_front();
+        _not_full.notify_one();
+        return item;
+    }
+
+    void Close() {
+        std::lock_guard lock(_mutex);
+        _closed = true;
+        _not_full.notify_all();
+        _not_empty.notify_all();
+    }
+
+   private:
+    std::mutex _mutex;
+    std::condition_variable _not_full;
+    std::condition_variable _not_empty;
+    std::deque<T> _items;
+    std::size_t _capacity;
+    bool _closed = false;
+};
+
+}  // namespace brightroom
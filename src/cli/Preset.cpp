@@ -0,0 +1,78 @@
+#include "Preset.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+
+namespace {
+
+auto Trim(const std::string& text) -> std::string {
+    const auto first = text.find_first_not_of(" \t\r");
+    if (first == std::string::npos) {
+        return {};
+    }
+    const auto last = text.find_last_not_of(" \t\r");
+    return text.substr(first, last - first + 1);
+}
+
+}  // namespace
+
+namespace brightroom {
+
+auto LoadPreset(const std::filesystem::path& file_name) -> std::optional<Parameters> {
+    std::ifstream file(file_name);
+    if (!file) {
+        std::cerr << "Cannot open preset " << file_name << "\n";
+        return std::nullopt;
+    }
+
+    Parameters parameters{};
+    std::string line;
+    int line_number = 0;
+    while (std::getline(file, line)) {
+        ++line_number;
+        line = Trim(line.substr(0, line.find('#')));
+        if (line.empty()) {
+            continue;
+        }
+        const auto separator = line.find('=');
+        if (separator == std::string::npos) {
+            std::cerr << file_name << ":" << line_number << ": expected key = value\n";
+            return std::nullopt;
+        }
+        const auto key = Trim(line.substr(0, separator));
+        if (key == "adjustments") {
+            auto stack = ParseAdjustmentStack(Trim(line.substr(separator + 1)));
+            if (!stack) {
+                std::cerr << file_name << ":" << line_number << ": invalid adjustment stack\n";
+                return std::nullopt;
+            }
+            parameters.adjustments = std::move(*stack);
+            continue;
+        }
+        float value = 0.0f;
+        std::istringstream value_stream(Trim(line.substr(separator + 1)));
+        if (!(value_stream >> value)) {
+            std::cerr << file_name << ":" << line_number << ": invalid value for " << key << "\n";
+            return std::nullopt;
+        }
+
+        if (key == "exposure") {
+            parameters.exposure = value;
+        } else if (key == "contrast") {
+            parameters.contrast = value;
+        } else if (key == "saturation") {
+            parameters.saturation = value;
+        } else if (key == "tone_mapping_key") {
+            parameters.tone_mapping_key = value;
+        } else {
+            std::cerr << file_name << ":" << line_number << ": unknown parameter " << key << "\n";
+            return std::nullopt;
+        }
+    }
+    return parameters;
+}
+
+}  // namespace brightroom
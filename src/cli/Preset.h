@@ -0,0 +1,18 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include "IRawPipeline.h"
+
+namespace brightroom {
+
+// Reads a Parameters preset. The format is one "key = value" pair per line, '#' starts a comment:
+//   exposure = 1.5
+//   contrast = 1.0
+//   saturation = 1.2
+// An adjustment stack replaces gamma, contrast and saturation with the listed adjustments in order, see
+// AdjustmentStack.h:
+//   adjustments = exposure 0.3, gamma 2.2, contrast 1.4, saturation 1.1
+auto LoadPreset(const std::filesystem::path& file_name) -> std::optional<Parameters>;
+
+}  // namespace brightroom
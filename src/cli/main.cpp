@@ -0,0 +1,170 @@
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include "AdjustmentCompiler.h"
+#include "BatchConverter.h"
+#include "DiskCache.h"
+#include "Preset.h"
+
+namespace {
+
+void PrintUsage(const char* program) {
+    std::printf(
+        "Usage: %s [options] <file or directory>...\n"
+        "  -o, --output DIR         Output directory (default: .)\n"
+        "  -f, --format jpeg|tiff   Output format (default: jpeg)\n"
+        "  -q, --quality N          JPEG quality, 1 to 100 (default: 90)\n"
+        "  -b, --bits 8|16          TIFF bits per sample (default: 8)\n"
+        "  -p, --preset FILE        Parameters preset (key = value lines)\n"
+        "      --intermediate FMT   Demosaiced intermediate: f32, f16 or u16 (default: f32)\n"
+        "      --tone-curve MODE    Gamma and contrast: analytic or lut (default: analytic)\n"
+        "      --demosaic ENGINE    bilinear, mhc or rcd, fastest first (default: bilinear)\n"
+        "      --input MODE         How RAW files are read: file or mmap (default: file)\n"
+        "      --decode-threads N   LibRaw decode workers (default: 2)\n"
+        "      --process-threads N  Halide pipeline and encoder workers (default: 1)\n"
+        "      --queue-depth N      Frames buffered between stages (default: 2)\n"
+        "      --max-memory MB      Export memory per process thread, tiles larger frames (default: 1024)\n",
+        program);
+}
+
+auto ParseInt(std::string_view text, int& value) -> bool {
+    char* end = nullptr;
+    const std::string copy(text);
+    const long parsed = std::strtol(copy.c_str(), &end, 10);
+    if (end == copy.c_str() || *end != '\0' || parsed < 0) {
+        return false;
+    }
+    value = static_cast<int>(parsed);
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    brightroom::BatchOptions options{};
+    std::vector<std::filesystem::path> inputs;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        auto next_int = [&](int& value) { return has_value && ParseInt(argv[++i], value); };
+
+        if (arg == "-h" || arg == "--help") {
+            PrintUsage(argv[0]);
+            return EXIT_SUCCESS;
+        }
+        bool ok = true;
+        if ((arg == "-o" || arg == "--output") && has_value) {
+            options.output_directory = argv[++i];
+        } else if ((arg == "-f" || arg == "--format") && has_value) {
+            const std::string_view format = argv[++i];
+            if (format == "jpeg" || format == "jpg") {
+                options.format = brightroom::ImageFormat::kJpeg;
+            } else if (format == "tiff" || format == "tif") {
+                options.format = brightroom::ImageFormat::kTiff;
+            } else {
+                ok = false;
+            }
+        } else if (arg == "-q" || arg == "--quality") {
+            ok = next_int(options.writer_options.jpeg_quality) && options.writer_options.jpeg_quality >= 1 &&
+                 options.writer_options.jpeg_quality <= 100;
+        } else if (arg == "-b" || arg == "--bits") {
+            ok = next_int(options.writer_options.tiff_bits) &&
+                 (options.writer_options.tiff_bits == 8 || options.writer_options.tiff_bits == 16);
+        } else if ((arg == "-p" || arg == "--preset") && has_value) {
+            auto preset = brightroom::LoadPreset(argv[++i]);
+            if (!preset) {
+                return EXIT_FAILURE;
+            }
+            options.parameters = *preset;
+        } else if (arg == "--intermediate" && has_value) {
+            const std::string_view format = argv[++i];
+            if (format == "f32") {
+                options.intermediate_format = brightroom::IntermediateFormat::kFloat32;
+            } else if (format == "f16") {
+                options.intermediate_format = brightroom::IntermediateFormat::kFloat16;
+            } else if (format == "u16") {
+                options.intermediate_format = brightroom::IntermediateFormat::kUInt16;
+            } else {
+                ok = false;
+            }
+        } else if (arg == "--tone-curve" && has_value) {
+            const std::string_view mode = argv[++i];
+            if (mode == "lut") {
+                options.tone_curve_mode = brightroom::ToneCurveMode::kLookupTable;
+            } else if (mode == "analytic") {
+                options.tone_curve_mode = brightroom::ToneCurveMode::kAnalytic;
+            } else {
+                ok = false;
+            }
+        } else if (arg == "--demosaic" && has_value) {
+            const std::string_view engine = argv[++i];
+            if (engine == "bilinear") {
+                options.demosaic = brightroom::Demosaic::kBilinear;
+            } else if (engine == "mhc") {
+                options.demosaic = brightroom::Demosaic::kMalvarHeCutler;
+            } else if (engine == "rcd") {
+                options.demosaic = brightroom::Demosaic::kRcd;
+            } else {
+                ok = false;
+            }
+        } else if (arg == "--input" && has_value) {
+            const std::string_view mode = argv[++i];
+            if (mode == "mmap") {
+                options.raw_input = brightroom::RawInput::kMapped;
+            } else if (mode == "file") {
+                options.raw_input = brightroom::RawInput::kFile;
+            } else {
+                ok = false;
+            }
+        } else if (arg == "--decode-threads") {
+            ok = next_int(options.decode_workers);
+        } else if (arg == "--process-threads") {
+            ok = next_int(options.process_workers);
+        } else if (arg == "--encode-threads") {
+            // Deprecated, every export encodes on a thread of its own
+            int ignored = 0;
+            ok = next_int(ignored);
+            std::fprintf(stderr, "--encode-threads is deprecated and has no effect\n");
+        } else if (arg == "--queue-depth") {
+            int depth = 0;
+            ok = next_int(depth);
+            options.queue_depth = static_cast<std::size_t>(depth);
+        } else if (arg == "--max-memory") {
+            int megabytes = 0;
+            ok = next_int(megabytes) && megabytes > 0;
+            options.max_working_set = static_cast<std::size_t>(megabytes) << 20;
+        } else if (arg.starts_with("-")) {
+            ok = false;
+        } else {
+            inputs.emplace_back(arg);
+        }
+        if (!ok) {
+            std::fprintf(stderr, "Invalid argument: %s\n", argv[i]);
+            PrintUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    options.inputs = brightroom::CollectRawFiles(inputs);
+    if (options.inputs.empty()) {
+        PrintUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    std::error_code error;
+    std::filesystem::create_directories(options.output_directory, error);
+    // Recipes compiled by earlier runs are loaded instead of compiled again
+    if (!options.parameters.adjustments.empty()) {
+        if (auto disk_cache = brightroom::DiskCache::FromEnvironment()) {
+            brightroom::AdjustmentCompiler::Global().SetDirectory(disk_cache->Directory() / "pipelines");
+        }
+    }
+
+    std::printf("Converting %zu images with %s\n", options.inputs.size(), options.parameters.ToString().c_str());
+    brightroom::BatchConverter converter(std::move(options));
+    const auto report = converter.Run();
+    brightroom::PrintReport(report);
+    return report.failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,76 @@
+#include "HistogramWidget.h"
+#include <QPainter>
+#include <QPainterPath>
+#include <algorithm>
+
+namespace {
+
+using brightroom::ImageStatistics;
+
+auto HistogramPath(const ImageStatistics& statistics, ImageStatistics::Channel channel, const QRectF& area,
+                   double scale, bool closed) -> QPainterPath {
+    const auto& bins = statistics.histogram[channel];
+    const double bin_width = area.width() / ImageStatistics::kBins;
+    QPainterPath path;
+    path.moveTo(area.left(), area.bottom());
+    for (int bin = 0; bin < ImageStatistics::kBins; bin++) {
+        const double height = std::min(1.0, bins[bin] * scale) * area.height();
+        path.lineTo(area.left() + (bin + 0.5) * bin_width, area.bottom() - height);
+    }
+    if (closed) {
+        path.lineTo(area.right(), area.bottom());
+        path.closeSubpath();
+    }
+    return path;
+}
+
+}  // namespace
+
+HistogramWidget::HistogramWidget(QWidget* parent) : QWidget(parent) {
+    setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Fixed);
+}
+
+void HistogramWidget::SetStatistics(const brightroom::ImageStatistics& statistics) {
+    _statistics = statistics;
+    update();
+}
+
+void HistogramWidget::Clear() {
+    _statistics.reset();
+    update();
+}
+
+auto HistogramWidget::sizeHint() const -> QSize {
+    return {ImageStatistics::kBins, 120};
+}
+
+void HistogramWidget::paintEvent(QPaintEvent* /*event*/) {
+    QPainter painter(this);
+    painter.fillRect(rect(), Qt::black);
+    if (!_statistics) {
+        return;
+    }
+
+    uint32_t peak = 1;
+    for (const auto& bins : _statistics->histogram) {
+        peak = std::max(peak, *std::max_element(bins.begin() + 1, bins.end() - 1));
+    }
+    const double scale = 1.0 / peak;
+    const QRectF area = QRectF(rect()).adjusted(1, 1, -1, -1);
+
+    // Additive blending makes overlapping channels mix to their sum, all three overlapping gives white
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.setCompositionMode(QPainter::CompositionMode_Plus);
+    painter.setPen(Qt::NoPen);
+    painter.setBrush(QColor(160, 0, 0));
+    painter.drawPath(HistogramPath(*_statistics, ImageStatistics::kRed, area, scale, true));
+    painter.setBrush(QColor(0, 160, 0));
+    painter.drawPath(HistogramPath(*_statistics, ImageStatistics::kGreen, area, scale, true));
+    painter.setBrush(QColor(0, 0, 160));
+    painter.drawPath(HistogramPath(*_statistics, ImageStatistics::kBlue, area, scale, true));
+
+    painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+    painter.setBrush(Qt::NoBrush);
+    painter.setPen(QPen(QColor(220, 220, 220), 1.0));
+    painter.drawPath(HistogramPath(*_statistics, ImageStatistics::kLuma, area, scale, false));
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <QWidget>
+#include <optional>
+#include "types.h"
+
+// Draws the R, G and B histograms of the current frame as overlapping filled areas and luma as a line on top.
+// Bins 0 and 255 hold every clipped pixel and would flatten the rest, so the vertical scale ignores them.
+class HistogramWidget : public QWidget {
+    Q_OBJECT
+
+   public:
+    explicit HistogramWidget(QWidget* parent = nullptr);
+
+    void SetStatistics(const brightroom::ImageStatistics& statistics);
+    void Clear();
+    auto sizeHint() const -> QSize override;
+
+   protected:
+    void paintEvent(QPaintEvent* event) override;
+
+   private:
+    std::optional<brightroom::ImageStatistics> _statistics;
+};
@@ -0,0 +1,55 @@
+#include "ImageCanvas.h"
+#include <QPaintEvent>
+#include <QPainter>
+
+ImageCanvas::ImageCanvas(QWidget* parent) : QWidget(parent) {
+    setSizePolicy(QSizePolicy::Ignored, QSizePolicy::Ignored);
+}
+
+void ImageCanvas::SetImageSize(const QSize& size) {
+    _imageSize = size;
+    _base = QImage();
+    ClearDetail();
+}
+
+void ImageCanvas::SetBase(const QImage& image, const QRect& source_rect) {
+    _base = image;
+    _baseRect = source_rect;
+    update();
+}
+
+void ImageCanvas::SetDetail(const QImage& image, const QRect& source_rect) {
+    // Repaint where the old detail layer was, it is not necessarily covered by the new one
+    update(MapToWidget(_detailRect).toAlignedRect());
+    _detail = image;
+    _detailRect = source_rect;
+    update(MapToWidget(_detailRect).toAlignedRect());
+}
+
+void ImageCanvas::ClearDetail() {
+    _detail = QImage();
+    _detailRect = QRect();
+    update();
+}
+
+auto ImageCanvas::MapToWidget(const QRect& source_rect) const -> QRectF {
+    if (_imageSize.isEmpty()) {
+        return {};
+    }
+    const double scale_x = static_cast<double>(width()) / _imageSize.width();
+    const double scale_y = static_cast<double>(height()) / _imageSize.height();
+    return {source_rect.x() * scale_x, source_rect.y() * scale_y, source_rect.width() * scale_x,
+            source_rect.height() * scale_y};
+}
+
+void ImageCanvas::paintEvent(QPaintEvent* event) {
+    QPainter painter(this);
+    painter.setClipRect(event->rect());
+    painter.setRenderHint(QPainter::SmoothPixmapTransform);
+    if (!_base.isNull()) {
+        painter.drawImage(MapToWidget(_baseRect), _base);
+    }
+    if (!_detail.isNull()) {
+        painter.drawImage(MapToWidget(_detailRect), _detail);
+    }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <QImage>
+#include <QRect>
+#include <QWidget>
+
+// Displays a frame that is rendered in pieces. The base layer covers the whole frame at low resolution, the detail
+// layer covers only the visible part at display resolution and is drawn on top. The widget itself is sized to
+// zoom * ImageSize() by the scroll area that contains it.
+class ImageCanvas : public QWidget {
+    Q_OBJECT
+
+   public:
+    explicit ImageCanvas(QWidget* parent = nullptr);
+
+    // Full-resolution size of the frame, all layer rectangles are in these coordinates
+    void SetImageSize(const QSize& size);
+    auto ImageSize() const -> QSize { return _imageSize; }
+
+    void SetBase(const QImage& image, const QRect& source_rect);
+    void SetDetail(const QImage& image, const QRect& source_rect);
+    void ClearDetail();
+    auto HasDetail() const -> bool { return !_detail.isNull(); }
+
+   protected:
+    void paintEvent(QPaintEvent* event) override;
+
+   private:
+    auto MapToWidget(const QRect& source_rect) const -> QRectF;
+
+    QSize _imageSize;
+    QImage _base;
+    QRect _baseRect;
+    QImage _detail;
+    QRect _detailRect;
+};
@@ -1,11 +1,16 @@
 #include "MainWindow.h"
 #include <qimage.h>
+#include <algorithm>
 #include <iostream>
+#include <utility>
 #include "RawLoader.h"
+#include "Telemetry.h"
 
 #include <QApplication>
+#include <QCheckBox>
 #include <QClipboard>
 #include <QColorSpace>
+#include <QDateTime>
 #include <QDir>
 #include <QFileDialog>
 #include <QImageReader>
@@ -26,15 +31,20 @@
 #include <QTimer>
 #include <QVBoxLayout>
 
-MainWindow::MainWindow(QWidget* parent, std::unique_ptr<brightroom::IRawPipeline> pipeline)
-    : QMainWindow(parent), _imageLabel(new QLabel), _scrollArea(new QScrollArea), _pipeline(std::move(pipeline)) {
+MainWindow::MainWindow(QWidget* parent, std::unique_ptr<brightroom::IRawPipeline> pipeline,
+                       std::shared_ptr<brightroom::DiskCache> disk_cache,
+                       std::unique_ptr<brightroom::Prefetcher> prefetcher)
+    : QMainWindow(parent),
+      _imageCanvas(new ImageCanvas),
+      _scrollArea(new QScrollArea),
+      _diskCache(std::move(disk_cache)),
+      _prefetcher(std::move(prefetcher)),
+      _renderWorker(new RenderWorker(std::move(pipeline), _prefetcher ? _prefetcher->Cache() : nullptr, this)) {
     setWindowTitle("BrightRoom");
-    _imageLabel->setBackgroundRole(QPalette::Base);
-    _imageLabel->setSizePolicy(QSizePolicy::Ignored, QSizePolicy::Ignored);
-    _imageLabel->setScaledContents(true);
+    _imageCanvas->setBackgroundRole(QPalette::Base);
 
     _scrollArea->setBackgroundRole(QPalette::Dark);
-    _scrollArea->setWidget(_imageLabel);
+    _scrollArea->setWidget(_imageCanvas);
     _scrollArea->setVisible(true);
     _scrollArea->viewport()->installEventFilter(this);
     setCentralWidget(_scrollArea);
@@ -44,14 +54,36 @@ MainWindow::MainWindow(QWidget* parent, std::unique_ptr<brightroom::IRawPipeline
     _refreshTimer->setSingleShot(true);
     _refreshTimer->setInterval(kDebounceDelayMs);
     connect(_refreshTimer, &QTimer::timeout, this, &MainWindow::RefreshImage);
+    connect(_renderWorker, &RenderWorker::FrameReady, this, &MainWindow::ShowFrame);
+    connect(_renderWorker, &RenderWorker::StatisticsReady, this, &MainWindow::ShowStatistics);
+    connect(_renderWorker, &RenderWorker::UnpackFailed, this, &MainWindow::ShowUnpackFailed);
+    // Panning changes which pixels are visible, so a zoomed-in view has to be re-rendered
+    connect(_scrollArea->horizontalScrollBar(), &QScrollBar::valueChanged, this, &MainWindow::QueueImageRefresh);
+    connect(_scrollArea->verticalScrollBar(), &QScrollBar::valueChanged, this, &MainWindow::QueueImageRefresh);
 
     CreateEditDock();
     CreateActions();
 
+    // The catalog is an index next to the cached thumbnails, without a cache it only lasts for the session
+    if (!CatalogFile().empty()) {
+        _catalog.Load(CatalogFile());
+    }
+
     resize(QGuiApplication::primaryScreen()->availableSize() * 3 / 5);
     // QTimer::singleShot(0, this, [this]() { LoadRaw("/media/philip/Data SSD/photos/2025/06/22/QI9B7671.CR2"); });
 }
 
+MainWindow::~MainWindow() {
+    _scanThread = {};
+    if (!CatalogFile().empty()) {
+        _catalog.Save(CatalogFile());
+    }
+}
+
+auto MainWindow::CatalogFile() const -> std::filesystem::path {
+    return _diskCache ? _diskCache->Directory() / "catalog.brci" : std::filesystem::path{};
+}
+
 auto MainWindow::CreateAdjustmentSlider(QWidget* parent, const QString& label, QVBoxLayout* layout) -> MySlider* {
     auto* slider_label = new QLabel(label, parent);
     auto* slider = new MySlider(Qt::Horizontal, parent);
@@ -98,15 +130,23 @@ void MainWindow::CreateEditDock() {
     _exposureSlider = CreateAdjustmentSlider(adjustmentsWidget, tr("Exposure"), adjustmentsLayout);
     _contrastSlider = CreateAdjustmentSlider(adjustmentsWidget, tr("Contrast"), adjustmentsLayout);
     _saturationSlider = CreateAdjustmentSlider(adjustmentsWidget, tr("Saturation"), adjustmentsLayout);
+    _autoExposureCheckBox = new QCheckBox(tr("Auto exposure"), adjustmentsWidget);
+    adjustmentsLayout->addWidget(_autoExposureCheckBox);
 
     adjustmentsLayout->addStretch();
     adjustmentsWidget->setLayout(adjustmentsLayout);
     stackedWidget->addWidget(adjustmentsWidget);
 
-    // --- Metadata layout (placeholder) ---
+    // --- Metadata layout ---
     auto* metadataWidget = new QWidget(stackedWidget);
     auto* metadataLayout = new QVBoxLayout(metadataWidget);
-    metadataLayout->addWidget(new QLabel(tr("Metadata content goes here"), metadataWidget));
+    _histogramWidget = new HistogramWidget(metadataWidget);
+    _clippingLabel = new QLabel(metadataWidget);
+    _metadataLabel = new QLabel(metadataWidget);
+    metadataLayout->addWidget(_histogramWidget);
+    metadataLayout->addWidget(_clippingLabel);
+    metadataLayout->addWidget(_metadataLabel);
+    metadataLayout->addStretch();
     metadataWidget->setLayout(metadataLayout);
     stackedWidget->addWidget(metadataWidget);
 
@@ -135,16 +175,24 @@ void MainWindow::CreateEditDock() {
                   [this](float value) { _parameters.contrast = std::pow(1.5f, value / kSliderTickInterval); });
     ConnectSlider(_saturationSlider,
                   [this](float value) { _parameters.saturation = std::pow(2.0f, value / kSliderTickInterval); });
+    // Tone mapping against the log-average luminance measured once per image, exposure then compensates on top
+    connect(_autoExposureCheckBox, &QCheckBox::toggled, this, [this](bool checked) {
+        _parameters.tone_mapping_key = checked ? 0.18f : 0.0f;
+        _baseIsStale = true;
+        QueueImageRefresh();
+    });
 }
 
 // Helper method for connecting sliders
 void MainWindow::ConnectSlider(MySlider* slider, std::function<void(float)> valueChanged) {
     connect(slider, &QSlider::valueChanged, this, [this, valueChanged, slider]() {
         valueChanged(static_cast<float>(slider->value()));
+        _baseIsStale = true;
         QueueImageRefresh();
     });
     connect(slider, &MySlider::doubleClicked, this, [this, slider]() {
         slider->setValue(0);
+        _baseIsStale = true;
         QueueImageRefresh();
     });
 }
@@ -167,46 +215,277 @@ bool MainWindow::LoadImage(const QString& fileName) {
     setWindowFilePath(fileName);
     const QString message = tr("Opened \"%1\", %2x%3, Depth: %4")
                                 .arg(QDir::toNativeSeparators(fileName))
-                                .arg(_fullSizeImage.width())
-                                .arg(_fullSizeImage.height())
-                                .arg(_fullSizeImage.depth());
+                                .arg(_imageSize.width())
+                                .arg(_imageSize.height())
+                                .arg(new_image.depth());
     statusBar()->showMessage(message);
     return true;
 }
 
 bool MainWindow::LoadRaw(const QString& fileName) {
-    brightroom::RawLoader loader{};
-    _currentRaw = loader.LoadRaw(fileName.toStdString());
-
-    _pipeline->Preprocess(*_currentRaw);
-    auto processed_image = _pipeline->Process(*_currentRaw, _parameters);
-    QImage new_image(processed_image.pixels.data(), processed_image.width, processed_image.height,
-                     QImage::Format::Format_RGB888);
-    if (new_image.isNull()) {
-        QMessageBox::information(this, QGuiApplication::applicationDisplayName(), tr("Cannot load %1: %2"));
+    _loadTimer.start();
+    brightroom::RawLoader loader{_diskCache};
+    const std::filesystem::path path = fileName.toStdString();
+    const auto source = brightroom::FileIdentity::Of(path);
+    // A prefetched image is opened and preprocessed already, unless the file changed since
+    std::optional<brightroom::PreparedImage> prepared;
+    if (_prefetcher) {
+        prepared = _prefetcher->Cache()->Find(path);
+        if (prepared && prepared->source != source) {
+            prepared.reset();
+        }
+    }
+    // Otherwise only the metadata and the embedded preview are read here, the sensor data is unpacked on the
+    // render worker
+    std::unique_ptr<LibRaw> opened = prepared ? nullptr : loader.OpenRaw(fileName.toStdString());
+    if (!prepared && !opened) {
+        QMessageBox::information(this, QGuiApplication::applicationDisplayName(),
+                                 tr("Cannot load %1").arg(QDir::toNativeSeparators(fileName)));
         return false;
     }
-    SetImage(new_image, true);
+    _currentRaw = prepared ? prepared->raw
+                           : std::make_shared<const brightroom::RawFile>(brightroom::CreateRawFile(*opened));
+    _currentFileName = fileName;
+    _awaitingFirstFrame = true;
+    _histogramWidget->Clear();
+    _clippingLabel->clear();
+
+    // Files from a scanned folder are in the catalog already, others are added from the headers just read. A
+    // prepared image let go of its LibRaw, its headers are read again.
+    const auto* entry = _catalog.Find(path);
+    if (!entry || !source || entry->file_size != source->size || entry->modified != source->modified) {
+        auto headers = opened ? nullptr : loader.OpenRaw(fileName.toStdString());
+        if (const LibRaw* raw = opened ? opened.get() : headers.get()) {
+            auto new_entry = brightroom::CatalogEntryOf(*raw, path);
+            if (source) {
+                new_entry.file_size = source->size;
+                new_entry.modified = source->modified;
+            }
+            _catalog.Update(std::move(new_entry));
+            if (_scanThread.joinable()) {
+                _scanUpdates.push_back(path);
+            }
+            entry = _catalog.Find(path);
+        }
+    }
+    if (entry) {
+        ShowMetadata(*entry);
+    }
 
-    setWindowFilePath(fileName);
-    const QString message = tr("Opened \"%1\", %2x%3, Depth: %4")
-                                .arg(QDir::toNativeSeparators(fileName))
-                                .arg(_fullSizeImage.width())
-                                .arg(_fullSizeImage.height())
-                                .arg(_fullSizeImage.depth());
-    statusBar()->showMessage(message);
+    // The frame size is known before anything is rendered, so the first render can already target the fitted view
+    _imageSize = QSize(_currentRaw->width, _currentRaw->height);
+    _imageCanvas->SetImageSize(_imageSize);
+    _fitToWindowAct->setEnabled(true);
+    FitToWindow();
+
+    // Show the embedded preview until the first render replaces it, decoded at about the size it is displayed at.
+    // It is stretched over the whole frame, which is close enough for the moment it is visible. A prepared image
+    // renders about as fast as the preview decodes, so it goes without.
+    const QSize preview_size = (QSizeF(_imageSize) * _fit_zoom * devicePixelRatioF()).toSize();
+    _previewMs = -1;
+    auto thumbnail = prepared ? brightroom::RgbImage{}
+                              : loader.Thumbnail(*opened, source, preview_size.width(), preview_size.height());
+    if (thumbnail.pixels) {
+        using SharedPixels = std::shared_ptr<brightroom::RGB8_Data>;
+        auto* pixels = new SharedPixels(std::move(thumbnail.pixels));
+        const QImage preview(
+            (*pixels)->data(), thumbnail.width, thumbnail.height, thumbnail.width * 3, QImage::Format::Format_RGB888,
+            [](void* info) { delete static_cast<SharedPixels*>(info); }, pixels);
+        _imageCanvas->SetBase(preview, QRect(QPoint(0, 0), _imageSize));
+        _previewMs = _loadTimer.elapsed();
+    }
+
+    // The worker unpacks and preprocesses from here on
+    _currentImageId = _renderWorker->SetRaw(
+        prepared ? *prepared : brightroom::PreparedImage{_currentRaw, source, nullptr}, path, std::move(opened));
+    _refreshTimer->stop();
+    _baseIsStale = false;
+    _renderWorker->Render(_parameters, FitViewport());
+    statusBar()->showMessage(tr("Rendering \"%1\"...").arg(QDir::toNativeSeparators(fileName)));
+
+    // The neighbours wait for the first frame, the prefetch preprocess would compete with it for the thread pool.
+    // Neighbours of the previous image still waiting are dropped.
+    ListFolder(path);
+    if (_prefetcher) {
+        _prefetcher->Prefetch({});
+    }
     return true;
 }
 
+void MainWindow::ListFolder(const std::filesystem::path& file) {
+    const auto folder = file.parent_path();
+    if (_folderFiles.empty() || _folderFiles.front().parent_path() != folder) {
+        _folderFiles.clear();
+        std::error_code error;
+        for (const auto& entry : std::filesystem::directory_iterator(folder, error)) {
+            if (entry.is_regular_file(error) && brightroom::IsRawFile(entry.path())) {
+                _folderFiles.push_back(entry.path());
+            }
+        }
+        std::sort(_folderFiles.begin(), _folderFiles.end());
+    }
+    const auto found = std::find(_folderFiles.begin(), _folderFiles.end(), file);
+    if (found == _folderFiles.end()) {
+        // Not a RAW extension, or created since the folder was listed
+        _folderFiles.clear();
+        _folderIndex = 0;
+        return;
+    }
+    _folderIndex = static_cast<size_t>(found - _folderFiles.begin());
+}
+
+void MainWindow::PrefetchNeighbours() {
+    if (!_prefetcher || _folderFiles.empty()) {
+        return;
+    }
+    // Nearest first, alternating directions
+    std::vector<std::filesystem::path> files;
+    for (size_t distance = 1; distance <= std::max(kPrefetchAhead, kPrefetchBehind); ++distance) {
+        if (distance <= kPrefetchAhead && _folderIndex + distance < _folderFiles.size()) {
+            files.push_back(_folderFiles[_folderIndex + distance]);
+        }
+        if (distance <= kPrefetchBehind && _folderIndex >= distance) {
+            files.push_back(_folderFiles[_folderIndex - distance]);
+        }
+    }
+    _prefetcher->Prefetch(std::move(files));
+}
+
+void MainWindow::OpenNeighbour(int step) {
+    if (_folderFiles.empty()) {
+        return;
+    }
+    const auto index = static_cast<std::ptrdiff_t>(_folderIndex) + step;
+    if (index < 0 || index >= static_cast<std::ptrdiff_t>(_folderFiles.size())) {
+        return;
+    }
+    LoadRaw(QString::fromStdString(_folderFiles[index].string()));
+}
+
+void MainWindow::NextImage() {
+    OpenNeighbour(1);
+}
+
+void MainWindow::PreviousImage() {
+    OpenNeighbour(-1);
+}
+
+void MainWindow::ShowMetadata(const brightroom::CatalogEntry& entry) {
+    QStringList lines;
+    lines << tr("Camera: %1 %2").arg(QString::fromStdString(entry.make), QString::fromStdString(entry.model));
+    if (!entry.lens.empty()) {
+        lines << tr("Lens: %1").arg(QString::fromStdString(entry.lens));
+    }
+    if (entry.focal_length > 0) {
+        lines << tr("Focal length: %1 mm").arg(entry.focal_length, 0, 'f', 0);
+    }
+    if (entry.shutter > 0) {
+        lines << (entry.shutter < 1 ? tr("Shutter: 1/%1 s").arg(std::round(1 / entry.shutter))
+                                    : tr("Shutter: %1 s").arg(entry.shutter, 0, 'f', 1));
+    }
+    if (entry.aperture > 0) {
+        lines << tr("Aperture: f/%1").arg(entry.aperture, 0, 'f', 1);
+    }
+    if (entry.iso > 0) {
+        lines << tr("ISO: %1").arg(entry.iso, 0, 'f', 0);
+    }
+    if (entry.timestamp > 0) {
+        lines << tr("Taken: %1").arg(QDateTime::fromSecsSinceEpoch(entry.timestamp).toString(Qt::ISODate));
+    }
+    lines << tr("Size: %1x%2, %3 bit").arg(entry.width).arg(entry.height).arg(entry.bits);
+    _metadataLabel->setText(lines.join('\n'));
+}
+
+void MainWindow::ShowScanReport(const brightroom::ScanReport& report) {
+    const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(report.wall_time).count();
+    statusBar()->showMessage(tr("Scanned %1 RAW files in %2 ms, %3 new or changed, %4 unreadable")
+                                 .arg(report.files)
+                                 .arg(ms)
+                                 .arg(report.opened)
+                                 .arg(report.unreadable));
+}
+
+void MainWindow::ShowUnpackFailed(quint64 image_id) {
+    if (image_id != _currentImageId) {
+        return;
+    }
+    _awaitingFirstFrame = false;
+    statusBar()->showMessage(tr("Cannot decode \"%1\"").arg(QDir::toNativeSeparators(_currentFileName)));
+    PrefetchNeighbours();
+}
+
+void MainWindow::ShowFrame(const QImage& image, const QRect& source_rect, bool full_frame, quint64 image_id) {
+    // Frames of a previously opened image can still arrive after a new one was loaded
+    if (image_id != _currentImageId || image.isNull()) {
+        return;
+    }
+
+    if (full_frame) {
+        _imageCanvas->SetBase(image, source_rect);
+        _baseIsStale = false;
+        if (_zoom <= _fit_zoom) {
+            _imageCanvas->ClearDetail();
+        }
+    } else {
+        _imageCanvas->SetDetail(image, source_rect);
+        // Keep the parts outside the view current as well, they show while panning until the next detail render
+        if (_baseIsStale) {
+            _renderWorker->Render(_parameters, FitViewport());
+        }
+    }
+
+    if (!std::exchange(_awaitingFirstFrame, false)) {
+        return;
+    }
+    PrefetchNeighbours();
+    setWindowFilePath(_currentFileName);
+    // Time to first pixel: the embedded preview, then the first render of the RAW data
+    const qint64 render_ms = _loadTimer.elapsed();
+    const QString preview = _previewMs >= 0 ? tr("%1 ms").arg(_previewMs) : tr("none");
+    if (_previewMs >= 0) {
+        brightroom::PlotMilliseconds("Time to first preview ms", static_cast<double>(_previewMs));
+    }
+    brightroom::PlotMilliseconds("Time to first render ms", static_cast<double>(render_ms));
+    const QString message = tr("Opened \"%1\", %2x%3, Depth: %4, Preview: %5, Rendered: %6 ms")
+                                .arg(QDir::toNativeSeparators(_currentFileName))
+                                .arg(_imageSize.width())
+                                .arg(_imageSize.height())
+                                .arg(image.depth())
+                                .arg(preview)
+                                .arg(render_ms);
+    statusBar()->showMessage(message);
+}
+
+void MainWindow::ShowStatistics(const brightroom::ImageStatistics& statistics, quint64 image_id) {
+    if (image_id != _currentImageId || statistics.pixels == 0) {
+        return;
+    }
+    _histogramWidget->SetStatistics(statistics);
+
+    // Per-channel counts, the label reports the channel that clips most
+    using Channel = brightroom::ImageStatistics::Channel;
+    uint32_t highlights = 0;
+    uint32_t shadows = 0;
+    for (auto channel : {Channel::kRed, Channel::kGreen, Channel::kBlue}) {
+        highlights = std::max(highlights, statistics.HighlightClipped(channel));
+        shadows = std::max(shadows, statistics.ShadowClipped(channel));
+    }
+    const double percent = 100.0 / static_cast<double>(statistics.pixels);
+    _clippingLabel->setText(tr("Highlights clipped: %1%\nShadows clipped: %2%")
+                                .arg(highlights * percent, 0, 'f', 2)
+                                .arg(shadows * percent, 0, 'f', 2));
+}
+
 void MainWindow::SetImage(const QImage& new_image, bool fit_to_window) {
-    _fullSizeImage = new_image;
-    if (_fullSizeImage.colorSpace().isValid()) {
-        _fullSizeImage.convertToColorSpace(QColorSpace::SRgb);
+    QImage image = new_image;
+    if (image.colorSpace().isValid()) {
+        image.convertToColorSpace(QColorSpace::SRgb);
     }
-    _imageLabel->setPixmap(QPixmap::fromImage(_fullSizeImage));
+    _imageSize = image.size();
+    _imageCanvas->SetImageSize(_imageSize);
+    _imageCanvas->SetBase(image, QRect(QPoint(0, 0), _imageSize));
     _scrollArea->setVisible(true);
     _fitToWindowAct->setEnabled(true);
-    _imageLabel->adjustSize();
     if (fit_to_window) {
         FitToWindow();
     } else {
@@ -214,6 +493,27 @@ void MainWindow::SetImage(const QImage& new_image, bool fit_to_window) {
     }
 }
 
+auto MainWindow::FitViewport() const -> brightroom::Viewport {
+    // An empty region requests the whole frame. It is what the histogram describes, detail renders only cover
+    // the visible part.
+    return {{}, std::max(1, static_cast<int>(1.0 / _fit_zoom)), true};
+}
+
+auto MainWindow::VisibleViewport() const -> brightroom::Viewport {
+    if (_zoom <= _fit_zoom) {
+        return FitViewport();
+    }
+    // Visible part of the canvas, mapped back to full-resolution pixels
+    const QRect visible(_scrollArea->horizontalScrollBar()->value(), _scrollArea->verticalScrollBar()->value(),
+                        _scrollArea->viewport()->width(), _scrollArea->viewport()->height());
+    const QRect source = QRect(static_cast<int>(visible.x() / _zoom), static_cast<int>(visible.y() / _zoom),
+                               static_cast<int>(std::ceil(visible.width() / _zoom)) + 1,
+                               static_cast<int>(std::ceil(visible.height() / _zoom)) + 1)
+                             .intersected(QRect(QPoint(0, 0), _imageSize));
+    const int downscale = std::max(1, static_cast<int>(1.0 / _zoom));
+    return {{source.x(), source.y(), source.width(), source.height()}, downscale};
+}
+
 static void InitializeLoadRawFileDialog(QFileDialog& dialog) {
     QStringList mime_type_filters;
     dialog.setNameFilter(QFileDialog::tr("Raw Images (*.ORF *.RAW *.DNG *.NEF *.CR2)"));
@@ -227,6 +527,42 @@ void MainWindow::Open() {
     while (dialog.exec() == QDialog::Accepted && !LoadRaw(dialog.selectedFiles().constFirst())) {}
 }
 
+void MainWindow::ScanFolder() {
+    if (_scanThread.joinable()) {
+        statusBar()->showMessage(tr("A folder is already being scanned"));
+        return;
+    }
+    const QString folder = QFileDialog::getExistingDirectory(this, tr("Scan Folder"));
+    if (folder.isEmpty()) {
+        return;
+    }
+    statusBar()->showMessage(tr("Scanning \"%1\"...").arg(QDir::toNativeSeparators(folder)));
+    auto catalog = std::make_shared<brightroom::Catalog>(_catalog);
+    _scanThread = std::jthread([this, catalog, root = std::filesystem::path(folder.toStdString())](
+                                   std::stop_token stop_token) {
+        const auto report = catalog->Scan({root}, 0, stop_token);
+        if (stop_token.stop_requested()) {
+            return;
+        }
+        QMetaObject::invokeMethod(
+            this,
+            [this, catalog, report] {
+                _scanThread.join();
+                for (const auto& path : std::exchange(_scanUpdates, {})) {
+                    if (const auto* entry = _catalog.Find(path)) {
+                        catalog->Update(*entry);
+                    }
+                }
+                _catalog = std::move(*catalog);
+                if (!CatalogFile().empty()) {
+                    _catalog.Save(CatalogFile());
+                }
+                ShowScanReport(report);
+            },
+            Qt::QueuedConnection);
+    });
+}
+
 void MainWindow::ZoomIn() {
     ScaleImage(_zoom * kZoomInFactor);
 }
@@ -236,15 +572,17 @@ void MainWindow::ZoomOut() {
 }
 
 void MainWindow::NormalSize() {
-    _imageLabel->adjustSize();
-    _zoom = 1.0;
+    ScaleImage(1.0);
 }
 
 void MainWindow::FitToWindow() {
 
     // Calculate scale factors for both width and height
-    double scale_width = static_cast<double>(_scrollArea->viewport()->size().width()) / _fullSizeImage.width();
-    double scale_height = static_cast<double>(_scrollArea->viewport()->size().height()) / _fullSizeImage.height();
+    if (_imageSize.isEmpty()) {
+        return;
+    }
+    double scale_width = static_cast<double>(_scrollArea->viewport()->size().width()) / _imageSize.width();
+    double scale_height = static_cast<double>(_scrollArea->viewport()->size().height()) / _imageSize.height();
 
     // Use the larger scale factor to ensure the image fills the window
     _fit_zoom = std::min(scale_width, scale_height);
@@ -259,6 +597,14 @@ void MainWindow::CreateActions() {
     QAction* open_act = file_menu->addAction(tr("&Open..."), this, &MainWindow::Open);
     open_act->setShortcut(QKeySequence::Open);
 
+    file_menu->addAction(tr("&Scan Folder..."), this, &MainWindow::ScanFolder);
+
+    // With Ctrl, plain arrows still move the focused slider or scroll the view
+    QAction* next_act = file_menu->addAction(tr("&Next Image"), this, &MainWindow::NextImage);
+    next_act->setShortcut(Qt::CTRL | Qt::Key_Right);
+    QAction* previous_act = file_menu->addAction(tr("&Previous Image"), this, &MainWindow::PreviousImage);
+    previous_act->setShortcut(Qt::CTRL | Qt::Key_Left);
+
     file_menu->addSeparator();
 
     QAction* exit_act = file_menu->addAction(tr("E&xit"), this, &QWidget::close);
@@ -290,10 +636,13 @@ void MainWindow::CreateActions() {
 void MainWindow::ScaleImage(double requested_zoom) {
     double old_zoom = _zoom;
     _zoom = std::clamp(requested_zoom, _fit_zoom, 1.0);
-    _imageLabel->resize(_zoom * _fullSizeImage.size());
+    _imageCanvas->resize(_zoom * _imageSize);
 
     AdjustScrollBar(_scrollArea->horizontalScrollBar(), _zoom / old_zoom);
     AdjustScrollBar(_scrollArea->verticalScrollBar(), _zoom / old_zoom);
+    if (_zoom != old_zoom) {
+        QueueImageRefresh();
+    }
 }
 
 void MainWindow::AdjustScrollBar(QScrollBar* scroll_bar, double zoom_change) {
@@ -329,14 +678,14 @@ void MainWindow::HandleWheelEvent(QWheelEvent* event) {
     double new_zoom = _zoom * zoom_factor;
 
     // Calculate relative position before zoom
-    double rel_x = (mouse_pos.x() + _scrollArea->horizontalScrollBar()->value()) / (_zoom * _fullSizeImage.width());
-    double rel_y = (mouse_pos.y() + _scrollArea->verticalScrollBar()->value()) / (_zoom * _fullSizeImage.height());
+    double rel_x = (mouse_pos.x() + _scrollArea->horizontalScrollBar()->value()) / (_zoom * _imageSize.width());
+    double rel_y = (mouse_pos.y() + _scrollArea->verticalScrollBar()->value()) / (_zoom * _imageSize.height());
 
     ScaleImage(new_zoom);
 
     // Maintain mouse position after zoom
-    int new_x = static_cast<int>(rel_x * _zoom * _fullSizeImage.width() - mouse_pos.x());
-    int new_y = static_cast<int>(rel_y * _zoom * _fullSizeImage.height() - mouse_pos.y());
+    int new_x = static_cast<int>(rel_x * _zoom * _imageSize.width() - mouse_pos.x());
+    int new_y = static_cast<int>(rel_y * _zoom * _imageSize.height() - mouse_pos.y());
 
     _scrollArea->horizontalScrollBar()->setValue(new_x);
     _scrollArea->verticalScrollBar()->setValue(new_y);
@@ -366,20 +715,10 @@ void MainWindow::HandleMouseMoveEvent(QMouseEvent* event) {
 }
 
 void MainWindow::RefreshImage() {
-    // TODO: This should run in a separate worker thread
     if (!_currentRaw) {
         return;
     }
 
-    // std::cout << "Sleeping 1000ms\n";
-    // std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-
     std::cout << "Generating image with params: " << _parameters.ToString() << std::endl;
-    auto processed_image = _pipeline->Process(*_currentRaw, _parameters);
-    QImage new_image(processed_image.pixels.data(), processed_image.width, processed_image.height,
-                     QImage::Format::Format_RGB888);
-
-    if (!new_image.isNull()) {
-        SetImage(new_image, false);
-    }
+    _renderWorker->Render(_parameters, VisibleViewport());
 }
\ No newline at end of file
@@ -1,20 +1,34 @@
 #pragma once
 
 #include <qboxlayout.h>
+#include <QCheckBox>
 #include <QDockWidget>
+#include <QElapsedTimer>
 #include <QLabel>
 #include <QMainWindow>
 #include <QScrollArea>
 #include <QSlider>
+#include <thread>
+#include <vector>
+#include "Catalog.h"
+#include "HistogramWidget.h"
 #include "IRawPipeline.h"
+#include "ImageCanvas.h"
 #include "MySlider.h"
+#include "Prefetcher.h"
+#include "RenderWorker.h"
 #include "libraw/libraw.h"
 
 class MainWindow : public QMainWindow {
     Q_OBJECT
 
    public:
-    MainWindow(QWidget* parent, std::unique_ptr<brightroom::IRawPipeline> pipeline);
+    // Thumbnails are cached in disk_cache if it is set, the pipeline has its own reference for its intermediates.
+    // With a prefetcher, the neighbours of the open image in its folder are prepared in the background.
+    MainWindow(QWidget* parent, std::unique_ptr<brightroom::IRawPipeline> pipeline,
+               std::shared_ptr<brightroom::DiskCache> disk_cache = nullptr,
+               std::unique_ptr<brightroom::Prefetcher> prefetcher = nullptr);
+    ~MainWindow() override;
     bool LoadImage(const QString&);
     bool LoadRaw(const QString&);
 
@@ -23,6 +37,9 @@ class MainWindow : public QMainWindow {
 
    private slots:
     void Open();
+    void ScanFolder();
+    void NextImage();
+    void PreviousImage();
     void ZoomIn();
     void ZoomOut();
     void NormalSize();
@@ -35,6 +52,17 @@ class MainWindow : public QMainWindow {
     void AdjustScrollBar(QScrollBar* scroll_bar, double zoom_change);
     void CreateEditDock();
     void RefreshImage();
+    void ShowFrame(const QImage& image, const QRect& source_rect, bool full_frame, quint64 image_id);
+    void ShowStatistics(const brightroom::ImageStatistics& statistics, quint64 image_id);
+    void ShowUnpackFailed(quint64 image_id);
+    void ShowMetadata(const brightroom::CatalogEntry& entry);
+    void ShowScanReport(const brightroom::ScanReport& report);
+    auto CatalogFile() const -> std::filesystem::path;
+    void ListFolder(const std::filesystem::path& file);
+    void PrefetchNeighbours();
+    void OpenNeighbour(int step);
+    auto VisibleViewport() const -> brightroom::Viewport;
+    auto FitViewport() const -> brightroom::Viewport;
     void QueueImageRefresh();
     void ConnectSlider(MySlider* slider, std::function<void(float)> value_changed);
     void HandleWheelEvent(QWheelEvent* event);
@@ -43,9 +71,8 @@ class MainWindow : public QMainWindow {
     void HandleMouseMoveEvent(QMouseEvent* event);
     MySlider* CreateAdjustmentSlider(QWidget* parent, const QString& label, QVBoxLayout* layout);
 
-    QImage _fullSizeImage;
-    QImage _scaledImage;
-    QLabel* _imageLabel;
+    QSize _imageSize;
+    ImageCanvas* _imageCanvas;
     QScrollArea* _scrollArea;
     double _zoom = 1;
     double _fit_zoom = 1;
@@ -63,14 +90,35 @@ class MainWindow : public QMainWindow {
     MySlider* _exposureSlider;
     MySlider* _contrastSlider;
     MySlider* _saturationSlider;
+    QCheckBox* _autoExposureCheckBox;
+    HistogramWidget* _histogramWidget;
+    QLabel* _clippingLabel;
+    QLabel* _metadataLabel;
 
-    std::unique_ptr<LibRaw> _currentRaw;
+    std::shared_ptr<brightroom::DiskCache> _diskCache;
+    std::unique_ptr<brightroom::Prefetcher> _prefetcher;
+    std::vector<std::filesystem::path> _folderFiles;  // RAW files in the folder of the open image, sorted
+    size_t _folderIndex = 0;                          // Of the open image in _folderFiles
+    std::shared_ptr<const brightroom::RawFile> _currentRaw;  // Metadata of the open image
+    QString _currentFileName;
+    quint64 _currentImageId = 0;
+    bool _awaitingFirstFrame = false;
+    QElapsedTimer _loadTimer;  // Started when a file is opened, for the time to first pixel
+    qint64 _previewMs = -1;    // Time until the embedded preview showed, -1 without one
+    bool _baseIsStale = false;
     brightroom::Parameters _parameters{};
-    std::unique_ptr<brightroom::IRawPipeline> _pipeline;
+    RenderWorker* _renderWorker;
+    brightroom::Catalog _catalog;
+    std::jthread _scanThread;  // Scans a copy of _catalog, which is swapped in once it finishes
+    std::vector<std::filesystem::path> _scanUpdates;  // Entries updated while the scan ran, kept over its copy
 
     // Add these constants
     static constexpr double kZoomInFactor = 1.25;
     static constexpr double kZoomOutFactor = 0.8;
     static constexpr int kSliderTickInterval = 33;
-    static constexpr int kDebounceDelayMs = 100;
+    // Renders run on the worker and stale requests are dropped, so this only needs to coalesce slider events
+    static constexpr int kDebounceDelayMs = 15;
+    // Images prepared after and before the open one, more ahead since that is the usual direction
+    static constexpr size_t kPrefetchAhead = 2;
+    static constexpr size_t kPrefetchBehind = 1;
 };
\ No newline at end of file
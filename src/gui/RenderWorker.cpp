@@ -0,0 +1,161 @@
+#include "RenderWorker.h"
+#include <iostream>
+#include <utility>
+#include "RawLoader.h"
+
+RenderWorker::RenderWorker(std::unique_ptr<brightroom::IRawPipeline> pipeline,
+                           std::shared_ptr<brightroom::ImageCache> image_cache, QObject* parent)
+    : QObject(parent),
+      _pipeline(std::move(pipeline)),
+      _image_cache(std::move(image_cache)),
+      _thread([this](std::stop_token stop_token) { Run(stop_token); }) {}
+
+RenderWorker::~RenderWorker() {
+    std::lock_guard lock(_mutex);
+    _render_stop.request_stop();
+    _thread.request_stop();
+}
+
+auto RenderWorker::SetRaw(brightroom::PreparedImage prepared, std::filesystem::path file,
+                          std::unique_ptr<LibRaw> opened) -> quint64 {
+    std::lock_guard lock(_mutex);
+    _pending_image = PendingImage{std::move(prepared), std::move(file), std::move(opened)};
+    _pending_request.reset();
+    _render_stop.request_stop();
+    _wakeup.notify_one();
+    return ++_image_id;
+}
+
+void RenderWorker::Render(const brightroom::Parameters& parameters, const brightroom::Viewport& viewport) {
+    std::lock_guard lock(_mutex);
+    _pending_request = Request{parameters, viewport};
+    _render_stop.request_stop();
+    _wakeup.notify_one();
+}
+
+void RenderWorker::Run(std::stop_token stop_token) {
+    std::shared_ptr<const brightroom::RawFile> raw;
+    std::unique_ptr<LibRaw> opened;  // Until the sensor data has been read from it
+    std::optional<brightroom::FileIdentity> source;
+    std::filesystem::path file;
+    quint64 image_id = 0;
+    // Makes the current intermediates available when the image is opened again
+    auto cache_image = [&] {
+        auto image = _pipeline->Image();
+        if (_image_cache && !file.empty() && image && !image->Empty()) {
+            _image_cache->Insert(file, brightroom::PreparedImage{raw, source, std::move(image)});
+        }
+    };
+    // Gives raw its sensor data, from the opened file or else by loading the file again, and lets go of LibRaw
+    auto read_sensor_data = [&]() -> bool {
+        if (raw && raw->HasSensorData()) {
+            return true;
+        }
+        std::shared_ptr<const brightroom::RawFile> loaded;
+        if (opened) {
+            if (brightroom::RawLoader::Unpack(*opened)) {
+                loaded = std::make_shared<const brightroom::RawFile>(brightroom::CreateRawFile(*opened));
+            }
+            opened.reset();
+        } else if (!file.empty()) {
+            loaded = brightroom::RawLoader{}.LoadRaw(file.string());
+        }
+        if (!loaded || !loaded->HasSensorData()) {
+            return false;
+        }
+        raw = std::move(loaded);
+        return true;
+    };
+
+    while (!stop_token.stop_requested()) {
+        std::optional<PendingImage> new_image;
+        Request request;
+        std::stop_token render_stop_token;
+        {
+            std::unique_lock lock(_mutex);
+            if (!_wakeup.wait(lock, stop_token, [this] { return _pending_image || _pending_request; })) {
+                return;
+            }
+            if (_pending_image) {
+                new_image = std::exchange(_pending_image, std::nullopt);
+                image_id = _image_id;
+            }
+            // A new image is preprocessed first, its render request may arrive while that is running
+            if (!new_image) {
+                request = *_pending_request;
+                _pending_request.reset();
+                _render_stop = std::stop_source{};
+                render_stop_token = _render_stop.get_token();
+            }
+        }
+
+        if (new_image) {
+            // Editing starts on the binned preview, the full-resolution demosaic is only computed once a render
+            // at 1:1 asks for it
+            raw = std::move(new_image->prepared.raw);
+            source = new_image->prepared.source;
+            file = std::move(new_image->file);
+            opened = std::move(new_image->opened);
+            if (new_image->prepared.image && _pipeline->SetImage(std::move(new_image->prepared.image))) {
+                continue;
+            }
+            const bool cached = source && _pipeline->IsCached(*source, brightroom::PreprocessMode::kPreview);
+            if (!raw || (!cached && !read_sensor_data())) {
+                raw.reset();
+                emit UnpackFailed(image_id);
+                continue;
+            }
+            _pipeline->Preprocess(*raw, brightroom::PreprocessMode::kPreview, source);
+            if (const auto image = _pipeline->Image(); !image || image->Empty()) {
+                // The cache entry was evicted after IsCached, compute the preview from the file instead
+                if (!read_sensor_data()) {
+                    raw.reset();
+                    emit UnpackFailed(image_id);
+                    continue;
+                }
+                _pipeline->Preprocess(*raw, brightroom::PreprocessMode::kPreview, source);
+            }
+            cache_image();
+            continue;
+        }
+        if (!raw) {
+            continue;
+        }
+
+        auto processed_image = _pipeline->Process(*raw, request.parameters, request.viewport, render_stop_token);
+        if (!processed_image || !processed_image->pixels || processed_image->pixels->empty()) {
+            continue;
+        }
+        // The QImage wraps the pipeline's output buffer and holds a reference to it until the UI drops the frame.
+        // The pipeline will not render into the buffer while that reference exists.
+        using SharedPixels = std::shared_ptr<brightroom::RGB8_Data>;
+        auto* pixels = new SharedPixels(std::move(processed_image->pixels));
+        QImage image(
+            (*pixels)->data(), processed_image->width, processed_image->height, processed_image->width * 3,
+            QImage::Format::Format_RGB888, [](void* info) { delete static_cast<SharedPixels*>(info); }, pixels);
+        const auto& source = processed_image->source;
+        const bool full_frame = request.viewport.region.width <= 0 || request.viewport.region.height <= 0;
+        emit FrameReady(image, QRect(source.x, source.y, source.width, source.height), full_frame, image_id);
+        if (const auto& statistics = _pipeline->LastStatistics()) {
+            emit StatisticsReady(*statistics, image_id);
+        }
+
+        // That frame came from the preview, compute the full resolution and render again unless the user moved on
+        if (request.viewport.downscale < 2 && !_pipeline->HasFullResolution()) {
+            if (!read_sensor_data()) {
+                emit UnpackFailed(image_id);
+                continue;
+            }
+            _pipeline->Preprocess(*raw, brightroom::PreprocessMode::kAddFullResolution);
+            // Process only reads the metadata from here on
+            auto metadata = std::make_shared<brightroom::RawFile>(*raw);
+            metadata->packed.reset();
+            raw = std::move(metadata);
+            cache_image();
+            std::lock_guard lock(_mutex);
+            if (!_pending_image && !_pending_request) {
+                _pending_request = request;
+            }
+        }
+    }
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <QImage>
+#include <QObject>
+#include <condition_variable>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <thread>
+#include "IRawPipeline.h"
+#include "ImageCache.h"
+#include "libraw/libraw.h"
+
+// Runs the pipeline on a dedicated thread. Only the newest requested Parameters are rendered: requests that arrive
+// while a render is in flight replace any pending one and abandon the running render.
+class RenderWorker : public QObject {
+    Q_OBJECT
+
+   public:
+    // Images the worker preprocesses are added to image_cache if it is set
+    RenderWorker(std::unique_ptr<brightroom::IRawPipeline> pipeline,
+                 std::shared_ptr<brightroom::ImageCache> image_cache = nullptr, QObject* parent = nullptr);
+    ~RenderWorker() override;
+
+    // Replaces the image being edited. prepared.raw may come without the sensor data, which is then read on the worker
+    // thread from opened, a file RawLoader::OpenRaw returned, or else by loading file again. With a source, a cached
+    // preview lets that wait until the full resolution is needed. A prepared.image from the ImageCache skips the
+    // Preprocess. file is the key the result is cached under. Returns the id that FrameReady reports for frames of
+    // this image.
+    auto SetRaw(brightroom::PreparedImage prepared, std::filesystem::path file = {},
+                std::unique_ptr<LibRaw> opened = nullptr) -> quint64;
+    void Render(const brightroom::Parameters& parameters, const brightroom::Viewport& viewport);
+
+   signals:
+    // Emitted from the worker thread, delivered to receivers in their own thread. source_rect is the part of the
+    // frame the image covers, in full-resolution pixels; full_frame is set if the whole frame was requested.
+    void FrameReady(const QImage& image, const QRect& source_rect, bool full_frame, quint64 image_id);
+    // Follows the FrameReady of a render whose viewport set compute_statistics
+    void StatisticsReady(const brightroom::ImageStatistics& statistics, quint64 image_id);
+    // The sensor data of the image could not be read, no frames will follow
+    void UnpackFailed(quint64 image_id);
+
+   private:
+    void Run(std::stop_token stop_token);
+
+    std::unique_ptr<brightroom::IRawPipeline> _pipeline;
+    std::shared_ptr<brightroom::ImageCache> _image_cache;
+
+    std::mutex _mutex;
+    std::condition_variable_any _wakeup;
+    struct PendingImage {
+        brightroom::PreparedImage prepared;
+        std::filesystem::path file;
+        std::unique_ptr<LibRaw> opened;
+    };
+    std::optional<PendingImage> _pending_image;
+    struct Request {
+        brightroom::Parameters parameters;
+        brightroom::Viewport viewport;
+    };
+
+    std::optional<Request> _pending_request;
+    std::stop_source _render_stop;
+    quint64 _image_id = 0;
+
+    // Declared last so the thread is joined before the state above is destroyed
+    std::jthread _thread;
+};
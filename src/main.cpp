@@ -1,5 +1,6 @@
 #include <QApplication>
 #include <QGuiApplication>
+#include "AdjustmentCompiler.h"
 #include "HalideRawPipeline.h"
 #include "MainWindow.h"
 
@@ -8,8 +9,20 @@ int main(int argc, char* argv[]) {
     //load_raw();
     QApplication app(argc, argv);
     QGuiApplication::setApplicationDisplayName("BrightRoom");
-    auto pipeline = std::make_unique<brightroom::HalideRawPipeline>();
-    MainWindow main_window{nullptr, std::move(pipeline)};
+    auto disk_cache = brightroom::DiskCache::FromEnvironment();
+    if (disk_cache) {
+        brightroom::AdjustmentCompiler::Global().SetDirectory(disk_cache->Directory() / "pipelines");
+    }
+    auto make_pipeline = [disk_cache] {
+        auto pipeline = std::make_unique<brightroom::HalideRawPipeline>();
+        pipeline->SetDiskCache(disk_cache);
+        return pipeline;
+    };
+    std::unique_ptr<brightroom::Prefetcher> prefetcher;
+    if (auto image_cache = brightroom::ImageCache::FromEnvironment()) {
+        prefetcher = std::make_unique<brightroom::Prefetcher>(std::move(image_cache), make_pipeline);
+    }
+    MainWindow main_window{nullptr, make_pipeline(), disk_cache, std::move(prefetcher)};
     main_window.show();
     return QApplication::exec();
 }
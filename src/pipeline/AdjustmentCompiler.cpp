@@ -0,0 +1,366 @@
+#include "AdjustmentCompiler.h"
+#include <Halide.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "Telemetry.h"
+#include "Tracy.hpp"
+#include "halide/functions.h"
+#include "halide/strips.h"
+
+#ifndef _WIN32
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cerrno>
+
+extern char** environ;
+#endif
+
+namespace {
+
+// Part of the key of every compiled pipeline. Bump it whenever BuildPipeline or a stage it uses changes, so
+// pipelines an older build stored are not loaded.
+constexpr int kStackVersion = 2;
+
+auto ApplyAdjustment(brightroom::AdjustmentKind kind, Halide::Func input, Halide::Var x, Halide::Var y,
+                     Halide::Var c, Halide::Expr amount) -> Halide::Func {
+    switch (kind) {
+        case brightroom::AdjustmentKind::kExposure:
+            return brightroom::ExposureAdjustment(input, x, y, c, amount);
+        case brightroom::AdjustmentKind::kGamma:
+            return brightroom::GammaCorrection(input, x, y, c, amount);
+        case brightroom::AdjustmentKind::kContrast:
+            return brightroom::ContrastAdjustment(input, x, y, c, amount);
+        case brightroom::AdjustmentKind::kSaturation:
+            return brightroom::SaturationAdjustment(input, x, y, c, amount);
+    }
+    return input;
+}
+
+struct StackPipeline {
+    Halide::Pipeline pipeline;
+    std::vector<Halide::Argument> arguments;  // Inputs in order, the outputs follow
+};
+
+// The display stage of ProcessDisplayGenerator with the stack in place of gamma, contrast and saturation: the same
+// inputs and outputs, except that the two factors become one amount per adjustment
+auto BuildPipeline(const brightroom::AdjustmentStack& stack, int bits, const Halide::Target& target)
+    -> StackPipeline {
+    Halide::Var x("x"), y("y"), c("c");
+    Halide::ImageParam linear(Halide::Float(32), 3, "linear");
+    std::vector<Halide::Argument> arguments{linear};
+    Halide::Func adjusted("stack_input");
+    adjusted(x, y, c) = linear(x, y, c);
+    for (size_t i = 0; i < stack.size(); ++i) {
+        Halide::Param<float> amount("amount_" + std::to_string(i));
+        arguments.push_back(amount);
+        adjusted = ApplyAdjustment(stack[i].kind, adjusted, x, y, c, amount);
+    }
+    Halide::Param<bool> compute_histogram("compute_histogram");
+    arguments.push_back(compute_histogram);
+
+    // The quantized pixels, which output stores and the histogram counts, as in ProcessRawGenerator. 16-bit samples
+    // are counted by their high byte.
+    Halide::Func pixels = bits == 16 ? brightroom::ToRgb16(adjusted, x, y, c) : brightroom::ToRgb8(adjusted, x, y, c);
+    Halide::Func histogram_input = pixels;
+    if (bits == 16) {
+        histogram_input = Halide::Func("histogram_rgb8");
+        histogram_input(x, y, c) = Halide::cast<uint8_t>(Halide::Expr(pixels(x, y, c)) >> 8);
+    }
+    Halide::Func output("stored");
+    output(x, y, c) = pixels(x, y, c);
+    auto output_buffer = output.output_buffer();
+    Halide::Func partial_histogram;
+    Halide::Expr histogram_rows = Halide::select(compute_histogram, output_buffer.dim(1).extent(), 0);
+    Halide::Func histogram = brightroom::Histogram(histogram_input, output_buffer.dim(0).min(),
+                                                   output_buffer.dim(1).min(), output_buffer.dim(0).extent(),
+                                                   histogram_rows, partial_histogram, brightroom::kRowsPerTask);
+
+    // For interleaved input and output
+    linear.dim(0).set_stride(3);
+    linear.dim(2).set_stride(1);
+    linear.dim(2).set_bounds(0, 3);
+    output_buffer.dim(0).set_stride(3);
+    output_buffer.dim(2).set_stride(1);
+    output_buffer.dim(2).set_bounds(0, 3);
+    histogram.output_buffer().dim(0).set_bounds(0, 256);
+    histogram.output_buffer().dim(1).set_bounds(0, 4);
+
+    // Every adjustment is pointwise, inlined they become one vectorized pass over the output. The autoscheduler
+    // would have to be loaded as a plugin at runtime for no gain here.
+    Halide::Var strip = brightroom::ScheduleRgbStrips(output, x, y, c, target);
+    brightroom::ScheduleFusedHistogram(partial_histogram, pixels, output, strip, x, y, c, target);
+    return {Halide::Pipeline({output, histogram}), arguments};
+}
+
+auto StackKey(const brightroom::AdjustmentStack& stack, int bits, const Halide::Target& target) -> std::string {
+    return "v" + std::to_string(kStackVersion) + "/halide-" + std::to_string(HALIDE_VERSION_MAJOR) + "." +
+           std::to_string(HALIDE_VERSION_MINOR) + "." + std::to_string(HALIDE_VERSION_PATCH) + "/" +
+           target.to_string() + "/rgb" + std::to_string(bits) + "/" + brightroom::AdjustmentStackShape(stack);
+}
+
+// Name of the function and file of the pipeline with key, a 64-bit FNV-1a hash of it
+auto StackName(const std::string& key) -> std::string {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (char character : key) {
+        hash = (hash ^ static_cast<uint8_t>(character)) * 0x100000001b3ull;
+    }
+    char name[32];
+    std::snprintf(name, sizeof(name), "brightroom_stack_%016llx", static_cast<unsigned long long>(hash));
+    return name;
+}
+
+auto CompileJit(const brightroom::AdjustmentStack& stack, int bits, const Halide::Target& target)
+    -> std::function<int(void**)> {
+    auto [pipeline, arguments] = BuildPipeline(stack, bits, target);
+    const auto callable = pipeline.compile_to_callable(arguments, target);
+    const size_t argument_count = arguments.size() + 2;  // And the two outputs
+    return [callable, argument_count](void** pipeline_arguments) {
+        // A JIT pipeline takes a JITUserContext first, passed like a scalar, by address
+        Halide::JITUserContext context;
+        Halide::JITUserContext* context_pointer = &context;
+        std::vector<const void*> argv{&context_pointer};
+        argv.insert(argv.end(), pipeline_arguments, pipeline_arguments + argument_count);
+        return callable.call_argv_fast(argv.size(), argv.data());
+    };
+}
+
+#ifndef _WIN32
+
+// The driver that links stored pipelines: $BRIGHTROOM_LINKER, a full path, else the compiler of the build if it is
+// still installed. Empty if there is neither.
+auto Linker() -> std::filesystem::path {
+    if (const char* linker = std::getenv("BRIGHTROOM_LINKER"); linker != nullptr && *linker != '\0') {
+        return linker;
+    }
+#ifdef BRIGHTROOM_SHARED_LINKER
+    std::error_code error;
+    if (std::filesystem::is_regular_file(BRIGHTROOM_SHARED_LINKER, error)) {
+        return BRIGHTROOM_SHARED_LINKER;
+    }
+#endif
+    return {};
+}
+
+// Whether path is a file or directory, not a link, of this user that nobody else can write to
+auto OwnedByUser(const std::filesystem::path& path) -> bool {
+    struct stat status {};
+    return lstat(path.c_str(), &status) == 0 && (S_ISREG(status.st_mode) || S_ISDIR(status.st_mode)) &&
+           status.st_uid == geteuid() && (status.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+}
+
+// Runs program with arguments and no shell, its output discarded. Returns whether it exited with 0.
+auto RunProgram(const std::vector<std::string>& arguments) -> bool {
+    std::vector<char*> argv;
+    for (const auto& argument : arguments) {
+        argv.push_back(const_cast<char*>(argument.c_str()));
+    }
+    argv.push_back(nullptr);
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    pid_t pid = 0;
+    const int spawned = posix_spawn(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (spawned != 0) {
+        return false;
+    }
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// The library stays loaded, its Halide runtime may have started worker threads. Its runtime is not the one of the
+// generators, it gets the same number of threads.
+auto LoadStackLibrary(const std::filesystem::path& library, const std::string& name) -> std::function<int(void**)> {
+    if (!OwnedByUser(library)) {
+        return nullptr;
+    }
+    void* handle = dlopen(library.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (handle == nullptr) {
+        return nullptr;
+    }
+    auto* function = reinterpret_cast<int (*)(void**)>(dlsym(handle, (name + "_argv").c_str()));
+    if (function == nullptr) {
+        dlclose(handle);
+        return nullptr;
+    }
+    if (auto* set_num_threads = reinterpret_cast<int (*)(int)>(dlsym(handle, "halide_set_num_threads"))) {
+        set_num_threads(brightroom::HalideThreadCount());
+    }
+    return function;
+}
+
+// Compiles the pipeline into an object with its own Halide runtime and links it into library. The library is
+// written under a temporary name and renamed, so a concurrent process never loads a partial file.
+auto CompileLibrary(const brightroom::AdjustmentStack& stack, int bits, const Halide::Target& target,
+                    const std::filesystem::path& library, const std::string& name) -> bool {
+    const auto linker = Linker();
+    if (linker.empty()) {
+        return false;
+    }
+    auto [pipeline, arguments] = BuildPipeline(stack, bits, target);
+    const auto temporary = library.string() + "." + std::to_string(std::random_device{}());
+    const auto object = temporary + ".o";
+    pipeline.compile_to_object(object, arguments, name, target);
+    const bool linked = RunProgram({linker.string(), "-shared", "-o", temporary, object});
+    std::error_code error;
+    std::filesystem::remove(object, error);
+    if (linked) {
+        using std::filesystem::perms;
+        std::filesystem::permissions(temporary, perms::owner_read | perms::owner_write, error);
+        if (!error) {
+            std::filesystem::rename(temporary, library, error);
+        }
+    }
+    if (!linked || error) {
+        std::filesystem::remove(temporary, error);
+        return false;
+    }
+    return true;
+}
+
+#endif
+
+}  // namespace
+
+namespace brightroom {
+
+auto AdjustmentCompiler::Global() -> AdjustmentCompiler& {
+    static auto* compiler = new AdjustmentCompiler();
+    return *compiler;
+}
+
+auto AdjustmentCompiler::SupportsDirectory() -> bool {
+#ifndef _WIN32
+    return !Linker().empty();
+#else
+    return false;
+#endif
+}
+
+void AdjustmentCompiler::SetDirectory(std::filesystem::path directory) {
+#ifndef _WIN32
+    std::error_code error;
+    if (!directory.empty()) {
+        std::filesystem::create_directories(directory, error);
+        std::filesystem::permissions(directory, std::filesystem::perms::owner_all, error);
+        if (!OwnedByUser(directory)) {
+            std::cout << "Cannot use " << directory << ", adjustment stacks are kept in memory only" << "\n";
+            directory.clear();
+        }
+    }
+#else
+    directory.clear();
+#endif
+    std::lock_guard lock(_mutex);
+    _directory = std::move(directory);
+}
+
+auto AdjustmentCompiler::Prepare(const AdjustmentStack& stack, int bits) -> bool {
+    return Find(stack, bits) != nullptr;
+}
+
+auto AdjustmentCompiler::Run(const AdjustmentStack& stack, halide_buffer_t* linear, bool compute_histogram,
+                             halide_buffer_t* output, halide_buffer_t* histogram) -> int {
+    ZoneScoped;
+    const auto compiled = Find(stack, output->type.bits);
+    if (!compiled) {
+        return kCompileError;
+    }
+    std::vector<float> amounts;
+    for (const auto& adjustment : stack) {
+        amounts.push_back(adjustment.amount);
+    }
+    std::vector<void*> arguments{linear};
+    for (auto& amount : amounts) {
+        arguments.push_back(&amount);
+    }
+    arguments.push_back(&compute_histogram);
+    arguments.push_back(output);
+    arguments.push_back(histogram);
+    return (*compiled)(arguments.data());
+}
+
+auto AdjustmentCompiler::Statistics() const -> AdjustmentCompilerStatistics {
+    std::lock_guard lock(_mutex);
+    return _statistics;
+}
+
+auto AdjustmentCompiler::Find(const AdjustmentStack& stack, int bits) -> std::shared_ptr<const CompiledStack> {
+    // The key names the target the pipeline is compiled for, which HL_JIT_TARGET may change from the host
+    const auto target = Halide::get_jit_target_from_environment();
+    const auto key = StackKey(stack, bits, target);
+    std::promise<std::shared_ptr<const CompiledStack>> promise;
+    PendingStack pending;
+    std::filesystem::path directory;
+    {
+        std::lock_guard lock(_mutex);
+        if (auto found = _compiled.find(key); found != _compiled.end()) {
+            ++_statistics.memory_hits;
+            pending = found->second;
+        } else {
+            _compiled.emplace(key, promise.get_future().share());
+            directory = _directory;
+        }
+    }
+    if (pending.valid()) {
+        return pending.get();  // Waits without the lock if another thread is still compiling it
+    }
+
+    ZoneScopedN("compile_adjustments");
+    CompiledStack compiled;
+    bool loaded = false;
+    bool stored = true;
+    try {
+#ifndef _WIN32
+        if (!directory.empty()) {
+            const auto name = StackName(key);
+            const auto library = directory / (name + ".so");
+            compiled = LoadStackLibrary(library, name);
+            loaded = compiled != nullptr;
+            if (!loaded) {
+                stored = CompileLibrary(stack, bits, target, library, name);
+                if (stored) {
+                    compiled = LoadStackLibrary(library, name);
+                }
+            }
+        }
+#endif
+        if (!compiled) {
+            compiled = CompileJit(stack, bits, target);
+        }
+    } catch (const Halide::Error& error) {
+        std::cout << "Adjustment stack compile error: " << error.what() << "\n";
+    }
+    // A failure is kept too, compiling the same shape again would fail the same way
+    auto entry = compiled ? std::make_shared<const CompiledStack>(std::move(compiled)) : nullptr;
+    {
+        std::lock_guard lock(_mutex);
+        if (entry) {
+            ++(loaded ? _statistics.loaded : _statistics.compiled);
+        }
+        // Storing fails the same way for every shape, so it is reported once and not tried again
+        if (!stored && !_directory.empty()) {
+            std::cout << "Cannot store adjustment stacks in " << _directory << ", they are kept in memory only"
+                      << "\n";
+            _directory.clear();
+        }
+    }
+    promise.set_value(entry);
+    return entry;
+}
+
+}  // namespace brightroom
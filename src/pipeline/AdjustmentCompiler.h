@@ -0,0 +1,74 @@
+#pragma once
+
+#include <HalideRuntime.h>
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "AdjustmentStack.h"
+
+namespace brightroom {
+
+struct AdjustmentCompilerStatistics {
+    std::size_t compiled = 0;     // Shapes compiled with the Halide compiler
+    std::size_t loaded = 0;       // Shapes loaded from the directory instead
+    std::size_t memory_hits = 0;  // Runs and Prepares that found their shape compiled already
+};
+
+// Compiles adjustment stacks into Halide pipelines at runtime, from the same stages as the generators, so a recipe
+// does not need a rebuild. A pipeline is compiled once per stack shape, output bits and target, and kept for the
+// lifetime of the compiler. With a directory it is also stored there as a shared library, so later runs load it
+// instead of compiling again. Stored pipelines are never evicted, there is one per recipe shape. Safe to use from
+// several threads, a compile only blocks the threads that need the same pipeline.
+// A compiled pipeline runs on a Halide runtime of its own, the JIT's or the one linked into its library, not the one
+// of the AOT generators. A library gets HalideThreadCount threads when it is loaded, the JIT sizes its pool from
+// HL_NUM_THREADS or the hardware. Later calls of SetHalideThreadCount do not reach either, and the scratch they
+// allocate is not counted in PipelineTelemetry.
+class AdjustmentCompiler {
+   public:
+    // Returned by Run if the stack could not be compiled
+    static constexpr int kCompileError = -1;
+
+    AdjustmentCompiler() = default;
+    AdjustmentCompiler(const AdjustmentCompiler&) = delete;
+    auto operator=(const AdjustmentCompiler&) -> AdjustmentCompiler& = delete;
+
+    // The compiler HalideRawPipeline renders stacks with
+    static auto Global() -> AdjustmentCompiler&;
+    // Whether this platform can store compiled pipelines in a directory
+    static auto SupportsDirectory() -> bool;
+
+    // Where compiled pipelines are stored and looked up, created if needed and only readable by the user. Empty keeps
+    // them in memory only, as does a directory another user could write to. Only libraries owned by the user and not
+    // writable by anyone else are loaded.
+    void SetDirectory(std::filesystem::path directory);
+    // Compiles or loads the pipeline of stack for bits per sample unless it is ready. Returns false if that failed.
+    auto Prepare(const AdjustmentStack& stack, int bits = 8) -> bool;
+    // Applies stack to linear, float linear sRGB, and writes output, 8 or 16-bit samples with the bounds of linear.
+    // Both are interleaved RGB. histogram is 256 x 4 as for process_display, filled if compute_histogram and zeroed
+    // otherwise. Returns the Halide error, or kCompileError.
+    auto Run(const AdjustmentStack& stack, halide_buffer_t* linear, bool compute_histogram, halide_buffer_t* output,
+             halide_buffer_t* histogram) -> int;
+    auto Statistics() const -> AdjustmentCompilerStatistics;
+
+   private:
+    // Called with the arguments of the pipeline in the order of the argv functions Halide generates: linear, one
+    // amount per adjustment, compute_histogram, output and histogram
+    using CompiledStack = std::function<int(void** arguments)>;
+    using PendingStack = std::shared_future<std::shared_ptr<const CompiledStack>>;
+
+    // Compiles or loads the pipeline unless another thread did or is doing so, without holding _mutex while it
+    // compiles. nullptr if that failed.
+    auto Find(const AdjustmentStack& stack, int bits) -> std::shared_ptr<const CompiledStack>;
+
+    mutable std::mutex _mutex;
+    std::filesystem::path _directory;
+    std::unordered_map<std::string, PendingStack> _compiled;  // By key, ready once compiled
+    AdjustmentCompilerStatistics _statistics;
+};
+
+}  // namespace brightroom
@@ -0,0 +1,92 @@
+#include "AdjustmentStack.h"
+#include <array>
+#include <cmath>
+#include <sstream>
+
+namespace {
+
+constexpr std::array kKinds{brightroom::AdjustmentKind::kExposure, brightroom::AdjustmentKind::kGamma,
+                            brightroom::AdjustmentKind::kContrast, brightroom::AdjustmentKind::kSaturation};
+
+// Whether the stage of kind renders finite values with amount. Exposure is in stops, a negative amount darkens.
+auto ValidAmount(brightroom::AdjustmentKind kind, float amount) -> bool {
+    if (!std::isfinite(amount)) {
+        return false;
+    }
+    switch (kind) {
+        case brightroom::AdjustmentKind::kExposure:
+            return true;
+        case brightroom::AdjustmentKind::kGamma:
+            return amount > 0.0f;
+        case brightroom::AdjustmentKind::kContrast:
+        case brightroom::AdjustmentKind::kSaturation:
+            return amount >= 0.0f;
+    }
+    return false;
+}
+
+}  // namespace
+
+namespace brightroom {
+
+auto AdjustmentName(AdjustmentKind kind) -> const char* {
+    switch (kind) {
+        case AdjustmentKind::kExposure:
+            return "exposure";
+        case AdjustmentKind::kGamma:
+            return "gamma";
+        case AdjustmentKind::kContrast:
+            return "contrast";
+        case AdjustmentKind::kSaturation:
+            return "saturation";
+    }
+    return "";
+}
+
+auto ParseAdjustmentStack(std::string_view text) -> std::optional<AdjustmentStack> {
+    AdjustmentStack stack;
+    std::istringstream entries{std::string(text)};
+    std::string entry;
+    while (std::getline(entries, entry, ',')) {
+        std::istringstream fields(entry);
+        std::string name;
+        Adjustment adjustment{};
+        std::string rest;
+        if (!(fields >> name >> adjustment.amount) || (fields >> rest)) {
+            return std::nullopt;
+        }
+        bool known = false;
+        for (auto kind : kKinds) {
+            if (name == AdjustmentName(kind)) {
+                adjustment.kind = kind;
+                known = true;
+            }
+        }
+        if (!known || !ValidAmount(adjustment.kind, adjustment.amount)) {
+            return std::nullopt;
+        }
+        stack.push_back(adjustment);
+    }
+    return stack;
+}
+
+auto FormatAdjustmentStack(const AdjustmentStack& stack) -> std::string {
+    std::ostringstream text;
+    for (size_t i = 0; i < stack.size(); ++i) {
+        text << (i > 0 ? ", " : "") << AdjustmentName(stack[i].kind) << " " << stack[i].amount;
+    }
+    return text.str();
+}
+
+auto AdjustmentStackShape(const AdjustmentStack& stack) -> std::string {
+    std::string shape;
+    for (const auto& adjustment : stack) {
+        if (!shape.empty()) {
+            shape += ",";
+        }
+        shape += AdjustmentName(adjustment.kind);
+    }
+    return shape;
+}
+
+}  // namespace brightroom
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace brightroom {
+
+// The adjustments an edit recipe can stack, each one of the stages in halide/functions.h with a single amount
+enum class AdjustmentKind {
+    kExposure,    // Multiplies by 2^amount, amount in stops
+    kGamma,       // Raises [0, 1] to 1 / amount, 2.2 encodes linear sRGB for display
+    kContrast,    // Scales the distance from 0.5 by amount
+    kSaturation,  // Scales the saturation by amount
+};
+
+struct Adjustment {
+    AdjustmentKind kind;
+    float amount = 1.0f;
+
+    auto operator==(const Adjustment&) const -> bool = default;
+};
+
+// Adjustments applied in order to linear sRGB, in place of the fixed gamma, contrast and saturation. The result is
+// quantized as display values, so a stack normally contains a gamma. Stacks of the same kinds in the same order
+// share one compiled pipeline, whatever their amounts.
+using AdjustmentStack = std::vector<Adjustment>;
+
+auto AdjustmentName(AdjustmentKind kind) -> const char*;
+
+// "exposure 0.5, gamma 2.2, contrast 1.2", the format of FormatAdjustmentStack. Returns std::nullopt for an unknown
+// adjustment, a missing amount or one the stage cannot render: a gamma that is not positive, or a negative contrast
+// or saturation.
+auto ParseAdjustmentStack(std::string_view text) -> std::optional<AdjustmentStack>;
+auto FormatAdjustmentStack(const AdjustmentStack& stack) -> std::string;
+
+// The kinds of stack in order, "exposure,gamma,contrast", which is what its compiled pipeline depends on
+auto AdjustmentStackShape(const AdjustmentStack& stack) -> std::string;
+
+}  // namespace brightroom
@@ -0,0 +1,233 @@
+#include "BufferPool.h"
+#include <HalideRuntime.h>
+#include <algorithm>
+#include <cassert>
+#include <bit>
+#include <cstddef>
+#include <cstdlib>
+#include <mutex>
+#include "Tracy.hpp"
+
+namespace {
+
+// Every block the Halide hooks hand out starts with a header that says whether it came from the pool, so freeing a
+// small block never takes the pool's lock. A whole alignment unit keeps the memory behind it aligned.
+constexpr std::size_t kHeaderBytes = brightroom::BufferPool::kAlignment;
+
+auto HalideMalloc(void* /*user_context*/, std::size_t size) -> void* {
+    const bool pooled = size >= brightroom::BufferPool::kSmallLimit;
+    const std::size_t block_size = (size + kHeaderBytes + brightroom::BufferPool::kAlignment - 1) /
+                                   brightroom::BufferPool::kAlignment * brightroom::BufferPool::kAlignment;
+    void* block = pooled ? brightroom::BufferPool::Global().Allocate(block_size)
+                         : std::aligned_alloc(brightroom::BufferPool::kAlignment, block_size);
+    if (block == nullptr) {
+        return nullptr;
+    }
+    *static_cast<bool*>(block) = pooled;
+    return static_cast<std::byte*>(block) + kHeaderBytes;
+}
+
+void HalideFree(void* /*user_context*/, void* pointer) {
+    if (pointer == nullptr) {
+        return;
+    }
+    void* block = static_cast<std::byte*>(pointer) - kHeaderBytes;
+    if (*static_cast<bool*>(block)) {
+        brightroom::BufferPool::Global().Free(block);
+    } else {
+        std::free(block);
+    }
+}
+
+// Buffer::allocate takes plain functions
+auto BufferAllocate(std::size_t size) -> void* {
+    return brightroom::BufferPool::Global().Allocate(size);
+}
+
+void BufferFree(void* pointer) {
+    brightroom::BufferPool::Global().Free(pointer);
+}
+
+}  // namespace
+
+namespace brightroom {
+
+BufferPool::BufferPool(std::size_t max_cached_bytes) : _max_cached_bytes(max_cached_bytes) {}
+
+BufferPool::~BufferPool() {
+    Trim();
+}
+
+auto BufferPool::Global() -> BufferPool& {
+    static auto* pool = new BufferPool();
+    return *pool;
+}
+
+auto BufferPool::SizeClass(std::size_t size) -> std::size_t {
+    size = std::max(size, kAlignment);
+    if (size <= kSmallLimit) {
+        return std::bit_ceil(size);
+    }
+    // Eight classes between consecutive powers of two
+    const std::size_t step = std::bit_floor(size - 1) / 8;
+    return (size + step - 1) / step * step;
+}
+
+auto BufferPool::Allocate(std::size_t size) -> void* {
+    ZoneScoped;
+    const auto size_class = SizeClass(size);
+    void* pointer = nullptr;
+    {
+        std::lock_guard lock(_mutex);
+        ++_statistics.allocations;
+        auto& free = _free[size_class];
+        free.last_use = _statistics.system_allocations;
+        if (!free.blocks.empty()) {
+            pointer = free.blocks.back();
+            free.blocks.pop_back();
+            _statistics.bytes_cached -= size_class;
+            _statistics.bytes_in_use += size_class;
+            ++_statistics.reused;
+            _in_use.emplace(pointer, size_class);
+            return pointer;
+        }
+    }
+
+    // Outside the lock, large allocations map and may take a while
+    pointer = std::aligned_alloc(kAlignment, size_class);
+    if (pointer == nullptr) {
+        return nullptr;
+    }
+    std::vector<void*> released;
+    {
+        std::lock_guard lock(_mutex);
+        ++_statistics.system_allocations;
+        _free[size_class].last_use = _statistics.system_allocations;
+        _statistics.bytes_in_use += size_class;
+        _statistics.peak_bytes =
+            std::max(_statistics.peak_bytes, _statistics.bytes_in_use + _statistics.bytes_cached);
+        _in_use.emplace(pointer, size_class);
+        ReleaseStale(released);
+    }
+    for (void* block : released) {
+        std::free(block);
+    }
+    return pointer;
+}
+
+void BufferPool::Free(void* pointer) {
+    if (pointer == nullptr) {
+        return;
+    }
+    std::vector<void*> released;
+    {
+        std::lock_guard lock(_mutex);
+        const auto found = _in_use.find(pointer);
+        assert(found != _in_use.end() && "BufferPool::Free of a block the pool did not allocate");
+        if (found == _in_use.end()) {
+            return;
+        }
+        const auto size_class = found->second;
+        _in_use.erase(found);
+        _statistics.bytes_in_use -= size_class;
+        if (size_class > _max_cached_bytes) {
+            _statistics.bytes_released += size_class;
+            released.push_back(pointer);
+        } else {
+            ReleaseCached(_max_cached_bytes - size_class, released);
+            auto& free = _free[size_class];
+            free.blocks.push_back(pointer);
+            free.last_use = _statistics.system_allocations;
+            _statistics.bytes_cached += size_class;
+        }
+    }
+    for (void* block : released) {
+        std::free(block);
+    }
+}
+
+void BufferPool::Trim() {
+    std::vector<void*> released;
+    {
+        std::lock_guard lock(_mutex);
+        ReleaseCached(0, released);
+    }
+    for (void* block : released) {
+        std::free(block);
+    }
+}
+
+void BufferPool::SetMaxCachedBytes(std::size_t max_cached_bytes) {
+    std::vector<void*> released;
+    {
+        std::lock_guard lock(_mutex);
+        _max_cached_bytes = max_cached_bytes;
+        ReleaseCached(max_cached_bytes, released);
+    }
+    for (void* block : released) {
+        std::free(block);
+    }
+}
+
+auto BufferPool::Statistics() const -> BufferPoolStatistics {
+    std::lock_guard lock(_mutex);
+    return _statistics;
+}
+
+void BufferPool::ResetPeak() {
+    std::lock_guard lock(_mutex);
+    _statistics.peak_bytes = _statistics.bytes_in_use + _statistics.bytes_cached;
+}
+
+void BufferPool::ReleaseCached(std::size_t target_bytes, std::vector<void*>& released) {
+    // Largest first, a few large blocks free the most memory for the fewest future page faults
+    for (auto it = _free.rbegin(); it != _free.rend() && _statistics.bytes_cached > target_bytes; ++it) {
+        auto& blocks = it->second.blocks;
+        while (!blocks.empty() && _statistics.bytes_cached > target_bytes) {
+            released.push_back(blocks.back());
+            blocks.pop_back();
+            _statistics.bytes_cached -= it->first;
+            _statistics.bytes_released += it->first;
+        }
+    }
+}
+
+void BufferPool::ReleaseStale(std::vector<void*>& released) {
+    for (auto it = _free.begin(); it != _free.end();) {
+        if (_statistics.system_allocations - it->second.last_use < kStaleMisses) {
+            ++it;
+            continue;
+        }
+        const auto bytes = it->first * it->second.blocks.size();
+        released.insert(released.end(), it->second.blocks.begin(), it->second.blocks.end());
+        _statistics.bytes_cached -= bytes;
+        _statistics.bytes_released += bytes;
+        it = _free.erase(it);
+    }
+}
+
+void InstallHalideAllocator() {
+    static std::once_flag installed;
+    std::call_once(installed, [] {
+        halide_set_custom_malloc(HalideMalloc);
+        halide_set_custom_free(HalideFree);
+    });
+}
+
+auto PooledBuffer(halide_type_t type, int width, int height) -> Halide::Runtime::Buffer<void> {
+    const halide_dimension_t shape[2] = {{0, width, 1}, {0, height, width}};
+    Halide::Runtime::Buffer<void> buffer(type, nullptr, 2, shape);
+    buffer.allocate(BufferAllocate, BufferFree);
+    return buffer;
+}
+
+auto PooledInterleavedBuffer(halide_type_t type, int width, int height, int channels)
+    -> Halide::Runtime::Buffer<void> {
+    // The layout make_interleaved would give, without its allocation
+    const halide_dimension_t shape[3] = {{0, width, channels}, {0, height, channels * width}, {0, channels, 1}};
+    Halide::Runtime::Buffer<void> buffer(type, nullptr, 3, shape);
+    buffer.allocate(BufferAllocate, BufferFree);
+    return buffer;
+}
+
+}  // namespace brightroom
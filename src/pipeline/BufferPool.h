@@ -0,0 +1,92 @@
+#pragma once
+
+#include <HalideBuffer.h>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace brightroom {
+
+struct BufferPoolStatistics {
+    std::size_t allocations = 0;          // Requests served
+    std::size_t reused = 0;               // Requests served from a freed block of the same size class
+    std::size_t system_allocations = 0;   // Requests that needed new memory
+    std::size_t bytes_in_use = 0;         // Handed out and not freed yet, rounded up to the size class
+    std::size_t bytes_cached = 0;         // Freed and kept for reuse
+    std::size_t peak_bytes = 0;           // Highest bytes_in_use + bytes_cached
+    std::size_t bytes_released = 0;       // Cached memory given back to the system, over the limit or unused
+};
+
+// Keeps freed blocks for reuse by later allocations of the same size class, so opening one image after another of
+// the same camera reuses the intermediates of the previous one instead of mapping and faulting in fresh pages. The
+// frame-sized buffers of PooledBuffer and PooledInterleavedBuffer come from here, and with InstallHalideAllocator the
+// large scratch Halide allocates inside the generators.
+// Size classes are powers of two up to 64 KiB and eighths of a power of two above, which wastes at most 12.5% on
+// the large buffers that matter. Freed blocks are kept up to max_cached_bytes, the largest are released first
+// beyond that. A size class nobody asked for during the last kStaleMisses allocations the pool could not serve is
+// released too: those come in bursts when frames of a new size arrive, and its buffers replace the old ones. Safe to
+// use from several threads.
+class BufferPool {
+   public:
+    static constexpr std::size_t kAlignment = 128;  // At least what Halide expects of halide_malloc
+    static constexpr std::size_t kDefaultMaxCachedBytes = 1ull << 30;
+    static constexpr std::size_t kStaleMisses = 16;
+
+    explicit BufferPool(std::size_t max_cached_bytes = kDefaultMaxCachedBytes);
+    ~BufferPool();
+    BufferPool(const BufferPool&) = delete;
+    auto operator=(const BufferPool&) -> BufferPool& = delete;
+
+    // The pool behind PooledBuffer, PooledInterleavedBuffer and the Halide allocator hooks. Never destroyed, buffers
+    // held in statics and Halide may free memory during static destruction.
+    static auto Global() -> BufferPool&;
+
+    // Aligned to kAlignment. Returns nullptr if the system is out of memory.
+    auto Allocate(std::size_t size) -> void*;
+    // pointer must come from Allocate of this pool, which is asserted. nullptr is ignored.
+    void Free(void* pointer);
+    // Releases every cached block
+    void Trim();
+    void SetMaxCachedBytes(std::size_t max_cached_bytes);
+    auto Statistics() const -> BufferPoolStatistics;
+    // Starts peak_bytes over from the memory the pool holds now
+    void ResetPeak();
+
+    static auto SizeClass(std::size_t size) -> std::size_t;
+
+    // Blocks smaller than this are not worth the lock, the Halide allocator hooks take them from the system
+    static constexpr std::size_t kSmallLimit = 64 * 1024;
+
+   private:
+    struct FreeBlocks {
+        std::vector<void*> blocks;
+        std::size_t last_use = 0;  // system_allocations when the class was last allocated or freed
+    };
+
+    // Both expect _mutex to be held and move the blocks to release into released, to be freed after unlocking
+    void ReleaseCached(std::size_t target_bytes, std::vector<void*>& released);
+    void ReleaseStale(std::vector<void*>& released);
+
+    std::size_t _max_cached_bytes;
+    mutable std::mutex _mutex;
+    std::map<std::size_t, FreeBlocks> _free;           // By size class
+    std::unordered_map<void*, std::size_t> _in_use;    // Size class of every block handed out
+    BufferPoolStatistics _statistics;
+};
+
+// Routes the allocations of kSmallLimit bytes or more that Halide's runtime makes for intermediate Funcs through
+// BufferPool::Global(), the smaller ones go to the system allocator without taking its lock. Safe to call more than
+// once.
+void InstallHalideAllocator();
+
+// A single-channel width x height buffer, pooled like PooledInterleavedBuffer
+auto PooledBuffer(halide_type_t type, int width, int height) -> Halide::Runtime::Buffer<void>;
+
+// An interleaved width x height x channels buffer in memory from BufferPool::Global(), returned to the pool once the
+// last buffer sharing it is destroyed
+auto PooledInterleavedBuffer(halide_type_t type, int width, int height, int channels)
+    -> Halide::Runtime::Buffer<void>;
+
+}  // namespace brightroom
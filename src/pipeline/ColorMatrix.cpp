@@ -0,0 +1,25 @@
+#include "ColorMatrix.h"
+#include <algorithm>
+
+namespace brightroom {
+
+auto WhiteBalanceFactors(const RawFile& raw) -> std::array<float, 3> {
+    const float max_wb = std::max({raw.cam_mul[0], raw.cam_mul[1], raw.cam_mul[2]});
+    return {raw.cam_mul[0] / max_wb, raw.cam_mul[1] / max_wb, raw.cam_mul[2] / max_wb};
+}
+
+auto FoldColorMatrix(const RawFile& raw, float exposure) -> ColorMatrix {
+    // Rec. 709 weights, applied to camera RGB like the luminance statistics measure it
+    constexpr std::array<float, 3> kLuminance{0.2126f, 0.7152f, 0.0722f};
+    const auto wb = WhiteBalanceFactors(raw);
+    ColorMatrix matrix{};
+    for (int j = 0; j < 3; j++) {
+        for (int i = 0; i < 3; i++) {
+            matrix[i][j] = raw.rgb_cam[i][j] * wb[j] * exposure;
+        }
+        matrix[3][j] = kLuminance[j] * wb[j] * exposure;
+    }
+    return matrix;
+}
+
+}  // namespace brightroom
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <array>
+#include "types.h"
+
+namespace brightroom {
+
+// Rows 0 to 2 take camera RGB to linear sRGB, row 3 to luminance, as ColorMatrix in halide/functions.h applies it
+using ColorMatrix = std::array<std::array<float, 3>, 4>;
+
+// Linear gain Process applies at an exposure of 1, before any exposure compensation
+constexpr float kBaseExposure = 3.0f;
+
+// Camera white balance, normalized to the largest factor
+auto WhiteBalanceFactors(const RawFile& raw) -> std::array<float, 3>;
+
+// White balance, exposure and the camera to sRGB conversion are all linear in camera RGB, so the three stages fold
+// into one matrix computed once per Process instead of three multiplies per pixel
+auto FoldColorMatrix(const RawFile& raw, float exposure) -> ColorMatrix;
+
+}  // namespace brightroom
@@ -0,0 +1,304 @@
+#include "DiskCache.h"
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "Generators.h"
+#include "Tracy.hpp"
+
+namespace {
+
+constexpr std::string_view kEntryExtension = ".brc";
+constexpr char kMagic[4] = {'B', 'R', 'C', '1'};
+// The pixels start here, which keeps them aligned for vector loads
+constexpr size_t kPixelOffset = 64;
+
+struct EntryHeader {
+    char magic[4];
+    uint8_t type_code;
+    uint8_t type_bits;
+    uint16_t type_lanes;
+    int32_t width;
+    int32_t height;
+    int32_t channels;
+    uint64_t pixel_bytes;
+};
+static_assert(sizeof(EntryHeader) <= kPixelOffset);
+
+// 64-bit FNV-1a
+class Hasher {
+   public:
+    void Add(const void* data, size_t size) {
+        const auto* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            _hash = (_hash ^ bytes[i]) * 0x100000001b3ull;
+        }
+    }
+    template <typename T>
+    void Add(const T& value) {
+        Add(&value, sizeof(value));
+    }
+    auto Hash() const -> uint64_t { return _hash; }
+
+   private:
+    uint64_t _hash = 0xcbf29ce484222325ull;
+};
+
+auto GetEnvironment(const char* name) -> std::optional<std::string> {
+    const char* value = std::getenv(name);
+    if (value == nullptr || *value == '\0') {
+        return std::nullopt;
+    }
+    return std::string(value);
+}
+
+auto DefaultDirectory() -> std::filesystem::path {
+    if (auto directory = GetEnvironment("BRIGHTROOM_CACHE_DIR")) {
+        return *directory;
+    }
+    if (auto directory = GetEnvironment("XDG_CACHE_HOME")) {
+        return std::filesystem::path(*directory) / "brightroom";
+    }
+    if (auto directory = GetEnvironment("LOCALAPPDATA")) {
+        return std::filesystem::path(*directory) / "BrightRoom" / "cache";
+    }
+    if (auto directory = GetEnvironment("HOME")) {
+        return std::filesystem::path(*directory) / ".cache" / "brightroom";
+    }
+    return std::filesystem::temp_directory_path() / "brightroom-cache";
+}
+
+}  // namespace
+
+namespace brightroom {
+
+auto FileIdentity::Of(const std::filesystem::path& file) -> std::optional<FileIdentity> {
+    ZoneScoped;
+    std::error_code error;
+    FileIdentity identity;
+    identity.size = std::filesystem::file_size(file, error);
+    if (error) {
+        return std::nullopt;
+    }
+    const auto modified = std::filesystem::last_write_time(file, error);
+    if (error) {
+        return std::nullopt;
+    }
+    identity.modified = modified.time_since_epoch().count();
+
+    // Head and tail catch a rewritten file even if its size and time were restored, without reading the whole file
+    std::ifstream stream(file, std::ios::binary);
+    if (!stream) {
+        return std::nullopt;
+    }
+    Hasher hasher;
+    hasher.Add(identity.size);
+    std::vector<char> chunk(std::min<uint64_t>(kPartialHashBytes, identity.size));
+    stream.read(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+    hasher.Add(chunk.data(), static_cast<size_t>(stream.gcount()));
+    if (identity.size > kPartialHashBytes) {
+        stream.seekg(static_cast<std::streamoff>(identity.size - chunk.size()));
+        stream.read(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+        hasher.Add(chunk.data(), static_cast<size_t>(stream.gcount()));
+    }
+    if (stream.bad()) {
+        return std::nullopt;
+    }
+    identity.partial_hash = hasher.Hash();
+    return identity;
+}
+
+DiskCache::DiskCache(std::filesystem::path directory, uint64_t max_bytes)
+    : _directory(std::move(directory)), _max_bytes(max_bytes) {
+    std::error_code error;
+    std::filesystem::create_directories(_directory, error);
+    for (const auto& file : std::filesystem::directory_iterator(_directory, error)) {
+        const auto& path = file.path();
+        if (path.extension() == kEntryExtension) {
+            // An entry removed or unreadable since it was listed would count as uintmax_t(-1) bytes, it is skipped
+            std::error_code size_error;
+            std::error_code time_error;
+            const Entry entry{file.file_size(size_error), file.last_write_time(time_error)};
+            if (size_error || time_error) {
+                continue;
+            }
+            _entries[path.stem().string()] = entry;
+            _size += entry.size;
+        } else if (path.extension() == ".tmp") {
+            // Left behind by a writer that did not finish
+            std::filesystem::remove(path, error);
+        }
+    }
+    std::lock_guard lock(_mutex);
+    Evict();
+}
+
+auto DiskCache::FromEnvironment() -> std::shared_ptr<DiskCache> {
+    uint64_t max_bytes = kDefaultMaxBytes;
+    if (auto megabytes = GetEnvironment("BRIGHTROOM_CACHE_MB")) {
+        uint64_t value = 0;
+        const auto result = std::from_chars(megabytes->data(), megabytes->data() + megabytes->size(), value);
+        if (result.ec != std::errc{}) {
+            std::cout << "Ignoring BRIGHTROOM_CACHE_MB=" << *megabytes << ", not a number" << std::endl;
+        } else {
+            max_bytes = value << 20;
+        }
+    }
+    if (max_bytes == 0) {
+        return nullptr;
+    }
+    const auto directory = DefaultDirectory();
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (!std::filesystem::is_directory(directory, error)) {
+        std::cout << "Cannot create cache directory " << directory << ", caching disabled" << std::endl;
+        return nullptr;
+    }
+    return std::make_shared<DiskCache>(directory, max_bytes);
+}
+
+auto DiskCache::EntryName(const FileIdentity& source, const std::string& variant) const -> std::string {
+    Hasher hasher;
+    hasher.Add(source.size);
+    hasher.Add(source.modified);
+    hasher.Add(source.partial_hash);
+    hasher.Add(kPipelineVersion);
+    hasher.Add(variant.data(), variant.size());
+    char name[17];
+    std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hasher.Hash()));
+    return name;
+}
+
+auto DiskCache::Find(const FileIdentity& source, const std::string& variant) -> std::optional<CachedImage> {
+    ZoneScoped;
+    const auto name = EntryName(source, variant);
+    const auto path = _directory / (name + std::string(kEntryExtension));
+    {
+        std::lock_guard lock(_mutex);
+        if (!_entries.contains(name)) {
+            return std::nullopt;
+        }
+    }
+    auto file = std::shared_ptr<MappedFile>(MappedFile::Open(path));
+    if (!file || file->Size() < kPixelOffset) {
+        return std::nullopt;
+    }
+    EntryHeader header;
+    std::memcpy(&header, file->Data(), sizeof(header));
+    const uint64_t expected_bytes = static_cast<uint64_t>(header.width) * header.height * header.channels *
+                                    ((header.type_bits + 7) / 8) * header.type_lanes;
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.width <= 0 || header.height <= 0 ||
+        header.channels <= 0 || header.pixel_bytes != expected_bytes ||
+        file->Size() < kPixelOffset + header.pixel_bytes) {
+        return std::nullopt;
+    }
+
+    // Record the use for eviction
+    std::error_code error;
+    const auto now = std::filesystem::file_time_type::clock::now();
+    std::filesystem::last_write_time(path, now, error);
+    {
+        std::lock_guard lock(_mutex);
+        if (auto entry = _entries.find(name); entry != _entries.end()) {
+            entry->second.last_used = now;
+        }
+    }
+
+    CachedImage image;
+    image.type = halide_type_t(static_cast<halide_type_code_t>(header.type_code), header.type_bits,
+                               header.type_lanes);
+    image.width = header.width;
+    image.height = header.height;
+    image.channels = header.channels;
+    image.pixels = file->Data() + kPixelOffset;
+    image.file = std::move(file);
+    return image;
+}
+
+auto DiskCache::Contains(const FileIdentity& source, const std::string& variant) -> bool {
+    std::lock_guard lock(_mutex);
+    return _entries.contains(EntryName(source, variant));
+}
+
+auto DiskCache::Store(const FileIdentity& source, const std::string& variant, halide_type_t type, int width,
+                      int height, int channels, const void* pixels) -> bool {
+    ZoneScoped;
+    const auto name = EntryName(source, variant);
+    const auto path = _directory / (name + std::string(kEntryExtension));
+    EntryHeader header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.type_code = static_cast<uint8_t>(type.code);
+    header.type_bits = type.bits;
+    header.type_lanes = type.lanes;
+    header.width = width;
+    header.height = height;
+    header.channels = channels;
+    header.pixel_bytes = static_cast<uint64_t>(width) * height * channels * type.bytes();
+
+    // Written under a temporary name and renamed, so readers never map a partial entry
+    const auto thread_id = std::hash<std::thread::id>{}(std::this_thread::get_id());
+    const auto temporary = _directory / (name + "." + std::to_string(thread_id) + ".tmp");
+    {
+        std::ofstream stream(temporary, std::ios::binary | std::ios::trunc);
+        char padded_header[kPixelOffset] = {};
+        std::memcpy(padded_header, &header, sizeof(header));
+        stream.write(padded_header, sizeof(padded_header));
+        stream.write(static_cast<const char*>(pixels), static_cast<std::streamsize>(header.pixel_bytes));
+        if (!stream.flush()) {
+            std::error_code error;
+            std::filesystem::remove(temporary, error);
+            return false;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+    if (error) {
+        std::filesystem::remove(temporary, error);
+        return false;
+    }
+
+    std::lock_guard lock(_mutex);
+    auto& entry = _entries[name];
+    _size -= entry.size;
+    entry.size = kPixelOffset + header.pixel_bytes;
+    entry.last_used = std::filesystem::file_time_type::clock::now();
+    _size += entry.size;
+    Evict();
+    return true;
+}
+
+auto DiskCache::SizeInBytes() const -> uint64_t {
+    std::lock_guard lock(_mutex);
+    return _size;
+}
+
+void DiskCache::Evict() {
+    if (_size <= _max_bytes) {
+        return;
+    }
+    std::vector<std::pair<std::filesystem::file_time_type, std::string>> by_age;
+    by_age.reserve(_entries.size());
+    for (const auto& [name, entry] : _entries) {
+        by_age.emplace_back(entry.last_used, name);
+    }
+    std::sort(by_age.begin(), by_age.end());
+    for (const auto& [last_used, name] : by_age) {
+        if (_size <= _max_bytes) {
+            break;
+        }
+        // Mapped entries stay readable until they are unmapped
+        std::error_code error;
+        std::filesystem::remove(_directory / (name + std::string(kEntryExtension)), error);
+        _size -= _entries[name].size;
+        _entries.erase(name);
+    }
+}
+
+}  // namespace brightroom
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <HalideRuntime.h>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include "MappedFile.h"
+
+namespace brightroom {
+
+// Identifies the contents of a source file without reading all of it
+struct FileIdentity {
+    uint64_t size = 0;
+    int64_t modified = 0;       // Last write time in file clock ticks
+    uint64_t partial_hash = 0;  // Of the size and the first and last kPartialHashBytes of the file
+
+    static constexpr size_t kPartialHashBytes = 64 * 1024;
+
+    // Returns std::nullopt if the file cannot be read
+    static auto Of(const std::filesystem::path& file) -> std::optional<FileIdentity>;
+    auto operator==(const FileIdentity&) const -> bool = default;
+};
+
+// An image read from the cache. The pixels are interleaved and stay mapped for as long as the entry is held.
+struct CachedImage {
+    std::shared_ptr<MappedFile> file;
+    halide_type_t type;
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    uint8_t* pixels = nullptr;  // Points into file
+};
+
+// Decoded thumbnails and preprocessed buffers on disk, so reopening a file or browsing a folder again skips LibRaw
+// and the demosaic. Entries are named by a hash of the source file identity, kPipelineVersion and what was derived
+// from it, which makes stale entries unreachable instead of wrong. Each entry is a small header followed by the
+// pixels, mapped on lookup. The least recently used entries are removed once the cache grows past max_bytes, entry
+// modification times record the last use. Safe to use from several threads.
+class DiskCache {
+   public:
+    static constexpr uint64_t kDefaultMaxBytes = 4ull << 30;
+
+    DiskCache(std::filesystem::path directory, uint64_t max_bytes = kDefaultMaxBytes);
+
+    // $BRIGHTROOM_CACHE_DIR or the user cache directory, limited to $BRIGHTROOM_CACHE_MB megabytes if set. Returns
+    // nullptr if the limit is 0 or the directory cannot be created.
+    static auto FromEnvironment() -> std::shared_ptr<DiskCache>;
+
+    // variant names what was derived from the file, including every setting that changes the result
+    auto Find(const FileIdentity& source, const std::string& variant) -> std::optional<CachedImage>;
+    auto Contains(const FileIdentity& source, const std::string& variant) -> bool;
+    // pixels are width * height * channels interleaved elements of type. Returns false if writing failed.
+    auto Store(const FileIdentity& source, const std::string& variant, halide_type_t type, int width, int height,
+               int channels, const void* pixels) -> bool;
+
+    auto SizeInBytes() const -> uint64_t;
+    auto MaxBytes() const -> uint64_t { return _max_bytes; }
+    auto Directory() const -> const std::filesystem::path& { return _directory; }
+
+   private:
+    struct Entry {
+        uint64_t size = 0;
+        std::filesystem::file_time_type last_used;
+    };
+
+    auto EntryName(const FileIdentity& source, const std::string& variant) const -> std::string;
+    void Evict();  // Expects _mutex to be held
+
+    std::filesystem::path _directory;
+    uint64_t _max_bytes;
+    mutable std::mutex _mutex;
+    std::unordered_map<std::string, Entry> _entries;
+    uint64_t _size = 0;
+};
+
+}  // namespace brightroom
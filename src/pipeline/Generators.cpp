@@ -0,0 +1,36 @@
+#include "Generators.h"
+#include <array>
+#include <cstdint>
+#include "brightroom_halide_generators.h"
+
+// The libraries of one format, "", "_f16" or "_u16" as named in CMakeLists.txt
+#define BRIGHTROOM_GENERATOR_SET(format, type)           \
+    GeneratorSet{preprocess_raw_generator##format,       \
+                 preprocess_raw_mhc_generator##format,   \
+                 preprocess_raw_rcd_generator##format,   \
+                 preview_raw_generator##format,          \
+                 process_raw_generator##format,          \
+                 process_raw_lut_generator##format,      \
+                 process_raw_rgb16_generator##format,    \
+                 process_linear_generator##format,       \
+                 process_display_generator,              \
+                 process_display_lut_generator,          \
+                 luminance_statistics_generator##format, \
+                 type}
+
+namespace brightroom {
+
+auto Generators(IntermediateFormat format) -> const GeneratorSet& {
+    static const halide_type_t kFloat32 = halide_type_of<float>();
+    static const halide_type_t kFloat16 = halide_type_t(halide_type_float, 16);
+    static const halide_type_t kUInt16 = halide_type_of<uint16_t>();
+    // Indexed by IntermediateFormat
+    static const std::array<GeneratorSet, 3> kGenerators{{
+        BRIGHTROOM_GENERATOR_SET(, kFloat32),
+        BRIGHTROOM_GENERATOR_SET(_f16, kFloat16),
+        BRIGHTROOM_GENERATOR_SET(_u16, kUInt16),
+    }};
+    return kGenerators[static_cast<size_t>(format)];
+}
+
+}  // namespace brightroom
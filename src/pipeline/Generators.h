@@ -0,0 +1,54 @@
+#pragma once
+
+#include <HalideRuntime.h>
+#include <cstdint>
+
+namespace brightroom {
+
+// Part of every DiskCache key. Bump it whenever a change to the generators alters their output, which makes the
+// cached results of older builds unreachable.
+constexpr uint32_t kPipelineVersion = 2;
+
+// Element type of the demosaiced intermediate that Process re-reads on every edit. The reduced formats halve the
+// memory and bandwidth of the float path; uint16 holds values normalized to [0, 65535].
+enum class IntermediateFormat { kFloat32, kFloat16, kUInt16 };
+
+// The AOT libraries of one intermediate format. All sets share these signatures, the buffer element
+// types travel in the halide_buffer_t arguments.
+struct GeneratorSet {
+    int (*preprocess)(halide_buffer_t* input, int filters, int black_level, halide_buffer_t* cblack, int white_input,
+                      halide_buffer_t* output);
+    // preprocess with the Malvar-He-Cutler and RCD demosaics instead of bilinear
+    int (*preprocess_mhc)(halide_buffer_t* input, int filters, int black_level, halide_buffer_t* cblack,
+                          int white_input, halide_buffer_t* output);
+    int (*preprocess_rcd)(halide_buffer_t* input, int filters, int black_level, halide_buffer_t* cblack,
+                          int white_input, halide_buffer_t* output);
+    int (*preview)(halide_buffer_t* input, int filters, int black_level, halide_buffer_t* cblack, int white_input,
+                   halide_buffer_t* output);
+    int (*process)(halide_buffer_t* input, halide_buffer_t* color_matrix, float saturation_factor, int downscale,
+                   bool compute_histogram, float log_average, float key_value, float contrast_factor,
+                   halide_buffer_t* output, halide_buffer_t* histogram);
+    // process with gamma and contrast looked up in tone_curve, which already contains the contrast
+    int (*process_lut)(halide_buffer_t* input, halide_buffer_t* color_matrix, float saturation_factor, int downscale,
+                       bool compute_histogram, float log_average, float key_value, halide_buffer_t* tone_curve,
+                       halide_buffer_t* output, halide_buffer_t* histogram);
+    // process with 16 bits per channel, for export
+    int (*process_rgb16)(halide_buffer_t* input, halide_buffer_t* color_matrix, float saturation_factor,
+                         int downscale, bool compute_histogram, float log_average, float key_value,
+                         float contrast_factor, halide_buffer_t* output, halide_buffer_t* histogram);
+    // process split in two at its float32 linear sRGB, see ProcessGraph.h. The display stages are the same for
+    // every intermediate format.
+    int (*process_linear)(halide_buffer_t* input, halide_buffer_t* color_matrix, int downscale, float log_average,
+                          float key_value, halide_buffer_t* output);
+    int (*process_display)(halide_buffer_t* input, float saturation_factor, bool compute_histogram,
+                           float contrast_factor, halide_buffer_t* output, halide_buffer_t* histogram);
+    int (*process_display_lut)(halide_buffer_t* input, float saturation_factor, bool compute_histogram,
+                               halide_buffer_t* tone_curve, halide_buffer_t* output, halide_buffer_t* histogram);
+    int (*luminance_statistics)(halide_buffer_t* input, halide_buffer_t* wb_factors, int downscale,
+                                halide_buffer_t* log_average);
+    halide_type_t intermediate_type;
+};
+
+auto Generators(IntermediateFormat format) -> const GeneratorSet&;
+
+}  // namespace brightroom
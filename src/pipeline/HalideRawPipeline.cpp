@@ -1,123 +1,879 @@
 #include "HalideRawPipeline.h"
+#include <HalideRuntime.h>
 #include <algorithm>
+#include <array>
 #include <chrono>
+#include <cmath>
 #include <cstdint>
 #include <iostream>
-#include "libraw/libraw.h"
-#include "preprocess_raw_generator.h"
-#include "process_raw_generator.h"
+#include <optional>
+#include "AdjustmentCompiler.h"
+#include "BufferPool.h"
+#include "ColorMatrix.h"
+#include "PackedBayer.h"
+#include "ParallelFor.h"
+#include "Tracy.hpp"
+#include "ToneCurve.h"
 #include "types.h"
 
+namespace {
+
+// Clamps the requested region to the frame and aligns it to whole output pixels
+auto ResolveViewport(const brightroom::Viewport& viewport, int width, int height) -> brightroom::Viewport {
+    brightroom::Viewport resolved;
+    resolved.downscale = std::clamp(viewport.downscale, 1, std::max(1, std::min(width, height)));
+    const int ds = resolved.downscale;
+    const int frame_width = width / ds * ds;
+    const int frame_height = height / ds * ds;
+
+    auto region = viewport.region;
+    if (region.width <= 0 || region.height <= 0) {
+        region = {0, 0, frame_width, frame_height};
+    }
+    const int x0 = std::clamp(region.x, 0, frame_width) / ds * ds;
+    const int y0 = std::clamp(region.y, 0, frame_height) / ds * ds;
+    const int x1 = std::clamp(region.x + region.width + ds - 1, 0, frame_width) / ds * ds;
+    const int y1 = std::clamp(region.y + region.height + ds - 1, 0, frame_height) / ds * ds;
+    resolved.region = {x0, y0, x1 - x0, y1 - y0};
+    return resolved;
+}
+
+// Rows of the sensor data every task of UnpackSensorData unpacks
+constexpr int kUnpackRows = 64;
+
+// The generators read 16-bit samples, the packed sensor data is expanded on Halide's thread pool right before they
+// run and the buffer goes back to the pool right after. Unpacks rows [first_row, first_row + rows) into a buffer in
+// sensor coordinates.
+auto UnpackSensorData(const brightroom::RawFile& raw, int first_row, int rows) -> Halide::Runtime::Buffer<uint16_t> {
+    ZoneScoped;
+    auto buffer = brightroom::PooledBuffer(halide_type_of<uint16_t>(), raw.width, rows).as<uint16_t>();
+    const auto width = static_cast<size_t>(raw.width);
+    auto unpack = [&](int task) {
+        const int task_rows = std::min(kUnpackRows, rows - task * kUnpackRows);
+        brightroom::UnpackBayerRows(raw, first_row + task * kUnpackRows, task_rows,
+                                    buffer.data() + task * kUnpackRows * width, width);
+        return 0;
+    };
+    brightroom::ParallelFor((rows + kUnpackRows - 1) / kUnpackRows, unpack);
+    buffer.set_min(0, first_row);
+    return buffer;
+}
+
+// Queues rows on the writer's thread, the buffer must stay untouched until the next Wait returns
+void WriteRows(brightroom::BackgroundWriter& writer, const Halide::Runtime::Buffer<void>& rows) {
+    const auto stride = static_cast<std::ptrdiff_t>(rows.dim(1).stride()) * rows.type().bytes();
+    writer.Write(static_cast<const uint8_t*>(rows.data()), rows.height(), stride);
+}
+
+// The engines share the signature of preprocess
+auto PreprocessEngine(const brightroom::GeneratorSet& generators, brightroom::Demosaic demosaic)
+    -> decltype(brightroom::GeneratorSet::preprocess) {
+    return demosaic == brightroom::Demosaic::kRcd              ? generators.preprocess_rcd
+           : demosaic == brightroom::Demosaic::kMalvarHeCutler ? generators.preprocess_mhc
+                                                               : generators.preprocess;
+}
+
+void FillWhiteBalance(const brightroom::RawFile& raw, Halide::Runtime::Buffer<float>& wb_factors) {
+    const auto factors = brightroom::WhiteBalanceFactors(raw);
+    for (int i = 0; i < 3; i++) {
+        wb_factors(i) = factors[i];
+    }
+}
+
+// Columns LuminanceStatisticsGenerator samples across the frame
+constexpr int kStatisticsWidth = 256;
+
+// Cache variant of the binned preview, which depends on the element type of the intermediate
+auto PreviewVariant(halide_type_t type) -> std::string {
+    return "preview/" + std::to_string(type.code) + "/" + std::to_string(type.bits);
+}
+
+}  // namespace
+
 namespace brightroom {
 using Clock = std::chrono::steady_clock;
-using Duration = std::chrono::milliseconds;
 
-void HalideRawPipeline::Preprocess(LibRaw& raw_data) {
-    auto total_start = Clock::now();
-    auto step_start = Clock::now();
+struct HalideImage : PreprocessedImage {
+    IntermediateFormat format;
+    int width = 0;  // Full-resolution frame size
+    int height = 0;
+    Halide::Runtime::Buffer<void> demosaiced;
+    // In place of demosaiced for frames above the working set limit. Process demosaics the region it renders from
+    // it with demosaic, a tile with its halo like a tiled Export.
+    RawFile sensor;
+    Demosaic demosaic = Demosaic::kBilinear;
+    Halide::Runtime::Buffer<void> preview;     // Half resolution, one pixel per CFA quad
+    std::shared_ptr<MappedFile> preview_file;  // Holds the pixels of preview if it came from the cache
+    float log_average = 0.0f;                  // Of the white-balanced luminance, 0 until measured
+
+    auto SizeInBytes() const -> size_t override {
+        return demosaiced.size_in_bytes() + (sensor.packed ? sensor.packed->capacity() : 0) +
+               (preview_file ? 0 : preview.size_in_bytes());
+    }
+    auto Empty() const -> bool override { return demosaiced.data() == nullptr && preview.data() == nullptr; }
+};
+
+HalideRawPipeline::HalideRawPipeline(IntermediateFormat intermediate_format, ToneCurveMode tone_curve_mode)
+    : _intermediate_format(intermediate_format),
+      _tone_curve_mode(tone_curve_mode),
+      _tone_curve(kToneCurveSize),
+      _cblack(4),
+      _wb_factors(3),
+      _color_matrix(4, 3),
+      _log_average(Halide::Runtime::Buffer<float>::make_scalar()),
+      _strip_histogram(ImageStatistics::kBins, 4) {
+    // Before any generator runs, Halide must not free memory that came from its default allocator to the pool
+    InstallHalideAllocator();
+    InstallHalideTraceHooks();
+}
+
+void HalideRawPipeline::SetDiskCache(std::shared_ptr<DiskCache> disk_cache) {
+    _disk_cache = std::move(disk_cache);
+}
+
+auto HalideRawPipeline::IsCached(const FileIdentity& source, PreprocessMode mode) -> bool {
+    // Only the previews are cached, a full-resolution demosaic is too large to be worth reading back
+    if (!_disk_cache || mode != PreprocessMode::kPreview) {
+        return false;
+    }
+    const auto type = Generators(_intermediate_format).intermediate_type;
+    return _disk_cache->Contains(source, PreviewVariant(type));
+}
+
+void HalideRawPipeline::Preprocess(const RawFile& raw, PreprocessMode mode, const std::optional<FileIdentity>& source,
+                                   Demosaic demosaic) {
+    ZoneScoped;
+    const auto total_start = Clock::now();
+    _preprocess_telemetry = PipelineTelemetry{};
+    _preprocess_telemetry.threads = HalideThreadCount();
+
+    const int width = raw.width;
+    const int height = raw.height;
+    // The previous image may be held elsewhere, adding to it copies the buffer handles and shares the pixels. The
+    // copy is only written to until this call returns.
+    std::shared_ptr<HalideImage> image;
+    if (mode == PreprocessMode::kAddFullResolution && _image) {
+        image = std::make_shared<HalideImage>(*_image);
+    } else {
+        image = std::make_shared<HalideImage>();
+        image->format = _intermediate_format;
+        image->width = width;
+        image->height = height;
+    }
+    _image = image;
+    ++_image_generation;
+
+    const auto& generators = Generators(_intermediate_format);
+    const bool use_cache = _disk_cache && source && mode == PreprocessMode::kPreview;
+    const auto variant = PreviewVariant(generators.intermediate_type);
+    bool cache_hit = false;
+    if (use_cache) {
+        StageTimer stage(_preprocess_telemetry, "cache_lookup");
+        auto cached = _disk_cache->Find(*source, variant);
+        if (cached && cached->type == generators.intermediate_type && cached->width == width / 2 &&
+            cached->height == height / 2 && cached->channels == 3) {
+            // Interleaved, as make_interleaved would lay it out
+            const halide_dimension_t shape[3] = {
+                {0, cached->width, 3}, {0, cached->height, 3 * cached->width}, {0, 3, 1}};
+            image->preview = Halide::Runtime::Buffer<void>(cached->type, cached->pixels, 3, shape);
+            image->preview_file = std::move(cached->file);
+            cache_hit = true;
+        }
+    }
+    if (cache_hit) {
+        MeasureLuminance(*image, raw);
+    }
+    if (cache_hit || !raw.HasSensorData()) {
+        // An entry evicted since IsCached leaves the image empty, the caller unpacks the file and calls again
+        if (!cache_hit && !use_cache) {
+            std::cout << "Preprocess error: sensor data not unpacked" << "\n";
+        }
+        _preprocess_telemetry.total = Clock::now() - total_start;
+        PlotTelemetry("Preprocess ms", "Preprocess bytes allocated", _preprocess_telemetry);
+        return;
+    }
+    // A demosaic above the working set limit is not kept, the image holds on to the sensor data instead
+    if (mode == PreprocessMode::kAddFullResolution && ExportsTiled(raw)) {
+        image->sensor = raw;
+        image->demosaic = demosaic;
+        _preprocess_telemetry.total = Clock::now() - total_start;
+        PlotTelemetry("Preprocess ms", "Preprocess bytes allocated", _preprocess_telemetry);
+        return;
+    }
 
     // Create input buffers for the generator
-    Halide::Runtime::Buffer<uint16_t> input_buffer(raw_data.imgdata.rawdata.raw_image, raw_data.imgdata.sizes.raw_width,
-                                                   raw_data.imgdata.sizes.raw_height);
+    Halide::Runtime::Buffer<uint16_t> input_buffer;
+    {
+        StageTimer stage(_preprocess_telemetry, "unpack");
+        input_buffer = UnpackSensorData(raw, 0, height);
+    }
+    _preprocess_telemetry.bytes_allocated += input_buffer.size_in_bytes();
 
-    // Create buffer for cblack values
-    Halide::Runtime::Buffer<int> cblack_buffer(4);
     for (int i = 0; i < 4; i++) {
-        cblack_buffer(i) = raw_data.imgdata.color.cblack[i];
+        _cblack(i) = raw.cblack[i];
     }
 
-    // Create buffer for white balance factors
-    Halide::Runtime::Buffer<float> wb_factors(3);
-    float wb_r = raw_data.imgdata.color.cam_mul[0];
-    float wb_g = raw_data.imgdata.color.cam_mul[1];
-    float wb_b = raw_data.imgdata.color.cam_mul[2];
-    float max_wb = std::max({wb_r, wb_g, wb_b});
-    wb_factors(0) = wb_r / max_wb;
-    wb_factors(1) = wb_g / max_wb;
-    wb_factors(2) = wb_b / max_wb;
+    const auto filters = static_cast<int>(raw.filters);
+    const auto black = raw.black;
+    const auto white = raw.white;
 
-    // Create buffer for color space conversion matrix
-    Halide::Runtime::Buffer<float> rgb_cam_buffer(3, 3);
-    for (int i = 0; i < 3; i++) {
-        for (int j = 0; j < 3; j++) {
-            rgb_cam_buffer(i, j) = raw_data.imgdata.color.rgb_cam[i][j];
+    int error = 0;
+    if (mode == PreprocessMode::kPreview) {
+        Halide::Runtime::Buffer<void> preview_buffer;
+        {
+            StageTimer stage(_preprocess_telemetry, "allocate");
+            preview_buffer = PooledInterleavedBuffer(generators.intermediate_type, width / 2, height / 2, 3);
+        }
+        _preprocess_telemetry.bytes_allocated += preview_buffer.size_in_bytes();
+        {
+            StageTimer stage(_preprocess_telemetry, "preview");
+            error = generators.preview(input_buffer.raw_buffer(), filters, black, _cblack.raw_buffer(), white,
+                                       preview_buffer.raw_buffer());
+        }
+        if (use_cache && error == 0) {
+            StageTimer stage(_preprocess_telemetry, "cache_store");
+            _disk_cache->Store(*source, variant, generators.intermediate_type, width / 2, height / 2, 3,
+                               preview_buffer.data());
+        }
+        image->preview = std::move(preview_buffer);
+    } else {
+        Halide::Runtime::Buffer<void> demosaiced_buffer;
+        {
+            StageTimer stage(_preprocess_telemetry, "allocate");
+            demosaiced_buffer = PooledInterleavedBuffer(generators.intermediate_type, width, height, 3);
         }
+        _preprocess_telemetry.bytes_allocated += demosaiced_buffer.size_in_bytes();
+        {
+            StageTimer stage(_preprocess_telemetry, "demosaic");
+            const auto preprocess = PreprocessEngine(generators, demosaic);
+            // Call preprocess with all parameters
+            error = preprocess(input_buffer.raw_buffer(),   // Raw Bayer input
+                               filters,                     // Bayer pattern
+                               black,                       // Global black level
+                               _cblack.raw_buffer(),        // Per-channel black levels
+                               white,                       // White level
+                               demosaiced_buffer.raw_buffer());
+        }
+        image->demosaiced = std::move(demosaiced_buffer);
+    }
+    if (error != 0) {
+        std::cout << "Preprocess error: " << error << "\n";
+    } else {
+        MeasureLuminance(*image, raw);
     }
 
-    auto demosaiced_buffer = Halide::Runtime::Buffer<float>::make_interleaved(raw_data.imgdata.sizes.raw_width,
-                                                                              raw_data.imgdata.sizes.raw_height, 3);
-    std::cout << "Running preprocess..." << "\n";
-    step_start = Clock::now();
+    _preprocess_telemetry.total = Clock::now() - total_start;
+    PlotTelemetry("Preprocess ms", "Preprocess bytes allocated", _preprocess_telemetry);
+}
 
-    // Call preprocess with all parameters
-    auto error = preprocess_raw_generator(input_buffer.raw_buffer(),                         // Raw Bayer input
-                                          static_cast<int>(raw_data.imgdata.idata.filters),  // Bayer pattern
-                                          static_cast<int>(raw_data.imgdata.color.black),    // Global black level
-                                          cblack_buffer.raw_buffer(),                        // Per-channel black levels
-                                          static_cast<int>(raw_data.imgdata.color.maximum),  // White level
-                                          demosaiced_buffer.raw_buffer());
+void HalideRawPipeline::MeasureLuminance(HalideImage& image, const RawFile& raw) {
+    if (image.log_average > 0.0f) {
+        // Measured on the preview, the full-resolution demosaic would only shift auto exposure when it arrives
+        return;
+    }
+    auto source = image.preview.data() != nullptr ? image.preview : image.demosaiced;
+    if (source.data() == nullptr) {
+        return;
+    }
+    StageTimer stage(_preprocess_telemetry, "statistics");
+    FillWhiteBalance(raw, _wb_factors);
+    const auto& generators = Generators(_intermediate_format);
+    const int downscale = std::max(1, source.width() / kStatisticsWidth);
+    const int error = generators.luminance_statistics(source.raw_buffer(), _wb_factors.raw_buffer(), downscale,
+                                                      _log_average.raw_buffer());
     if (error != 0) {
-        std::cout << "Preprocess error: " << error << "\n";
+        std::cout << "Luminance statistics error: " << error << "\n";
+        return;
     }
-    std::cout << "Preprocess time: " << std::chrono::duration_cast<Duration>(Clock::now() - step_start).count() << " ms"
-              << "\n";
-
-    _demosaiced_buffer = std::move(demosaiced_buffer);
-
-    step_start = Clock::now();
-    // Allocate vector for final image output
-    _rgb8_vector.resize(raw_data.imgdata.sizes.raw_width * raw_data.imgdata.sizes.raw_height * 3);
-    // Wrap the vector as a interleaved Halide buffer
-    _rgb8_buffer = Halide::Runtime::Buffer<uint8_t>::make_interleaved(
-        _rgb8_vector.data(), raw_data.imgdata.sizes.raw_width, raw_data.imgdata.sizes.raw_height, 3);
-    std::cout << "RGB8 vector time: " << std::chrono::duration_cast<Duration>(Clock::now() - step_start).count()
-              << " ms" << "\n";
-    std::cout << "Total Preprocess time: " << std::chrono::duration_cast<Duration>(Clock::now() - total_start).count()
-              << " ms" << "\n";
-}
-
-auto HalideRawPipeline::Process(LibRaw& raw_data, const Parameters& parameters) -> RgbImage {
-    auto total_start = Clock::now();
-    auto step_start = Clock::now();
-
-    // Create buffer for white balance factors
-    Halide::Runtime::Buffer<float> wb_factors(3);
-    float wb_r = raw_data.imgdata.color.cam_mul[0];
-    float wb_g = raw_data.imgdata.color.cam_mul[1];
-    float wb_b = raw_data.imgdata.color.cam_mul[2];
-    float max_wb = std::max({wb_r, wb_g, wb_b});
-    wb_factors(0) = wb_r / max_wb;
-    wb_factors(1) = wb_g / max_wb;
-    wb_factors(2) = wb_b / max_wb;
-
-    // Create buffer for color space conversion matrix
-    Halide::Runtime::Buffer<float> rgb_cam_buffer(3, 3);
-    for (int i = 0; i < 3; i++) {
+    image.log_average = _log_average();
+}
+
+auto HalideRawPipeline::LastPreprocessTelemetry() const -> const PipelineTelemetry& {
+    return _preprocess_telemetry;
+}
+
+auto HalideRawPipeline::LastProcessTelemetry() const -> const PipelineTelemetry& {
+    return _process_telemetry;
+}
+
+auto HalideRawPipeline::LastStatistics() const -> const std::optional<ImageStatistics>& {
+    return _statistics;
+}
+
+auto HalideRawPipeline::HasFullResolution() const -> bool {
+    return _image && (_image->demosaiced.data() != nullptr || _image->sensor.HasSensorData());
+}
+
+auto HalideRawPipeline::Image() const -> std::shared_ptr<const PreprocessedImage> {
+    return _image;
+}
+
+auto HalideRawPipeline::SetImage(std::shared_ptr<const PreprocessedImage> image) -> bool {
+    if (!image) {
+        _image.reset();
+        ++_image_generation;
+        return true;
+    }
+    auto halide_image = std::dynamic_pointer_cast<const HalideImage>(image);
+    if (!halide_image || halide_image->format != _intermediate_format) {
+        return false;
+    }
+    _image = std::move(halide_image);
+    ++_image_generation;
+    return true;
+}
+
+auto HalideRawPipeline::Process(const RawFile& raw, const Parameters& parameters, const Viewport& viewport,
+                                std::stop_token stop_token) -> std::optional<RgbImage> {
+    ZoneScoped;
+    const auto total_start = Clock::now();
+    _process_telemetry = PipelineTelemetry{};
+    _process_telemetry.threads = HalideThreadCount();
+    _statistics.reset();
+    auto finish = [&] {
+        _process_telemetry.total = Clock::now() - total_start;
+        PlotTelemetry("Process ms", "Process bytes allocated", _process_telemetry);
+    };
+    std::optional<StageTimer> setup_stage(std::in_place, _process_telemetry, "setup");
+
+    // The binned preview serves every downscale of two or more and stands in for the full-resolution demosaic
+    // until that has been computed
+    if (!_image) {
+        setup_stage.reset();
+        finish();
+        return RgbImage{{}, 0, 0, {}};
+    }
+    const bool use_preview = _image->preview.data() != nullptr && (!HasFullResolution() || viewport.downscale >= 2);
+    auto requested = viewport;
+    if (use_preview) {
+        requested.downscale = std::max(2, viewport.downscale & ~1);
+    }
+
+    // Only the requested region is computed, at output resolution. Output coordinates are sensor coordinates
+    // divided by the downscale factor, which the generator uses to locate its input block.
+    const auto resolved = ResolveViewport(requested, _image->width, _image->height);
+    const int downscale = resolved.downscale;
+    // A handle of its own, sharing the pixels
+    auto source_buffer = use_preview ? _image->preview : _image->demosaiced;
+    const bool from_sensor = !use_preview && source_buffer.data() == nullptr && _image->sensor.HasSensorData();
+    const int source_downscale = use_preview ? downscale / 2 : downscale;
+    const int width = resolved.region.width / downscale;
+    const int height = resolved.region.height / downscale;
+    if (width == 0 || height == 0 || (source_buffer.data() == nullptr && !from_sensor)) {
+        setup_stage.reset();
+        if (viewport.compute_statistics) {
+            _statistics.emplace();
+        }
+        finish();
+        return RgbImage{{}, 0, 0, resolved.region};
+    }
+    auto pixels = AcquireOutputBuffer(static_cast<size_t>(width) * height * 3);
+    auto rgb8_buffer = Halide::Runtime::Buffer<uint8_t>::make_interleaved(pixels->data(), width, height, 3);
+    rgb8_buffer.set_min(resolved.region.x / downscale, resolved.region.y / downscale);
+    ImageStatistics statistics;
+    setup_stage.reset();
+    const auto scalars = PrepareRender(raw, parameters, _image->log_average);
+    const auto [contrast_factor, saturation_factor, log_average, key_value, use_tone_curve] = scalars;
+
+    // Keep the linear stage's output between edits if it is small enough, so an edit of the display stage's
+    // parameters skips the linear one
+    const StageSource stage_source{_image_generation, use_preview, resolved.region, downscale};
+    const size_t linear_bytes = static_cast<size_t>(width) * height * 3 * sizeof(float);
+    const bool use_graph = linear_bytes <= kMaxLinearBytes;
+    size_t first_stage = ProcessGraph::kLinear;
+    if (use_graph) {
+        if (_linear.width() != width || _linear.height() != height) {
+            StageTimer stage(_process_telemetry, "allocate");
+            _linear = PooledInterleavedBuffer(halide_type_of<float>(), width, height, 3).as<float>();
+            _process_telemetry.bytes_allocated += _linear.size_in_bytes();
+            _graph.Invalidate();
+        }
+        _linear.set_min(rgb8_buffer.dim(0).min(), rgb8_buffer.dim(1).min());
+        // The last stage always runs, it writes a new output buffer
+        first_stage = std::min(_graph.FirstDirtyStage(stage_source, parameters), ProcessGraph::kDisplay);
+    } else if (_linear.data() != nullptr) {
+        _linear = Halide::Runtime::Buffer<float>();
+        _graph.Invalidate();
+    }
+    // An edit of the linear stage's parameters renders the same region again, which stays demosaiced next to _linear
+    if (!from_sensor || !use_graph) {
+        _sensor_region = Halide::Runtime::Buffer<void>();
+        _sensor_region_source.reset();
+    }
+    if (from_sensor && (!use_graph || first_stage == ProcessGraph::kLinear)) {
+        if (use_graph && _sensor_region_source == stage_source) {
+            source_buffer = _sensor_region;
+        } else {
+            StageTimer stage(_process_telemetry, "demosaic");
+            source_buffer = DemosaicRegion(*_image, resolved.region);
+            _process_telemetry.bytes_allocated += source_buffer.size_in_bytes();
+            if (source_buffer.data() == nullptr) {
+                finish();
+                return std::nullopt;
+            }
+            if (use_graph) {
+                _sensor_region = source_buffer;
+                _sensor_region_source = stage_source;
+            }
+        }
+    }
+
+    // Render in strips so an abandoned render stops early instead of finishing the whole frame
+    const auto& generators = Generators(_intermediate_format);
+    const int first_row = rgb8_buffer.dim(1).min();
+    const int strip_height = (height + kProcessStrips - 1) / kProcessStrips;
+    bool failed = false;
+    for (int strip_y = first_row; strip_y < first_row + height; strip_y += strip_height) {
+        if (stop_token.stop_requested()) {
+            if (first_stage == ProcessGraph::kLinear) {
+                // Strips below this one still hold the previous render
+                _graph.Invalidate();
+            }
+            finish();
+            return std::nullopt;
+        }
+        const int strip_rows = std::min(strip_height, first_row + height - strip_y);
+        auto strip = rgb8_buffer.cropped(1, strip_y, strip_rows);
+        int error = 0;
+        if (use_graph) {
+            auto linear_strip = _linear.cropped(1, strip_y, strip_rows);
+            if (first_stage == ProcessGraph::kLinear) {
+                StageTimer stage(_process_telemetry, ProcessGraph::kStages[ProcessGraph::kLinear].name);
+                error = generators.process_linear(source_buffer.raw_buffer(),    // Demosaiced input
+                                                  _color_matrix.raw_buffer(),    // Folded color matrix
+                                                  source_downscale,              // Output downscale factor
+                                                  log_average,                   // Tone mapping log-average
+                                                  key_value,                     // Tone mapping key, 0 for off
+                                                  linear_strip.raw_buffer());
+            }
+            if (error == 0) {
+                StageTimer stage(_process_telemetry, ProcessGraph::kStages[ProcessGraph::kDisplay].name);
+                if (!_adjustments.empty()) {
+                    error = AdjustmentCompiler::Global().Run(_adjustments, linear_strip.raw_buffer(),
+                                                             viewport.compute_statistics, strip.raw_buffer(),
+                                                             _strip_histogram.raw_buffer());
+                } else if (use_tone_curve) {
+                    error = generators.process_display_lut(linear_strip.raw_buffer(),     // Linear sRGB
+                                                           saturation_factor,             // Saturation factor
+                                                           viewport.compute_statistics,   // Fill the strip histogram
+                                                           _tone_curve.raw_buffer(),      // Gamma and contrast curve
+                                                           strip.raw_buffer(), _strip_histogram.raw_buffer());
+                } else {
+                    error = generators.process_display(linear_strip.raw_buffer(),     // Linear sRGB
+                                                       saturation_factor,             // Saturation factor
+                                                       viewport.compute_statistics,   // Fill the strip histogram
+                                                       contrast_factor,               // Contrast factor
+                                                       strip.raw_buffer(), _strip_histogram.raw_buffer());
+                }
+            }
+        } else if (!_adjustments.empty()) {
+            StageTimer stage(_process_telemetry, "process");
+            error = RenderAdjustments(generators, source_buffer, source_downscale, scalars, viewport.compute_statistics,
+                                      strip.raw_buffer(), _strip_histogram.raw_buffer());
+        } else if (use_tone_curve) {
+            StageTimer stage(_process_telemetry, "process");
+            error = generators.process_lut(source_buffer.raw_buffer(),    // Demosaiced input
+                                           _color_matrix.raw_buffer(),    // Folded color matrix
+                                           saturation_factor,             // Saturation factor
+                                           source_downscale,              // Output downscale factor
+                                           viewport.compute_statistics,   // Fill the strip histogram
+                                           log_average,                   // Tone mapping log-average
+                                           key_value,                     // Tone mapping key, 0 for off
+                                           _tone_curve.raw_buffer(),      // Gamma and contrast curve
+                                           strip.raw_buffer(), _strip_histogram.raw_buffer());
+        } else {
+            StageTimer stage(_process_telemetry, "process");
+            error = generators.process(source_buffer.raw_buffer(),    // Demosaiced input
+                                       _color_matrix.raw_buffer(),    // Folded color matrix
+                                       saturation_factor,             // Saturation factor
+                                       source_downscale,              // Output downscale factor
+                                       viewport.compute_statistics,   // Fill the strip histogram
+                                       log_average,                   // Tone mapping log-average
+                                       key_value,                     // Tone mapping key, 0 for off
+                                       contrast_factor,               // Contrast factor
+                                       strip.raw_buffer(), _strip_histogram.raw_buffer());
+        }
+        if (error != 0) {
+            std::cout << "Process error: " << error << "\n";
+            failed = true;
+        }
+        if (viewport.compute_statistics) {
+            for (int channel = 0; channel < 4; channel++) {
+                for (int bin = 0; bin < ImageStatistics::kBins; bin++) {
+                    statistics.histogram[channel][bin] += _strip_histogram(bin, channel);
+                }
+            }
+        }
+    }
+    if (failed) {
+        _graph.Invalidate();
+    } else if (use_graph) {
+        _graph.MarkClean(stage_source, parameters);
+    }
+    if (viewport.compute_statistics) {
+        statistics.pixels = static_cast<uint64_t>(width) * height;
+        _statistics = statistics;
+    }
+    finish();
+    return RgbImage{std::move(pixels), width, height, resolved.region};
+}
+
+auto HalideRawPipeline::PrepareRender(const RawFile& raw, const Parameters& parameters, float log_average,
+                                      int output_bits) -> RenderScalars {
+    // White balance, exposure compensation and color space conversion
+    const auto color_matrix = FoldColorMatrix(raw, parameters.exposure * kBaseExposure);
+    for (int i = 0; i < 4; i++) {
         for (int j = 0; j < 3; j++) {
-            rgb_cam_buffer(i, j) = raw_data.imgdata.color.rgb_cam[i][j];
+            _color_matrix(i, j) = color_matrix[i][j];
+        }
+    }
+
+    RenderScalars scalars{};
+    scalars.contrast_factor = parameters.contrast * 1.5f;
+    scalars.saturation_factor = parameters.saturation * 1.0f;
+    // The log-average is measured without exposure, scaling it by the base exposure makes the exposure parameter a
+    // compensation relative to what tone mapping chooses
+    scalars.log_average = log_average * kBaseExposure;
+    scalars.key_value = scalars.log_average > 0.0f ? parameters.tone_mapping_key : 0.0f;
+    scalars.use_tone_curve = _tone_curve_mode == ToneCurveMode::kLookupTable;
+    if (scalars.use_tone_curve && scalars.contrast_factor != _tone_curve_contrast) {
+        StageTimer stage(_process_telemetry, "tone_curve");
+        BakeToneCurve(scalars.contrast_factor, {_tone_curve.data(), static_cast<size_t>(kToneCurveSize)});
+        _tone_curve_contrast = scalars.contrast_factor;
+    }
+    _adjustments = parameters.adjustments;
+    if (!_adjustments.empty()) {
+        // Only the first render of a stack shape takes time here, a failure shows as an error of the render
+        StageTimer stage(_process_telemetry, "compile");
+        AdjustmentCompiler::Global().Prepare(_adjustments, output_bits);
+    }
+    return scalars;
+}
+
+auto HalideRawPipeline::RenderAdjustments(const GeneratorSet& generators, Halide::Runtime::Buffer<void>& input,
+                                          int downscale, const RenderScalars& scalars, bool compute_histogram,
+                                          halide_buffer_t* output, halide_buffer_t* histogram) -> int {
+    auto linear = PooledInterleavedBuffer(halide_type_of<float>(), output->dim[0].extent, output->dim[1].extent, 3);
+    linear.set_min(output->dim[0].min, output->dim[1].min);
+    const int error = generators.process_linear(input.raw_buffer(), _color_matrix.raw_buffer(), downscale,
+                                                scalars.log_average, scalars.key_value, linear.raw_buffer());
+    if (error != 0) {
+        return error;
+    }
+    return AdjustmentCompiler::Global().Run(_adjustments, linear.raw_buffer(), compute_histogram, output, histogram);
+}
+
+void HalideRawPipeline::SetWorkingSetLimit(size_t bytes) {
+    _working_set_limit = bytes;
+}
+
+auto HalideRawPipeline::ExportsTiled(const RawFile& raw) const -> bool {
+    const auto type = Generators(_intermediate_format).intermediate_type;
+    return static_cast<size_t>(raw.width) * raw.height * 3 * type.bytes() > _working_set_limit;
+}
+
+auto HalideRawPipeline::Export(const RawFile& raw, const Parameters& parameters, ImageFormat format,
+                               const std::string& file_name, const ImageWriterOptions& options, Demosaic demosaic)
+    -> bool {
+    ZoneScoped;
+    const auto total_start = Clock::now();
+    _process_telemetry = PipelineTelemetry{};
+    _process_telemetry.threads = HalideThreadCount();
+    _statistics.reset();
+    auto finish = [&](bool written) {
+        _process_telemetry.total = Clock::now() - total_start;
+        PlotTelemetry("Process ms", "Process bytes allocated", _process_telemetry);
+        return written;
+    };
+    const bool tiled = !_image || _image->demosaiced.data() == nullptr;
+    // The image may hold the sensor data in place of the demosaic after raw let go of it
+    const RawFile& sensor = raw.HasSensorData() || !_image ? raw : _image->sensor;
+    if (tiled && !sensor.HasSensorData()) {
+        std::cout << "Export error: no full-resolution demosaic or sensor data" << "\n";
+        return finish(false);
+    }
+    const auto frame = tiled ? Region{0, 0, raw.width, raw.height}
+                             : ResolveViewport({}, _image->width, _image->height).region;
+    std::unique_ptr<ImageWriter> writer;
+    {
+        StageTimer stage(_process_telemetry, "setup");
+        writer = ImageWriter::Create(format, file_name, frame.width, frame.height, options);
+    }
+    if (!writer) {
+        return finish(false);
+    }
+    const bool rgb16 = writer->Bits() == 16;
+    if (!tiled) {
+        const auto scalars = PrepareRender(raw, parameters, _image->log_average, writer->Bits());
+        return finish(ExportStrips(*writer, scalars, rgb16));
+    }
+
+    // An adjustment stack adds the linear stage's float output of every tile
+    const auto intermediate_type = Generators(_intermediate_format).intermediate_type;
+    const size_t tile_sample_bytes = intermediate_type.bytes() + (parameters.adjustments.empty() ? 0 : sizeof(float));
+    const auto plan = PlanTiles(frame.width, frame.height, demosaic, tile_sample_bytes, rgb16 ? 2 : 1,
+                                sensor.packed->capacity(), HalideThreadCount(), _working_set_limit);
+    if (!plan.within_limit) {
+        std::cout << "Export warning: the smallest tiles need " << (plan.working_set >> 20)
+                  << " MiB, over the working set limit of " << (_working_set_limit >> 20) << " MiB" << "\n";
+    }
+    for (int i = 0; i < 4; i++) {
+        _cblack(i) = sensor.cblack[i];
+    }
+    // Tone mapping needs the log-average of the whole frame before the first tile renders
+    const float log_average =
+        parameters.tone_mapping_key > 0.0f ? MeasureLuminanceTiled(sensor, plan.tile_height) : 0.0f;
+    const auto scalars = PrepareRender(raw, parameters, log_average, writer->Bits());
+    return finish(ExportTiles(sensor, *writer, scalars, rgb16, plan, demosaic));
+}
+
+auto HalideRawPipeline::RenderExport(const GeneratorSet& generators, Halide::Runtime::Buffer<void>& input,
+                                     const RenderScalars& scalars, bool rgb16, Halide::Runtime::Buffer<void>& output,
+                                     Halide::Runtime::Buffer<uint32_t>& histogram) -> int {
+    if (!_adjustments.empty()) {
+        return RenderAdjustments(generators, input, 1, scalars, false, output.raw_buffer(), histogram.raw_buffer());
+    }
+    // There is no 16-bit variant of the tone curve, a 4096-sample curve would band in 16 bits anyway
+    if (scalars.use_tone_curve && !rgb16) {
+        return generators.process_lut(input.raw_buffer(), _color_matrix.raw_buffer(), scalars.saturation_factor, 1,
+                                      false, scalars.log_average, scalars.key_value, _tone_curve.raw_buffer(),
+                                      output.raw_buffer(), histogram.raw_buffer());
+    }
+    const auto process = rgb16 ? generators.process_rgb16 : generators.process;
+    return process(input.raw_buffer(), _color_matrix.raw_buffer(), scalars.saturation_factor, 1, false,
+                   scalars.log_average, scalars.key_value, scalars.contrast_factor, output.raw_buffer(),
+                   histogram.raw_buffer());
+}
+
+auto HalideRawPipeline::ExportStrips(ImageWriter& writer, const RenderScalars& scalars, bool rgb16) -> bool {
+    const auto frame = ResolveViewport({}, _image->width, _image->height).region;
+    std::array<Halide::Runtime::Buffer<void>, kExportBuffers> strips;
+    {
+        StageTimer stage(_process_telemetry, "allocate");
+        const auto type = rgb16 ? halide_type_of<uint16_t>() : halide_type_of<uint8_t>();
+        for (auto& strip : strips) {
+            strip = PooledInterleavedBuffer(type, frame.width, std::min(kExportStripRows, frame.height), 3);
+            _process_telemetry.bytes_allocated += strip.size_in_bytes();
+        }
+    }
+
+    // Strip n + 1 is computed into the other buffer while strip n is written, waiting for the write of strip n
+    // before strip n + 2 reuses its buffer
+    auto source_buffer = _image->demosaiced;
+    const auto& generators = Generators(_intermediate_format);
+    BackgroundWriter background(writer);
+    bool ok = true;
+    for (int strip_y = 0, index = 0; ok && strip_y < frame.height; strip_y += kExportStripRows, ++index) {
+        auto strip = strips[index % kExportBuffers].cropped(1, 0, std::min(kExportStripRows, frame.height - strip_y));
+        strip.set_min(0, strip_y);
+        int error = 0;
+        {
+            StageTimer stage(_process_telemetry, "process");
+            error = RenderExport(generators, source_buffer, scalars, rgb16, strip, _strip_histogram);
+        }
+        if (error != 0) {
+            std::cout << "Export error: " << error << "\n";
+            ok = false;
+            break;
+        }
+        {
+            StageTimer stage(_process_telemetry, "encode_wait");
+            ok = background.Wait();
+        }
+        WriteRows(background, strip);
+    }
+    return FinishExport(writer, background, ok);
+}
+
+auto HalideRawPipeline::ExportTiles(const RawFile& raw, ImageWriter& writer, const RenderScalars& scalars, bool rgb16,
+                                    const TilePlan& plan, Demosaic demosaic) -> bool {
+    const int width = raw.width;
+    const int height = raw.height;
+    const auto& generators = Generators(_intermediate_format);
+    const auto preprocess = PreprocessEngine(generators, demosaic);
+
+    std::array<Halide::Runtime::Buffer<void>, kExportBuffers> bands;
+    // One intermediate and histogram per task, the histogram is written even though it is not computed
+    std::vector<Halide::Runtime::Buffer<void>> intermediates(plan.concurrency);
+    std::vector<Halide::Runtime::Buffer<uint32_t>> histograms(plan.concurrency);
+    {
+        StageTimer stage(_process_telemetry, "allocate");
+        const auto type = rgb16 ? halide_type_of<uint16_t>() : halide_type_of<uint8_t>();
+        for (auto& band : bands) {
+            band = PooledInterleavedBuffer(type, width, plan.tile_height, 3);
+            _process_telemetry.bytes_allocated += band.size_in_bytes();
+        }
+        for (int task = 0; task < plan.concurrency; ++task) {
+            intermediates[task] = PooledInterleavedBuffer(generators.intermediate_type, plan.tile_width,
+                                                          plan.tile_height, 3);
+            histograms[task] = Halide::Runtime::Buffer<uint32_t>(ImageStatistics::kBins, 4);
+            _process_telemetry.bytes_allocated += intermediates[task].size_in_bytes();
         }
     }
 
-    std::cout << "Running process..." << "\n";
-    step_start = Clock::now();
+    const int columns = (width + plan.tile_width - 1) / plan.tile_width;
+    const auto filters = static_cast<int>(raw.filters);
+    BackgroundWriter background(writer);
+    bool ok = true;
+    // Each band's sensor rows replace the previous band's, only the largest counts
+    size_t input_bytes = 0;
+    for (int band_y = 0, index = 0; ok && band_y < height; band_y += plan.tile_height, ++index) {
+        const int band_height = std::min(plan.tile_height, height - band_y);
+        // The sensor rows of the band and the halo above and below it, which the frame edge may cut short
+        const int input_y0 = std::max(0, band_y - plan.halo);
+        const int input_y1 = std::min(height, band_y + band_height + plan.halo);
+        Halide::Runtime::Buffer<uint16_t> input;
+        {
+            StageTimer stage(_process_telemetry, "unpack");
+            input = UnpackSensorData(raw, input_y0, input_y1 - input_y0);
+        }
+        input_bytes = std::max(input_bytes, input.size_in_bytes());
+        auto band = bands[index % kExportBuffers].cropped(1, 0, band_height);
+        band.set_min(0, band_y);
 
-    // Call the generator with all parameters
-    auto error = process_raw_generator(_demosaiced_buffer.raw_buffer(),  // Raw Bayer input
-                                       wb_factors.raw_buffer(),          // White balance factors
-                                       parameters.exposure * 3.0f,       // Exposure compensation
-                                       rgb_cam_buffer.raw_buffer(),      // Color space conversion matrix
-                                       parameters.contrast * 1.5f,       // Contrast factor
-                                       parameters.saturation * 1.0f,     // Saturation factor
-                                       _rgb8_buffer.raw_buffer());
+        // Task t renders columns t, t + concurrency, ... into its own intermediate. A tile is demosaiced from its
+        // sensor pixels and the halo around them, so it matches the full-frame demosaic, and the boundary
+        // conditions still apply at the frame edge because the input is cropped to the frame.
+        auto render_tiles = [&](int task) {
+            for (int column = task; column < columns; column += plan.concurrency) {
+                const int x0 = column * plan.tile_width;
+                const int x1 = std::min(width, x0 + plan.tile_width);
+                const int input_x0 = std::max(0, x0 - plan.halo);
+                auto tile_input = input.cropped(0, input_x0, std::min(width, x1 + plan.halo) - input_x0);
+                auto intermediate = intermediates[task].cropped(0, 0, x1 - x0).cropped(1, 0, band_height);
+                intermediate.set_min(x0, band_y);
+                int error = preprocess(tile_input.raw_buffer(), filters, raw.black, _cblack.raw_buffer(), raw.white,
+                                       intermediate.raw_buffer());
+                if (error == 0) {
+                    auto tile_output = band.cropped(0, x0, x1 - x0);
+                    error = RenderExport(generators, intermediate, scalars, rgb16, tile_output, histograms[task]);
+                }
+                if (error != 0) {
+                    return error;
+                }
+            }
+            return 0;
+        };
+        int error = 0;
+        {
+            StageTimer stage(_process_telemetry, "tiles");
+            error = ParallelFor(plan.concurrency, render_tiles);
+        }
+        if (error != 0) {
+            std::cout << "Export error: " << error << "\n";
+            ok = false;
+            break;
+        }
+        {
+            StageTimer stage(_process_telemetry, "encode_wait");
+            ok = background.Wait();
+        }
+        WriteRows(background, band);
+    }
+    _process_telemetry.bytes_allocated += input_bytes;
+    return FinishExport(writer, background, ok);
+}
+
+auto HalideRawPipeline::DemosaicRegion(const HalideImage& image, const Region& region)
+    -> Halide::Runtime::Buffer<void> {
+    const auto& raw = image.sensor;
+    const int halo = DemosaicHalo(image.demosaic);
+    const int input_x0 = std::max(0, region.x - halo);
+    const int input_y0 = std::max(0, region.y - halo);
+    const int input_x1 = std::min(raw.width, region.x + region.width + halo);
+    const int input_y1 = std::min(raw.height, region.y + region.height + halo);
+    auto input = UnpackSensorData(raw, input_y0, input_y1 - input_y0).cropped(0, input_x0, input_x1 - input_x0);
+    const auto& generators = Generators(_intermediate_format);
+    auto demosaiced = PooledInterleavedBuffer(generators.intermediate_type, region.width, region.height, 3);
+    demosaiced.set_min(region.x, region.y);
+    for (int i = 0; i < 4; i++) {
+        _cblack(i) = raw.cblack[i];
+    }
+    const int error = PreprocessEngine(generators, image.demosaic)(input.raw_buffer(), static_cast<int>(raw.filters),
+                                                                   raw.black, _cblack.raw_buffer(), raw.white,
+                                                                   demosaiced.raw_buffer());
     if (error != 0) {
-        std::cout << "Process error: " << error << "\n";
+        std::cout << "Demosaic error: " << error << "\n";
+        return {};
     }
-    std::cout << "Process time: " << std::chrono::duration_cast<Duration>(Clock::now() - step_start).count() << " ms"
-              << "\n";
+    return demosaiced;
+}
 
-    std::cout << "Total process time: " << std::chrono::duration_cast<Duration>(Clock::now() - total_start).count()
-              << " ms" << "\n";
+auto HalideRawPipeline::MeasureLuminanceTiled(const RawFile& raw, int band_rows) -> float {
+    StageTimer stage(_process_telemetry, "statistics");
+    // Whole CFA quads, the preview bins them
+    band_rows = std::max(2, band_rows & ~1);
+    const int width = raw.width / 2;
+    const int height = raw.height / 2;
+    const auto& generators = Generators(_intermediate_format);
+    auto preview = PooledInterleavedBuffer(generators.intermediate_type, width, band_rows / 2, 3);
+    _process_telemetry.bytes_allocated += preview.size_in_bytes();
+    FillWhiteBalance(raw, _wb_factors);
+
+    // The log-average of the frame is the exp of the mean log luminance, weighted by the samples of every band
+    double log_sum = 0.0;
+    double samples = 0.0;
+    for (int y = 0; y < height; y += band_rows / 2) {
+        const int rows = std::min(band_rows / 2, height - y);
+        auto input = UnpackSensorData(raw, 2 * y, 2 * rows);
+        auto band = preview.cropped(1, 0, rows);
+        band.set_min(0, y);
+        int error = generators.preview(input.raw_buffer(), static_cast<int>(raw.filters), raw.black,
+                                       _cblack.raw_buffer(), raw.white, band.raw_buffer());
+        // The statistics reduce over [0, width) x [0, height)
+        band.set_min(0, 0);
+        const int downscale = std::max(1, std::min(width / kStatisticsWidth, rows));
+        if (error == 0) {
+            error = generators.luminance_statistics(band.raw_buffer(), _wb_factors.raw_buffer(), downscale,
+                                                    _log_average.raw_buffer());
+        }
+        if (error != 0) {
+            std::cout << "Luminance statistics error: " << error << "\n";
+            return 0.0f;
+        }
+        const double band_samples = static_cast<double>(width / downscale) * (rows / downscale);
+        log_sum += band_samples * std::log(_log_average());
+        samples += band_samples;
+    }
+    return samples > 0.0 ? static_cast<float>(std::exp(log_sum / samples)) : 0.0f;
+}
 
-    return {_rgb8_vector, raw_data.imgdata.sizes.raw_width, raw_data.imgdata.sizes.raw_height};
+auto HalideRawPipeline::FinishExport(ImageWriter& writer, BackgroundWriter& background, bool ok) -> bool {
+    {
+        StageTimer stage(_process_telemetry, "encode_wait");
+        ok = background.Wait() && ok;
+    }
+    if (ok) {
+        StageTimer stage(_process_telemetry, "encode_finish");
+        ok = writer.Finish();
+    }
+    return ok;
+}
+
+auto HalideRawPipeline::AcquireOutputBuffer(size_t size) -> std::shared_ptr<RGB8_Data> {
+    std::unique_ptr<RGB8_Data> buffer;
+    {
+        std::lock_guard lock(_output_buffers->mutex);
+        if (!_output_buffers->free.empty()) {
+            buffer = std::move(_output_buffers->free.back());
+            _output_buffers->free.pop_back();
+        }
+    }
+    if (!buffer) {
+        buffer = std::make_unique<RGB8_Data>();
+    }
+    const size_t capacity = buffer->capacity();
+    buffer->resize(size);
+    if (buffer->capacity() != capacity) {
+        _process_telemetry.bytes_allocated += buffer->capacity();
+    }
+    // The last reference is dropped after every consumer's last access, the mutex hands the buffer over from there
+    return std::shared_ptr<RGB8_Data>(buffer.release(), [buffers = _output_buffers](RGB8_Data* released) {
+        std::unique_ptr<RGB8_Data> owned(released);
+        std::lock_guard lock(buffers->mutex);
+        if (buffers->free.size() < kMaxOutputBuffers) {
+            buffers->free.push_back(std::move(owned));
+        }
+    });
 }
 }  // namespace brightroom
\ No newline at end of file
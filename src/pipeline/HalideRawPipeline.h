@@ -1,21 +1,145 @@
 #pragma once
 
 #include <HalideBuffer.h>
-#include <libraw/libraw.h>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+#include "DiskCache.h"
+#include "Generators.h"
 #include "IRawPipeline.h"
+#include "ImageWriter.h"
+#include "ProcessGraph.h"
+#include "Tiling.h"
 #include "types.h"
 
 namespace brightroom {
 
+// How Process evaluates gamma and contrast. kLookupTable bakes both into a curve on the host whenever the contrast
+// changes, so the generator interpolates a table instead of calling pow for every channel of every pixel.
+enum class ToneCurveMode { kAnalytic, kLookupTable };
+
+struct HalideImage;
+
 class HalideRawPipeline : public IRawPipeline {
    public:
-    HalideRawPipeline() = default;
-    void Preprocess(LibRaw& raw_data) override;
-    auto Process(LibRaw& raw_data, const Parameters& parameters) -> RgbImage override;
+    explicit HalideRawPipeline(IntermediateFormat intermediate_format = IntermediateFormat::kFloat32,
+                               ToneCurveMode tone_curve_mode = ToneCurveMode::kAnalytic);
+    void Preprocess(const RawFile& raw, PreprocessMode mode = PreprocessMode::kFull,
+                    const std::optional<FileIdentity>& source = std::nullopt,
+                    Demosaic demosaic = Demosaic::kBilinear) override;
+    auto IsCached(const FileIdentity& source, PreprocessMode mode) -> bool override;
+    auto HasFullResolution() const -> bool override;
+    auto Image() const -> std::shared_ptr<const PreprocessedImage> override;
+    auto SetImage(std::shared_ptr<const PreprocessedImage> image) -> bool override;
+    auto Process(const RawFile& raw, const Parameters& parameters, const Viewport& viewport = {},
+                 std::stop_token stop_token = {}) -> std::optional<RgbImage> override;
+    auto LastPreprocessTelemetry() const -> const PipelineTelemetry& override;
+    auto LastProcessTelemetry() const -> const PipelineTelemetry& override;
+    auto LastStatistics() const -> const std::optional<ImageStatistics>& override;
+
+    // Renders the full-resolution frame in strips of kExportStripRows rows and streams them into a new file. The
+    // writer encodes each strip while the next one is computed, so beyond the demosaic the export holds
+    // kExportBuffers strips whatever the size of the frame. With options.tiff_bits 16 a TIFF gets 16 bits per
+    // sample, rendered with the analytic gamma and contrast.
+    // Without the full-resolution demosaic the frame is demosaiced with demosaic and rendered from the sensor data
+    // of raw in tiles, see PlanTiles, so the export stays within the working set limit whatever the size of the
+    // frame. Returns false if raw has no sensor data then. Fills LastProcessTelemetry, with the time spent waiting
+    // for the writer as stage "encode_wait".
+    auto Export(const RawFile& raw, const Parameters& parameters, ImageFormat format, const std::string& file_name,
+                const ImageWriterOptions& options = {}, Demosaic demosaic = Demosaic::kBilinear) -> bool;
+    // Bytes the buffers of a tiled Export may hold at once. Halide's intermediates inside the generators come on top.
+    void SetWorkingSetLimit(size_t bytes);
+    // Whether the full-resolution demosaic of raw exceeds the working set limit, so the caller should skip
+    // Preprocess and let Export render it in tiles
+    auto ExportsTiled(const RawFile& raw) const -> bool;
+
+    // Caches the binned previews. Without a cache, or if it is nullptr, every Preprocess computes its result.
+    void SetDiskCache(std::shared_ptr<DiskCache> disk_cache);
 
    private:
-    Halide::Runtime::Buffer<float> _demosaiced_buffer;
-    std::vector<uint8_t> _rgb8_vector;
-    Halide::Runtime::Buffer<uint8_t> _rgb8_buffer;
+    // Scalars of a render of parameters, as the process generators take them
+    struct RenderScalars {
+        float contrast_factor;
+        float saturation_factor;
+        float log_average;
+        float key_value;
+        bool use_tone_curve;
+    };
+    // Folds the colour matrix into _color_matrix, bakes _tone_curve if its contrast changed and compiles the
+    // adjustment stack for output_bits on first use. log_average is that of the image, 0 if unknown.
+    auto PrepareRender(const RawFile& raw, const Parameters& parameters, float log_average, int output_bits = 8)
+        -> RenderScalars;
+    // Runs process_linear on input into a pooled buffer with the bounds of output and _adjustments on that
+    auto RenderAdjustments(const GeneratorSet& generators, Halide::Runtime::Buffer<void>& input, int downscale,
+                           const RenderScalars& scalars, bool compute_histogram, halide_buffer_t* output,
+                           halide_buffer_t* histogram) -> int;
+    // The strip loop of Export, from the full-resolution demosaic
+    auto ExportStrips(ImageWriter& writer, const RenderScalars& scalars, bool rgb16) -> bool;
+    // The tile loop of Export, from the sensor data
+    auto ExportTiles(const RawFile& raw, ImageWriter& writer, const RenderScalars& scalars, bool rgb16,
+                     const TilePlan& plan, Demosaic demosaic) -> bool;
+    // Runs the fused process generator Export uses on input at full resolution. Only reads members, tiles call it
+    // concurrently.
+    auto RenderExport(const GeneratorSet& generators, Halide::Runtime::Buffer<void>& input,
+                      const RenderScalars& scalars, bool rgb16, Halide::Runtime::Buffer<void>& output,
+                      Halide::Runtime::Buffer<uint32_t>& histogram) -> int;
+    // Waits for the last write and finishes the file unless the export already failed
+    auto FinishExport(ImageWriter& writer, BackgroundWriter& background, bool ok) -> bool;
+    // Demosaics region of the frame from the sensor data image keeps in place of the full-resolution demosaic, with
+    // the halo around it, so it matches the same pixels of a full-frame demosaic
+    auto DemosaicRegion(const HalideImage& image, const Region& region) -> Halide::Runtime::Buffer<void>;
+    // Log-average luminance of the sensor data, measured band by band on binned previews the size of a tile row
+    auto MeasureLuminanceTiled(const RawFile& raw, int band_rows) -> float;
+    auto AcquireOutputBuffer(size_t size) -> std::shared_ptr<RGB8_Data>;
+    // Fills image.log_average from its preview, or its demosaic without one, unless it is known already. Once per
+    // image, so tone mapping costs Process nothing but a scale per pixel.
+    void MeasureLuminance(HalideImage& image, const RawFile& raw);
+
+    // Process renders the frame in this many horizontal strips and checks for cancellation in between
+    static constexpr int kProcessStrips = 8;
+    // Largest linear sRGB render kept between edits, a 3840 x 2160 viewport takes 95 MiB. Larger renders, such as
+    // exports, run the fused generator and keep nothing.
+    static constexpr size_t kMaxLinearBytes = size_t{128} << 20;
+    // Export strip height, and the strips it cycles through so one can be computed while another is written
+    static constexpr int kExportStripRows = 128;
+    static constexpr int kExportBuffers = 2;
+    static constexpr size_t kDefaultWorkingSetLimit = size_t{1} << 30;
+
+    IntermediateFormat _intermediate_format;
+    ToneCurveMode _tone_curve_mode;
+    size_t _working_set_limit = kDefaultWorkingSetLimit;
+    Halide::Runtime::Buffer<float> _tone_curve;
+    float _tone_curve_contrast = -1.0f;  // Contrast factor _tone_curve was baked for
+    AdjustmentStack _adjustments;        // Of the current render, in place of the display stages if not empty
+    // Small inputs, filled in by every call instead of allocated
+    Halide::Runtime::Buffer<int> _cblack;
+    Halide::Runtime::Buffer<float> _wb_factors;
+    Halide::Runtime::Buffer<float> _color_matrix;
+    Halide::Runtime::Buffer<float> _log_average;  // Output of the luminance statistics
+    std::shared_ptr<const HalideImage> _image;
+    uint64_t _image_generation = 0;  // Incremented whenever _image is replaced, addresses may be reused
+    // Output of the linear stage of the last render, in output coordinates, valid as far as _graph says
+    Halide::Runtime::Buffer<float> _linear;
+    // The region of the sensor data _linear was rendered from, demosaiced, if the image has no full-resolution
+    // demosaic. Kept for as long as _linear is, for the next edit of the linear stage.
+    Halide::Runtime::Buffer<void> _sensor_region;
+    std::optional<StageSource> _sensor_region_source;
+    ProcessGraph _graph;
+    std::shared_ptr<DiskCache> _disk_cache;
+    PipelineTelemetry _preprocess_telemetry;
+    PipelineTelemetry _process_telemetry;
+    Halide::Runtime::Buffer<uint32_t> _strip_histogram;  // Written by every Process strip, summed into _statistics
+    std::optional<ImageStatistics> _statistics;
+
+    // Output frames are handed out by reference. The last consumer to release one returns it to free, from whichever
+    // thread that is, so a consumer holding on to the previous frame while the next one renders costs one extra
+    // buffer, not a copy. Shared with those releases, which may outlive the pipeline.
+    struct OutputBuffers {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<RGB8_Data>> free;
+    };
+    static constexpr size_t kMaxOutputBuffers = 3;  // Kept in free, further released buffers are deleted
+    std::shared_ptr<OutputBuffers> _output_buffers = std::make_shared<OutputBuffers>();
 };
-}  // namespace brightroom
\ No newline at end of file
+}  // namespace brightroom
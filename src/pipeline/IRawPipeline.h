@@ -1,7 +1,13 @@
 #pragma once
 
-#include <libraw/libraw.h>
+#include "AdjustmentStack.h"
+#include "DiskCache.h"
+#include "Telemetry.h"
 #include "types.h"
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <stop_token>
 #include <string>
 
 namespace brightroom {
@@ -10,17 +16,81 @@ struct Parameters {
     float exposure = 1.0f;
     float contrast = 1.0f;
     float saturation = 1.0f;
+    // Global tone mapping brings the log-average luminance of the image to this middle grey, exposure then
+    // compensates relative to it. 0 turns it off.
+    float tone_mapping_key = 0.0f;
+    // Replaces gamma, contrast and saturation if not empty, see AdjustmentStack.h. Compiled on first use.
+    AdjustmentStack adjustments;
 
     auto ToString() const -> std::string {
-        return "Exposure: " + std::to_string(exposure) + ", Contrast: " + std::to_string(contrast) +
-               ", Saturation: " + std::to_string(saturation);
+        auto text = "Exposure: " + std::to_string(exposure) + ", Contrast: " + std::to_string(contrast) +
+                    ", Saturation: " + std::to_string(saturation) +
+                    ", Tone mapping key: " + std::to_string(tone_mapping_key);
+        if (!adjustments.empty()) {
+            text += ", Adjustments: " + FormatAdjustmentStack(adjustments);
+        }
+        return text;
     }
 };
 
+// What Process should render. An empty region renders the whole frame.
+struct Viewport {
+    Region region{};
+    int downscale = 1;  // Every output pixel averages a downscale x downscale block of sensor pixels
+    bool compute_statistics = false;  // Fill LastStatistics with the histograms of the rendered pixels
+};
+
+enum class PreprocessMode {
+    kFull,               // Starts a new image with the full-resolution demosaic
+    kPreview,            // Starts a new image with only the half-resolution binned preview
+    kAddFullResolution,  // Adds the full-resolution demosaic to the current image, or the sensor data to demosaic
+                         // each render's region from if the frame's demosaic is too large to keep
+};
+
+// Interpolation of the full-resolution demosaic, fastest first. brightroom_bench --benchmark_filter=BM_Preprocess
+// measures the throughput of each.
+enum class Demosaic {
+    kBilinear,        // Zipper artifacts along edges, for interactive use
+    kMalvarHeCutler,  // Gradient-corrected bilinear, few zippers at almost the same cost
+    kRcd,             // Ratio corrected demosaicing, free of zippers and mazes, for export
+};
+
+// The intermediates Preprocess computed for one image. Never modified once a pipeline hands it out, so several
+// pipelines can render from it at once and it can be kept after the pipeline moved on to another image.
+class PreprocessedImage {
+   public:
+    // Memory held by the intermediates, not counting pages mapped from the disk cache
+    virtual auto SizeInBytes() const -> size_t = 0;
+    // Nothing to render from, Preprocess failed
+    virtual auto Empty() const -> bool = 0;
+    virtual ~PreprocessedImage() = default;
+};
+
 class IRawPipeline {
    public:
-    virtual void Preprocess(LibRaw& raw_data) = 0;
-    virtual auto Process(LibRaw& raw_data, const Parameters& parameters) -> RgbImage = 0;
+    // With a source, the result of a preview Preprocess is looked up in and added to the disk cache. The sensor data
+    // is only read on a cache miss, raw may be without it if IsCached. The preview bins and ignores demosaic.
+    virtual void Preprocess(const RawFile& raw, PreprocessMode mode = PreprocessMode::kFull,
+                            const std::optional<FileIdentity>& source = std::nullopt,
+                            Demosaic demosaic = Demosaic::kBilinear) = 0;
+    // Whether Preprocess would find its result in the disk cache and not need the sensor data
+    virtual auto IsCached(const FileIdentity& source, PreprocessMode mode) -> bool = 0;
+    virtual auto HasFullResolution() const -> bool = 0;
+    // The intermediates of the current image, nullptr before the first Preprocess. A later kAddFullResolution
+    // replaces it with a new one instead of changing it.
+    virtual auto Image() const -> std::shared_ptr<const PreprocessedImage> = 0;
+    // Makes image the current image in place of a Preprocess of the RawFile it was computed from, nullptr drops the
+    // current image. Returns false if image came from a different kind of pipeline or intermediate format.
+    virtual auto SetImage(std::shared_ptr<const PreprocessedImage> image) -> bool = 0;
+    // Renders from the preview when it is enough for the requested downscale or no full-resolution demosaic exists.
+    // Returns std::nullopt if stop was requested before the render finished.
+    virtual auto Process(const RawFile& raw, const Parameters& parameters, const Viewport& viewport = {},
+                         std::stop_token stop_token = {}) -> std::optional<RgbImage> = 0;
+    // Stage timings, allocations and threads of the most recent Preprocess and Process call
+    virtual auto LastPreprocessTelemetry() const -> const PipelineTelemetry& = 0;
+    virtual auto LastProcessTelemetry() const -> const PipelineTelemetry& = 0;
+    // Histograms of the most recent Process call, std::nullopt unless its viewport asked for them
+    virtual auto LastStatistics() const -> const std::optional<ImageStatistics>& = 0;
     virtual ~IRawPipeline() = default;
 };
 
@@ -0,0 +1,92 @@
+#include "ImageCache.h"
+#include <charconv>
+#include <cstdlib>
+#include <iostream>
+#include <string_view>
+
+namespace {
+
+auto Key(const std::filesystem::path& file) -> std::string {
+    return file.lexically_normal().generic_string();
+}
+
+}  // namespace
+
+namespace brightroom {
+
+ImageCache::ImageCache(size_t budget_bytes) : _budget_bytes(budget_bytes) {}
+
+auto ImageCache::FromEnvironment() -> std::shared_ptr<ImageCache> {
+    size_t budget_bytes = kDefaultBudgetBytes;
+    if (const char* megabytes = std::getenv("BRIGHTROOM_PREFETCH_MB"); megabytes && *megabytes) {
+        const std::string_view text = megabytes;
+        size_t value = 0;
+        const auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+        if (result.ec != std::errc{}) {
+            std::cout << "Ignoring BRIGHTROOM_PREFETCH_MB=" << text << ", not a number" << std::endl;
+        } else {
+            budget_bytes = value << 20;
+        }
+    }
+    if (budget_bytes == 0) {
+        return nullptr;
+    }
+    return std::make_shared<ImageCache>(budget_bytes);
+}
+
+auto ImageCache::SizeOf(const PreparedImage& image) -> size_t {
+    size_t size = image.image ? image.image->SizeInBytes() : 0;
+    if (image.raw) {
+        size += image.raw->SizeInBytes();
+    }
+    return size;
+}
+
+auto ImageCache::Find(const std::filesystem::path& file) -> std::optional<PreparedImage> {
+    std::lock_guard lock(_mutex);
+    const auto found = _by_key.find(Key(file));
+    if (found == _by_key.end()) {
+        return std::nullopt;
+    }
+    _entries.splice(_entries.begin(), _entries, found->second);
+    return found->second->image;
+}
+
+auto ImageCache::Contains(const std::filesystem::path& file) const -> bool {
+    std::lock_guard lock(_mutex);
+    return _by_key.contains(Key(file));
+}
+
+void ImageCache::Insert(const std::filesystem::path& file, PreparedImage image) {
+    const auto size = SizeOf(image);
+    auto key = Key(file);
+    std::lock_guard lock(_mutex);
+    if (const auto found = _by_key.find(key); found != _by_key.end()) {
+        _size -= found->second->size;
+        _entries.erase(found->second);
+        _by_key.erase(found);
+    }
+    if (size > _budget_bytes) {
+        return;
+    }
+    _entries.push_front(Entry{key, std::move(image), size});
+    _by_key.emplace(std::move(key), _entries.begin());
+    _size += size;
+    Evict();
+}
+
+auto ImageCache::SizeInBytes() const -> size_t {
+    std::lock_guard lock(_mutex);
+    return _size;
+}
+
+void ImageCache::Evict() {
+    while (_size > _budget_bytes && !_entries.empty()) {
+        const auto& oldest = _entries.back();
+        _size -= oldest.size;
+        _by_key.erase(oldest.key);
+        _entries.pop_back();
+    }
+}
+
+}  // namespace brightroom
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include "DiskCache.h"
+#include "IRawPipeline.h"
+#include "types.h"
+
+namespace brightroom {
+
+// An opened image ready to render: what RenderWorker needs to skip the unpack and Preprocess
+struct PreparedImage {
+    std::shared_ptr<const RawFile> raw;  // Without sensor data if the preview came from the disk cache
+    std::optional<FileIdentity> source;
+    std::shared_ptr<const PreprocessedImage> image;
+};
+
+// Recently opened and prefetched images in memory, keyed by file path. The least recently used are dropped once the
+// entries hold more than the budget. Entries are shared, dropping one only frees it once nobody renders from it.
+// Safe to use from several threads.
+class ImageCache {
+   public:
+    static constexpr size_t kDefaultBudgetBytes = 2ull << 30;
+
+    explicit ImageCache(size_t budget_bytes = kDefaultBudgetBytes);
+
+    // kDefaultBudgetBytes, or $BRIGHTROOM_PREFETCH_MB megabytes if set. Returns nullptr if that is 0.
+    static auto FromEnvironment() -> std::shared_ptr<ImageCache>;
+
+    // Marks the entry as the most recently used
+    auto Find(const std::filesystem::path& file) -> std::optional<PreparedImage>;
+    auto Contains(const std::filesystem::path& file) const -> bool;
+    // Adds or replaces the entry of file. An entry larger than the whole budget is not kept.
+    void Insert(const std::filesystem::path& file, PreparedImage image);
+
+    auto SizeInBytes() const -> size_t;
+    auto BudgetBytes() const -> size_t { return _budget_bytes; }
+
+    // Memory an entry is charged for: the packed sensor data and the intermediates
+    static auto SizeOf(const PreparedImage& image) -> size_t;
+
+   private:
+    struct Entry {
+        std::string key;
+        PreparedImage image;
+        size_t size = 0;
+    };
+
+    void Evict();  // Expects _mutex to be held
+
+    size_t _budget_bytes;
+    mutable std::mutex _mutex;
+    std::list<Entry> _entries;  // Most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> _by_key;
+    size_t _size = 0;
+};
+
+}  // namespace brightroom
@@ -0,0 +1,305 @@
+#include "ImageWriter.h"
+
+#include <array>
+#include <csetjmp>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <vector>
+#include "Tracy.hpp"
+#include "jpeglib.h"
+
+namespace {
+
+struct JpegErrorManager {
+    struct jpeg_error_mgr pub;
+    jmp_buf setjmp_buffer;
+};
+
+void JpegErrorExit(j_common_ptr cinfo) {
+    auto* error_manager = reinterpret_cast<JpegErrorManager*>(cinfo->err);
+    (*cinfo->err->output_message)(cinfo);
+    longjmp(error_manager->setjmp_buffer, 1);
+}
+
+// A file written under a temporary name and renamed to its own once committed. Removed if it never is.
+class OutputFile {
+   public:
+    OutputFile(FILE* file, std::filesystem::path temporary, std::filesystem::path path)
+        : _file(file), _temporary(std::move(temporary)), _path(std::move(path)) {}
+
+    ~OutputFile() {
+        if (_file != nullptr) {
+            std::fclose(_file);
+            std::error_code error;
+            std::filesystem::remove(_temporary, error);
+        }
+    }
+
+    OutputFile(const OutputFile&) = delete;
+    auto operator=(const OutputFile&) -> OutputFile& = delete;
+
+    auto Get() const -> FILE* { return _file; }
+
+    auto Commit() -> bool {
+        const bool flushed = std::fflush(_file) == 0;
+        const bool closed = std::fclose(_file) == 0;
+        _file = nullptr;
+        std::error_code error;
+        if (flushed && closed) {
+            std::filesystem::rename(_temporary, _path, error);
+            if (!error) {
+                return true;
+            }
+            std::cout << "Cannot rename " << _temporary.string() << " to " << _path.string() << ": "
+                      << error.message() << "\n";
+        }
+        std::filesystem::remove(_temporary, error);
+        return false;
+    }
+
+   private:
+    FILE* _file;
+    std::filesystem::path _temporary;
+    std::filesystem::path _path;
+};
+
+class JpegWriter : public brightroom::ImageWriter {
+   public:
+    JpegWriter(std::unique_ptr<OutputFile> file, int width, int height, int quality)
+        : _file(std::move(file)), _height(height) {
+        _cinfo.err = jpeg_std_error(&_jerr.pub);
+        _jerr.pub.error_exit = JpegErrorExit;
+        if (setjmp(_jerr.setjmp_buffer)) {
+            _failed = true;
+            return;
+        }
+        jpeg_create_compress(&_cinfo);
+        jpeg_stdio_dest(&_cinfo, _file->Get());
+        _cinfo.image_width = width;
+        _cinfo.image_height = height;
+        _cinfo.input_components = 3;
+        _cinfo.in_color_space = JCS_RGB;
+        jpeg_set_defaults(&_cinfo);
+        jpeg_set_quality(&_cinfo, quality, TRUE);
+        jpeg_start_compress(&_cinfo, TRUE);
+    }
+
+    ~JpegWriter() override { jpeg_destroy_compress(&_cinfo); }
+
+    auto WriteRows(const uint8_t* rows, int row_count, std::ptrdiff_t stride) -> bool override {
+        if (_failed) {
+            return false;
+        }
+        if (setjmp(_jerr.setjmp_buffer)) {
+            _failed = true;
+            return false;
+        }
+        for (int row = 0; row < row_count; ++row) {
+            JSAMPROW row_pointer = const_cast<uint8_t*>(rows + row * stride);
+            jpeg_write_scanlines(&_cinfo, &row_pointer, 1);
+        }
+        return true;
+    }
+
+    auto Finish() -> bool override {
+        if (_failed || _cinfo.next_scanline != static_cast<JDIMENSION>(_height)) {
+            return false;
+        }
+        if (setjmp(_jerr.setjmp_buffer)) {
+            _failed = true;
+            return false;
+        }
+        jpeg_finish_compress(&_cinfo);
+        return _file->Commit();
+    }
+
+   private:
+    std::unique_ptr<OutputFile> _file;
+    int _height;
+    bool _failed = false;
+    JpegErrorManager _jerr{};
+    jpeg_compress_struct _cinfo{};
+};
+
+// Baseline uncompressed little-endian TIFF with 8 or 16 bits per sample. The pixel data is stored as a single strip
+// right after the IFD, so all offsets are known up front and rows can be appended as they arrive. 16-bit rows are
+// written as they are in memory, which is little-endian on every platform the generators are built for.
+class TiffWriter : public brightroom::ImageWriter {
+   public:
+    TiffWriter(std::unique_ptr<OutputFile> file, int width, int height, int bits)
+        : _file(std::move(file)), _width(width), _height(height), _bits(bits == 16 ? 16 : 8) {
+        _failed = !WriteHeader();
+    }
+
+    auto Bits() const -> int override { return _bits; }
+
+    auto WriteRows(const uint8_t* rows, int row_count, std::ptrdiff_t stride) -> bool override {
+        if (_failed) {
+            return false;
+        }
+        const auto row_bytes = static_cast<std::size_t>(_width) * 3 * (_bits / 8);
+        for (int row = 0; row < row_count; ++row) {
+            if (std::fwrite(rows + row * stride, 1, row_bytes, _file->Get()) != row_bytes) {
+                _failed = true;
+                return false;
+            }
+        }
+        _rows_written += row_count;
+        return true;
+    }
+
+    auto Finish() -> bool override { return !_failed && _rows_written == _height && _file->Commit(); }
+
+   private:
+    static constexpr uint16_t kTypeShort = 3;
+    static constexpr uint16_t kTypeLong = 4;
+    static constexpr int kEntryCount = 11;
+
+    template <typename T>
+    void Put(std::vector<uint8_t>& out, T value) {
+        for (std::size_t i = 0; i < sizeof(T); ++i) {
+            out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+        }
+    }
+
+    void PutEntry(std::vector<uint8_t>& out, uint16_t tag, uint16_t type, uint32_t count, uint32_t value) {
+        Put<uint16_t>(out, tag);
+        Put<uint16_t>(out, type);
+        Put<uint32_t>(out, count);
+        if (type == kTypeShort && count == 1) {
+            Put<uint16_t>(out, static_cast<uint16_t>(value));
+            Put<uint16_t>(out, 0);
+        } else {
+            Put<uint32_t>(out, value);
+        }
+    }
+
+    auto WriteHeader() -> bool {
+        constexpr uint32_t kIfdOffset = 8;
+        constexpr uint32_t kIfdSize = 2 + kEntryCount * 12 + 4;
+        constexpr uint32_t kBitsOffset = kIfdOffset + kIfdSize;
+        constexpr uint32_t kDataOffset = kBitsOffset + 3 * sizeof(uint16_t);
+        const auto data_size = static_cast<uint32_t>(_width) * _height * 3 * (_bits / 8);
+
+        std::vector<uint8_t> header;
+        header.insert(header.end(), {'I', 'I', 42, 0});
+        Put<uint32_t>(header, kIfdOffset);
+        Put<uint16_t>(header, kEntryCount);
+        PutEntry(header, 256, kTypeLong, 1, _width);          // ImageWidth
+        PutEntry(header, 257, kTypeLong, 1, _height);         // ImageLength
+        PutEntry(header, 258, kTypeShort, 3, kBitsOffset);    // BitsPerSample
+        PutEntry(header, 259, kTypeShort, 1, 1);              // Compression: none
+        PutEntry(header, 262, kTypeShort, 1, 2);              // PhotometricInterpretation: RGB
+        PutEntry(header, 273, kTypeLong, 1, kDataOffset);     // StripOffsets
+        PutEntry(header, 277, kTypeShort, 1, 3);              // SamplesPerPixel
+        PutEntry(header, 278, kTypeLong, 1, _height);         // RowsPerStrip
+        PutEntry(header, 279, kTypeLong, 1, data_size);       // StripByteCounts
+        PutEntry(header, 284, kTypeShort, 1, 1);              // PlanarConfiguration: chunky
+        PutEntry(header, 339, kTypeShort, 1, 1);              // SampleFormat: unsigned
+        Put<uint32_t>(header, 0);                             // No further IFDs
+        for (int i = 0; i < 3; ++i) {
+            Put<uint16_t>(header, static_cast<uint16_t>(_bits));
+        }
+        return std::fwrite(header.data(), 1, header.size(), _file->Get()) == header.size();
+    }
+
+    std::unique_ptr<OutputFile> _file;
+    int _width;
+    int _height;
+    int _bits;
+    int _rows_written = 0;
+    bool _failed = false;
+};
+
+}  // namespace
+
+namespace brightroom {
+
+auto ImageWriter::Create(ImageFormat format, const std::string& file_name, int width, int height,
+                         const ImageWriterOptions& options) -> std::unique_ptr<ImageWriter> {
+    const std::string temporary = file_name + ".partial";
+    FILE* file = std::fopen(temporary.c_str(), "wb");
+    if (file == nullptr) {
+        std::cout << "Cannot open " << temporary << " for writing" << "\n";
+        return nullptr;
+    }
+    auto output = std::make_unique<OutputFile>(file, temporary, file_name);
+    switch (format) {
+        case ImageFormat::kJpeg:
+            return std::make_unique<JpegWriter>(std::move(output), width, height, options.jpeg_quality);
+        case ImageFormat::kTiff:
+            return std::make_unique<TiffWriter>(std::move(output), width, height, options.tiff_bits);
+    }
+    return nullptr;
+}
+
+BackgroundWriter::BackgroundWriter(ImageWriter& writer)
+    : _writer(writer), _thread([this](std::stop_token stop_token) { Run(stop_token); }) {}
+
+BackgroundWriter::~BackgroundWriter() {
+    Wait();
+}
+
+void BackgroundWriter::Write(const uint8_t* rows, int row_count, std::ptrdiff_t stride) {
+    {
+        std::lock_guard lock(_mutex);
+        _queue.push_back({rows, row_count, stride});
+    }
+    _changed.notify_all();
+}
+
+auto BackgroundWriter::Wait() -> bool {
+    std::unique_lock lock(_mutex);
+    _changed.wait(lock, [this] { return _queue.empty() && !_writing; });
+    return _ok;
+}
+
+void BackgroundWriter::Run(std::stop_token stop_token) {
+    std::unique_lock lock(_mutex);
+    while (_changed.wait(lock, stop_token, [this] { return !_queue.empty(); })) {
+        const auto rows = _queue.front();
+        _queue.pop_front();
+        _writing = true;
+        // Rows after a failed write are dropped, the file is discarded anyway
+        const bool write = _ok;
+        lock.unlock();
+        bool written = true;
+        if (write) {
+            ZoneScopedN("encode");
+            written = _writer.WriteRows(rows.data, rows.count, rows.stride);
+        }
+        lock.lock();
+        _ok = _ok && written;
+        _writing = false;
+        _changed.notify_all();
+    }
+}
+
+auto WriteImage(const RgbImage& image, ImageFormat format, const std::string& file_name,
+                const ImageWriterOptions& options) -> bool {
+    if (!image.pixels) {
+        return false;
+    }
+    // RgbImage is 8 bits per sample
+    auto writer_options = options;
+    writer_options.tiff_bits = 8;
+    auto writer = ImageWriter::Create(format, file_name, image.width, image.height, writer_options);
+    if (!writer) {
+        return false;
+    }
+    const auto stride = static_cast<std::ptrdiff_t>(image.width) * 3;
+    return writer->WriteRows(image.pixels->data(), image.height, stride) && writer->Finish();
+}
+
+auto FileExtension(ImageFormat format) -> const char* {
+    switch (format) {
+        case ImageFormat::kJpeg:
+            return ".jpg";
+        case ImageFormat::kTiff:
+            return ".tif";
+    }
+    return "";
+}
+
+}  // namespace brightroom
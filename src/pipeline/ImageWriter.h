@@ -0,0 +1,74 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "types.h"
+
+namespace brightroom {
+
+enum class ImageFormat { kJpeg, kTiff };
+
+struct ImageWriterOptions {
+    int jpeg_quality = 90;
+    int tiff_bits = 8;  // 8 or 16 bits per sample, JPEG is always 8
+};
+
+// Writes interleaved RGB rows top to bottom, so callers can stream an image out without holding all of it. Rows
+// hold uint8_t samples, or uint16_t in host byte order for a 16-bit writer, and stride is in bytes. The image is
+// written to a temporary file next to file_name, which only replaces file_name once Finish succeeds.
+class ImageWriter {
+   public:
+    static auto Create(ImageFormat format, const std::string& file_name, int width, int height,
+                       const ImageWriterOptions& options = {}) -> std::unique_ptr<ImageWriter>;
+
+    virtual auto WriteRows(const uint8_t* rows, int row_count, std::ptrdiff_t stride) -> bool = 0;
+    virtual auto Finish() -> bool = 0;
+    // Bits per sample of the rows WriteRows expects
+    virtual auto Bits() const -> int { return 8; }
+    virtual ~ImageWriter() = default;
+};
+
+// Feeds the rows of Write to writer on one thread for the lifetime of the object, in order
+class BackgroundWriter {
+   public:
+    explicit BackgroundWriter(ImageWriter& writer);
+    // Waits for the queued rows
+    ~BackgroundWriter();
+    BackgroundWriter(const BackgroundWriter&) = delete;
+    auto operator=(const BackgroundWriter&) -> BackgroundWriter& = delete;
+
+    // Queues rows, which must stay untouched until Wait returns
+    void Write(const uint8_t* rows, int row_count, std::ptrdiff_t stride);
+    // Waits until every queued row is written, false if any write failed
+    auto Wait() -> bool;
+
+   private:
+    struct Rows {
+        const uint8_t* data;
+        int count;
+        std::ptrdiff_t stride;
+    };
+
+    void Run(std::stop_token stop_token);
+
+    ImageWriter& _writer;
+    std::mutex _mutex;
+    std::condition_variable_any _changed;
+    std::deque<Rows> _queue;
+    bool _writing = false;
+    bool _ok = true;
+    std::jthread _thread;  // Last, it must stop before the members it uses are destroyed
+};
+
+auto WriteImage(const RgbImage& image, ImageFormat format, const std::string& file_name,
+                const ImageWriterOptions& options = {}) -> bool;
+
+auto FileExtension(ImageFormat format) -> const char*;
+
+}  // namespace brightroom
@@ -0,0 +1,150 @@
+#include "MappedFile.h"
+#include <fstream>
+#include <mutex>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifndef _WIN32
+namespace {
+
+// The mapping a GuardedRead on this thread is reading, and where to return to if it faults
+struct Guard {
+    const uint8_t* begin;
+    const uint8_t* end;
+    sigjmp_buf resume;
+};
+thread_local Guard* active_guard = nullptr;
+struct sigaction previous_bus_action {};
+
+void OnBusError(int signal, siginfo_t* info, void* context) {
+    const auto* address = static_cast<const uint8_t*>(info->si_addr);
+    if (auto* guard = active_guard; guard && address >= guard->begin && address < guard->end) {
+        siglongjmp(guard->resume, 1);
+    }
+    // Not a guarded read, hand the fault to whoever handled it before
+    if (previous_bus_action.sa_flags & SA_SIGINFO) {
+        previous_bus_action.sa_sigaction(signal, info, context);
+    } else if (previous_bus_action.sa_handler != SIG_DFL && previous_bus_action.sa_handler != SIG_IGN) {
+        previous_bus_action.sa_handler(signal);
+    } else {
+        // Returning re-executes the access, which now faults with the default action
+        ::sigaction(SIGBUS, &previous_bus_action, nullptr);
+    }
+}
+
+void InstallBusErrorHandler() {
+    static std::once_flag installed;
+    std::call_once(installed, [] {
+        struct sigaction action {};
+        action.sa_sigaction = OnBusError;
+        action.sa_flags = SA_SIGINFO;
+        sigemptyset(&action.sa_mask);
+        ::sigaction(SIGBUS, &action, &previous_bus_action);
+    });
+}
+
+}  // namespace
+#endif
+
+namespace brightroom {
+
+auto MappedFile::Open(const std::filesystem::path& path) -> std::unique_ptr<MappedFile> {
+    auto file = std::unique_ptr<MappedFile>(new MappedFile());
+#ifndef _WIN32
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat status {};
+    if (::fstat(fd, &status) != 0 || status.st_size <= 0) {
+        ::close(fd);
+        return nullptr;
+    }
+    file->_size = static_cast<size_t>(status.st_size);
+    void* data = ::mmap(nullptr, file->_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    // A file that shrank between fstat and mmap would fault on its first read past the new end
+    struct stat mapped_status {};
+    const bool resized = ::fstat(fd, &mapped_status) != 0 || mapped_status.st_size != status.st_size;
+    // The mapping keeps its own reference to the file
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        return nullptr;
+    }
+    if (resized) {
+        ::munmap(data, file->_size);
+        return nullptr;
+    }
+    file->_data = static_cast<uint8_t*>(data);
+    file->_mapped = true;
+#else
+    std::ifstream stream(path, std::ios::binary | std::ios::ate);
+    if (!stream) {
+        return nullptr;
+    }
+    file->_fallback.resize(static_cast<size_t>(stream.tellg()));
+    stream.seekg(0);
+    auto* bytes = reinterpret_cast<char*>(file->_fallback.data());
+    if (file->_fallback.empty() || !stream.read(bytes, static_cast<std::streamsize>(file->_fallback.size()))) {
+        return nullptr;
+    }
+    file->_data = file->_fallback.data();
+    file->_size = file->_fallback.size();
+#endif
+    return file;
+}
+
+MappedFile::~MappedFile() {
+#ifndef _WIN32
+    if (_mapped) {
+        ::munmap(_data, _size);
+    }
+#endif
+}
+
+void MappedFile::AdviseSequential() const {
+#ifndef _WIN32
+    if (_mapped) {
+        // Advice values are not flags, each needs its own call
+        ::madvise(_data, _size, MADV_SEQUENTIAL);
+        ::madvise(_data, _size, MADV_WILLNEED);
+    }
+#endif
+}
+
+void MappedFile::Release() const {
+#ifndef _WIN32
+    if (_mapped) {
+        ::madvise(_data, _size, MADV_DONTNEED);
+    }
+#endif
+}
+
+auto MappedFile::GuardedRead(const std::function<void()>& read) const -> bool {
+#ifndef _WIN32
+    if (_mapped) {
+        InstallBusErrorHandler();
+        Guard guard{_data, _data + _size, {}};
+        Guard* const outer = active_guard;
+        // Save the signal mask, SIGBUS is blocked while the handler runs and must be unblocked again after a fault
+        if (sigsetjmp(guard.resume, 1) != 0) {
+            active_guard = outer;
+            return false;
+        }
+        active_guard = &guard;
+        read();
+        active_guard = outer;
+        return true;
+    }
+#endif
+    read();
+    return true;
+}
+
+}  // namespace brightroom
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace brightroom {
+
+// A whole file mapped into memory. Pages are private copy-on-write, so the contents can be handed to code that
+// expects a writable pointer without changing the file. Platforms without mmap read the file into memory instead.
+class MappedFile {
+   public:
+    // Returns nullptr if the file cannot be opened or mapped
+    static auto Open(const std::filesystem::path& path) -> std::unique_ptr<MappedFile>;
+
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    auto operator=(const MappedFile&) -> MappedFile& = delete;
+
+    auto Data() const -> uint8_t* { return _data; }
+    auto Size() const -> size_t { return _size; }
+    auto Bytes() const -> std::span<const uint8_t> { return {_data, _size}; }
+
+    // Paging hints, no-ops without madvise. Sequential starts reading the whole file in and lets the kernel drop
+    // pages behind the reader sooner. Release drops the resident pages, reading them again faults them back in from
+    // the file, so it must only be used while nothing was written to the mapping.
+    void AdviseSequential() const;
+    void Release() const;
+
+    // Runs read and returns true, or false if read touched a page past the end of the file. That happens when the
+    // file is truncated or rewritten while it is mapped, a private mapping still faults in unmodified pages from
+    // the file, and the kernel raises SIGBUS instead of returning an error. read is abandoned at the faulting
+    // access without unwinding, so whatever it was building must be discarded when this returns false.
+    auto GuardedRead(const std::function<void()>& read) const -> bool;
+
+   private:
+    MappedFile() = default;
+
+    uint8_t* _data = nullptr;
+    size_t _size = 0;
+    bool _mapped = false;            // _data comes from mmap, not from _fallback
+    std::vector<uint8_t> _fallback;  // Contents if the file could not be mapped
+};
+
+}  // namespace brightroom
@@ -0,0 +1,85 @@
+#include "PackedBayer.h"
+#include <bit>
+#include <cstring>
+
+namespace {
+
+// With the bit depth known at compile time the offsets are multiples of a constant and the loop unrolls
+template <int kBits>
+void UnpackRow(const uint8_t* packed, int width, uint16_t* destination) {
+    if constexpr (kBits == 16) {
+        std::memcpy(destination, packed, static_cast<size_t>(width) * sizeof(uint16_t));
+    } else {
+        constexpr uint32_t kMask = (1u << kBits) - 1;
+        for (int x = 0; x < width; ++x) {
+            const size_t bit = static_cast<size_t>(x) * kBits;
+            const uint8_t* bytes = packed + (bit >> 3);
+            // A sample starts at most 7 bits into its first byte and spans at most 21 bits, 3 bytes cover it
+            const uint32_t word = bytes[0] | (static_cast<uint32_t>(bytes[1]) << 8) |
+                                  (static_cast<uint32_t>(bytes[2]) << 16);
+            destination[x] = static_cast<uint16_t>((word >> (bit & 7)) & kMask);
+        }
+    }
+}
+
+}  // namespace
+
+namespace brightroom {
+
+auto PackedBits(uint16_t max_value) -> int {
+    const int bits = std::bit_width(max_value);
+    return bits <= 12 ? 12 : bits <= 14 ? 14 : 16;
+}
+
+auto PackedRowBytes(int width, int bits) -> size_t {
+    return (static_cast<size_t>(width) * bits + 7) / 8;
+}
+
+auto PackBayer(const uint16_t* samples, size_t stride, int width, int height, int bits) -> PackedBayerData {
+    PackedBayerData packed(PackedRowBytes(width, bits) * height + RawFile::kPackedPadding);
+    PackBayerRows(samples, stride, width, bits, 0, height, packed);
+    return packed;
+}
+
+void PackBayerRows(const uint16_t* samples, size_t stride, int width, int bits, int first_row, int rows,
+                   PackedBayerData& packed) {
+    const size_t row_bytes = PackedRowBytes(width, bits);
+    for (int y = first_row; y < first_row + rows; ++y) {
+        const uint16_t* row = samples + y * stride;
+        uint8_t* out = packed.data() + y * row_bytes;
+        uint64_t accumulator = 0;
+        int filled = 0;
+        for (int x = 0; x < width; ++x) {
+            accumulator |= static_cast<uint64_t>(row[x]) << filled;
+            filled += bits;
+            while (filled >= 8) {
+                *out++ = static_cast<uint8_t>(accumulator);
+                accumulator >>= 8;
+                filled -= 8;
+            }
+        }
+        if (filled > 0) {
+            *out = static_cast<uint8_t>(accumulator);
+        }
+    }
+}
+
+void UnpackBayerRows(const RawFile& raw, int first_row, int rows, uint16_t* destination, size_t stride) {
+    for (int y = first_row; y < first_row + rows; ++y) {
+        const uint8_t* packed = raw.packed->data() + y * raw.row_bytes;
+        uint16_t* row = destination + (y - first_row) * stride;
+        switch (raw.bits) {
+            case 12:
+                UnpackRow<12>(packed, raw.width, row);
+                break;
+            case 14:
+                UnpackRow<14>(packed, raw.width, row);
+                break;
+            default:
+                UnpackRow<16>(packed, raw.width, row);
+                break;
+        }
+    }
+}
+
+}  // namespace brightroom
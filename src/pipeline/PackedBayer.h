@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "types.h"
+
+namespace brightroom {
+
+// Smallest of 12, 14 and 16 bits per sample that holds max_value
+auto PackedBits(uint16_t max_value) -> int;
+
+auto PackedRowBytes(int width, int bits) -> size_t;
+
+// Packs height rows of width samples, stride samples apart, in the layout of RawFile::packed. Every sample must fit
+// in bits.
+auto PackBayer(const uint16_t* samples, size_t stride, int width, int height, int bits) -> PackedBayerData;
+
+// Packs rows [first_row, first_row + rows) of samples into packed, which must already hold them. Blocks of rows are
+// independent, PackBayer packs all of them on one thread.
+void PackBayerRows(const uint16_t* samples, size_t stride, int width, int bits, int first_row, int rows,
+                   PackedBayerData& packed);
+
+// Unpacks rows [first_row, first_row + rows) of the sensor data of raw into rows of raw.width samples, stride
+// samples apart
+void UnpackBayerRows(const RawFile& raw, int first_row, int rows, uint16_t* destination, size_t stride);
+
+}  // namespace brightroom
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <HalideRuntime.h>
+#include <cstdint>
+
+namespace brightroom {
+
+// Calls task(index) for every index in [0, count) on Halide's thread pool, returns the first error of a task
+template <typename Task>
+auto ParallelFor(int count, Task& task) -> int {
+    return halide_do_par_for(
+        nullptr,
+        [](void* /*user_context*/, int index, uint8_t* closure) { return (*reinterpret_cast<Task*>(closure))(index); },
+        0, count, reinterpret_cast<uint8_t*>(&task));
+}
+
+}  // namespace brightroom
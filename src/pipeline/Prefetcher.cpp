@@ -0,0 +1,79 @@
+#include "Prefetcher.h"
+#include <algorithm>
+#include <iostream>
+#include "RawLoader.h"
+#include "Tracy.hpp"
+
+namespace brightroom {
+
+Prefetcher::Prefetcher(std::shared_ptr<ImageCache> cache, PipelineFactory make_pipeline, int workers)
+    : _cache(std::move(cache)) {
+    for (int i = 0; i < std::max(1, workers); ++i) {
+        _workers.emplace_back([this, pipeline = std::shared_ptr(make_pipeline())](std::stop_token stop_token) {
+            Run(stop_token, *pipeline);
+        });
+    }
+}
+
+Prefetcher::~Prefetcher() {
+    std::lock_guard lock(_mutex);
+    _pending.clear();
+    for (auto& worker : _workers) {
+        worker.request_stop();
+    }
+}
+
+void Prefetcher::Prefetch(std::vector<std::filesystem::path> files) {
+    std::lock_guard lock(_mutex);
+    _pending.clear();
+    for (auto& file : files) {
+        if (!_in_progress.contains(file) && !_cache->Contains(file)) {
+            _pending.push_back(std::move(file));
+        }
+    }
+    _wakeup.notify_all();
+}
+
+void Prefetcher::Run(std::stop_token stop_token, IRawPipeline& pipeline) {
+    RawLoader loader;
+    while (true) {
+        std::filesystem::path file;
+        {
+            std::unique_lock lock(_mutex);
+            if (!_wakeup.wait(lock, stop_token, [this] { return !_pending.empty(); })) {
+                return;
+            }
+            file = std::move(_pending.front());
+            _pending.pop_front();
+            _in_progress.insert(file);
+        }
+
+        {
+            ZoneScopedN("prefetch");
+            const auto source = FileIdentity::Of(file);
+            auto opened = loader.OpenRaw(file.string());
+            // The same steps as RenderWorker takes for a newly opened image
+            const bool cached = source && pipeline.IsCached(*source, PreprocessMode::kPreview);
+            std::shared_ptr<const RawFile> raw;
+            if (opened && (cached || RawLoader::Unpack(*opened))) {
+                raw = std::make_shared<const RawFile>(CreateRawFile(*opened));
+            }
+            opened.reset();
+            if (raw) {
+                pipeline.Preprocess(*raw, PreprocessMode::kPreview, source);
+                if (auto image = pipeline.Image(); image && !image->Empty()) {
+                    _cache->Insert(file, PreparedImage{std::move(raw), source, std::move(image)});
+                }
+                // Otherwise the pipeline would keep the image alive after the cache evicted it
+                pipeline.SetImage(nullptr);
+            } else {
+                std::cout << "Cannot prefetch " << file << std::endl;
+            }
+        }
+
+        std::lock_guard lock(_mutex);
+        _in_progress.erase(file);
+    }
+}
+
+}  // namespace brightroom
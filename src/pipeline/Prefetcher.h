@@ -0,0 +1,50 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stop_token>
+#include <thread>
+#include <vector>
+#include "IRawPipeline.h"
+#include "ImageCache.h"
+
+namespace brightroom {
+
+// Opens, unpacks and preprocesses the files around the one being viewed on background threads and puts them in an
+// ImageCache, so moving to one of them only costs a Process call. Prefetching uses the preview Preprocess, as opening
+// an image does, and skips the unpack when the disk cache has the preview.
+class Prefetcher {
+   public:
+    using PipelineFactory = std::function<std::unique_ptr<IRawPipeline>()>;
+
+    // Each worker preprocesses with its own pipeline from make_pipeline. Halide parallelizes every Preprocess
+    // already, more than one worker mostly helps to overlap the single-threaded unpack.
+    Prefetcher(std::shared_ptr<ImageCache> cache, PipelineFactory make_pipeline, int workers = 1);
+    ~Prefetcher();
+    Prefetcher(const Prefetcher&) = delete;
+    auto operator=(const Prefetcher&) -> Prefetcher& = delete;
+
+    // Replaces the files waiting to be prefetched, taken in the order given. Files that are cached or already being
+    // prefetched are skipped.
+    void Prefetch(std::vector<std::filesystem::path> files);
+    auto Cache() const -> const std::shared_ptr<ImageCache>& { return _cache; }
+
+   private:
+    void Run(std::stop_token stop_token, IRawPipeline& pipeline);
+
+    std::shared_ptr<ImageCache> _cache;
+    std::mutex _mutex;
+    std::condition_variable_any _wakeup;
+    std::deque<std::filesystem::path> _pending;
+    std::set<std::filesystem::path> _in_progress;
+
+    // Declared last so the threads are joined before the state above is destroyed
+    std::vector<std::jthread> _workers;
+};
+
+}  // namespace brightroom
@@ -0,0 +1,47 @@
+#include "ProcessGraph.h"
+
+namespace brightroom {
+
+auto ChangedParameters(const Parameters& a, const Parameters& b) -> uint32_t {
+    uint32_t changed = 0;
+    if (a.exposure != b.exposure) {
+        changed |= kExposureBit;
+    }
+    if (a.contrast != b.contrast) {
+        changed |= kContrastBit;
+    }
+    if (a.saturation != b.saturation) {
+        changed |= kSaturationBit;
+    }
+    if (a.tone_mapping_key != b.tone_mapping_key) {
+        changed |= kToneMappingKeyBit;
+    }
+    if (a.adjustments != b.adjustments) {
+        changed |= kAdjustmentsBit;
+    }
+    return changed;
+}
+
+auto ProcessGraph::FirstDirtyStage(const StageSource& source, const Parameters& parameters) const -> size_t {
+    if (!_source || *_source != source) {
+        return 0;
+    }
+    const uint32_t changed = ChangedParameters(_parameters, parameters);
+    for (size_t stage = 0; stage < kStages.size(); ++stage) {
+        if ((kStages[stage].parameters & changed) != 0) {
+            return stage;
+        }
+    }
+    return kStages.size();
+}
+
+void ProcessGraph::MarkClean(const StageSource& source, const Parameters& parameters) {
+    _source = source;
+    _parameters = parameters;
+}
+
+void ProcessGraph::Invalidate() {
+    _source.reset();
+}
+
+}  // namespace brightroom
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include "IRawPipeline.h"
+#include "types.h"
+
+namespace brightroom {
+
+// One bit per field of Parameters, for the set of parameters a stage reads
+enum ParameterBit : uint32_t {
+    kExposureBit = 1u << 0,
+    kContrastBit = 1u << 1,
+    kSaturationBit = 1u << 2,
+    kToneMappingKeyBit = 1u << 3,
+    kAdjustmentsBit = 1u << 4,
+};
+
+// Bits of the parameters that differ between a and b
+auto ChangedParameters(const Parameters& a, const Parameters& b) -> uint32_t;
+
+// What the first stage reads besides the parameters. Any change invalidates every stage.
+struct StageSource {
+    uint64_t image = 0;    // Generation of the preprocessed image, a new one for every Preprocess and SetImage
+    bool preview = false;  // Rendered from the binned preview rather than the full-resolution demosaic
+    Region region{};       // Output region and downscale, as resolved by Process
+    int downscale = 1;
+
+    auto operator==(const StageSource&) const -> bool = default;
+};
+
+// Process as a chain of stages, each reading only some of the parameters. HalideRawPipeline keeps the output of
+// every stage but the last between calls, so an edit reruns the chain from the first stage whose parameters changed
+// and dragging the saturation slider never repeats the resampling and colour matrix.
+class ProcessGraph {
+   public:
+    struct Stage {
+        const char* name;     // Telemetry stage it is timed as
+        uint32_t parameters;  // ParameterBits it reads
+    };
+    static constexpr size_t kLinear = 0;
+    static constexpr size_t kDisplay = 1;
+    static constexpr std::array<Stage, 2> kStages{{
+        {"linear", kExposureBit | kToneMappingKeyBit},
+        {"display", kContrastBit | kSaturationBit | kAdjustmentsBit},
+    }};
+
+    // Index of the first stage whose cached output does not match rendering parameters from source,
+    // kStages.size() if all of them do
+    auto FirstDirtyStage(const StageSource& source, const Parameters& parameters) const -> size_t;
+    // The cached outputs now hold a render of parameters from source
+    void MarkClean(const StageSource& source, const Parameters& parameters);
+    // The cached outputs are incomplete or were released
+    void Invalidate();
+
+   private:
+    std::optional<StageSource> _source;
+    Parameters _parameters;
+};
+
+}  // namespace brightroom
@@ -11,13 +11,20 @@
 #include <QGraphicsScene>
 #include <QGraphicsView>
 #include <QImageReader>
+#include <algorithm>
+#include <cctype>
 #include <cstdint>
+#include <functional>
 #include <iostream>
+#include <memory>
 #include <opencv2/core/core.hpp>
 #include <opencv2/core/types.hpp>
 #include <opencv2/highgui.hpp>
 #include <opencv2/imgcodecs.hpp>
 #include <opencv2/imgproc.hpp>
+#include <vector>
+#include "PackedBayer.h"
+#include "ParallelFor.h"
 #include "Tracy.hpp"
 #include "jpeglib.h"
 #include "libraw/libraw_const.h"
@@ -26,96 +33,304 @@
 
 namespace {
 
+// Rows of the sensor data every task of CreateRawFile scans and packs
+constexpr int kPackRows = 64;
+
 struct jpegErrorManager {
     struct jpeg_error_mgr pub;
     jmp_buf setjmp_buffer;
 };
 
-brightroom::RgbImage CreateThumbnail(const LibRaw& _iProcessor) {
+// libjpeg's default handler exits the process on a corrupt stream, return to CreateThumbnail instead
+void JpegErrorExit(j_common_ptr cinfo) {
+    auto* error = reinterpret_cast<jpegErrorManager*>(cinfo->err);
+    (*cinfo->err->output_message)(cinfo);
+    longjmp(error->setjmp_buffer, 1);
+}
+
+// Largest DCT scale denominator whose output still covers the target, 1 if there is no target
+auto ScaleDenominator(int width, int height, int target_width, int target_height) -> unsigned int {
+    if (target_width <= 0 || target_height <= 0) {
+        return 1;
+    }
+    for (unsigned int denominator : {8u, 4u, 2u}) {
+        const auto scaled_width = (static_cast<unsigned int>(width) + denominator - 1) / denominator;
+        const auto scaled_height = (static_cast<unsigned int>(height) + denominator - 1) / denominator;
+        if (scaled_width >= static_cast<unsigned int>(target_width) &&
+            scaled_height >= static_cast<unsigned int>(target_height)) {
+            return denominator;
+        }
+    }
+    return 1;
+}
+
+// Scale denominator CreateThumbnail decodes the embedded preview with. LibRaw's twidth and theight do not always
+// match the JPEG, so its header is read here the same way.
+auto ThumbnailScale(const libraw_thumbnail_t& thumbnail, int target_width, int target_height) -> unsigned int {
+    if (thumbnail.tformat != LIBRAW_THUMBNAIL_JPEG || thumbnail.thumb == nullptr || thumbnail.tlength == 0) {
+        return 1;
+    }
+    jpegErrorManager jerr;
+    struct jpeg_decompress_struct cinfo;
+    cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = JpegErrorExit;
+    if (setjmp(jerr.setjmp_buffer)) {
+        jpeg_destroy_decompress(&cinfo);
+        return 1;
+    }
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, reinterpret_cast<unsigned char*>(thumbnail.thumb), thumbnail.tlength);
+    jpeg_read_header(&cinfo, TRUE);
+    const auto denominator = ScaleDenominator(static_cast<int>(cinfo.image_width),
+                                              static_cast<int>(cinfo.image_height), target_width, target_height);
+    jpeg_destroy_decompress(&cinfo);
+    return denominator;
+}
+
+// A LibRaw that reads from a mapped file through open_buffer. LibRaw keeps reading from the buffer until the data
+// is unpacked, so the mapping is owned alongside it.
+class MappedRaw : public LibRaw {
+   public:
+    explicit MappedRaw(std::unique_ptr<brightroom::MappedFile> file) : _file(std::move(file)) {}
+
+    auto File() const -> const brightroom::MappedFile& { return *_file; }
+
+   private:
+    std::unique_ptr<brightroom::MappedFile> _file;
+};
+
+// Runs a LibRaw call that may read the file and returns its error code. Returns nullopt instead of crashing the
+// process with SIGBUS if the file was mapped and has been truncated or rewritten meanwhile, the LibRaw must then be
+// destroyed.
+auto ReadRaw(LibRaw& raw, const std::function<int()>& read) -> std::optional<int> {
+    const auto* mapped = dynamic_cast<const MappedRaw*>(&raw);
+    if (!mapped) {
+        return read();
+    }
+    int error = LibRaw_errors::LIBRAW_SUCCESS;
+    if (!mapped->File().GuardedRead([&] { error = read(); })) {
+        return std::nullopt;
+    }
+    return error;
+}
+
+}  // namespace
+
+namespace brightroom {
+
+auto IsRawFile(const std::filesystem::path& path) -> bool {
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char character) { return std::toupper(character); });
+    return extension == ".ORF" || extension == ".RAW" || extension == ".DNG" || extension == ".NEF" ||
+           extension == ".CR2";
+}
+
+auto CreateThumbnail(const LibRaw& _iProcessor, int target_width, int target_height) -> RgbImage {
     ZoneScoped;
     const auto& thumbnail = _iProcessor.imgdata.thumbnail;
+    if (thumbnail.thumb == nullptr || thumbnail.tlength == 0) {
+        return {};
+    }
+    if (thumbnail.tformat == LIBRAW_THUMBNAIL_BITMAP) {
+        // Already RGB8, not worth scaling
+        const size_t size = static_cast<size_t>(thumbnail.twidth) * thumbnail.theight * 3;
+        if (thumbnail.tcolors != 3 || thumbnail.tlength < size) {
+            return {};
+        }
+        auto pixels = std::make_shared<brightroom::RGB8_Data>(thumbnail.thumb, thumbnail.thumb + size);
+        return brightroom::RgbImage{std::move(pixels), thumbnail.twidth, thumbnail.theight};
+    }
+    if (thumbnail.tformat != LIBRAW_THUMBNAIL_JPEG) {
+        return {};
+    }
+
     jpegErrorManager jerr;
     struct jpeg_decompress_struct cinfo;
     cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = JpegErrorExit;
+    // Declared before setjmp, a longjmp back here must not skip its destructor
+    std::vector<unsigned char> jdata;
+    if (setjmp(jerr.setjmp_buffer)) {
+        jpeg_destroy_decompress(&cinfo);
+        return {};
+    }
 
     jpeg_create_decompress(&cinfo);
-    jpeg_mem_src(&cinfo, (unsigned char*)thumbnail.thumb, thumbnail.tlength);
-    int rc = jpeg_read_header(&cinfo, TRUE);
+    jpeg_mem_src(&cinfo, reinterpret_cast<unsigned char*>(thumbnail.thumb), thumbnail.tlength);
+    jpeg_read_header(&cinfo, TRUE);
+    cinfo.out_color_space = JCS_RGB;
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = ScaleDenominator(static_cast<int>(cinfo.image_width), static_cast<int>(cinfo.image_height),
+                                         target_width, target_height);
     jpeg_start_decompress(&cinfo);
 
-    std::vector<unsigned char> jdata(thumbnail.twidth * thumbnail.theight * 3);
+    const auto width = static_cast<int>(cinfo.output_width);
+    const auto height = static_cast<int>(cinfo.output_height);
+    jdata.resize(static_cast<size_t>(width) * height * 3);
     unsigned char* rowptr[1];
-    while (cinfo.output_scanline < cinfo.output_height)  // loop
-    {
-        rowptr[0] = jdata.data() +  // secret to method
-                    3 * cinfo.output_width * cinfo.output_scanline;
-
+    while (cinfo.output_scanline < cinfo.output_height) {
+        rowptr[0] = jdata.data() + static_cast<size_t>(3) * width * cinfo.output_scanline;
         jpeg_read_scanlines(&cinfo, rowptr, 1);
     }
-    jpeg_finish_decompress(&cinfo);  //finish decompressing
-    return brightroom::RgbImage{jdata, thumbnail.twidth, thumbnail.theight};
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return brightroom::RgbImage{std::make_shared<brightroom::RGB8_Data>(std::move(jdata)), width, height};
 }
 
-brightroom::RawFile CreateRawFile(LibRaw& _iProcessor) {
+auto CreateRawFile(const LibRaw& raw) -> RawFile {
     ZoneScoped;
-    auto thumbnail = CreateThumbnail(_iProcessor);
-    std::vector<uint16_t> rawdata(_iProcessor.imgdata.sizes.raw_width * _iProcessor.imgdata.sizes.raw_height * 3, 0);
-    std::cout << "col" << _iProcessor.COLOR(0, 0) << _iProcessor.imgdata.idata.cdesc << std::endl;
-    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
-    for (int row = 0; row < _iProcessor.imgdata.sizes.raw_height; ++row) {
-        for (int col = 0; col < _iProcessor.imgdata.sizes.raw_width; ++col) {
-            auto index = row * _iProcessor.imgdata.sizes.raw_width + col;
-            if (row % 2 == 0) {
-                if (col % 2 == 0) {
-                    rawdata[index * 3 + 0] = _iProcessor.imgdata.rawdata.raw_image[index];
-                } else {
-                    rawdata[index * 3 + 1] = _iProcessor.imgdata.rawdata.raw_image[index];
-                }
-            } else {
-                if (col % 2 == 0) {
-                    rawdata[index * 3 + 1] = _iProcessor.imgdata.rawdata.raw_image[index];
-                } else {
-                    rawdata[index * 3 + 2] = _iProcessor.imgdata.rawdata.raw_image[index];
-                }
-            }
+    const auto& sizes = raw.imgdata.sizes;
+    const auto& color = raw.imgdata.color;
+    RawFile raw_file;
+    raw_file.width = sizes.width;
+    raw_file.height = sizes.height;
+    raw_file.active_area = {sizes.left_margin, sizes.top_margin, sizes.width, sizes.height};
+    raw_file.filters = raw.imgdata.idata.filters;
+    raw_file.black = static_cast<int>(color.black);
+    for (int i = 0; i < 4; i++) {
+        raw_file.cblack[i] = static_cast<int>(color.cblack[i]);
+        raw_file.cam_mul[i] = color.cam_mul[i];
+    }
+    raw_file.white = static_cast<int>(color.maximum);
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 4; j++) {
+            raw_file.rgb_cam[i][j] = color.rgb_cam[i][j];
         }
     }
-    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
-    std::cout << "Time taken: " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << " ms"
-              << std::endl;
-    brightroom::RawFile raw_file;
-    raw_file.thumbnail = std::move(thumbnail);
-    raw_file.rawdata = std::move(rawdata);
-    raw_file.width = _iProcessor.imgdata.sizes.raw_width;
-    raw_file.height = _iProcessor.imgdata.sizes.raw_height;
 
+    const uint16_t* raw_image = raw.imgdata.rawdata.raw_image;
+    if (raw_image == nullptr || raw_file.width <= 0 || raw_file.height <= 0) {
+        return raw_file;
+    }
+    // Rows of the unpacked data may be padded, raw_pitch is in bytes
+    const size_t stride = sizes.raw_pitch != 0 ? sizes.raw_pitch / sizeof(uint16_t) : sizes.raw_width;
+    const uint16_t* active = raw_image + static_cast<size_t>(sizes.top_margin) * stride + sizes.left_margin;
+    // Both passes read the whole frame before the first pixel is shown, they run on Halide's thread pool in blocks
+    // of kPackRows rows as UnpackSensorData does
+    const int blocks = (raw_file.height + kPackRows - 1) / kPackRows;
+    auto block_rows = [&](int block) { return std::min(kPackRows, raw_file.height - block * kPackRows); };
+
+    // The white level is not always the largest value in the file, the data decides the bit depth
+    std::vector<uint16_t> block_max(blocks, 0);
+    auto scan = [&](int block) {
+        for (int y = block * kPackRows; y < block * kPackRows + block_rows(block); ++y) {
+            const uint16_t* row = active + y * stride;
+            block_max[block] = std::max(block_max[block], *std::max_element(row, row + raw_file.width));
+        }
+        return 0;
+    };
+    ParallelFor(blocks, scan);
+    raw_file.bits = PackedBits(*std::max_element(block_max.begin(), block_max.end()));
+    raw_file.row_bytes = PackedRowBytes(raw_file.width, raw_file.bits);
+
+    auto packed = std::make_shared<PackedBayerData>(raw_file.row_bytes * raw_file.height + RawFile::kPackedPadding);
+    auto pack = [&](int block) {
+        PackBayerRows(active, stride, raw_file.width, raw_file.bits, block * kPackRows, block_rows(block), *packed);
+        return 0;
+    };
+    ParallelFor(blocks, pack);
+    raw_file.packed = std::move(packed);
     return raw_file;
 }
-}  // namespace
 
-namespace brightroom {
+RawLoader::RawLoader(std::shared_ptr<DiskCache> disk_cache, RawInput input)
+    : _disk_cache(std::move(disk_cache)), _input(input) {}
 
-std::unique_ptr<LibRaw> RawLoader::LoadRaw(const std::string& file_name) {
+std::unique_ptr<LibRaw> RawLoader::OpenRaw(const std::string& file_name) {
     ZoneScoped;
-    std::cout << "Loading RAW" << std::endl;
-    auto i_processor = std::make_unique<LibRaw>();
-
-    // Let us create an image processor
+    std::unique_ptr<LibRaw> i_processor;
+    int error = LibRaw_errors::LIBRAW_SUCCESS;
+    if (auto file = _input == RawInput::kMapped ? MappedFile::Open(file_name) : nullptr) {
+        // Only the headers are parsed here, in no particular order, so the sequential hint waits for Unpack
+        auto* mapped = new MappedRaw(std::move(file));
+        i_processor.reset(mapped);
+        error = ReadRaw(*mapped, [&] { return mapped->open_buffer(mapped->File().Data(), mapped->File().Size()); })
+                    .value_or(LibRaw_errors::LIBRAW_IO_ERROR);
+    } else {
+        // Also the fallback for files that cannot be mapped
+        i_processor = std::make_unique<LibRaw>();
+        error = i_processor->open_file(file_name.c_str());
+    }
 
     // Open the file and read the metadata
-    i_processor->open_file(file_name.c_str());
+    if (error != LibRaw_errors::LIBRAW_SUCCESS) {
+        std::cout << "Cannot open " << file_name << ": " << libraw_strerror(error) << std::endl;
+        return nullptr;
+    }
 
     // The metadata are accessible through data fields of the class
     printf("Image size: %d x %d\n", i_processor->imgdata.sizes.width, i_processor->imgdata.sizes.height);
 
+    // Fills _iProcessor.imgdata.thumbnail. Not every file has a preview, the image still loads without one.
+    const auto thumb_error = ReadRaw(*i_processor, [&] { return i_processor->unpack_thumb(); });
+    if (!thumb_error) {
+        std::cout << "Cannot read " << file_name << ": the file changed while it was read" << std::endl;
+        return nullptr;
+    }
+    if (*thumb_error != LibRaw_errors::LIBRAW_SUCCESS) {
+        std::cout << "No embedded preview in " << file_name << ": " << libraw_strerror(*thumb_error) << std::endl;
+    }
+    return i_processor;
+}
+
+auto RawLoader::Unpack(LibRaw& raw) -> bool {
+    ZoneScoped;
+    // The sensor data is one long run through the file. Once it is decoded the compressed pages are dead weight, the
+    // unpacked copy is all that is read from here on.
+    const auto* mapped = dynamic_cast<const MappedRaw*>(&raw);
+    if (mapped) {
+        mapped->File().AdviseSequential();
+    }
     // Fills _iProcessor.rawdata.raw_image
-    i_processor->unpack();
+    const auto error = ReadRaw(raw, [&] { return raw.unpack(); }).value_or(LibRaw_errors::LIBRAW_IO_ERROR);
+    if (mapped) {
+        mapped->File().Release();
+    }
+    if (error != LibRaw_errors::LIBRAW_SUCCESS) {
+        std::cout << "Cannot unpack: " << libraw_strerror(error) << std::endl;
+        return false;
+    }
+    return true;
+}
 
-    if (i_processor->unpack_thumb() != LibRaw_errors::LIBRAW_SUCCESS) {
-        std::cout << "error:" << i_processor->unpack_thumb() << std::endl;
-    };
+auto RawLoader::LoadRaw(const std::string& file_name) -> std::unique_ptr<RawFile> {
+    ZoneScoped;
+    std::cout << "Loading RAW" << std::endl;
+    auto i_processor = OpenRaw(file_name);
+    if (!i_processor || !Unpack(*i_processor)) {
+        return nullptr;
+    }
     std::cout << "Read Raw Image" << std::endl;
-    return i_processor;
+    // LibRaw, its unpacked copy and the mapping go once the sensor data is packed
+    auto raw_file = std::make_unique<RawFile>(CreateRawFile(*i_processor));
+    if (!raw_file->HasSensorData()) {
+        std::cout << "No Bayer sensor data in " << file_name << std::endl;
+        return nullptr;
+    }
+    return raw_file;
+}
+
+auto RawLoader::Thumbnail(const LibRaw& raw, const std::optional<FileIdentity>& source, int target_width,
+                          int target_height) -> RgbImage {
+    ZoneScoped;
+    if (!_disk_cache || !source) {
+        return CreateThumbnail(raw, target_width, target_height);
+    }
+    const auto variant =
+        "thumbnail/" + std::to_string(ThumbnailScale(raw.imgdata.thumbnail, target_width, target_height));
+    if (auto cached = _disk_cache->Find(*source, variant); cached && cached->channels == 3 &&
+                                                           cached->type == halide_type_t(halide_type_uint, 8)) {
+        const size_t size = static_cast<size_t>(cached->width) * cached->height * 3;
+        auto pixels = std::make_shared<RGB8_Data>(cached->pixels, cached->pixels + size);
+        return RgbImage{std::move(pixels), cached->width, cached->height};
+    }
+    auto image = CreateThumbnail(raw, target_width, target_height);
+    if (image.pixels) {
+        _disk_cache->Store(*source, variant, halide_type_t(halide_type_uint, 8), image.width, image.height, 3,
+                           image.pixels->data());
+    }
+    return image;
 }
 
-}  // namespace brightroom
\ No newline at end of file
+}  // namespace brightroom
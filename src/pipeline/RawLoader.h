@@ -1,17 +1,55 @@
 #pragma once
 #include <libraw/libraw.h>
+#include <filesystem>
 #include <memory>
+#include <optional>
 #include <string>
+#include "DiskCache.h"
 #include "types.h"
 
 namespace brightroom {
 
+// Whether the extension is one of the RAW formats BrightRoom looks for in directories
+auto IsRawFile(const std::filesystem::path& path) -> bool;
+
+// Decodes the embedded preview that unpack_thumb read. Given a target size, a JPEG preview is decoded with libjpeg's
+// DCT scaling at the smallest of 1/8, 1/4, 1/2 and full scale that still covers it, which skips most of the IDCT
+// work for a window-sized view. Returns an image without pixels if there is no preview or it cannot be decoded.
+auto CreateThumbnail(const LibRaw& raw, int target_width = 0, int target_height = 0) -> RgbImage;
+
+// Copies the metadata of a file opened with RawLoader::OpenRaw and, once it is unpacked, its sensor data. The LibRaw
+// can be destroyed afterwards.
+auto CreateRawFile(const LibRaw& raw) -> RawFile;
+
+// How LibRaw reads the file
+enum class RawInput {
+    kFile,    // open_file, buffered stdio reads
+    // open_buffer on a memory mapping, without read calls or a copy of the compressed data in user space. A file
+    // truncated or rewritten while it is read fails to open or unpack, see MappedFile::GuardedRead.
+    kMapped,
+};
+
 class RawLoader {
    public:
-    std::unique_ptr<LibRaw> LoadRaw(const std::string& file_name);
+    explicit RawLoader(std::shared_ptr<DiskCache> disk_cache = nullptr, RawInput input = RawInput::kFile);
+
+    // Reads the metadata and the embedded preview but not the sensor data, which is enough to show the image.
+    // Returns nullptr if the file cannot be opened. A mapped file stays mapped until the LibRaw is destroyed, its
+    // pages are released once Unpack has read them.
+    std::unique_ptr<LibRaw> OpenRaw(const std::string& file_name);
+    // Reads the sensor data of a file opened with OpenRaw, the slow part of loading. Returns false on failure. Follow
+    // it with CreateRawFile and drop the LibRaw, which holds the sensor data at 16 bits with the masked borders.
+    static auto Unpack(LibRaw& raw) -> bool;
+    // OpenRaw, Unpack and CreateRawFile. Returns nullptr if the file cannot be opened or unpacked.
+    auto LoadRaw(const std::string& file_name) -> std::unique_ptr<RawFile>;
+    // CreateThumbnail of a file opened with OpenRaw, looked up in and added to the disk cache if there is one.
+    // Targets that decode at the same DCT scale share an entry.
+    auto Thumbnail(const LibRaw& raw, const std::optional<FileIdentity>& source, int target_width = 0,
+                   int target_height = 0) -> RgbImage;
 
    private:
-    int _cache;
+    std::shared_ptr<DiskCache> _disk_cache;
+    RawInput _input;
 };
 
 }  // namespace brightroom
\ No newline at end of file
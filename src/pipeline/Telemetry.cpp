@@ -0,0 +1,106 @@
+#include "Telemetry.h"
+#include <HalideRuntime.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <numeric>
+#include <thread>
+#include "TracyC.h"
+
+namespace {
+
+auto BeginZone(std::string_view name) -> TracyCZoneCtx {
+    constexpr std::string_view kSource = __FILE__;
+    const auto source_location = ___tracy_alloc_srcloc_name(__LINE__, kSource.data(), kSource.size(), name.data(),
+                                                            name.size(), name.data(), name.size(), 0);
+    return ___tracy_emit_zone_begin_alloc(source_location, 1);
+}
+
+#ifdef BRIGHTROOM_HALIDE_TRACE
+// Halide emits the begin and end events of a pipeline or a Func production on the same thread, so each thread keeps
+// its open zones as a stack
+auto TraceToTracy(void* /*user_context*/, const halide_trace_event_t* event) -> int32_t {
+    thread_local std::vector<TracyCZoneCtx> open_zones;
+    switch (event->event) {
+        case halide_trace_begin_pipeline:
+        case halide_trace_produce:
+            open_zones.push_back(BeginZone(event->func));
+            break;
+        case halide_trace_end_pipeline:
+        case halide_trace_end_produce:
+            if (!open_zones.empty()) {
+                ___tracy_emit_zone_end(open_zones.back());
+                open_zones.pop_back();
+            }
+            break;
+        default:
+            break;
+    }
+    // Begin events need an id unique within the pipeline run
+    static std::atomic<int32_t> next_id{1};
+    return next_id.fetch_add(1, std::memory_order_relaxed);
+}
+#endif
+
+}  // namespace
+
+namespace brightroom {
+
+auto PipelineTelemetry::StageDuration(std::string_view name) const -> std::chrono::nanoseconds {
+    return std::accumulate(stages.begin(), stages.end(), std::chrono::nanoseconds{0},
+                           [name](auto sum, const auto& stage) {
+                               return stage.name == name ? sum + stage.duration : sum;
+                           });
+}
+
+StageTimer::StageTimer(PipelineTelemetry& telemetry, std::string_view name)
+    : _telemetry(telemetry), _name(name), _start(std::chrono::steady_clock::now()) {
+    const auto zone = BeginZone(name);
+    _zone_id = zone.id;
+    _zone_active = zone.active;
+}
+
+StageTimer::~StageTimer() {
+    _telemetry.stages.push_back({std::string(_name), std::chrono::steady_clock::now() - _start});
+    ___tracy_emit_zone_end(TracyCZoneCtx{_zone_id, _zone_active});
+}
+
+namespace {
+// Count of the last SetHalideThreadCount, 0 before the first one
+std::atomic<int> halide_threads{0};
+}  // namespace
+
+void SetHalideThreadCount(int threads) {
+    halide_threads.store(threads, std::memory_order_relaxed);
+    halide_set_num_threads(threads);
+}
+
+auto HalideThreadCount() -> int {
+    if (const int threads = halide_threads.load(std::memory_order_relaxed); threads > 0) {
+        return threads;
+    }
+    if (const char* threads = std::getenv("HL_NUM_THREADS"); threads != nullptr && std::atoi(threads) > 0) {
+        return std::atoi(threads);
+    }
+    return static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+}
+
+void PlotTelemetry(const char* duration_plot, const char* allocation_plot, const PipelineTelemetry& telemetry) {
+    ___tracy_emit_plot(duration_plot, std::chrono::duration<double, std::milli>(telemetry.total).count());
+    ___tracy_emit_plot(allocation_plot, static_cast<double>(telemetry.bytes_allocated));
+}
+
+void PlotMilliseconds(const char* plot, double milliseconds) {
+    ___tracy_emit_plot(plot, milliseconds);
+}
+
+void InstallHalideTraceHooks() {
+#ifdef BRIGHTROOM_HALIDE_TRACE
+    static std::once_flag installed;
+    std::call_once(installed, [] { halide_set_custom_trace(TraceToTracy); });
+#endif
+}
+
+}  // namespace brightroom
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace brightroom {
+
+struct StageTiming {
+    std::string name;
+    std::chrono::nanoseconds duration{0};
+};
+
+// What one Preprocess or Process call spent its time and memory on
+struct PipelineTelemetry {
+    std::vector<StageTiming> stages;  // In execution order, a stage run repeatedly appears once per run
+    std::chrono::nanoseconds total{0};
+    // Buffers the call allocated on the host. The scratch Halide allocates inside the generators is not counted.
+    std::size_t bytes_allocated = 0;
+    // Halide worker threads available to the call. An adjustment stack runs on a runtime of its own, see
+    // AdjustmentCompiler.
+    int threads = 0;
+
+    // Sum over every run of the stage
+    auto StageDuration(std::string_view name) const -> std::chrono::nanoseconds;
+};
+
+// Times one stage of a call into its telemetry and shows it as a Tracy zone of the same name
+class StageTimer {
+   public:
+    StageTimer(PipelineTelemetry& telemetry, std::string_view name);
+    ~StageTimer();
+    StageTimer(const StageTimer&) = delete;
+    auto operator=(const StageTimer&) -> StageTimer& = delete;
+
+   private:
+    PipelineTelemetry& _telemetry;
+    std::string_view _name;
+    std::chrono::steady_clock::time_point _start;
+    uint32_t _zone_id = 0;  // TracyCZoneCtx
+    int _zone_active = 0;
+};
+
+// Sizes the Halide runtime thread pool. Brightroom sets the count only through here, the runtime cannot report it.
+void SetHalideThreadCount(int threads);
+// Worker threads of the Halide runtime thread pool: the last SetHalideThreadCount, else HL_NUM_THREADS or the
+// hardware concurrency like Halide does
+auto HalideThreadCount() -> int;
+
+// Plots the totals of a call in Tracy. The plot names must be string literals, Tracy identifies plots by pointer.
+void PlotTelemetry(const char* duration_plot, const char* allocation_plot, const PipelineTelemetry& telemetry);
+// Plots a duration in milliseconds in Tracy, plot a string literal as for PlotTelemetry
+void PlotMilliseconds(const char* plot, double milliseconds);
+
+// Shows the pipelines and Funcs of generators built with BRIGHTROOM_HALIDE_TRACE as Tracy zones. Does nothing
+// in other builds. Safe to call more than once.
+void InstallHalideTraceHooks();
+
+}  // namespace brightroom
@@ -0,0 +1,48 @@
+#include "Tiling.h"
+#include <algorithm>
+#include <cstdint>
+
+namespace brightroom {
+
+namespace {
+// Floats a strip's stages may be wider than the tile by, the schedule rounds them up to whole vectors
+constexpr int kVectorSlack = 16;
+}  // namespace
+
+auto PlanTiles(int width, int height, Demosaic demosaic, size_t intermediate_sample_bytes, size_t output_sample_bytes,
+               size_t sensor_bytes, int threads, size_t max_working_set) -> TilePlan {
+    TilePlan plan;
+    plan.halo = DemosaicHalo(demosaic);
+    auto working_set = [&] {
+        const auto band_rows = static_cast<size_t>(std::min(plan.tile_height + 2 * plan.halo, height));
+        const size_t sensor_rows = static_cast<size_t>(width) * band_rows * sizeof(uint16_t);
+        const size_t tiles = static_cast<size_t>(plan.concurrency) * plan.tile_width * plan.tile_height * 3 *
+                             intermediate_sample_bytes;
+        const size_t output_bands = size_t{2} * width * plan.tile_height * 3 * output_sample_bytes;
+        // Every thread may be demosaicing a strip of one of the concurrent tiles
+        const int tile_strips = (plan.tile_height + kDemosaicStripRows - 1) / kDemosaicStripRows;
+        const auto strips = static_cast<size_t>(std::clamp(threads, 1, plan.concurrency * tile_strips));
+        const auto strip_width = static_cast<size_t>(plan.tile_width + 2 * plan.halo + kVectorSlack);
+        const auto strip_rows = static_cast<size_t>(std::min(kDemosaicStripRows, plan.tile_height) + 2 * plan.halo);
+        plan.scratch = strips * DemosaicScratchPlanes(demosaic) * strip_width * strip_rows * sizeof(float);
+        return sensor_bytes + sensor_rows + tiles + output_bands + plan.scratch;
+    };
+    for (int size = kMaxTileSize; size >= kMinTileSize; size /= 2) {
+        plan.tile_width = std::min(size, width);
+        plan.tile_height = std::min(size, height);
+        const int columns = (width + plan.tile_width - 1) / plan.tile_width;
+        plan.concurrency = std::clamp(threads, 1, std::max(1, columns));
+        plan.working_set = working_set();
+        if (plan.working_set <= max_working_set) {
+            return plan;
+        }
+    }
+    while (plan.concurrency > 1 && plan.working_set > max_working_set) {
+        --plan.concurrency;
+        plan.working_set = working_set();
+    }
+    plan.within_limit = plan.working_set <= max_working_set;
+    return plan;
+}
+
+}  // namespace brightroom
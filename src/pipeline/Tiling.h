@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include "IRawPipeline.h"
+
+namespace brightroom {
+
+// Sensor pixels a demosaic engine reads beyond the pixel it interpolates, in every direction. A tile demosaiced
+// from its sensor data plus this halo matches the same pixels of the full-frame demosaic exactly. Must follow the
+// stencils in halide/functions.h.
+constexpr auto DemosaicHalo(Demosaic demosaic) -> int {
+    switch (demosaic) {
+        case Demosaic::kBilinear:
+            return 1;  // The 3x3 neighbourhood
+        case Demosaic::kMalvarHeCutler:
+            return 2;  // The 5x5 kernels
+        case Demosaic::kRcd:
+            // 7-tap energies (3), summed along the direction (4) and refined diagonally (5) for the direction
+            // weights, the diagonal gradients compare green two pixels away (7) and red and blue at green pixels
+            // read red_blue three pixels away (10)
+            return 10;
+    }
+    return 0;
+}
+
+// Output rows of the strips the default preprocess schedule demosaics in parallel, kRowsPerTask in
+// halide/strips.h
+constexpr int kDemosaicStripRows = 32;
+
+// Float planes the default preprocess schedule computes for every strip it demosaics, each as wide as the tile and
+// as high as the strip, both plus the halo. Halide allocates them inside the generator for as long as the strip
+// takes. Must follow the schedule in halide/generator.cpp.
+constexpr auto DemosaicScratchPlanes(Demosaic demosaic) -> int {
+    switch (demosaic) {
+        case Demosaic::kBilinear:
+        case Demosaic::kMalvarHeCutler:
+            return 1;  // The black and white levelled CFA
+        case Demosaic::kRcd:
+            // The levelled CFA, nine single-channel stages and red_blue, which has all three channels
+            return 13;
+    }
+    return 0;
+}
+
+// How a tiled export splits the frame. Tiles of tile_width x tile_height output pixels are demosaiced and rendered
+// in parallel, a band of tile_height rows at a time, and each band is encoded while the next one renders.
+struct TilePlan {
+    int tile_width = 0;
+    int tile_height = 0;
+    int halo = 0;
+    int concurrency = 0;       // Tiles rendered at the same time
+    size_t working_set = 0;    // Bytes of the memory the export holds, see PlanTiles
+    size_t scratch = 0;        // Of those, Halide's intermediates inside the demosaic
+    bool within_limit = true;  // False if even the smallest tiles on one thread exceed the limit
+};
+
+// Largest square tiles, at most kMaxTileSize and at least kMinTileSize wide, whose working set fits in
+// max_working_set: the sensor_bytes of packed sensor data the export reads from, the unpacked sensor rows of one band
+// with its halo, the intermediate of every concurrent tile, two output bands and the DemosaicScratchPlanes of the
+// strips threads demosaic at once. If the smallest tiles do not fit either, fewer of them are rendered at once, down
+// to one. A plan that still exceeds the limit has within_limit false and is left to the caller to report.
+auto PlanTiles(int width, int height, Demosaic demosaic, size_t intermediate_sample_bytes, size_t output_sample_bytes,
+               size_t sensor_bytes, int threads, size_t max_working_set) -> TilePlan;
+
+constexpr int kMaxTileSize = 512;
+constexpr int kMinTileSize = 32;
+
+}  // namespace brightroom
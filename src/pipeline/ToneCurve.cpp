@@ -0,0 +1,18 @@
+#include "ToneCurve.h"
+#include <algorithm>
+#include <cmath>
+
+namespace brightroom {
+
+void BakeToneCurve(float contrast_factor, std::span<float> curve) {
+    constexpr float kGamma = 1.0f / 2.2f;
+    constexpr float kMidpoint = 0.5f;
+    const float step = 1.0f / static_cast<float>(curve.size() - 1);
+    for (size_t i = 0; i < curve.size(); ++i) {
+        const float root = static_cast<float>(i) * step;
+        const float gamma_corrected = std::pow(root * root, kGamma);
+        curve[i] = std::clamp((gamma_corrected - kMidpoint) * contrast_factor + kMidpoint, 0.0f, 1.0f);
+    }
+}
+
+}  // namespace brightroom
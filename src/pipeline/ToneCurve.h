@@ -0,0 +1,15 @@
+#pragma once
+
+#include <span>
+
+namespace brightroom {
+
+// Samples in a baked tone curve
+constexpr int kToneCurveSize = 4096;
+
+// Fills curve with gamma correction followed by the contrast adjustment. Sample i holds the value for the input
+// (i / (curve.size() - 1))^2, which is how ApplyCurve in halide/functions.h indexes it. Must match GammaCorrection
+// and ContrastAdjustment there.
+void BakeToneCurve(float contrast_factor, std::span<float> curve);
+
+}  // namespace brightroom
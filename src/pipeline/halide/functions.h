@@ -1,10 +1,28 @@
 #pragma once
 
 #include <Halide.h>
+#include <vector>
 
 using namespace Halide;
 namespace brightroom {
 
+// Storage of the demosaiced intermediate between the preprocess and process generators. Unsigned integer types hold
+// values in [0, 1] normalized to the full range of the type, floating point types hold them as they are.
+inline auto EncodeIntermediate(Halide::Expr value, Halide::Type type) -> Halide::Expr {
+    if (type.is_uint()) {
+        Halide::Expr max_value = Halide::cast<float>(type.max());
+        return Halide::cast(type, Halide::clamp(Halide::round(value * max_value), 0.0f, max_value));
+    }
+    return Halide::cast(type, value);
+}
+
+inline auto DecodeIntermediate(Halide::Expr value) -> Halide::Expr {
+    if (value.type().is_uint()) {
+        return Halide::cast<float>(value) * (1.0f / Halide::cast<float>(value.type().max()));
+    }
+    return Halide::cast<float>(value);
+}
+
 inline auto FC(Halide::Var x, Halide::Var y, Halide::Expr filters) -> Halide::Func {
     Halide::Func fc("fc");
     fc(x, y) = Halide::cast<uint16_t>(filters >> (((y << 1 & 14) | (x & 1)) << 1) & 3);
@@ -80,70 +98,237 @@ inline auto DemosaicBilinear(Halide::Func input, Halide::Var x, Halide::Var y, H
     return demosaiced;
 }
 
-inline auto LogSum(Halide::Func input, Halide::Var x, Halide::Var y, Expr width, Expr height) -> Halide::Func {
-    Halide::Func luminance("luminance");
-    luminance(x, y) = 0.2126f * input(x, y, 0) + 0.7152f * input(x, y, 1) + 0.0722f * input(x, y, 2);
+// Malvar, He and Cutler, "High-quality linear interpolation for demosaicing of Bayer-patterned color images" (2004).
+// Bilinear interpolation corrected by the Laplacian of the channel sampled at the pixel, 5x5 kernels in eighths.
+// Removes most of the bilinear zippers at about the same cost.
+inline auto DemosaicMalvarHeCutler(Halide::Func input, Halide::Var x, Halide::Var y, Halide::Var c,
+                                   Halide::Func fc) -> Halide::Func {
+    Halide::Func demosaiced("demosaiced_mhc");
+    auto at = [&](int dx, int dy) { return input(x + dx, y + dy); };
+    Halide::Expr center = at(0, 0);
+    Halide::Expr row = at(-1, 0) + at(1, 0);
+    Halide::Expr column = at(0, -1) + at(0, 1);
+    Halide::Expr diagonals = at(-1, -1) + at(1, -1) + at(-1, 1) + at(1, 1);
+    Halide::Expr row_2 = at(-2, 0) + at(2, 0);
+    Halide::Expr column_2 = at(0, -2) + at(0, 2);
+
+    Halide::Expr green_at_rb = (4.0f * center + 2.0f * (row + column) - row_2 - column_2) / 8.0f;
+    // Red or blue at a green pixel, from the row or the column that holds the channel
+    Halide::Expr from_row = (5.0f * center + 4.0f * row - diagonals - row_2 + 0.5f * column_2) / 8.0f;
+    Halide::Expr from_column = (5.0f * center + 4.0f * column - diagonals - column_2 + 0.5f * row_2) / 8.0f;
+    // Red at a blue pixel and blue at a red one
+    Halide::Expr from_diagonals = (6.0f * center + 2.0f * diagonals - 1.5f * (row_2 + column_2)) / 8.0f;
 
-    Halide::Func log_luminance("log_luminance");
-    log_luminance(x, y) = Halide::log(Halide::max(luminance(x, y), 1e-6f));
+    auto color = fc(x, y);
+    Halide::Expr at_green = (color == 1) || (color == 3);
+    Halide::Expr red = Halide::select(color == 0, center,                                           // At red pixel
+                                      at_green, Halide::select(fc(x + 1, y) == 0, from_row, from_column),
+                                      from_diagonals);                                              // At blue pixel
+    Halide::Expr green = Halide::select(at_green, center, green_at_rb);
+    Halide::Expr blue = Halide::select(color == 2, center,                                          // At blue pixel
+                                       at_green, Halide::select(fc(x + 1, y) == 2, from_row, from_column),
+                                       from_diagonals);                                             // At red pixel
+
+    // The corrections overshoot at hard edges
+    demosaiced(x, y, c) = Halide::clamp(Halide::select(c == 0, red, c == 1, green, blue), 0.0f, 1.0f);
+    return demosaiced;
+}
 
-    Halide::RDom r(0, width, 0, height);
-    Halide::Func log_sum("log_sum");
-    log_sum() = Halide::sum(log_luminance(r.x, r.y));
+// Ratio Corrected Demosaicing by Luis Sanz Rodriguez, as in RawTherapee and darktable. Green is interpolated along
+// the direction with less high-frequency energy, from neighbours scaled by the ratio of a low-pass estimate. Red and
+// blue follow from colour differences to green: along the quieter diagonal at blue and red pixels, then along the
+// quieter axis at green pixels. No zippers or mazes, several times the cost of bilinear. stages receives the
+// intermediate stages in the order they are computed, for the caller to schedule.
+inline auto DemosaicRcd(Halide::Func input, Halide::Var x, Halide::Var y, Halide::Var c, Halide::Func fc,
+                        std::vector<Halide::Func>& stages) -> Halide::Func {
+    constexpr float kEps = 1e-5f;
+    constexpr float kEpsSquared = 1e-10f;
+    Halide::Func cfa("rcd_cfa");
+    cfa(x, y) = input(x, y);
+    auto at = [&](int dx, int dy) { return cfa(x + dx, y + dy); };
+    auto color = fc(x, y);
+    Halide::Expr at_green = (color == 1) || (color == 3);
 
-    Halide::Var yo, yi;
-    log_luminance.split(y, yo, yi, 16);
-    log_luminance.parallel(yo);
-    log_luminance.vectorize(x, 8);
-    log_luminance.compute_root();
+    // Squared 7-tap high-pass along (dx, dy)
+    auto high_pass = [&](const char* name, int dx, int dy) {
+        Halide::Func energy(name);
+        auto tap = [&](int i) { return at(i * dx, i * dy); };
+        Halide::Expr value = (tap(-3) - tap(-1) - tap(1) + tap(3)) - 3.0f * (tap(-2) + tap(2)) + 6.0f * tap(0);
+        energy(x, y) = value * value;
+        return energy;
+    };
+    // Share of the first direction in the energy of both, each summed over three samples along itself. Near 1 means
+    // the signal changes along the first direction, so the second one is interpolated along.
+    auto discrimination = [&](const char* name, Halide::Func first, int fx, int fy, Halide::Func second, int sx,
+                              int sy) {
+        Halide::Func share(name);
+        Halide::Expr first_energy =
+            Halide::max(kEpsSquared, first(x - fx, y - fy) + first(x, y) + first(x + fx, y + fy));
+        Halide::Expr second_energy =
+            Halide::max(kEpsSquared, second(x - sx, y - sy) + second(x, y) + second(x + sx, y + sy));
+        share(x, y) = first_energy / (first_energy + second_energy);
+        return share;
+    };
+    // The average of the diagonal neighbours replaces the pixel's own share where it is further from undecided
+    auto refined = [&](Halide::Func share) {
+        Halide::Expr own = share(x, y);
+        Halide::Expr neighbourhood =
+            0.25f * (share(x - 1, y - 1) + share(x + 1, y - 1) + share(x - 1, y + 1) + share(x + 1, y + 1));
+        return Halide::select(Halide::abs(0.5f - own) < Halide::abs(0.5f - neighbourhood), neighbourhood, own);
+    };
+
+    Halide::Func vertical_energy = high_pass("rcd_vertical_energy", 0, 1);
+    Halide::Func horizontal_energy = high_pass("rcd_horizontal_energy", 1, 0);
+    Halide::Func vh_share = discrimination("rcd_vh_share", vertical_energy, 0, 1, horizontal_energy, 1, 0);
+    Halide::Expr vh = refined(vh_share);
+
+    // Green at red and blue pixels
+    Halide::Func low_pass("rcd_low_pass");
+    low_pass(x, y) = at(0, 0) + 0.5f * (at(-1, 0) + at(1, 0) + at(0, -1) + at(0, 1)) +
+                     0.25f * (at(-1, -1) + at(1, -1) + at(-1, 1) + at(1, 1));
+    auto gradient = [&](int dx, int dy) {
+        return kEps + Halide::abs(at(-dx, -dy) - at(dx, dy)) + Halide::abs(at(0, 0) - at(2 * dx, 2 * dy)) +
+               Halide::abs(at(dx, dy) - at(3 * dx, 3 * dy)) + Halide::abs(at(2 * dx, 2 * dy) - at(4 * dx, 4 * dy));
+    };
+    auto ratio_estimate = [&](int dx, int dy) {
+        Halide::Expr own = low_pass(x, y);
+        Halide::Expr other = low_pass(x + 2 * dx, y + 2 * dy);
+        return at(dx, dy) * (1.0f + (own - other) / (kEps + own + other));
+    };
+    Halide::Expr n_gradient = gradient(0, -1), s_gradient = gradient(0, 1);
+    Halide::Expr w_gradient = gradient(-1, 0), e_gradient = gradient(1, 0);
+    Halide::Expr v_estimate = (s_gradient * ratio_estimate(0, -1) + n_gradient * ratio_estimate(0, 1)) /
+                              (n_gradient + s_gradient);
+    Halide::Expr h_estimate = (e_gradient * ratio_estimate(-1, 0) + w_gradient * ratio_estimate(1, 0)) /
+                              (w_gradient + e_gradient);
+    Halide::Func green("rcd_green");
+    green(x, y) = Halide::select(at_green, at(0, 0), vh * h_estimate + (1.0f - vh) * v_estimate);
+
+    // Blue at red pixels and red at blue pixels, the diagonal neighbours hold the missing channel
+    Halide::Func p_energy = high_pass("rcd_p_energy", 1, 1);
+    Halide::Func q_energy = high_pass("rcd_q_energy", 1, -1);
+    Halide::Func pq_share = discrimination("rcd_pq_share", p_energy, 1, 1, q_energy, 1, -1);
+    Halide::Expr pq = refined(pq_share);
+    auto diagonal_gradient = [&](int dx, int dy) {
+        return kEps + Halide::abs(at(-1, -dx * dy) - at(1, dx * dy)) + Halide::abs(at(dx, dy) - at(3 * dx, 3 * dy)) +
+               Halide::abs(green(x, y) - green(x + 2 * dx, y + 2 * dy));
+    };
+    auto difference = [&](int dx, int dy) { return at(dx, dy) - green(x + dx, y + dy); };
+    Halide::Expr nw_gradient = diagonal_gradient(-1, -1), se_gradient = diagonal_gradient(1, 1);
+    Halide::Expr ne_gradient = diagonal_gradient(1, -1), sw_gradient = diagonal_gradient(-1, 1);
+    Halide::Expr p_estimate = (nw_gradient * difference(1, 1) + se_gradient * difference(-1, -1)) /
+                              (nw_gradient + se_gradient);
+    Halide::Expr q_estimate = (ne_gradient * difference(-1, 1) + sw_gradient * difference(1, -1)) /
+                              (ne_gradient + sw_gradient);
+    Halide::Func opposite("rcd_opposite");
+    opposite(x, y) = green(x, y) + pq * q_estimate + (1.0f - pq) * p_estimate;
+
+    // Red and blue at every red and blue pixel
+    Halide::Func red_blue("rcd_red_blue");
+    red_blue(x, y, c) = Halide::select(Halide::cast<int>(fc(x, y)) == c, at(0, 0), opposite(x, y));
+
+    // Red and blue at green pixels, the row and the column each hold one of them sampled and one interpolated
+    auto rb = [&](int dx, int dy) { return red_blue(x + dx, y + dy, c); };
+    auto green_step = [&](int dx, int dy) { return kEps + Halide::abs(green(x, y) - green(x + dx, y + dy)); };
+    Halide::Expr column_change = Halide::abs(rb(0, -1) - rb(0, 1));
+    Halide::Expr row_change = Halide::abs(rb(-1, 0) - rb(1, 0));
+    Halide::Expr n_rb_gradient = green_step(0, -2) + column_change + Halide::abs(rb(0, -1) - rb(0, -3));
+    Halide::Expr s_rb_gradient = green_step(0, 2) + column_change + Halide::abs(rb(0, 1) - rb(0, 3));
+    Halide::Expr w_rb_gradient = green_step(-2, 0) + row_change + Halide::abs(rb(-1, 0) - rb(-3, 0));
+    Halide::Expr e_rb_gradient = green_step(2, 0) + row_change + Halide::abs(rb(1, 0) - rb(3, 0));
+    auto rb_difference = [&](int dx, int dy) { return rb(dx, dy) - green(x + dx, y + dy); };
+    Halide::Expr v_rb_estimate = (n_rb_gradient * rb_difference(0, 1) + s_rb_gradient * rb_difference(0, -1)) /
+                                 (n_rb_gradient + s_rb_gradient);
+    Halide::Expr h_rb_estimate = (e_rb_gradient * rb_difference(-1, 0) + w_rb_gradient * rb_difference(1, 0)) /
+                                 (e_rb_gradient + w_rb_gradient);
+    Halide::Expr at_green_rb = green(x, y) + vh * h_rb_estimate + (1.0f - vh) * v_rb_estimate;
+
+    Halide::Func demosaiced("demosaiced_rcd");
+    demosaiced(x, y, c) = Halide::clamp(
+        Halide::select(c == 1, green(x, y), at_green, at_green_rb, red_blue(x, y, c)), 0.0f, 1.0f);
+    stages = {vertical_energy, horizontal_energy, vh_share, low_pass, green, p_energy, q_energy, pq_share, opposite,
+              red_blue};
+    return demosaiced;
+}
 
-    luminance.store_at(log_luminance, yo);
-    luminance.compute_at(log_luminance, yi);
-    luminance.vectorize(x, 8);
+// Collapses every 2x2 CFA quad into one RGB pixel without interpolation. Output (x, y) covers input
+// (2x..2x+1, 2y..2y+1); the two greens of the quad are averaged.
+inline auto BinBayer(Halide::Func input, Halide::Var x, Halide::Var y, Halide::Var c, Halide::Func fc) -> Halide::Func {
+    Halide::Func binned("binned");
+    Halide::Expr red = 0.0f, green = 0.0f, blue = 0.0f;
+    for (int dy = 0; dy < 2; dy++) {
+        for (int dx = 0; dx < 2; dx++) {
+            Halide::Expr value = input(2 * x + dx, 2 * y + dy);
+            Halide::Expr color = fc(2 * x + dx, 2 * y + dy);
+            red += Halide::select(color == 0, value, 0.0f);
+            green += Halide::select(color == 1 || color == 3, value, 0.0f);
+            blue += Halide::select(color == 2, value, 0.0f);
+        }
+    }
+    binned(x, y, c) = Halide::select(c == 0, red, c == 1, green * 0.5f, blue);
+    return binned;
+}
 
-    return log_sum;
+// Box-filters factor x factor blocks, so output (x, y) covers input [x * factor, (x + 1) * factor)
+inline auto Downscale(Halide::Func input, Halide::Var x, Halide::Var y, Halide::Var c, Expr factor) -> Halide::Func {
+    Halide::Func downscaled("downscaled");
+    Halide::RDom r(0, factor, 0, factor);
+    Halide::Expr weight = 1.0f / Halide::cast<float>(factor * factor);
+    downscaled(x, y, c) = Halide::sum(input(x * factor + r.x, y * factor + r.y, c)) * weight;
+    return downscaled;
 }
 
-inline auto ToneMapping(Halide::Func input, Halide::Var x, Halide::Var y, Halide::Var c, Expr log_avg,
-                        Expr key_value = 0.18f) -> Halide::Func {
-    Halide::Func tone_mapped("tone_mapped");
+// Sum of the log luminance over [0, width) x [0, height). Each row is reduced into row_sums first, so the rows can be
+// reduced in parallel and only height values are summed serially.
+inline auto LogSum(Halide::Func input, Halide::Var x, Halide::Var y, Expr width, Expr height,
+                   Halide::Func& row_sums) -> Halide::Func {
     Halide::Func luminance("luminance");
-
     luminance(x, y) = 0.2126f * input(x, y, 0) + 0.7152f * input(x, y, 1) + 0.0722f * input(x, y, 2);
 
-    Halide::Expr scale_factor = key_value / log_avg;
+    Halide::Func log_luminance("log_luminance");
+    log_luminance(x, y) = Halide::log(Halide::max(luminance(x, y), 1e-6f));
 
-    Halide::Expr lum = luminance(x, y);
-    Halide::Expr mapped_lum = (lum * scale_factor) / (1.0f + lum * scale_factor);
-    Halide::Expr scale = mapped_lum / (lum + 1e-6f);
+    Halide::RDom columns(0, width, "columns");
+    row_sums = Halide::Func("log_row_sums");
+    row_sums(y) = Halide::sum(log_luminance(columns, y));
 
-    tone_mapped(x, y, c) = Halide::clamp(input(x, y, c) * scale, 0.0f, 1.0f);
+    Halide::RDom rows(0, height, "rows");
+    Halide::Func log_sum("log_sum");
+    log_sum() = Halide::sum(row_sums(rows));
+    return log_sum;
+}
 
-    // luminance.compute_root().parallel(y).vectorize(x, 8);
-    // tone_mapped.compute_root().parallel(y).vectorize(x, 8);
+// Rows 0 to 2 of matrix take camera RGB to linear sRGB, with white balance and exposure folded in on the host (see
+// ColorMatrix.h). Row 3 holds the luminance weights of the white-balanced, exposed camera RGB, so converted(x, y, 3)
+// is the luminance tone mapping reads.
+inline auto ColorMatrix(Halide::Func input, Halide::Var x, Halide::Var y, Halide::Var c, Func matrix) -> Halide::Func {
+    Halide::Func converted("color_matrix_applied");
+    converted(x, y, c) = matrix(c, 0) * input(x, y, 0) + matrix(c, 1) * input(x, y, 1) + matrix(c, 2) * input(x, y, 2);
+    return converted;
+}
 
-    return tone_mapped;
+// Reinhard's global operator as a factor per pixel: luminance L becomes L' / (1 + L') with L' = L * key / log_avg.
+// A key of 0 leaves every pixel unscaled.
+inline auto ToneMappingScale(Halide::Func luminance, Halide::Var x, Halide::Var y, Expr log_avg,
+                             Expr key_value) -> Halide::Func {
+    Halide::Func scale("tone_mapping_scale");
+    Halide::Expr lum = Halide::max(luminance(x, y), 0.0f);
+    Halide::Expr scaled = lum * (key_value / log_avg);
+    scale(x, y) = Halide::select(key_value > 0.0f, scaled / (1.0f + scaled) / (lum + 1e-6f), 1.0f);
+    return scale;
 }
 
-inline auto Exposure(Halide::Func input, Halide::Var x, Halide::Var y, Halide::Var c, Expr exposure) -> Halide::Func {
+inline auto ExposureAdjustment(Halide::Func input, Halide::Var x, Halide::Var y, Halide::Var c,
+                               Halide::Expr stops) -> Halide::Func {
     Halide::Func exposure_adjusted("exposure_adjusted");
-    exposure_adjusted(x, y, c) = input(x, y, c) * exposure;
+    exposure_adjusted(x, y, c) = input(x, y, c) * Halide::pow(2.0f, stops);
     return exposure_adjusted;
 }
 
-inline auto ColorSpaceConversion(Halide::Func input, Halide::Var x, Halide::Var y, Halide::Var c,
-                                 Func rgb_cam) -> Halide::Func {
-    Halide::Func color_space_converted("color_space_converted");
-    color_space_converted(x, y, c) = Halide::select(
-        c == 0, rgb_cam(0, 0) * input(x, y, 0) + rgb_cam(0, 1) * input(x, y, 1) + rgb_cam(0, 2) * input(x, y, 2),
-        c == 1, rgb_cam(1, 0) * input(x, y, 0) + rgb_cam(1, 1) * input(x, y, 1) + rgb_cam(1, 2) * input(x, y, 2),
-        rgb_cam(2, 0) * input(x, y, 0) + rgb_cam(2, 1) * input(x, y, 1) + rgb_cam(2, 2) * input(x, y, 2));
-    return color_space_converted;
-}
-
-inline auto GammaCorrection(Halide::Func input, Halide::Var x, Halide::Var y, Halide::Var c) -> Halide::Func {
+inline auto GammaCorrection(Halide::Func input, Halide::Var x, Halide::Var y, Halide::Var c,
+                            Halide::Expr gamma = 2.2f) -> Halide::Func {
     Halide::Func gamma_corrected("gamma_corrected");
-    gamma_corrected(x, y, c) = Halide::pow(Halide::clamp(input(x, y, c), 0.0f, 1.0f), 1.0f / 2.2f);
+    gamma_corrected(x, y, c) = Halide::pow(Halide::clamp(input(x, y, c), 0.0f, 1.0f), 1.0f / gamma);
     return gamma_corrected;
 }
 
@@ -154,6 +339,18 @@ inline auto ContrastAdjustment(Halide::Func input, Halide::Var x, Halide::Var y,
     return contrast_adjusted;
 }
 
+// Looks up a curve sampled at size points evenly spaced in sqrt(input) over [0, 1], interpolating linearly between
+// samples. Sampling in the square root keeps the steep start of gamma curves accurate.
+inline auto ApplyCurve(Halide::Func input, Halide::Var x, Halide::Var y, Halide::Var c, Halide::Func curve,
+                       Expr size) -> Halide::Func {
+    Halide::Func curve_applied("curve_applied");
+    Halide::Expr position = Halide::sqrt(Halide::clamp(input(x, y, c), 0.0f, 1.0f)) * Halide::cast<float>(size - 1);
+    Halide::Expr index = Halide::clamp(Halide::cast<int>(position), 0, size - 2);
+    Halide::Expr fraction = position - Halide::cast<float>(index);
+    curve_applied(x, y, c) = Halide::lerp(curve(index), curve(index + 1), fraction);
+    return curve_applied;
+}
+
 inline auto SaturationAdjustment(Halide::Func input, Halide::Var x, Halide::Var y, Halide::Var c,
                                  Expr saturation_factor) -> Halide::Func {
     Halide::Func saturation_adjusted("saturation_adjusted");
@@ -183,10 +380,79 @@ inline auto SaturationAdjustment(Halide::Func input, Halide::Var x, Halide::Var
     return saturation_adjusted;
 }
 
+// 256-bin histograms of the R, G, B and luma channels of an 8-bit frame, channel 3 being luma. Rows are counted in
+// blocks of block_rows with one partial histogram each, so the blocks can be reduced in parallel before they are
+// summed. Covers x in [x0, x0 + width) and y in [y0, y0 + height), an empty range gives an all-zero histogram.
+inline auto Histogram(Halide::Func rgb8, Halide::Expr x0, Halide::Expr y0, Halide::Expr width, Halide::Expr height,
+                      Halide::Func& partial, int block_rows = 32) -> Halide::Func {
+    Halide::Var bin("bin"), channel("channel"), block("block");
+    Halide::RDom r(0, width, 0, block_rows, "r");
+    Halide::Expr row = block * block_rows + r.y;
+    r.where(row < height);
+    Halide::Expr px = x0 + r.x;
+    Halide::Expr py = y0 + row;
+    Halide::Expr red = Halide::cast<int>(rgb8(px, py, 0));
+    Halide::Expr green = Halide::cast<int>(rgb8(px, py, 1));
+    Halide::Expr blue = Halide::cast<int>(rgb8(px, py, 2));
+    // Rec. 709 weights in 1/256 steps, summing to 256
+    Halide::Expr luma = (54 * red + 183 * green + 19 * blue + 128) >> 8;
+    Halide::Expr value = Halide::select(channel == 0, red, channel == 1, green, channel == 2, blue, luma);
+
+    partial = Halide::Func("partial_histogram");
+    partial(bin, channel, block) = Halide::cast<uint32_t>(0);
+    partial(Halide::clamp(value, 0, 255), channel, block) += Halide::cast<uint32_t>(1);
+
+    Halide::RDom blocks(0, (height + block_rows - 1) / block_rows, "blocks");
+    Halide::Func histogram("histogram");
+    histogram(bin, channel) = Halide::sum(partial(bin, channel, blocks));
+    return histogram;
+}
+
 inline auto ToRgb8(Halide::Func input, Halide::Var x, Halide::Var y, Halide::Var c) -> Halide::Func {
     Halide::Func rgb8("rgb8");
     rgb8(x, y, c) = Halide::cast<uint8_t>(Halide::clamp(Halide::round(input(x, y, c) * 255.0f), 0.0f, 255.0f));
     return rgb8;
 }
 
+inline auto ToRgb16(Halide::Func input, Halide::Var x, Halide::Var y, Halide::Var c) -> Halide::Func {
+    Halide::Func rgb16("rgb16");
+    rgb16(x, y, c) =
+        Halide::cast<uint16_t>(Halide::clamp(Halide::round(input(x, y, c) * 65535.0f), 0.0f, 65535.0f));
+    return rgb16;
+}
+
+// The stages of an edit that read exposure and the tone mapping key: resampling to output resolution, the folded
+// colour matrix and tone mapping, giving linear sRGB. Everything up to the matrix is linear, so averaging first is
+// equivalent to averaging the result and keeps the remaining stages at output resolution. resampled receives the
+// input at output resolution, which every output channel reads all three channels of.
+inline auto LinearStages(Halide::Func input, Halide::Var x, Halide::Var y, Halide::Var c, Expr downscale,
+                         Func color_matrix, Expr log_average, Expr key_value, Halide::Func& resampled) -> Halide::Func {
+    Halide::Func decoded("decoded");
+    decoded(x, y, c) = DecodeIntermediate(input(x, y, c));
+    resampled = Downscale(decoded, x, y, c, downscale);
+    Halide::Func converted = ColorMatrix(resampled, x, y, c, color_matrix);
+
+    Halide::Func luminance("luminance");
+    luminance(x, y) = converted(x, y, 3);
+    Halide::Func scale = ToneMappingScale(luminance, x, y, log_average, key_value);
+    Halide::Func linear("linear");
+    linear(x, y, c) = converted(x, y, c) * scale(x, y);
+    return linear;
+}
+
+// The stages of an edit that read contrast and saturation, from linear sRGB to display values in [0, 1] before
+// quantization. toned receives the values after gamma and contrast, which saturation reads all three channels of.
+inline auto DisplayStages(Halide::Func linear, Halide::Var x, Halide::Var y, Halide::Var c, Expr contrast_factor,
+                          Expr saturation_factor, Halide::Func& toned) -> Halide::Func {
+    toned = ContrastAdjustment(GammaCorrection(linear, x, y, c), x, y, c, contrast_factor);
+    return SaturationAdjustment(toned, x, y, c, saturation_factor);
+}
+
+// As above with gamma and contrast a lookup into curve, which is then defined over [0, curve_size)
+inline auto DisplayStages(Halide::Func linear, Halide::Var x, Halide::Var y, Halide::Var c, Halide::Func curve,
+                          Expr curve_size, Expr saturation_factor, Halide::Func& toned) -> Halide::Func {
+    toned = ApplyCurve(linear, x, y, c, curve, curve_size);
+    return SaturationAdjustment(toned, x, y, c, saturation_factor);
+}
+
 }  // namespace brightroom
\ No newline at end of file
@@ -1,5 +1,24 @@
 #include <Halide.h>
+#include <algorithm>
+#include <string>
+#include <vector>
 #include "functions.h"
+#include "strips.h"
+#include "schedules/schedules.h"
+
+namespace {
+
+// Applies a schedule from halide/schedules, which CMake selects instead of the default schedule when one is checked in
+void ApplyCheckedInSchedule(const std::string& name, Halide::Pipeline pipeline, const Halide::Target& target) {
+    if (name.empty()) {
+        return;
+    }
+    auto apply_schedule = brightroom::FindSchedule(name);
+    user_assert(apply_schedule != nullptr) << "No checked-in schedule " << name << "\n";
+    apply_schedule(pipeline, target);
+}
+
+}  // namespace
 
 class PreprocessRawGenerator : public Halide::Generator<PreprocessRawGenerator> {
    public:
@@ -10,16 +29,32 @@ class PreprocessRawGenerator : public Halide::Generator<PreprocessRawGenerator>
     Input<Buffer<int, 1>> cblack{"cblack"};     // Per-channel black levels
     Input<int> white_input{"white_input"};      // White level
 
-    // Output
-    Output<Buffer<float, 3>> output{"output"};  // Intermediate output
+    // Output, the element type is chosen per library with output.type (float32, float16 or uint16)
+    Output<Buffer<void, 3>> output{"output"};  // Intermediate output
+
+    // Output size the schedule is tuned for, and the checked-in schedule to use (see src/pipeline/CMakeLists.txt)
+    GeneratorParam<int> estimate_width{"estimate_width", 6000};
+    GeneratorParam<int> estimate_height{"estimate_height", 4000};
+    GeneratorParam<std::string> checked_in_schedule{"checked_in_schedule", ""};
+
+    // Interpolation, each engine is a library of its own (see src/pipeline/CMakeLists.txt)
+    enum class Demosaic { kBilinear, kMalvarHeCutler, kRcd };
+    GeneratorParam<Demosaic> demosaic{"demosaic",
+                                      Demosaic::kBilinear,
+                                      {{"bilinear", Demosaic::kBilinear},
+                                       {"mhc", Demosaic::kMalvarHeCutler},
+                                       {"rcd", Demosaic::kRcd}}};
 
     // Intermediate stages
     Var x{"x"}, y{"y"}, c{"c"};
     Var yo{"yo"}, yi{"yi"};
 
     void generate() {
-        // Create the Bayer pattern function
-        Halide::Func input_boundary = Halide::BoundaryConditions::repeat_edge(input);
+        // Create the Bayer pattern function. The wider stencils reach far enough past the border for a repeated edge
+        // to put the wrong colour in their taps, mirroring keeps the CFA phase.
+        Halide::Func input_boundary = demosaic.value() == Demosaic::kBilinear
+                                          ? Halide::BoundaryConditions::repeat_edge(input)
+                                          : Halide::BoundaryConditions::mirror_interior(input);
         Func fc = brightroom::FC(x, y, filters);
 
         // Black level subtraction
@@ -29,76 +64,182 @@ class PreprocessRawGenerator : public Halide::Generator<PreprocessRawGenerator>
         Func white_adjusted = brightroom::WhiteLevel(black_adjusted, x, y, white_input);
 
         // Demosaic
-        Func demosaiced = brightroom::DemosaicBilinear(white_adjusted, x, y, c, fc);
+        Func demosaiced;
+        std::vector<Func> demosaic_stages;
+        switch (demosaic.value()) {
+            case Demosaic::kBilinear:
+                demosaiced = brightroom::DemosaicBilinear(white_adjusted, x, y, c, fc);
+                break;
+            case Demosaic::kMalvarHeCutler:
+                demosaiced = brightroom::DemosaicMalvarHeCutler(white_adjusted, x, y, c, fc);
+                break;
+            case Demosaic::kRcd:
+                demosaiced = brightroom::DemosaicRcd(white_adjusted, x, y, c, fc, demosaic_stages);
+                break;
+        }
 
-        output = demosaiced;
+        output(x, y, c) = brightroom::EncodeIntermediate(demosaiced(x, y, c), output.type());
 
         // For interleaved output
         output.dim(0).set_stride(3);
         output.dim(2).set_stride(1);
 
-        constexpr bool kAutoSchedule = true;
-        if (kAutoSchedule) {
-            // Let the autoscheduler handle it
-            input.set_estimates({{0, 4000}, {0, 6000}});
+        if (using_autoscheduler()) {
+            const int width = estimate_width;
+            const int height = estimate_height;
+            input.set_estimates({{0, width}, {0, height}});
             filters.set_estimate(0);
             black_level.set_estimate(0);
             cblack.set_estimates({{0, 4}});
             white_input.set_estimate(0);
-            output.set_estimates({{0, 4000}, {0, 6000}, {0, 3}});
+            output.set_estimates({{0, width}, {0, height}, {0, 3}});
+        } else if (checked_in_schedule.value().empty()) {
+            Var strip = brightroom::ScheduleRgbStrips(output, x, y, c, get_target());
+            brightroom::ComputePerStrip(white_adjusted, output, strip, get_target());
+            for (Func stage : demosaic_stages) {
+                brightroom::ComputePerStrip(stage, output, strip, get_target());
+            }
         }
+        ApplyCheckedInSchedule(checked_in_schedule, get_pipeline(), get_target());
     }
 };
 
 HALIDE_REGISTER_GENERATOR(PreprocessRawGenerator, preprocess_raw_generator)
 
-class ProcessRawGenerator : public Halide::Generator<ProcessRawGenerator> {
+// Half-resolution alternative to PreprocessRawGenerator for interactive editing: every 2x2 CFA quad becomes one
+// RGB pixel, so there is no interpolation and a quarter of the output.
+class PreviewRawGenerator : public Halide::Generator<PreviewRawGenerator> {
    public:
     // Inputs
-    Input<Buffer<float, 3>> input{"input"};
-    Input<Buffer<float, 1>> wb_factors{"wb_factors"};
-    Input<float> exposure{"exposure"};
-    Input<Buffer<float, 2>> rgb_cam{"rgb_cam"};
-    Input<float> contrast_factor{"contrast_factor"};
-    Input<float> saturation_factor{"saturation_factor"};
+    Input<Buffer<uint16_t, 2>> input{"input"};  // Raw Bayer input
+    Input<int> filters{"filters"};              // Bayer pattern
+    Input<int> black_level{"black_level"};      // Global black level
+    Input<Buffer<int, 1>> cblack{"cblack"};     // Per-channel black levels
+    Input<int> white_input{"white_input"};      // White level
 
-    // Output
-    Output<Buffer<uint8_t, 3>> output{"output"};  // Final RGB8 output
+    // Output, the element type is chosen per library with output.type (float32, float16 or uint16)
+    Output<Buffer<void, 3>> output{"output"};  // Half-resolution intermediate output
+
+    // Output size the schedule is tuned for, and the checked-in schedule to use (see src/pipeline/CMakeLists.txt)
+    GeneratorParam<int> estimate_width{"estimate_width", 6000};
+    GeneratorParam<int> estimate_height{"estimate_height", 4000};
+    GeneratorParam<std::string> checked_in_schedule{"checked_in_schedule", ""};
 
-    // Intermediate stages
     Var x{"x"}, y{"y"}, c{"c"};
-    Var yo{"yo"}, yi{"yi"};
 
     void generate() {
+        Halide::Func input_boundary = Halide::BoundaryConditions::repeat_edge(input);
+        Func fc = brightroom::FC(x, y, filters);
 
-        // White balance
-        Func white_balanced = brightroom::WhiteBalance(input, x, y, c, wb_factors);
+        Func black_adjusted = brightroom::BlackLevel(input_boundary, x, y, fc, black_level, cblack);
+        Func white_adjusted = brightroom::WhiteLevel(black_adjusted, x, y, white_input);
 
-        // Exposure compensation
-        Func exposure_adjusted = brightroom::Exposure(white_balanced, x, y, c, exposure);
+        Func binned = brightroom::BinBayer(white_adjusted, x, y, c, fc);
+        output(x, y, c) = brightroom::EncodeIntermediate(binned(x, y, c), output.type());
 
-        // Tone mapping
-        // Func log_sum = brightroom::LogSum(exposure_adjusted, x, y, input.width(), input.height());
-        // log_sum.compute_root();
+        // For interleaved output
+        output.dim(0).set_stride(3);
+        output.dim(2).set_stride(1);
 
-        // Expr log_avg = Halide::exp(log_sum() / Halide::cast<float>(input.width() * input.height()));
+        if (using_autoscheduler()) {
+            const int width = estimate_width;
+            const int height = estimate_height;
+            input.set_estimates({{0, 2 * width}, {0, 2 * height}});
+            filters.set_estimate(0);
+            black_level.set_estimate(0);
+            cblack.set_estimates({{0, 4}});
+            white_input.set_estimate(0);
+            output.set_estimates({{0, width}, {0, height}, {0, 3}});
+        } else if (checked_in_schedule.value().empty()) {
+            Var strip = brightroom::ScheduleRgbStrips(output, x, y, c, get_target());
+            brightroom::ComputePerStrip(white_adjusted, output, strip, get_target());
+        }
+        ApplyCheckedInSchedule(checked_in_schedule, get_pipeline(), get_target());
+    }
+};
 
-        // auto tone_mapped = brightroom::ToneMapping(exposure_adjusted, x, y, c, log_avg, 0.18f);
+HALIDE_REGISTER_GENERATOR(PreviewRawGenerator, preview_raw_generator)
 
-        // Color space conversion
-        Func srgb = brightroom::ColorSpaceConversion(exposure_adjusted, x, y, c, rgb_cam);
+// Renders an edit in one pass, the linear and display stages fused. HalideRawPipeline uses it when the output is
+// too large to keep the linear stages' result between edits, ProcessLinearGenerator and ProcessDisplayGenerator
+// otherwise.
+class ProcessRawGenerator : public Halide::Generator<ProcessRawGenerator> {
+   public:
+    // Inputs
+    Input<Buffer<void, 3>> input{"input"};  // Demosaiced intermediate, element type set with input.type
+    // White balance, exposure and camera to sRGB folded into rows 0-2, luminance weights in row 3
+    Input<Buffer<float, 2>> color_matrix{"color_matrix"};
+    Input<float> saturation_factor{"saturation_factor"};
+    Input<int> downscale{"downscale"};  // Output pixels average downscale x downscale input pixels
+    Input<bool> compute_histogram{"compute_histogram"};  // Fill histogram, otherwise it is only zeroed
+    // Global tone mapping maps log_average, from LuminanceStatisticsGenerator, to key_value. 0 turns it off.
+    Input<float> log_average{"log_average"};
+    Input<float> key_value{"key_value"};
 
-        // Gamma correction
-        Func gamma_corrected = brightroom::GammaCorrection(srgb, x, y, c);
+    // Output
+    Output<Buffer<void, 3>> output{"output"};  // Final RGB8 output, RGB16 with rgb16
+    // R, G, B and luma histograms of output, 256 bins each. Bins 0 and 255 count the clipped pixels.
+    Output<Buffer<uint32_t, 2>> histogram{"histogram"};
 
-        // Contrast adjustment
-        Func contrast_adjusted = brightroom::ContrastAdjustment(gamma_corrected, x, y, c, contrast_factor);
+    // Gamma and contrast come from a contrast_factor input, which follows key_value, or with tone_curve_lut from a
+    // lookup into a host-baked tone_curve input in its place, which already contains the contrast
+    GeneratorParam<bool> tone_curve_lut{"tone_curve_lut", false};
+    Input<float>* contrast_factor = nullptr;
+    Input<Buffer<float, 1>>* tone_curve = nullptr;
+    // 16 bits per channel for TIFF export. The histogram bins the top 8 bits.
+    GeneratorParam<bool> rgb16{"rgb16", false};
 
-        // Add saturation adjustment
-        Func saturation_adjusted = brightroom::SaturationAdjustment(contrast_adjusted, x, y, c, saturation_factor);
+    // Output size the schedule is tuned for, and the checked-in schedule to use (see src/pipeline/CMakeLists.txt)
+    GeneratorParam<int> estimate_width{"estimate_width", 6000};
+    GeneratorParam<int> estimate_height{"estimate_height", 4000};
+    GeneratorParam<std::string> checked_in_schedule{"checked_in_schedule", ""};
 
-        // Convert to RGB8 (modify to use saturation_adjusted instead of contrast_adjusted)
-        output = brightroom::ToRgb8(saturation_adjusted, x, y, c);
+    // Intermediate stages
+    Var x{"x"}, y{"y"}, c{"c"};
+
+    void configure() {
+        if (tone_curve_lut) {
+            tone_curve = add_input<Buffer<float, 1>>("tone_curve");
+        } else {
+            contrast_factor = add_input<float>("contrast_factor");
+        }
+    }
+
+    void generate() {
+        Func resampled;
+        Func linear =
+            brightroom::LinearStages(input, x, y, c, downscale, color_matrix, log_average, key_value, resampled);
+        Func toned;
+        Func display;
+        if (tone_curve_lut) {
+            tone_curve->dim(0).set_min(0);
+            display = brightroom::DisplayStages(linear, x, y, c, Func(*tone_curve), tone_curve->dim(0).extent(),
+                                                saturation_factor, toned);
+        } else {
+            display = brightroom::DisplayStages(linear, x, y, c, *contrast_factor, saturation_factor, toned);
+        }
+        // The quantized pixels, which output stores and the histogram counts
+        Func pixels;
+        Func histogram_input;
+        if (rgb16) {
+            pixels = brightroom::ToRgb16(display, x, y, c);
+            histogram_input(x, y, c) = Halide::cast<uint8_t>(Halide::Expr(pixels(x, y, c)) >> 8);
+        } else {
+            pixels = brightroom::ToRgb8(display, x, y, c);
+            histogram_input = pixels;
+        }
+        Func stored("stored");
+        stored(x, y, c) = pixels(x, y, c);
+        output = stored;
+
+        // Statistics of the rendered rows, counted strip by strip as they are rendered, see ScheduleFusedHistogram
+        Func partial_histogram;
+        Expr histogram_rows = Halide::select(compute_histogram, output.dim(1).extent(), 0);
+        histogram = brightroom::Histogram(histogram_input, output.dim(0).min(), output.dim(1).min(),
+                                          output.dim(0).extent(), histogram_rows, partial_histogram,
+                                          brightroom::kRowsPerTask);
+        histogram.dim(0).set_bounds(0, 256);
+        histogram.dim(1).set_bounds(0, 4);
 
         // For interleaved output
         input.dim(0).set_stride(3);
@@ -108,31 +249,234 @@ class ProcessRawGenerator : public Halide::Generator<ProcessRawGenerator> {
         output.dim(2).set_stride(1);
 
         input.dim(2).set_bounds(0, 3);  // Dimension 2 (c) starts at 0 and has extent 3.
+        color_matrix.dim(0).set_bounds(0, 4);
+        color_matrix.dim(1).set_bounds(0, 3);
         output.dim(2).set_bounds(0, 3);
 
         output.reorder(c, x, y).unroll(c);
 
-        // Schedule
-        constexpr bool kAutoSchedule = true;
-        if (kAutoSchedule) {
-            // Let the autoscheduler handle it
-            input.set_estimates({{0, 4000}, {0, 6000}, {0, 3}});
-            wb_factors.set_estimates({{0, 3}});
-            rgb_cam.set_estimates({{0, 3}, {0, 3}});
-            exposure.set_estimate(3.0f);
-            contrast_factor.set_estimate(1.5f);
+        if (using_autoscheduler()) {
+            const int width = estimate_width;
+            const int height = estimate_height;
+            input.set_estimates({{0, width}, {0, height}, {0, 3}});
+            color_matrix.set_estimates({{0, 4}, {0, 3}});
             saturation_factor.set_estimate(1.0f);
-            output.set_estimates({{0, 4000}, {0, 6000}, {0, 3}});
-        } else {
-            // Manual schedule similar to your original pipeline
-            output.split(y, yo, yi, 32).parallel(yo).vectorize(x, 16);
-            saturation_adjusted.store_at(output, yo).compute_at(output, yi).vectorize(x, 8);
-            contrast_adjusted.store_at(output, yo).compute_at(output, yi).vectorize(x, 8);
-            gamma_corrected.store_at(output, yo).compute_at(output, yi).vectorize(x, 8);
-            srgb.store_at(output, yo).compute_at(output, yi).vectorize(x, 8);
-            // tone_mapped.store_at(output, yo).compute_at(output, yi).vectorize(x, 8);
+            downscale.set_estimate(1);
+            compute_histogram.set_estimate(true);
+            log_average.set_estimate(0.18f);
+            key_value.set_estimate(0.18f);
+            if (tone_curve_lut) {
+                tone_curve->set_estimates({{0, 4096}});
+            } else {
+                contrast_factor->set_estimate(1.5f);
+            }
+            output.set_estimates({{0, width}, {0, height}, {0, 3}});
+            histogram.set_estimates({{0, 256}, {0, 4}});
+        } else if (checked_in_schedule.value().empty()) {
+            Var strip = brightroom::ScheduleRgbStrips(output, x, y, c, get_target());
+            brightroom::ScheduleFusedHistogram(partial_histogram, pixels, output, strip, x, y, c, get_target());
+            brightroom::ComputePerVector(resampled, pixels, x, y, c, get_target());
+            brightroom::ComputePerVector(toned, pixels, x, y, c, get_target());
         }
+        ApplyCheckedInSchedule(checked_in_schedule, get_pipeline(), get_target());
     }
 };
 
 HALIDE_REGISTER_GENERATOR(ProcessRawGenerator, process_raw_generator)
+
+// The stages of ProcessRawGenerator that read exposure and the tone mapping key. Its linear sRGB output at display
+// resolution is kept between edits, so changing only contrast or saturation reruns ProcessDisplayGenerator alone.
+class ProcessLinearGenerator : public Halide::Generator<ProcessLinearGenerator> {
+   public:
+    // Inputs
+    Input<Buffer<void, 3>> input{"input"};  // Demosaiced intermediate, element type set with input.type
+    // White balance, exposure and camera to sRGB folded into rows 0-2, luminance weights in row 3
+    Input<Buffer<float, 2>> color_matrix{"color_matrix"};
+    Input<int> downscale{"downscale"};  // Output pixels average downscale x downscale input pixels
+    Input<float> log_average{"log_average"};
+    Input<float> key_value{"key_value"};  // 0 turns tone mapping off
+
+    // Output
+    Output<Buffer<float, 3>> output{"output"};  // Linear sRGB, interleaved
+
+    // Output size the schedule is tuned for, and the checked-in schedule to use (see src/pipeline/CMakeLists.txt)
+    GeneratorParam<int> estimate_width{"estimate_width", 6000};
+    GeneratorParam<int> estimate_height{"estimate_height", 4000};
+    GeneratorParam<std::string> checked_in_schedule{"checked_in_schedule", ""};
+
+    Var x{"x"}, y{"y"}, c{"c"};
+
+    void generate() {
+        Func resampled;
+        output = brightroom::LinearStages(input, x, y, c, downscale, color_matrix, log_average, key_value, resampled);
+
+        // For interleaved input and output
+        input.dim(0).set_stride(3);
+        input.dim(2).set_stride(1);
+        input.dim(2).set_bounds(0, 3);
+        color_matrix.dim(0).set_bounds(0, 4);
+        color_matrix.dim(1).set_bounds(0, 3);
+        output.dim(0).set_stride(3);
+        output.dim(2).set_stride(1);
+        output.dim(2).set_bounds(0, 3);
+
+        output.reorder(c, x, y).unroll(c);
+
+        if (using_autoscheduler()) {
+            const int width = estimate_width;
+            const int height = estimate_height;
+            input.set_estimates({{0, width}, {0, height}, {0, 3}});
+            color_matrix.set_estimates({{0, 4}, {0, 3}});
+            downscale.set_estimate(1);
+            log_average.set_estimate(0.18f);
+            key_value.set_estimate(0.18f);
+            output.set_estimates({{0, width}, {0, height}, {0, 3}});
+        } else if (checked_in_schedule.value().empty()) {
+            brightroom::ScheduleRgbStrips(output, x, y, c, get_target());
+            brightroom::ComputePerVector(resampled, output, x, y, c, get_target());
+        }
+        ApplyCheckedInSchedule(checked_in_schedule, get_pipeline(), get_target());
+    }
+};
+
+HALIDE_REGISTER_GENERATOR(ProcessLinearGenerator, process_linear_generator)
+
+// The stages of ProcessRawGenerator that read contrast and saturation, from the output of ProcessLinearGenerator
+class ProcessDisplayGenerator : public Halide::Generator<ProcessDisplayGenerator> {
+   public:
+    // Inputs
+    Input<Buffer<float, 3>> input{"input"};  // Linear sRGB, interleaved, in output coordinates
+    Input<float> saturation_factor{"saturation_factor"};
+    Input<bool> compute_histogram{"compute_histogram"};  // Fill histogram, otherwise it is only zeroed
+
+    // Output
+    Output<Buffer<uint8_t, 3>> output{"output"};  // Final RGB8 output
+    // R, G, B and luma histograms of output, 256 bins each. Bins 0 and 255 count the clipped pixels.
+    Output<Buffer<uint32_t, 2>> histogram{"histogram"};
+
+    // As in ProcessRawGenerator, contrast_factor or tone_curve follows compute_histogram
+    GeneratorParam<bool> tone_curve_lut{"tone_curve_lut", false};
+    Input<float>* contrast_factor = nullptr;
+    Input<Buffer<float, 1>>* tone_curve = nullptr;
+
+    // Output size the schedule is tuned for, and the checked-in schedule to use (see src/pipeline/CMakeLists.txt)
+    GeneratorParam<int> estimate_width{"estimate_width", 6000};
+    GeneratorParam<int> estimate_height{"estimate_height", 4000};
+    GeneratorParam<std::string> checked_in_schedule{"checked_in_schedule", ""};
+
+    Var x{"x"}, y{"y"}, c{"c"};
+
+    void configure() {
+        if (tone_curve_lut) {
+            tone_curve = add_input<Buffer<float, 1>>("tone_curve");
+        } else {
+            contrast_factor = add_input<float>("contrast_factor");
+        }
+    }
+
+    void generate() {
+        Func toned;
+        Func display;
+        if (tone_curve_lut) {
+            tone_curve->dim(0).set_min(0);
+            display = brightroom::DisplayStages(input, x, y, c, Func(*tone_curve), tone_curve->dim(0).extent(),
+                                                saturation_factor, toned);
+        } else {
+            display = brightroom::DisplayStages(input, x, y, c, *contrast_factor, saturation_factor, toned);
+        }
+        Func pixels = brightroom::ToRgb8(display, x, y, c);
+        output(x, y, c) = pixels(x, y, c);
+
+        // Counted strip by strip as in ProcessRawGenerator
+        Func partial_histogram;
+        Expr histogram_rows = Halide::select(compute_histogram, output.dim(1).extent(), 0);
+        histogram = brightroom::Histogram(pixels, output.dim(0).min(), output.dim(1).min(), output.dim(0).extent(),
+                                          histogram_rows, partial_histogram, brightroom::kRowsPerTask);
+        histogram.dim(0).set_bounds(0, 256);
+        histogram.dim(1).set_bounds(0, 4);
+
+        // For interleaved input and output
+        input.dim(0).set_stride(3);
+        input.dim(2).set_stride(1);
+        input.dim(2).set_bounds(0, 3);
+        output.dim(0).set_stride(3);
+        output.dim(2).set_stride(1);
+        output.dim(2).set_bounds(0, 3);
+
+        output.reorder(c, x, y).unroll(c);
+
+        if (using_autoscheduler()) {
+            const int width = estimate_width;
+            const int height = estimate_height;
+            input.set_estimates({{0, width}, {0, height}, {0, 3}});
+            saturation_factor.set_estimate(1.0f);
+            compute_histogram.set_estimate(true);
+            if (tone_curve_lut) {
+                tone_curve->set_estimates({{0, 4096}});
+            } else {
+                contrast_factor->set_estimate(1.5f);
+            }
+            output.set_estimates({{0, width}, {0, height}, {0, 3}});
+            histogram.set_estimates({{0, 256}, {0, 4}});
+        } else if (checked_in_schedule.value().empty()) {
+            Var strip = brightroom::ScheduleRgbStrips(output, x, y, c, get_target());
+            brightroom::ScheduleFusedHistogram(partial_histogram, pixels, output, strip, x, y, c, get_target());
+            brightroom::ComputePerVector(toned, pixels, x, y, c, get_target());
+        }
+        ApplyCheckedInSchedule(checked_in_schedule, get_pipeline(), get_target());
+    }
+};
+
+HALIDE_REGISTER_GENERATOR(ProcessDisplayGenerator, process_display_generator)
+
+// Log-average luminance of a demosaiced intermediate after white balance, the input of ProcessRawGenerator's tone
+// mapping. Runs once per image on a downscaled grid instead of reducing the full frame on every edit.
+class LuminanceStatisticsGenerator : public Halide::Generator<LuminanceStatisticsGenerator> {
+   public:
+    // Inputs
+    Input<Buffer<void, 3>> input{"input"};  // Demosaiced intermediate or preview, element type set with input.type
+    Input<Buffer<float, 1>> wb_factors{"wb_factors"};
+    Input<int> downscale{"downscale"};  // Every sample averages downscale x downscale input pixels
+
+    // Output
+    Output<Buffer<float, 0>> log_average{"log_average"};
+
+    // Input size the schedule is tuned for, and the checked-in schedule to use (see src/pipeline/CMakeLists.txt)
+    GeneratorParam<int> estimate_width{"estimate_width", 6000};
+    GeneratorParam<int> estimate_height{"estimate_height", 4000};
+    GeneratorParam<std::string> checked_in_schedule{"checked_in_schedule", ""};
+
+    Var x{"x"}, y{"y"}, c{"c"};
+
+    void generate() {
+        Func decoded("decoded");
+        decoded(x, y, c) = brightroom::DecodeIntermediate(input(x, y, c));
+        Func downscaled = brightroom::Downscale(decoded, x, y, c, downscale);
+        Func white_balanced = brightroom::WhiteBalance(downscaled, x, y, c, wb_factors);
+
+        // Whole samples only, the remainder columns and rows are left out
+        Expr width = input.dim(0).extent() / downscale;
+        Expr height = input.dim(1).extent() / downscale;
+        Func row_sums;
+        Func log_sum = brightroom::LogSum(white_balanced, x, y, width, height, row_sums);
+        log_average() = Halide::exp(log_sum() / Halide::cast<float>(Halide::max(width * height, 1)));
+
+        // For interleaved input
+        input.dim(0).set_stride(3);
+        input.dim(2).set_stride(1);
+        input.dim(2).set_bounds(0, 3);
+
+        if (using_autoscheduler()) {
+            const int width = estimate_width;
+            const int height = estimate_height;
+            input.set_estimates({{0, width}, {0, height}, {0, 3}});
+            wb_factors.set_estimates({{0, 3}});
+            downscale.set_estimate(std::max(1, width / 256));
+        } else if (checked_in_schedule.value().empty()) {
+            row_sums.compute_root().parallel(y);
+        }
+        ApplyCheckedInSchedule(checked_in_schedule, get_pipeline(), get_target());
+    }
+};
+
+HALIDE_REGISTER_GENERATOR(LuminanceStatisticsGenerator, luminance_statistics_generator)
@@ -0,0 +1,16 @@
+// Generated by scripts/autotune_schedules.sh from the *.schedule.h files in this directory, do not edit
+#pragma once
+
+#include <Halide.h>
+#include <string>
+
+namespace brightroom {
+
+using ApplySchedule = void (*)(Halide::Pipeline pipeline, Halide::Target target);
+
+// The checked-in schedule of that name, nullptr if there is none
+inline auto FindSchedule([[maybe_unused]] const std::string& name) -> ApplySchedule {
+    return nullptr;
+}
+
+}  // namespace brightroom
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <Halide.h>
+
+namespace brightroom {
+
+// Output rows every parallel task computes in the default schedules
+inline constexpr int kRowsPerTask = 32;
+
+// Default schedule of an interleaved RGB output, used when neither the autoscheduler nor a checked-in schedule is:
+// strips of kRowsPerTask rows in parallel, each one vectorized pass with the channels unrolled. Returns the strip
+// loop, for stages that are read at several rows.
+inline auto ScheduleRgbStrips(Halide::Func output, Halide::Var x, Halide::Var y, Halide::Var c,
+                              const Halide::Target& target) -> Halide::Var {
+    Halide::Var yo("yo"), yi("yi");
+    output.reorder(c, x, y)
+        .bound(c, 0, 3)
+        .unroll(c)
+        .split(y, yo, yi, kRowsPerTask, Halide::TailStrategy::GuardWithIf)
+        .parallel(yo)
+        .vectorize(x, target.natural_vector_size<float>(), Halide::TailStrategy::GuardWithIf);
+    return yo;
+}
+
+// Computes a stencil stage once per strip of output instead of once per tap. The stage must be defined beyond the
+// input, its vectors are rounded up.
+inline void ComputePerStrip(Halide::Func stage, Halide::Func output, Halide::Var strip, const Halide::Target& target) {
+    stage.compute_at(output, strip).vectorize(stage.args()[0], target.natural_vector_size<float>());
+}
+
+// Computes a stage that every output channel reads all three channels of once per vector of output pixels, instead
+// of once per output channel
+inline void ComputePerVector(Halide::Func stage, Halide::Func output, Halide::Var x, Halide::Var y, Halide::Var c,
+                             const Halide::Target& target) {
+    stage.compute_at(output, x)
+        .reorder(c, x, y)
+        .bound(c, 0, 3)
+        .unroll(c)
+        .vectorize(x, target.natural_vector_size<float>(), Halide::TailStrategy::GuardWithIf);
+}
+
+// Counts the histogram of every strip of output right after rendering it, in the same parallel loop, instead of
+// reading output back from memory in a second pass. The strip is quantized into pixels once, output copies them and
+// partial_histogram counts them while they are in cache. partial_histogram must count blocks of kRowsPerTask rows.
+inline void ScheduleFusedHistogram(Halide::Func partial_histogram, Halide::Func pixels, Halide::Func output,
+                                   Halide::Var strip, Halide::Var x, Halide::Var y, Halide::Var c,
+                                   const Halide::Target& target) {
+    pixels.compute_at(output, strip)
+        .reorder(c, x, y)
+        .bound(c, 0, 3)
+        .unroll(c)
+        .vectorize(x, target.natural_vector_size<float>(), Halide::TailStrategy::GuardWithIf);
+    partial_histogram.compute_root()
+        .update()
+        .parallel(partial_histogram.args()[2])
+        .compute_with(output, strip, Halide::LoopAlignStrategy::AlignStart);
+}
+
+}  // namespace brightroom
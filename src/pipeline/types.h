@@ -1,28 +1,70 @@
 #pragma once
 
+#include <array>
+#include <cstddef>
 #include <cstdint>
+#include <memory>
 #include <vector>
 namespace brightroom {
 using RGB8_Data = std::vector<uint8_t>;
+// Bayer samples packed back to back at the bit depth of the sensor, see RawFile
+using PackedBayerData = std::vector<uint8_t>;
 
-// Bayer data assumed format:
-// R G R G R
-// G B G B G
-// R G R G R
-// G B G B G
-using Raw16Data = std::vector<uint16_t>;
-using RawFloatData = std::vector<float>;
+// Rectangle in full-resolution sensor pixels
+struct Region {
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
 
+    auto operator==(const Region&) const -> bool = default;
+};
+
+// Shares its pixels instead of copying them. Producers may reuse a buffer once nobody else holds a reference.
 struct RgbImage {
-    RGB8_Data pixels;  // Format_RGB888
+    std::shared_ptr<RGB8_Data> pixels;  // Format_RGB888, rows are width * 3 bytes
     int width;
     int height;
+    Region source{};  // Part of the frame the pixels were rendered from, empty if not applicable
+};
+
+// Histograms of a rendered frame, computed by Process alongside the pixels
+struct ImageStatistics {
+    static constexpr int kBins = 256;
+    enum Channel { kRed, kGreen, kBlue, kLuma };
+
+    std::array<std::array<uint32_t, kBins>, 4> histogram{};  // Indexed by Channel, then 8-bit value
+    uint64_t pixels = 0;
+
+    // Pixels of the channel at full scale or black, clipped by the edit or already in the capture
+    auto HighlightClipped(Channel channel) const -> uint32_t { return histogram[channel][kBins - 1]; }
+    auto ShadowClipped(Channel channel) const -> uint32_t { return histogram[channel][0]; }
 };
 
+// What the pipeline needs of a RAW file, copied out of LibRaw by CreateRawFile so the LibRaw instance and its
+// buffers can be released as soon as the file is unpacked. The sensor data is cropped to the active area and packed
+// at 12, 14 or 16 bits per sample: sample x of row y starts at bit x * bits of byte y * row_bytes, little-endian.
 struct RawFile {
-    RgbImage thumbnail;
-    Raw16Data rawdata;
-    int width;
-    int height;
+    int width = 0;  // Of the active area, the frame the pipeline renders
+    int height = 0;
+    Region active_area{};  // In pixels of the sensor data as LibRaw unpacked it, including the masked borders
+
+    // Shared by copies, nullptr until the file is unpacked. Ends in kPackedPadding bytes so every sample can be read
+    // with a 3-byte load.
+    std::shared_ptr<const PackedBayerData> packed;
+    int bits = 0;
+    size_t row_bytes = 0;
+    static constexpr size_t kPackedPadding = 2;
+
+    // Colour metadata, as in LibRaw's imgdata
+    unsigned filters = 0;  // CFA pattern, relative to the active area
+    int black = 0;
+    std::array<int, 4> cblack{};
+    int white = 0;
+    std::array<float, 4> cam_mul{};
+    std::array<std::array<float, 4>, 3> rgb_cam{};
+
+    auto HasSensorData() const -> bool { return packed != nullptr; }
+    auto SizeInBytes() const -> size_t { return sizeof(RawFile) + (packed ? packed->capacity() : 0); }
 };
 }  // namespace brightroom
\ No newline at end of file
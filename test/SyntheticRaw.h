@@ -0,0 +1,95 @@
+#pragma once
+
+#include <libraw/libraw.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <random>
+#include <vector>
+#include "RawLoader.h"
+
+namespace brightroom::testing {
+
+// LibRaw filters values of the four Bayer layouts
+constexpr unsigned kRggb = 0x94949494;
+constexpr unsigned kBggr = 0x16161616;
+constexpr unsigned kGrbg = 0x61616161;
+constexpr unsigned kGbrg = 0x49494949;
+
+// A LibRaw instance filled as if open_file and unpack had read a 14-bit Bayer frame of smooth colour gradients
+// with some noise on top.
+class SyntheticRaw {
+   public:
+    SyntheticRaw(int width, int height, unsigned filters = kRggb, uint32_t seed = 1)
+        : _data(static_cast<size_t>(width) * height), _raw(std::make_unique<LibRaw>()) {
+        constexpr int kBlack = 512;
+        constexpr int kWhite = 16383;
+        std::mt19937 generator(seed);
+        std::normal_distribution<float> noise(0.0f, 8.0f);
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                const int color = static_cast<int>(filters >> ((((y << 1) & 14) | (x & 1)) << 1) & 3);
+                const float u = static_cast<float>(x) / width;
+                const float v = static_cast<float>(y) / height;
+                const float signal = color == 0 ? u : color == 2 ? v : 0.5f * (1.0f + std::sin(6.0f * (u + v)));
+                const float value = kBlack + signal * signal * (kWhite - kBlack) + noise(generator);
+                _data[static_cast<size_t>(y) * width + x] =
+                    static_cast<uint16_t>(std::clamp(value, 0.0f, static_cast<float>(kWhite)));
+            }
+        }
+
+        auto& imgdata = _raw->imgdata;
+        imgdata.sizes.raw_width = imgdata.sizes.width = static_cast<unsigned short>(width);
+        imgdata.sizes.raw_height = imgdata.sizes.height = static_cast<unsigned short>(height);
+        imgdata.sizes.top_margin = imgdata.sizes.left_margin = 0;
+        imgdata.sizes.raw_pitch = static_cast<unsigned>(width * sizeof(uint16_t));
+        imgdata.idata.filters = filters;
+        imgdata.color.black = kBlack;
+        std::fill(std::begin(imgdata.color.cblack), std::end(imgdata.color.cblack), 0);
+        imgdata.color.maximum = kWhite;
+        const float cam_mul[4] = {2.1f, 1.0f, 1.6f, 1.0f};
+        std::copy(std::begin(cam_mul), std::end(cam_mul), imgdata.color.cam_mul);
+        const float rgb_cam[3][4] = {{1.7f, -0.6f, -0.1f, 0.0f}, {-0.2f, 1.5f, -0.3f, 0.0f}, {0.0f, -0.5f, 1.5f, 0.0f}};
+        std::copy(&rgb_cam[0][0], &rgb_cam[0][0] + 12, &imgdata.color.rgb_cam[0][0]);
+        imgdata.rawdata.raw_image = _data.data();
+    }
+
+    ~SyntheticRaw() {
+        // The pixels and the thumbnail belong to this object, not to LibRaw
+        _raw->imgdata.rawdata.raw_image = nullptr;
+        _raw->imgdata.thumbnail.thumb = nullptr;
+    }
+
+    // Sets an embedded JPEG preview, as unpack_thumb would
+    void SetThumbnail(std::vector<char> jpeg, int width, int height) {
+        _thumbnail = std::move(jpeg);
+        auto& thumbnail = _raw->imgdata.thumbnail;
+        thumbnail.tformat = LIBRAW_THUMBNAIL_JPEG;
+        thumbnail.twidth = static_cast<unsigned short>(width);
+        thumbnail.theight = static_cast<unsigned short>(height);
+        thumbnail.tlength = static_cast<unsigned>(_thumbnail.size());
+        thumbnail.thumb = _thumbnail.data();
+    }
+
+    SyntheticRaw(const SyntheticRaw&) = delete;
+    auto operator=(const SyntheticRaw&) -> SyntheticRaw& = delete;
+
+    auto Get() -> LibRaw& { return *_raw; }
+    // The frame as CreateRawFile copies it out of the LibRaw
+    auto File() -> const RawFile& {
+        if (!_file) {
+            _file = CreateRawFile(*_raw);
+        }
+        return *_file;
+    }
+
+   private:
+    std::vector<uint16_t> _data;
+    std::vector<char> _thumbnail;
+    std::unique_ptr<LibRaw> _raw;
+    std::optional<RawFile> _file;
+};
+
+}  // namespace brightroom::testing
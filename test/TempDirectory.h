@@ -0,0 +1,25 @@
+#pragma once
+
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <string>
+
+namespace brightroom::testing {
+
+// Fixture that gives every test an empty directory of its own in the temp directory, named after the test suite and
+// the test so concurrent test binaries do not share it, and removes it afterwards
+class TempDirectoryTest : public ::testing::Test {
+   protected:
+    void SetUp() override {
+        const auto* test_info = ::testing::UnitTest::GetInstance()->current_test_info();
+        _directory = std::filesystem::temp_directory_path() /
+                     ("brightroom_" + std::string(test_info->test_suite_name()) + "_" + test_info->name());
+        std::filesystem::remove_all(_directory);
+        std::filesystem::create_directories(_directory);
+    }
+    void TearDown() override { std::filesystem::remove_all(_directory); }
+
+    std::filesystem::path _directory;
+};
+
+}  // namespace brightroom::testing
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <jpeglib.h>
+#include <vector>
+
+namespace brightroom::testing {
+
+// Encodes a gradient test pattern, standing in for the embedded preview of a RAW file
+inline auto EncodeJpeg(int width, int height) -> std::vector<char> {
+    jpeg_compress_struct cinfo{};
+    jpeg_error_mgr jerr{};
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+    unsigned char* buffer = nullptr;
+    unsigned long size = 0;
+    jpeg_mem_dest(&cinfo, &buffer, &size);
+    cinfo.image_width = static_cast<JDIMENSION>(width);
+    cinfo.image_height = static_cast<JDIMENSION>(height);
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, 90, TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+    std::vector<unsigned char> row(static_cast<size_t>(width) * 3);
+    while (cinfo.next_scanline < cinfo.image_height) {
+        for (int x = 0; x < width; ++x) {
+            row[x * 3 + 0] = static_cast<unsigned char>(x * 255 / width);
+            row[x * 3 + 1] = static_cast<unsigned char>(cinfo.next_scanline * 255 / cinfo.image_height);
+            row[x * 3 + 2] = static_cast<unsigned char>((x ^ cinfo.next_scanline) & 0xff);
+        }
+        JSAMPROW row_pointer = row.data();
+        jpeg_write_scanlines(&cinfo, &row_pointer, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+    std::vector<char> jpeg(buffer, buffer + size);
+    free(buffer);
+    return jpeg;
+}
+
+}  // namespace brightroom::testing
@@ -0,0 +1,131 @@
+#include <gtest/gtest.h>
+#include <HalideBuffer.h>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#include "AdjustmentCompiler.h"
+#include "AdjustmentStack.h"
+#include "HalideRawPipeline.h"
+#include "SyntheticRaw.h"
+#include "TempDirectory.h"
+
+namespace {
+
+constexpr int kWidth = 96;
+constexpr int kHeight = 80;
+
+// Runs stack over a horizontal ramp with compiler and returns the output
+auto RunRamp(brightroom::AdjustmentCompiler& compiler, const brightroom::AdjustmentStack& stack)
+    -> Halide::Runtime::Buffer<uint8_t> {
+    auto linear = Halide::Runtime::Buffer<float>::make_interleaved(kWidth, kHeight, 3);
+    linear.for_each_element([&](int x, int y, int c) { linear(x, y, c) = static_cast<float>(x) / kWidth; });
+    auto output = Halide::Runtime::Buffer<uint8_t>::make_interleaved(kWidth, kHeight, 3);
+    Halide::Runtime::Buffer<uint32_t> histogram(256, 4);
+    EXPECT_EQ(compiler.Run(stack, linear.raw_buffer(), true, output.raw_buffer(), histogram.raw_buffer()), 0);
+    return output;
+}
+
+TEST(AdjustmentStackTest, ParsesAndFormats) {
+    const auto stack = brightroom::ParseAdjustmentStack("exposure 0.5, gamma 2.2,contrast 1.2");
+    ASSERT_TRUE(stack.has_value());
+    ASSERT_EQ(stack->size(), 3u);
+    EXPECT_EQ((*stack)[0].kind, brightroom::AdjustmentKind::kExposure);
+    EXPECT_FLOAT_EQ((*stack)[1].amount, 2.2f);
+    EXPECT_EQ(brightroom::AdjustmentStackShape(*stack), "exposure,gamma,contrast");
+    EXPECT_EQ(brightroom::ParseAdjustmentStack(brightroom::FormatAdjustmentStack(*stack)), stack);
+
+    EXPECT_FALSE(brightroom::ParseAdjustmentStack("vignette 0.5").has_value());
+    EXPECT_FALSE(brightroom::ParseAdjustmentStack("gamma").has_value());
+    EXPECT_FALSE(brightroom::ParseAdjustmentStack("gamma 2.2 contrast").has_value());
+}
+
+// Amounts that would render inf or NaN are rejected, a negative exposure only darkens
+TEST(AdjustmentStackTest, RejectsAmountsStagesCannotRender) {
+    EXPECT_FALSE(brightroom::ParseAdjustmentStack("gamma 0").has_value());
+    EXPECT_FALSE(brightroom::ParseAdjustmentStack("gamma -2.2").has_value());
+    EXPECT_FALSE(brightroom::ParseAdjustmentStack("contrast -1").has_value());
+    EXPECT_FALSE(brightroom::ParseAdjustmentStack("gamma 2.2, saturation -0.5").has_value());
+    EXPECT_FALSE(brightroom::ParseAdjustmentStack("exposure nan").has_value());
+    EXPECT_TRUE(brightroom::ParseAdjustmentStack("exposure -1, gamma 2.2, contrast 0, saturation 0").has_value());
+}
+
+TEST(AdjustmentStackTest, CompilesEachShapeOnce) {
+    brightroom::AdjustmentCompiler compiler;
+    const brightroom::AdjustmentStack stack{{brightroom::AdjustmentKind::kGamma, 2.2f},
+                                            {brightroom::AdjustmentKind::kContrast, 1.2f}};
+    const auto first = RunRamp(compiler, stack);
+    // Other amounts reuse the pipeline
+    auto stronger = stack;
+    stronger[1].amount = 1.6f;
+    const auto second = RunRamp(compiler, stronger);
+    EXPECT_EQ(compiler.Statistics().compiled, 1u);
+    EXPECT_EQ(compiler.Statistics().memory_hits, 1u);
+    EXPECT_NE(first(kWidth / 8, 0, 0), second(kWidth / 8, 0, 0));
+
+    // A different order is a different pipeline
+    RunRamp(compiler, {stack[1], stack[0]});
+    EXPECT_EQ(compiler.Statistics().compiled, 2u);
+}
+
+// Threads asking for a shape while it compiles wait for it instead of compiling it again
+TEST(AdjustmentStackTest, ConcurrentRunsCompileOnce) {
+    brightroom::AdjustmentCompiler compiler;
+    const brightroom::AdjustmentStack stack{{brightroom::AdjustmentKind::kContrast, 1.3f},
+                                            {brightroom::AdjustmentKind::kGamma, 2.2f}};
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([&] { RunRamp(compiler, stack); });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(compiler.Statistics().compiled, 1u);
+    EXPECT_EQ(compiler.Statistics().memory_hits, 3u);
+}
+
+using AdjustmentStackStoreTest = brightroom::testing::TempDirectoryTest;
+
+TEST_F(AdjustmentStackStoreTest, LoadsStoredPipelines) {
+    if (!brightroom::AdjustmentCompiler::SupportsDirectory()) {
+        GTEST_SKIP() << "Pipelines are kept in memory only on this platform";
+    }
+    const brightroom::AdjustmentStack stack{{brightroom::AdjustmentKind::kExposure, 0.5f},
+                                            {brightroom::AdjustmentKind::kGamma, 2.2f}};
+
+    brightroom::AdjustmentCompiler compiler;
+    compiler.SetDirectory(_directory);
+    const auto compiled = RunRamp(compiler, stack);
+    EXPECT_EQ(compiler.Statistics().compiled, 1u);
+
+    brightroom::AdjustmentCompiler next_run;
+    next_run.SetDirectory(_directory);
+    const auto loaded = RunRamp(next_run, stack);
+    EXPECT_EQ(next_run.Statistics().loaded, 1u);
+    EXPECT_EQ(next_run.Statistics().compiled, 0u);
+    for (int x = 0; x < kWidth; ++x) {
+        ASSERT_EQ(loaded(x, 0, 1), compiled(x, 0, 1)) << x;
+    }
+}
+
+// The default display stage written as a stack renders the same image
+TEST(AdjustmentStackTest, MatchesFixedDisplayStage) {
+    brightroom::testing::SyntheticRaw raw(256, 192);
+    brightroom::HalideRawPipeline pipeline(brightroom::IntermediateFormat::kFloat32,
+                                           brightroom::ToneCurveMode::kAnalytic);
+    pipeline.Preprocess(raw.File());
+    const auto expected = pipeline.Process(raw.File(), brightroom::Parameters{});
+    ASSERT_TRUE(expected.has_value());
+
+    brightroom::Parameters parameters{};
+    parameters.adjustments = *brightroom::ParseAdjustmentStack("gamma 2.2, contrast 1.5, saturation 1.0");
+    const auto actual = pipeline.Process(raw.File(), parameters);
+    ASSERT_TRUE(actual.has_value());
+    ASSERT_EQ(actual->pixels->size(), expected->pixels->size());
+    for (size_t i = 0; i < actual->pixels->size(); ++i) {
+        ASSERT_LE(std::abs((*actual->pixels)[i] - (*expected->pixels)[i]), 1) << i;
+    }
+}
+
+}  // namespace
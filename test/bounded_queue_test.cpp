@@ -0,0 +1,45 @@
+#include <gtest/gtest.h>
+#include <numeric>
+#include <thread>
+#include <vector>
+#include "BoundedQueue.h"
+
+namespace {
+
+TEST(BoundedQueueTest, PopsInFifoOrder) {
+    brightroom::BoundedQueue<int> queue(4);
+    EXPECT_TRUE(queue.Push(1));
+    EXPECT_TRUE(queue.Push(2));
+    EXPECT_EQ(queue.Pop(), 1);
+    EXPECT_EQ(queue.Pop(), 2);
+}
+
+TEST(BoundedQueueTest, DrainsAfterClose) {
+    brightroom::BoundedQueue<int> queue(4);
+    queue.Push(7);
+    queue.Close();
+    EXPECT_FALSE(queue.Push(8));
+    EXPECT_EQ(queue.Pop(), 7);
+    EXPECT_EQ(queue.Pop(), std::nullopt);
+}
+
+TEST(BoundedQueueTest, ProducerBlocksUntilConsumerKeepsUp) {
+    brightroom::BoundedQueue<int> queue(1);
+    constexpr int kItems = 1000;
+    std::jthread producer([&queue]() {
+        for (int i = 0; i < kItems; ++i) {
+            queue.Push(i);
+        }
+        queue.Close();
+    });
+
+    std::vector<int> received;
+    while (auto item = queue.Pop()) {
+        received.push_back(*item);
+    }
+    std::vector<int> expected(kItems);
+    std::iota(expected.begin(), expected.end(), 0);
+    EXPECT_EQ(received, expected);
+}
+
+}  // namespace
@@ -0,0 +1,148 @@
+#include <gtest/gtest.h>
+#include <HalideRuntime.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "BufferPool.h"
+
+namespace {
+
+using brightroom::BufferPool;
+
+TEST(BufferPoolTest, FreedBlockIsReusedForSameSizeClass) {
+    BufferPool pool;
+    void* first = pool.Allocate(1'000'000);
+    ASSERT_NE(first, nullptr);
+    pool.Free(first);
+
+    // Rounds up to the same class as the first request
+    void* second = pool.Allocate(999'000);
+    EXPECT_EQ(second, first);
+    const auto statistics = pool.Statistics();
+    EXPECT_EQ(statistics.allocations, 2u);
+    EXPECT_EQ(statistics.reused, 1u);
+    EXPECT_EQ(statistics.system_allocations, 1u);
+    pool.Free(second);
+}
+
+TEST(BufferPoolTest, BlocksAreAlignedAndWritable) {
+    BufferPool pool;
+    for (std::size_t size : {1u, 100u, 4097u, 300'000u}) {
+        void* pointer = pool.Allocate(size);
+        ASSERT_NE(pointer, nullptr);
+        EXPECT_EQ(reinterpret_cast<std::uintptr_t>(pointer) % BufferPool::kAlignment, 0u);
+        std::memset(pointer, 0xab, size);
+        pool.Free(pointer);
+    }
+}
+
+TEST(BufferPoolTest, SizeClassesBoundWaste) {
+    EXPECT_EQ(BufferPool::SizeClass(1), BufferPool::kAlignment);
+    EXPECT_EQ(BufferPool::SizeClass(1000), 1024u);
+    EXPECT_EQ(BufferPool::SizeClass(64 * 1024), 64u * 1024);
+    for (std::size_t size = 64 * 1024 + 1; size < (std::size_t{1} << 30); size = size * 5 / 3 + 7) {
+        const auto size_class = BufferPool::SizeClass(size);
+        EXPECT_GE(size_class, size);
+        EXPECT_LE(size_class - size, size / 8) << size;
+        EXPECT_EQ(BufferPool::SizeClass(size_class), size_class) << size;
+    }
+}
+
+TEST(BufferPoolTest, CachedBytesStayUnderLimit) {
+    BufferPool pool(3 * 1024 * 1024);
+    void* blocks[4];
+    for (auto& block : blocks) {
+        block = pool.Allocate(1024 * 1024);
+    }
+    for (auto* block : blocks) {
+        pool.Free(block);
+    }
+
+    auto statistics = pool.Statistics();
+    EXPECT_EQ(statistics.bytes_in_use, 0u);
+    EXPECT_EQ(statistics.bytes_cached, 3u * 1024 * 1024);
+    EXPECT_EQ(statistics.bytes_released, 1024u * 1024);
+    EXPECT_EQ(statistics.peak_bytes, 4u * 1024 * 1024);
+
+    pool.SetMaxCachedBytes(1024 * 1024);
+    EXPECT_EQ(pool.Statistics().bytes_cached, 1024u * 1024);
+}
+
+TEST(BufferPoolTest, TrimReleasesCachedBlocks) {
+    BufferPool pool;
+    void* kept = pool.Allocate(200'000);
+    pool.Free(pool.Allocate(500'000));
+    pool.Free(pool.Allocate(100));
+    pool.Trim();
+
+    const auto statistics = pool.Statistics();
+    EXPECT_EQ(statistics.bytes_cached, 0u);
+    EXPECT_EQ(statistics.bytes_in_use, BufferPool::SizeClass(200'000));
+    void* fresh = pool.Allocate(500'000);
+    EXPECT_NE(fresh, nullptr);
+    EXPECT_EQ(pool.Statistics().reused, 0u);
+    pool.Free(fresh);
+    pool.Free(kept);
+}
+
+TEST(BufferPoolTest, ResetPeakStartsFromHeldMemory) {
+    BufferPool pool;
+    void* kept = pool.Allocate(200'000);
+    pool.Free(pool.Allocate(500'000));
+    pool.Trim();
+    EXPECT_GE(pool.Statistics().peak_bytes, BufferPool::SizeClass(200'000) + BufferPool::SizeClass(500'000));
+    pool.ResetPeak();
+    EXPECT_EQ(pool.Statistics().peak_bytes, BufferPool::SizeClass(200'000));
+    pool.Free(kept);
+}
+
+// Classes nobody asks for while frames of a new size arrive are released before the limit is reached
+TEST(BufferPoolTest, StaleSizeClassesAreReleased) {
+    BufferPool pool;
+    pool.Free(pool.Allocate(1'000'000));
+    void* hot = pool.Allocate(2'000'000);
+    pool.Free(hot);
+    std::vector<void*> held;
+    for (std::size_t i = 0; i < BufferPool::kStaleMisses; ++i) {
+        held.push_back(pool.Allocate(3'000'000 + i * 500'000));
+        // Another owner keeps using its class
+        pool.Free(pool.Allocate(2'000'000));
+    }
+    const auto statistics = pool.Statistics();
+    EXPECT_EQ(statistics.bytes_cached, BufferPool::SizeClass(2'000'000));
+    EXPECT_EQ(statistics.bytes_released, BufferPool::SizeClass(1'000'000));
+    for (void* block : held) {
+        pool.Free(block);
+    }
+}
+
+TEST(BufferPoolTest, HalidePoolsOnlyLargeAllocations) {
+    brightroom::InstallHalideAllocator();
+    auto& pool = BufferPool::Global();
+    const auto before = pool.Statistics().allocations;
+    const auto in_use_before = pool.Statistics().bytes_in_use;
+    void* small = halide_malloc(nullptr, 1000);
+    ASSERT_NE(small, nullptr);
+    EXPECT_EQ(pool.Statistics().allocations, before);
+    void* large = halide_malloc(nullptr, 1'000'000);
+    ASSERT_NE(large, nullptr);
+    EXPECT_EQ(pool.Statistics().allocations, before + 1);
+    for (void* pointer : {small, large}) {
+        EXPECT_EQ(reinterpret_cast<std::uintptr_t>(pointer) % BufferPool::kAlignment, 0u);
+    }
+    std::memset(large, 0xab, 1'000'000);
+    halide_free(nullptr, small);
+    halide_free(nullptr, large);
+    EXPECT_EQ(pool.Statistics().bytes_in_use, in_use_before);
+}
+
+TEST(BufferPoolTest, UnknownPointersAssert) {
+    BufferPool pool;
+    int not_from_pool = 0;
+    EXPECT_DEBUG_DEATH(pool.Free(&not_from_pool), "did not allocate");
+    pool.Free(nullptr);
+    EXPECT_EQ(pool.Statistics().bytes_cached, 0u);
+}
+
+}  // namespace
@@ -0,0 +1,174 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include "Catalog.h"
+#include "TempDirectory.h"
+
+namespace {
+
+namespace fs = std::filesystem;
+
+class CatalogTest : public brightroom::testing::TempDirectoryTest {
+   protected:
+    void SetUp() override {
+        TempDirectoryTest::SetUp();
+        fs::create_directories(_directory / "photos" / "day1");
+        fs::create_directories(_directory / "photos" / "day2");
+    }
+
+    // Files with a RAW extension that LibRaw cannot open, which is all a scan needs to walk and record them
+    void WriteFile(const fs::path& relative, const std::string& contents = "not a raw file") {
+        std::ofstream stream(_directory / relative, std::ios::binary | std::ios::trunc);
+        stream << contents;
+    }
+};
+
+TEST_F(CatalogTest, ScanFindsRawFilesInSubdirectories) {
+    WriteFile("photos/day1/a.dng");
+    WriteFile("photos/day1/b.CR2");
+    WriteFile("photos/day2/c.nef");
+    WriteFile("photos/day2/notes.txt");
+
+    brightroom::Catalog catalog;
+    const auto report = catalog.Scan({_directory / "photos"}, 4);
+
+    EXPECT_EQ(report.files, 3u);
+    EXPECT_EQ(report.opened, 3u);
+    EXPECT_EQ(report.unreadable, 3u);
+    ASSERT_EQ(catalog.Entries().size(), 3u);
+    const auto* entry = catalog.Find(_directory / "photos/day2/c.nef");
+    ASSERT_NE(entry, nullptr);
+    EXPECT_FALSE(entry->readable);
+    EXPECT_EQ(entry->file_size, std::string("not a raw file").size());
+    EXPECT_EQ(catalog.Find(_directory / "photos/day2/notes.txt"), nullptr);
+}
+
+TEST_F(CatalogTest, RescanSkipsUnchangedFiles) {
+    WriteFile("photos/day1/a.dng");
+    WriteFile("photos/day2/b.dng");
+    brightroom::Catalog catalog;
+    catalog.Scan({_directory / "photos"});
+
+    const auto report = catalog.Scan({_directory / "photos"});
+    EXPECT_EQ(report.files, 2u);
+    EXPECT_EQ(report.opened, 0u);
+    EXPECT_EQ(report.unchanged, 2u);
+    EXPECT_EQ(report.removed, 0u);
+
+    WriteFile("photos/day2/b.dng", "changed and longer than before");
+    const auto changed = catalog.Scan({_directory / "photos"});
+    EXPECT_EQ(changed.opened, 1u);
+    EXPECT_EQ(changed.unchanged, 1u);
+}
+
+TEST_F(CatalogTest, RescanDropsDeletedFiles) {
+    WriteFile("photos/day1/a.dng");
+    WriteFile("photos/day2/b.dng");
+    brightroom::Catalog catalog;
+    catalog.Scan({_directory / "photos"});
+
+    fs::remove(_directory / "photos/day2/b.dng");
+    const auto report = catalog.Scan({_directory / "photos"});
+    EXPECT_EQ(report.removed, 1u);
+    EXPECT_EQ(catalog.Entries().size(), 1u);
+    EXPECT_EQ(catalog.Find(_directory / "photos/day2/b.dng"), nullptr);
+}
+
+TEST_F(CatalogTest, ScanKeepsEntriesOutsideTheRoots) {
+    WriteFile("photos/day1/a.dng");
+    WriteFile("photos/day2/b.dng");
+    brightroom::Catalog catalog;
+    catalog.Scan({_directory / "photos/day1"});
+    catalog.Scan({_directory / "photos/day2"});
+
+    EXPECT_EQ(catalog.Entries().size(), 2u);
+    EXPECT_NE(catalog.Find(_directory / "photos/day1/a.dng"), nullptr);
+}
+
+TEST_F(CatalogTest, SaveAndLoadRoundTrip) {
+    brightroom::Catalog catalog;
+    brightroom::CatalogEntry entry;
+    entry.path = _directory / "photos/day1/a.cr2";
+    entry.file_size = 25'000'000;
+    entry.modified = 1234567890;
+    entry.readable = true;
+    entry.make = "Canon";
+    entry.model = "EOS R5";
+    entry.lens = "RF24-70mm F2.8 L IS USM";
+    entry.iso = 400;
+    entry.shutter = 1.0f / 250;
+    entry.aperture = 2.8f;
+    entry.focal_length = 50;
+    entry.timestamp = 1700000000;
+    entry.width = 8192;
+    entry.height = 5464;
+    entry.raw_width = 8352;
+    entry.raw_height = 5586;
+    entry.flip = 6;
+    entry.filters = 0x94949494;
+    entry.colors = 3;
+    entry.bits = 14;
+    entry.thumbnail_offset = 1 << 20;
+    entry.thumbnail_length = 2 << 20;
+    entry.thumbnail_width = 8192;
+    entry.thumbnail_height = 5464;
+    entry.thumbnail_format = 1;
+    catalog.Update(entry);
+    auto second = entry;
+    second.path = _directory / "photos/day1/b.cr2";
+    // Stitched and scanned files can be wider than 16 bits
+    second.width = 100'000;
+    second.thumbnail_width = 70'000;
+    catalog.Update(second);
+    brightroom::CatalogEntry unreadable;
+    unreadable.path = _directory / "photos/day2/c.dng";
+    unreadable.file_size = 10;
+    catalog.Update(unreadable);
+
+    const auto index_file = _directory / "catalog.brci";
+    ASSERT_TRUE(catalog.Save(index_file));
+    brightroom::Catalog loaded;
+    ASSERT_TRUE(loaded.Load(index_file));
+
+    ASSERT_EQ(loaded.Entries().size(), 3u);
+    const auto* found = loaded.Find(entry.path);
+    ASSERT_NE(found, nullptr);
+    EXPECT_EQ(found->file_size, entry.file_size);
+    EXPECT_EQ(found->modified, entry.modified);
+    EXPECT_EQ(found->model, entry.model);
+    EXPECT_EQ(found->lens, entry.lens);
+    EXPECT_FLOAT_EQ(found->shutter, entry.shutter);
+    EXPECT_EQ(found->timestamp, entry.timestamp);
+    EXPECT_EQ(found->raw_height, entry.raw_height);
+    EXPECT_EQ(found->flip, entry.flip);
+    EXPECT_EQ(found->filters, entry.filters);
+    EXPECT_EQ(found->bits, entry.bits);
+    EXPECT_EQ(found->thumbnail_offset, entry.thumbnail_offset);
+    EXPECT_EQ(found->thumbnail_height, entry.thumbnail_height);
+    const auto* found_second = loaded.Find(second.path);
+    ASSERT_NE(found_second, nullptr);
+    EXPECT_EQ(found_second->width, second.width);
+    EXPECT_EQ(found_second->thumbnail_width, second.thumbnail_width);
+    const auto* found_unreadable = loaded.Find(unreadable.path);
+    ASSERT_NE(found_unreadable, nullptr);
+    EXPECT_FALSE(found_unreadable->readable);
+    EXPECT_EQ(found_unreadable->file_size, 10u);
+}
+
+TEST_F(CatalogTest, LoadRejectsDamagedIndex) {
+    brightroom::Catalog catalog;
+    brightroom::CatalogEntry entry;
+    entry.path = _directory / "a.dng";
+    catalog.Update(entry);
+    const auto index_file = _directory / "catalog.brci";
+    ASSERT_TRUE(catalog.Save(index_file));
+    fs::resize_file(index_file, fs::file_size(index_file) - 3);
+
+    brightroom::Catalog loaded;
+    EXPECT_FALSE(loaded.Load(index_file));
+    EXPECT_TRUE(loaded.Entries().empty());
+    EXPECT_FALSE(loaded.Load(_directory / "missing.brci"));
+}
+
+}  // namespace
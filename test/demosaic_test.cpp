@@ -0,0 +1,116 @@
+#include <gtest/gtest.h>
+#include <HalideBuffer.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "Generators.h"
+#include "SyntheticRaw.h"
+
+namespace {
+
+constexpr int kWidth = 512;
+constexpr int kHeight = 384;
+constexpr int kWhite = 65535;
+// Pixels this close to the border are not compared, the engines extend the frame differently
+constexpr int kMargin = 8;
+
+using Scene = std::function<float(int x, int y, int c)>;
+using Engine = decltype(brightroom::GeneratorSet::preprocess);
+
+// Colour of channel c at every pixel after sampling scene through an RGGB filter and demosaicing it with engine
+auto Demosaic(Engine engine, const Scene& scene) -> Halide::Runtime::Buffer<float> {
+    std::vector<uint16_t> mosaic(static_cast<size_t>(kWidth) * kHeight);
+    for (int y = 0; y < kHeight; ++y) {
+        for (int x = 0; x < kWidth; ++x) {
+            // RGGB: red at even rows and columns, blue at odd ones
+            const int c = (y % 2 == 0 && x % 2 == 0) ? 0 : (y % 2 == 1 && x % 2 == 1) ? 2 : 1;
+            mosaic[static_cast<size_t>(y) * kWidth + x] =
+                static_cast<uint16_t>(std::lround(std::clamp(scene(x, y, c), 0.0f, 1.0f) * kWhite));
+        }
+    }
+    Halide::Runtime::Buffer<uint16_t> input(mosaic.data(), kWidth, kHeight);
+    Halide::Runtime::Buffer<int> cblack(4);
+    cblack.fill(0);
+    auto output = Halide::Runtime::Buffer<float>::make_interleaved(kWidth, kHeight, 3);
+    const int error = engine(input.raw_buffer(), static_cast<int>(brightroom::testing::kRggb), 0,
+                             cblack.raw_buffer(), kWhite, output.raw_buffer());
+    EXPECT_EQ(error, 0);
+    return output;
+}
+
+auto Psnr(const Halide::Runtime::Buffer<float>& output, const Scene& scene) -> double {
+    double squared_sum = 0.0;
+    int64_t count = 0;
+    for (int y = kMargin; y < kHeight - kMargin; ++y) {
+        for (int x = kMargin; x < kWidth - kMargin; ++x) {
+            for (int c = 0; c < 3; ++c) {
+                const double delta = output(x, y, c) - std::clamp(scene(x, y, c), 0.0f, 1.0f);
+                squared_sum += delta * delta;
+                ++count;
+            }
+        }
+    }
+    return 10.0 * std::log10(static_cast<double>(count) / squared_sum);
+}
+
+struct NamedEngine {
+    const char* name;
+    Engine engine;
+    // On the scene of GradientCorrectedEnginesBeatBilinear, in dB, about 1 dB under the measured PSNR of the engine
+    double min_psnr;
+};
+
+auto Engines() -> std::array<NamedEngine, 3> {
+    const auto& generators = brightroom::Generators(brightroom::IntermediateFormat::kFloat32);
+    return {{{"bilinear", generators.preprocess, 31.0},
+             {"mhc", generators.preprocess_mhc, 33.5},
+             {"rcd", generators.preprocess_rcd, 40.5}}};
+}
+
+TEST(DemosaicTest, FlatFieldIsReproduced) {
+    const Scene grey = [](int, int, int) { return 0.4f; };
+    for (const auto& [name, engine, min_psnr] : Engines()) {
+        const auto output = Demosaic(engine, grey);
+        float max_error = 0.0f;
+        for (int y = 0; y < kHeight; ++y) {
+            for (int x = 0; x < kWidth; ++x) {
+                for (int c = 0; c < 3; ++c) {
+                    max_error = std::max(max_error, std::abs(output(x, y, c) - 0.4f));
+                }
+            }
+        }
+        EXPECT_LT(max_error, 1e-4f) << name;
+    }
+}
+
+// Accuracy of each engine on a scene with the edges bilinear interpolation smears into zippers
+TEST(DemosaicTest, GradientCorrectedEnginesBeatBilinear) {
+    // Luminance with a slow gradient, a disk with a hard edge and a band of fine vertical stripes, tinted
+    // differently inside and outside the disk so the channels are correlated like in a photograph
+    const Scene scene = [](int x, int y, int c) {
+        const float dx = static_cast<float>(x - kWidth / 2);
+        const float dy = static_cast<float>(y - kHeight / 2);
+        const bool in_disk = dx * dx + dy * dy < (kHeight / 3.0f) * (kHeight / 3.0f);
+        float luminance = 0.1f + 0.3f * static_cast<float>(x) / kWidth + (in_disk ? 0.45f : 0.0f);
+        if (y >= 16 && y < 64) {
+            luminance += (x / 3) % 2 == 0 ? 0.3f : 0.0f;
+        }
+        constexpr std::array<float, 3> kOutside{0.9f, 1.0f, 0.7f};
+        constexpr std::array<float, 3> kInside{0.6f, 1.0f, 0.9f};
+        return luminance * (in_disk ? kInside[c] : kOutside[c]);
+    };
+
+    const auto engines = Engines();
+    std::array<double, 3> psnr{};
+    for (size_t i = 0; i < engines.size(); ++i) {
+        psnr[i] = Psnr(Demosaic(engines[i].engine, scene), scene);
+        EXPECT_GE(psnr[i], engines[i].min_psnr) << engines[i].name;
+    }
+    EXPECT_GT(psnr[1], psnr[0]);
+    EXPECT_GT(psnr[2], psnr[1]);
+}
+
+}  // namespace
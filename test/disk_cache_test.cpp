@@ -0,0 +1,143 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+#include <string>
+#include <vector>
+#include "DiskCache.h"
+#include "TempDirectory.h"
+
+namespace {
+
+namespace fs = std::filesystem;
+
+const halide_type_t kUInt8(halide_type_uint, 8);
+
+class DiskCacheTest : public brightroom::testing::TempDirectoryTest {
+   protected:
+    void SetUp() override {
+        TempDirectoryTest::SetUp();
+        _source_file = _directory / "source.raw";
+        WriteSource(std::vector<char>(200 * 1024, 'a'));
+    }
+
+    void WriteSource(const std::vector<char>& contents) {
+        std::ofstream stream(_source_file, std::ios::binary | std::ios::trunc);
+        stream.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+    }
+
+    static auto Pixels(int width, int height, uint8_t seed) -> std::vector<uint8_t> {
+        std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * 3);
+        std::iota(pixels.begin(), pixels.end(), seed);
+        return pixels;
+    }
+
+    fs::path _source_file;
+};
+
+TEST_F(DiskCacheTest, StoreAndFind) {
+    brightroom::DiskCache cache(_directory / "cache");
+    const auto source = brightroom::FileIdentity::Of(_source_file);
+    ASSERT_TRUE(source.has_value());
+    EXPECT_FALSE(cache.Find(*source, "thumbnail").has_value());
+
+    const auto pixels = Pixels(64, 32, 7);
+    ASSERT_TRUE(cache.Store(*source, "thumbnail", kUInt8, 64, 32, 3, pixels.data()));
+    EXPECT_TRUE(cache.Contains(*source, "thumbnail"));
+    EXPECT_FALSE(cache.Contains(*source, "preview"));
+
+    auto cached = cache.Find(*source, "thumbnail");
+    ASSERT_TRUE(cached.has_value());
+    EXPECT_EQ(cached->width, 64);
+    EXPECT_EQ(cached->height, 32);
+    EXPECT_EQ(cached->channels, 3);
+    EXPECT_TRUE(cached->type == kUInt8);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(cached->pixels) % 64, 0u);
+    EXPECT_TRUE(std::equal(pixels.begin(), pixels.end(), cached->pixels));
+}
+
+TEST_F(DiskCacheTest, PersistsAcrossInstances) {
+    const auto source = brightroom::FileIdentity::Of(_source_file);
+    ASSERT_TRUE(source.has_value());
+    const auto pixels = Pixels(16, 16, 1);
+    {
+        brightroom::DiskCache cache(_directory / "cache");
+        ASSERT_TRUE(cache.Store(*source, "thumbnail", kUInt8, 16, 16, 3, pixels.data()));
+    }
+    brightroom::DiskCache cache(_directory / "cache");
+    EXPECT_EQ(cache.SizeInBytes(), 64u + pixels.size());
+    auto cached = cache.Find(*source, "thumbnail");
+    ASSERT_TRUE(cached.has_value());
+    EXPECT_TRUE(std::equal(pixels.begin(), pixels.end(), cached->pixels));
+}
+
+#ifndef _WIN32
+// An entry that cannot be read when the cache opens, here a link to nothing, does not count towards its size
+TEST_F(DiskCacheTest, SkipsUnreadableEntries) {
+    const auto source = brightroom::FileIdentity::Of(_source_file);
+    ASSERT_TRUE(source.has_value());
+    const auto pixels = Pixels(16, 16, 1);
+    {
+        brightroom::DiskCache cache(_directory / "cache");
+        ASSERT_TRUE(cache.Store(*source, "thumbnail", kUInt8, 16, 16, 3, pixels.data()));
+    }
+    fs::create_symlink(_directory / "missing", _directory / "cache" / "dangling.brc");
+    brightroom::DiskCache cache(_directory / "cache");
+    EXPECT_EQ(cache.SizeInBytes(), 64u + pixels.size());
+    EXPECT_TRUE(cache.Contains(*source, "thumbnail"));
+}
+#endif
+
+TEST_F(DiskCacheTest, ChangedSourceMisses) {
+    brightroom::DiskCache cache(_directory / "cache");
+    const auto before = brightroom::FileIdentity::Of(_source_file);
+    ASSERT_TRUE(before.has_value());
+    const auto pixels = Pixels(8, 8, 0);
+    ASSERT_TRUE(cache.Store(*before, "thumbnail", kUInt8, 8, 8, 3, pixels.data()));
+
+    // Same size, different contents at the start
+    auto contents = std::vector<char>(200 * 1024, 'a');
+    contents[10] = 'b';
+    WriteSource(contents);
+    const auto after = brightroom::FileIdentity::Of(_source_file);
+    ASSERT_TRUE(after.has_value());
+    EXPECT_NE(before->partial_hash, after->partial_hash);
+    EXPECT_FALSE(cache.Find(*after, "thumbnail").has_value());
+}
+
+TEST_F(DiskCacheTest, EvictsLeastRecentlyUsed) {
+    const auto source = brightroom::FileIdentity::Of(_source_file);
+    ASSERT_TRUE(source.has_value());
+    const auto pixels = Pixels(32, 32, 3);
+    const uint64_t entry_size = 64 + pixels.size();
+    brightroom::DiskCache cache(_directory / "cache", entry_size * 2);
+
+    ASSERT_TRUE(cache.Store(*source, "a", kUInt8, 32, 32, 3, pixels.data()));
+    ASSERT_TRUE(cache.Store(*source, "b", kUInt8, 32, 32, 3, pixels.data()));
+    // Using a makes b the least recently used entry
+    ASSERT_TRUE(cache.Find(*source, "a").has_value());
+    ASSERT_TRUE(cache.Store(*source, "c", kUInt8, 32, 32, 3, pixels.data()));
+
+    EXPECT_LE(cache.SizeInBytes(), cache.MaxBytes());
+    EXPECT_TRUE(cache.Contains(*source, "a"));
+    EXPECT_FALSE(cache.Contains(*source, "b"));
+    EXPECT_TRUE(cache.Contains(*source, "c"));
+}
+
+TEST_F(DiskCacheTest, MappedEntrySurvivesEviction) {
+    const auto source = brightroom::FileIdentity::Of(_source_file);
+    ASSERT_TRUE(source.has_value());
+    const auto pixels = Pixels(32, 32, 5);
+    brightroom::DiskCache cache(_directory / "cache", 64 + pixels.size());
+
+    ASSERT_TRUE(cache.Store(*source, "a", kUInt8, 32, 32, 3, pixels.data()));
+    auto cached = cache.Find(*source, "a");
+    ASSERT_TRUE(cached.has_value());
+    ASSERT_TRUE(cache.Store(*source, "b", kUInt8, 32, 32, 3, pixels.data()));
+    EXPECT_FALSE(cache.Contains(*source, "a"));
+    EXPECT_TRUE(std::equal(pixels.begin(), pixels.end(), cached->pixels));
+}
+
+}  // namespace
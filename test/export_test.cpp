@@ -0,0 +1,264 @@
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <vector>
+#include "BufferPool.h"
+#include "HalideRawPipeline.h"
+#include "ImageWriter.h"
+#include "SyntheticRaw.h"
+#include "Telemetry.h"
+#include "TempDirectory.h"
+#include "Tiling.h"
+
+namespace {
+
+namespace fs = std::filesystem;
+
+// Not a multiple of the export strip height, so the last strip is a partial one
+constexpr int kWidth = 256;
+constexpr int kHeight = 600;
+
+struct Tiff {
+    int width = 0;
+    int height = 0;
+    int bits = 0;
+    std::vector<uint8_t> data;
+};
+
+// Reads the single-strip RGB TIFFs ImageWriter writes
+auto ReadTiff(const fs::path& file) -> Tiff {
+    std::ifstream stream(file, std::ios::binary);
+    const std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+    auto u16 = [&](size_t offset) { return static_cast<uint32_t>(bytes[offset] | bytes[offset + 1] << 8); };
+    auto u32 = [&](size_t offset) { return u16(offset) | u16(offset + 2) << 16; };
+
+    Tiff tiff;
+    const uint32_t ifd = u32(4);
+    uint32_t data_offset = 0;
+    uint32_t data_size = 0;
+    for (uint32_t entry = 0; entry < u16(ifd); ++entry) {
+        const size_t at = ifd + 2 + entry * 12;
+        const uint32_t value = u16(at + 2) == 3 && u32(at + 4) == 1 ? u16(at + 8) : u32(at + 8);
+        switch (u16(at)) {
+            case 256:
+                tiff.width = static_cast<int>(value);
+                break;
+            case 257:
+                tiff.height = static_cast<int>(value);
+                break;
+            case 258:
+                tiff.bits = static_cast<int>(u16(value));  // Offset of the three BitsPerSample values
+                break;
+            case 273:
+                data_offset = value;
+                break;
+            case 279:
+                data_size = value;
+                break;
+        }
+    }
+    tiff.data.assign(bytes.begin() + data_offset, bytes.begin() + data_offset + data_size);
+    return tiff;
+}
+
+using ExportTest = brightroom::testing::TempDirectoryTest;
+
+TEST_F(ExportTest, StreamedTiffMatchesProcess) {
+    brightroom::testing::SyntheticRaw raw(kWidth, kHeight);
+    brightroom::HalideRawPipeline pipeline;
+    pipeline.Preprocess(raw.File());
+    brightroom::Parameters parameters{};
+    parameters.saturation = 1.3f;
+    const auto image = pipeline.Process(raw.File(), parameters);
+    ASSERT_TRUE(image.has_value());
+
+    const auto file = _directory / "export.tif";
+    ASSERT_TRUE(pipeline.Export(raw.File(), parameters, brightroom::ImageFormat::kTiff, file.string()));
+    EXPECT_GT(pipeline.LastProcessTelemetry().StageDuration("process").count(), 0);
+    const auto tiff = ReadTiff(file);
+    EXPECT_EQ(tiff.width, kWidth);
+    EXPECT_EQ(tiff.height, kHeight);
+    EXPECT_EQ(tiff.bits, 8);
+    ASSERT_EQ(tiff.data.size(), image->pixels->size());
+    // Process keeps its linear stage in memory, Export fuses it, which may round differently
+    for (size_t i = 0; i < tiff.data.size(); ++i) {
+        ASSERT_LE(std::abs(tiff.data[i] - (*image->pixels)[i]), 1) << i;
+    }
+}
+
+TEST_F(ExportTest, SixteenBitTiffKeepsLowBits) {
+    brightroom::testing::SyntheticRaw raw(kWidth, kHeight);
+    brightroom::HalideRawPipeline pipeline(brightroom::IntermediateFormat::kFloat32,
+                                           brightroom::ToneCurveMode::kAnalytic);
+    pipeline.Preprocess(raw.File());
+    const auto image = pipeline.Process(raw.File(), brightroom::Parameters{});
+    ASSERT_TRUE(image.has_value());
+
+    brightroom::ImageWriterOptions options;
+    options.tiff_bits = 16;
+    const auto file = _directory / "export16.tif";
+    ASSERT_TRUE(pipeline.Export(raw.File(), brightroom::Parameters{}, brightroom::ImageFormat::kTiff, file.string(),
+                                options));
+    const auto tiff = ReadTiff(file);
+    EXPECT_EQ(tiff.bits, 16);
+    ASSERT_EQ(tiff.data.size(), image->pixels->size() * 2);
+    std::vector<uint16_t> samples(image->pixels->size());
+    std::memcpy(samples.data(), tiff.data.data(), tiff.data.size());
+    bool low_bits = false;
+    for (size_t i = 0; i < samples.size(); ++i) {
+        ASSERT_LE(std::abs(samples[i] / 257.0 - (*image->pixels)[i]), 1.0) << i;
+        low_bits = low_bits || samples[i] % 257 != 0;
+    }
+    EXPECT_TRUE(low_bits);
+}
+
+TEST_F(ExportTest, MemoryDoesNotGrowWithFrame) {
+    brightroom::testing::SyntheticRaw raw(kWidth, kHeight * 4);
+    brightroom::HalideRawPipeline pipeline;
+    pipeline.Preprocess(raw.File());
+    // Only the demosaic stays in the pool from here on
+    auto& pool = brightroom::BufferPool::Global();
+    pool.Trim();
+    pool.ResetPeak();
+    const auto before = pool.Statistics().bytes_in_use;
+    const auto file = _directory / "export.jpg";
+    ASSERT_TRUE(pipeline.Export(raw.File(), brightroom::Parameters{}, brightroom::ImageFormat::kJpeg, file.string()));
+    EXPECT_GT(fs::file_size(file), 0u);
+    // A few strips, not the RGB8 frame
+    EXPECT_LT(pool.Statistics().peak_bytes - before, size_t{kWidth} * kHeight * 4 * 3 / 4);
+}
+
+TEST_F(ExportTest, NeedsDemosaicOrSensorData) {
+    brightroom::testing::SyntheticRaw raw(kWidth, kHeight);
+    brightroom::HalideRawPipeline pipeline;
+    pipeline.Preprocess(raw.File(), brightroom::PreprocessMode::kPreview);
+    auto metadata = raw.File();
+    metadata.packed.reset();
+    const auto file = _directory / "export.jpg";
+    EXPECT_FALSE(pipeline.Export(metadata, brightroom::Parameters{}, brightroom::ImageFormat::kJpeg, file.string()));
+    EXPECT_FALSE(fs::exists(file));
+}
+
+TEST_F(ExportTest, UnfinishedWriteLeavesNoFile) {
+    const auto file = _directory / "unfinished.tif";
+    const std::vector<uint8_t> row(size_t{kWidth} * 3);
+    {
+        auto writer = brightroom::ImageWriter::Create(brightroom::ImageFormat::kTiff, file.string(), kWidth, 2);
+        ASSERT_NE(writer, nullptr);
+        ASSERT_TRUE(writer->WriteRows(row.data(), 1, 0));
+        // The second row is missing
+        EXPECT_FALSE(writer->Finish());
+    }
+    EXPECT_TRUE(fs::is_empty(_directory));
+
+    auto writer = brightroom::ImageWriter::Create(brightroom::ImageFormat::kTiff, file.string(), kWidth, 2);
+    ASSERT_NE(writer, nullptr);
+    ASSERT_TRUE(writer->WriteRows(row.data(), 2, 0));
+    EXPECT_FALSE(fs::exists(file));
+    ASSERT_TRUE(writer->Finish());
+    EXPECT_TRUE(fs::exists(file));
+    EXPECT_FALSE(fs::exists(file.string() + ".partial"));
+}
+
+TEST_F(ExportTest, TiledExportMatchesFullFrame) {
+    brightroom::testing::SyntheticRaw raw(kWidth, kHeight);
+    brightroom::Parameters parameters{};
+    parameters.contrast = 1.2f;
+    for (auto demosaic : {brightroom::Demosaic::kBilinear, brightroom::Demosaic::kMalvarHeCutler,
+                          brightroom::Demosaic::kRcd}) {
+        brightroom::HalideRawPipeline full_frame;
+        full_frame.Preprocess(raw.File(), brightroom::PreprocessMode::kFull, std::nullopt, demosaic);
+        const auto expected_file = _directory / "full_frame.tif";
+        ASSERT_TRUE(full_frame.Export(raw.File(), parameters, brightroom::ImageFormat::kTiff, expected_file.string()));
+
+        // Small enough for 32 x 32 tiles, so the frame splits into partial bands and tiles with halos on every side
+        brightroom::HalideRawPipeline tiled;
+        tiled.SetWorkingSetLimit(64 * 1024);
+        EXPECT_TRUE(tiled.ExportsTiled(raw.File()));
+        const auto file = _directory / "tiled.tif";
+        ASSERT_TRUE(tiled.Export(raw.File(), parameters, brightroom::ImageFormat::kTiff, file.string(), {},
+                                 demosaic));
+        EXPECT_GT(tiled.LastProcessTelemetry().StageDuration("tiles").count(), 0);
+        EXPECT_LT(tiled.LastProcessTelemetry().bytes_allocated, size_t{kWidth} * kHeight * 3 * sizeof(float));
+
+        const auto expected = ReadTiff(expected_file);
+        const auto tiff = ReadTiff(file);
+        EXPECT_EQ(tiff.width, kWidth);
+        EXPECT_EQ(tiff.height, kHeight);
+        ASSERT_EQ(tiff.data.size(), expected.data.size());
+        for (size_t i = 0; i < tiff.data.size(); ++i) {
+            ASSERT_LE(std::abs(tiff.data[i] - expected.data[i]), 1) << static_cast<int>(demosaic) << " " << i;
+        }
+    }
+}
+
+// The planned working set bounds what a tiled export takes from the pool, the scratch Halide allocates inside the
+// demosaic included. Blocks are rounded up to their size class, an eighth at most.
+TEST_F(ExportTest, TiledExportStaysWithinPlannedWorkingSet) {
+    brightroom::testing::SyntheticRaw raw(kWidth, kHeight);
+    constexpr size_t kLimit = size_t{1} << 20;
+    const size_t sensor_bytes = raw.File().packed->capacity();
+    auto& pool = brightroom::BufferPool::Global();
+    for (auto demosaic : {brightroom::Demosaic::kBilinear, brightroom::Demosaic::kMalvarHeCutler,
+                          brightroom::Demosaic::kRcd}) {
+        brightroom::HalideRawPipeline tiled;
+        tiled.SetWorkingSetLimit(kLimit);
+        ASSERT_TRUE(tiled.ExportsTiled(raw.File()));
+        // Freed blocks waiting for reuse would count towards the peak
+        pool.SetMaxCachedBytes(0);
+        pool.ResetPeak();
+        const auto before = pool.Statistics().bytes_in_use;
+        const auto file = _directory / "tiled.jpg";
+        ASSERT_TRUE(tiled.Export(raw.File(), brightroom::Parameters{}, brightroom::ImageFormat::kJpeg, file.string(),
+                                 {}, demosaic));
+        const auto plan = brightroom::PlanTiles(kWidth, kHeight, demosaic, sizeof(float), 1, sensor_bytes,
+                                                brightroom::HalideThreadCount(), kLimit);
+        EXPECT_TRUE(plan.within_limit);
+        // The packed sensor data is not pooled
+        EXPECT_LE(pool.Statistics().peak_bytes - before, (plan.working_set - sensor_bytes) * 9 / 8)
+            << static_cast<int>(demosaic);
+    }
+    pool.SetMaxCachedBytes(brightroom::BufferPool::kDefaultMaxCachedBytes);
+}
+
+// The GUI's 1:1 view of a frame above the working set limit demosaics the region it shows, not the frame
+TEST_F(ExportTest, FullResolutionOverLimitRendersFromSensorData) {
+    brightroom::testing::SyntheticRaw raw(kWidth, kHeight);
+    const brightroom::Viewport viewport{{40, 100, 96, 64}, 1, false};
+    brightroom::HalideRawPipeline full_frame;
+    full_frame.Preprocess(raw.File());
+    const auto expected = full_frame.Process(raw.File(), brightroom::Parameters{}, viewport);
+    ASSERT_TRUE(expected.has_value());
+
+    brightroom::HalideRawPipeline tiled;
+    tiled.SetWorkingSetLimit(64 * 1024);
+    tiled.Preprocess(raw.File(), brightroom::PreprocessMode::kPreview);
+    tiled.Preprocess(raw.File(), brightroom::PreprocessMode::kAddFullResolution);
+    EXPECT_TRUE(tiled.HasFullResolution());
+    EXPECT_LT(tiled.Image()->SizeInBytes(), size_t{kWidth} * kHeight * 3 * sizeof(float));
+    // The caller lets go of the sensor data, the image keeps it
+    auto metadata = raw.File();
+    metadata.packed.reset();
+    const auto actual = tiled.Process(metadata, brightroom::Parameters{}, viewport);
+    ASSERT_TRUE(actual.has_value());
+    EXPECT_GT(tiled.LastProcessTelemetry().StageDuration("demosaic").count(), 0);
+    ASSERT_EQ(actual->pixels->size(), expected->pixels->size());
+    for (size_t i = 0; i < actual->pixels->size(); ++i) {
+        ASSERT_LE(std::abs((*actual->pixels)[i] - (*expected->pixels)[i]), 1) << i;
+    }
+
+    // An exposure edit reruns the linear stage from the region demosaiced for the first render
+    brightroom::Parameters brighter{};
+    brighter.exposure = 1.5f;
+    ASSERT_TRUE(tiled.Process(metadata, brighter, viewport).has_value());
+    EXPECT_GT(tiled.LastProcessTelemetry().StageDuration("linear").count(), 0);
+    EXPECT_EQ(tiled.LastProcessTelemetry().StageDuration("demosaic").count(), 0);
+}
+
+}  // namespace
@@ -0,0 +1,83 @@
+#include <gtest/gtest.h>
+#include <cstddef>
+#include <memory>
+#include "ImageCache.h"
+
+namespace {
+
+// Stands in for a pipeline's intermediates of a given size
+class FakeImage : public brightroom::PreprocessedImage {
+   public:
+    explicit FakeImage(size_t size) : _size(size) {}
+    auto SizeInBytes() const -> size_t override { return _size; }
+    auto Empty() const -> bool override { return false; }
+
+   private:
+    size_t _size;
+};
+
+auto Prepared(size_t size) -> brightroom::PreparedImage {
+    return {nullptr, std::nullopt, std::make_shared<FakeImage>(size)};
+}
+
+TEST(ImageCacheTest, FindReturnsInsertedImage) {
+    brightroom::ImageCache cache(1000);
+    auto prepared = Prepared(100);
+    cache.Insert("/photos/a.cr2", prepared);
+
+    auto found = cache.Find("/photos/a.cr2");
+    ASSERT_TRUE(found);
+    EXPECT_EQ(found->image, prepared.image);
+    EXPECT_TRUE(cache.Contains("/photos/./a.cr2"));
+    EXPECT_FALSE(cache.Find("/photos/b.cr2"));
+    EXPECT_EQ(cache.SizeInBytes(), 100u);
+}
+
+TEST(ImageCacheTest, EvictsLeastRecentlyUsedOverBudget) {
+    brightroom::ImageCache cache(300);
+    cache.Insert("a", Prepared(100));
+    cache.Insert("b", Prepared(100));
+    cache.Insert("c", Prepared(100));
+    // a becomes the most recently used, b is the oldest now
+    ASSERT_TRUE(cache.Find("a"));
+
+    cache.Insert("d", Prepared(100));
+    EXPECT_TRUE(cache.Contains("a"));
+    EXPECT_FALSE(cache.Contains("b"));
+    EXPECT_TRUE(cache.Contains("c"));
+    EXPECT_TRUE(cache.Contains("d"));
+    EXPECT_EQ(cache.SizeInBytes(), 300u);
+}
+
+TEST(ImageCacheTest, InsertReplacesEntry) {
+    brightroom::ImageCache cache(1000);
+    cache.Insert("a", Prepared(100));
+    auto larger = Prepared(400);
+    cache.Insert("a", larger);
+
+    EXPECT_EQ(cache.SizeInBytes(), 400u);
+    EXPECT_EQ(cache.Find("a")->image, larger.image);
+}
+
+TEST(ImageCacheTest, EntryLargerThanBudgetIsNotKept) {
+    brightroom::ImageCache cache(300);
+    cache.Insert("a", Prepared(100));
+    cache.Insert("b", Prepared(301));
+
+    EXPECT_TRUE(cache.Contains("a"));
+    EXPECT_FALSE(cache.Contains("b"));
+    EXPECT_EQ(cache.SizeInBytes(), 100u);
+}
+
+TEST(ImageCacheTest, EvictedImageStaysValidForItsHolder) {
+    brightroom::ImageCache cache(100);
+    cache.Insert("a", Prepared(100));
+    auto held = cache.Find("a");
+    cache.Insert("b", Prepared(100));
+
+    EXPECT_FALSE(cache.Contains("a"));
+    ASSERT_TRUE(held);
+    EXPECT_EQ(held->image->SizeInBytes(), 100u);
+}
+
+}  // namespace
@@ -0,0 +1,72 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include "HalideRawPipeline.h"
+#include "SyntheticRaw.h"
+
+namespace {
+
+struct Difference {
+    int max = 0;
+    double mean = 0.0;
+    double psnr = 0.0;
+};
+
+auto Compare(const brightroom::RgbImage& expected, const brightroom::RgbImage& actual) -> Difference {
+    Difference difference;
+    double squared_sum = 0.0;
+    double sum = 0.0;
+    const auto& a = *expected.pixels;
+    const auto& b = *actual.pixels;
+    for (size_t i = 0; i < a.size(); ++i) {
+        const int delta = std::abs(static_cast<int>(a[i]) - static_cast<int>(b[i]));
+        difference.max = std::max(difference.max, delta);
+        sum += delta;
+        squared_sum += static_cast<double>(delta) * delta;
+    }
+    difference.mean = sum / static_cast<double>(a.size());
+    const double mse = squared_sum / static_cast<double>(a.size());
+    difference.psnr = mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : INFINITY;
+    return difference;
+}
+
+// Accuracy of the reduced intermediate formats against the float32 path. The PSNR and mean difference of each are
+// recorded as test properties, --gtest_output=xml writes them out.
+TEST(IntermediateFormatTest, ReducedFormatsMatchFloatPath) {
+    brightroom::testing::SyntheticRaw raw(1536, 1024);
+    brightroom::Parameters parameters{};
+
+    brightroom::HalideRawPipeline reference(brightroom::IntermediateFormat::kFloat32);
+    reference.Preprocess(raw.File());
+    auto expected = reference.Process(raw.File(), parameters);
+    ASSERT_TRUE(expected.has_value());
+
+    struct Case {
+        brightroom::IntermediateFormat format;
+        std::string name;
+        int max_difference;
+    };
+    // float16 keeps 11 significant bits down to subnormals, its error stays relative and below 1 LSB after the display
+    // gamma, plus 1 for rounding both outputs. A uint16 step is absolute, 1/65535, and the slope of x^(1/2.2) is
+    // unbounded at black: half a step through the color matrix and exposure, a gain of about 6, gives
+    // 255 * (6 * 0.5 / 65535)^(1 / 2.2) = 2.7 LSB in the darkest pixels, plus 1 for rounding.
+    for (const auto& test_case : {Case{brightroom::IntermediateFormat::kFloat16, "float16", 2},
+                                  Case{brightroom::IntermediateFormat::kUInt16, "uint16", 4}}) {
+        brightroom::HalideRawPipeline pipeline(test_case.format);
+        pipeline.Preprocess(raw.File());
+        auto actual = pipeline.Process(raw.File(), parameters);
+        ASSERT_TRUE(actual.has_value());
+        ASSERT_EQ(actual->pixels->size(), expected->pixels->size());
+
+        const auto difference = Compare(*expected, *actual);
+        RecordProperty(test_case.name + "_psnr_db", std::to_string(difference.psnr));
+        RecordProperty(test_case.name + "_mean_lsb", std::to_string(difference.mean));
+        EXPECT_LE(difference.max, test_case.max_difference) << test_case.name;
+        // Outside the shadows both differ by well under 1 LSB, so most pixels round the same
+        EXPECT_LT(difference.mean, 0.5) << test_case.name;
+        EXPECT_GT(difference.psnr, 45.0) << test_case.name;
+    }
+}
+
+}  // namespace
@@ -1,4 +1,14 @@
 #include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+#include "PackedBayer.h"
+#include "RawLoader.h"
+#include "SyntheticRaw.h"
+#include "TempDirectory.h"
+#include "TestJpeg.h"
 
 namespace {
 // Demonstrate some basic assertions.
@@ -9,4 +19,120 @@ TEST(LoaderTest, BasicAssertions) {
   EXPECT_EQ(7 * 6, 42);
 }
 
-}  // namespace
\ No newline at end of file
+TEST(LoaderTest, ThumbnailFullSize) {
+    brightroom::testing::SyntheticRaw raw(2, 2);
+    raw.SetThumbnail(brightroom::testing::EncodeJpeg(600, 400), 600, 400);
+    auto thumbnail = brightroom::CreateThumbnail(raw.Get());
+    ASSERT_TRUE(thumbnail.pixels);
+    EXPECT_EQ(thumbnail.width, 600);
+    EXPECT_EQ(thumbnail.height, 400);
+    EXPECT_EQ(thumbnail.pixels->size(), 600u * 400u * 3u);
+}
+
+// The smallest DCT scale that still covers the target is chosen
+TEST(LoaderTest, ThumbnailScaledToTarget) {
+    brightroom::testing::SyntheticRaw raw(2, 2);
+    raw.SetThumbnail(brightroom::testing::EncodeJpeg(800, 600), 800, 600);
+    struct Case {
+        int target_width;
+        int target_height;
+        int width;
+        int height;
+    };
+    for (const auto& test_case : {Case{100, 75, 100, 75}, Case{101, 75, 200, 150}, Case{300, 100, 400, 300},
+                                  Case{401, 300, 800, 600}, Case{1600, 1200, 800, 600}}) {
+        auto thumbnail = brightroom::CreateThumbnail(raw.Get(), test_case.target_width, test_case.target_height);
+        ASSERT_TRUE(thumbnail.pixels);
+        EXPECT_EQ(thumbnail.width, test_case.width) << test_case.target_width;
+        EXPECT_EQ(thumbnail.height, test_case.height) << test_case.target_width;
+        EXPECT_EQ(thumbnail.pixels->size(), static_cast<size_t>(thumbnail.width) * thumbnail.height * 3);
+    }
+}
+
+TEST(LoaderTest, ThumbnailCorruptOrMissing) {
+    brightroom::testing::SyntheticRaw raw(2, 2);
+    EXPECT_FALSE(brightroom::CreateThumbnail(raw.Get()).pixels);
+
+    raw.SetThumbnail(std::vector<char>(256, 0), 600, 400);
+    EXPECT_FALSE(brightroom::CreateThumbnail(raw.Get()).pixels);
+}
+
+// Both ways of reading report files LibRaw cannot parse the same way
+TEST(LoaderTest, OpenRawRejectsInvalidFiles) {
+    const auto directory = std::filesystem::temp_directory_path() / "brightroom_loader_test";
+    std::filesystem::create_directories(directory);
+    const auto garbage = directory / "garbage.dng";
+    std::ofstream(garbage, std::ios::binary) << std::string(4096, 'x');
+    for (auto input : {brightroom::RawInput::kFile, brightroom::RawInput::kMapped}) {
+        brightroom::RawLoader loader{nullptr, input};
+        EXPECT_EQ(loader.OpenRaw((directory / "missing.dng").string()), nullptr);
+        EXPECT_EQ(loader.OpenRaw(garbage.string()), nullptr);
+    }
+    std::filesystem::remove_all(directory);
+}
+
+TEST(LoaderTest, CreateRawFilePacksActiveArea) {
+    brightroom::testing::SyntheticRaw synthetic(37, 12);
+    auto& imgdata = synthetic.Get().imgdata;
+    // A masked border of 3 columns on the left and 2 rows on the top
+    imgdata.sizes.left_margin = 3;
+    imgdata.sizes.top_margin = 2;
+    imgdata.sizes.width = 33;
+    imgdata.sizes.height = 9;
+
+    const auto raw = brightroom::CreateRawFile(synthetic.Get());
+    ASSERT_TRUE(raw.HasSensorData());
+    EXPECT_EQ(raw.width, 33);
+    EXPECT_EQ(raw.height, 9);
+    EXPECT_EQ(raw.active_area.x, 3);
+    EXPECT_EQ(raw.active_area.y, 2);
+    EXPECT_EQ(raw.filters, imgdata.idata.filters);
+    EXPECT_EQ(raw.black, static_cast<int>(imgdata.color.black));
+    EXPECT_EQ(raw.white, static_cast<int>(imgdata.color.maximum));
+    EXPECT_EQ(raw.cam_mul[2], imgdata.color.cam_mul[2]);
+    EXPECT_EQ(raw.rgb_cam[1][1], imgdata.color.rgb_cam[1][1]);
+    EXPECT_LT(raw.bits, 16);
+
+    std::vector<uint16_t> unpacked(static_cast<size_t>(raw.width) * raw.height);
+    brightroom::UnpackBayerRows(raw, 0, raw.height, unpacked.data(), raw.width);
+    for (int y = 0; y < raw.height; ++y) {
+        for (int x = 0; x < raw.width; ++x) {
+            ASSERT_EQ(unpacked[y * raw.width + x], imgdata.rawdata.raw_image[(y + 2) * 37 + x + 3]) << x << "," << y;
+        }
+    }
+}
+
+TEST(LoaderTest, CreateRawFileBeforeUnpackHasOnlyMetadata) {
+    brightroom::testing::SyntheticRaw synthetic(16, 16);
+    synthetic.Get().imgdata.rawdata.raw_image = nullptr;
+    const auto raw = brightroom::CreateRawFile(synthetic.Get());
+    EXPECT_FALSE(raw.HasSensorData());
+    EXPECT_EQ(raw.width, 16);
+    EXPECT_EQ(raw.white, static_cast<int>(synthetic.Get().imgdata.color.maximum));
+}
+
+using MappedFileTest = brightroom::testing::TempDirectoryTest;
+
+// Reading a page the file no longer has fails the read instead of killing the process with SIGBUS
+TEST_F(MappedFileTest, GuardedReadSurvivesTruncation) {
+    const auto path = _directory / "truncated.dng";
+    constexpr size_t kSize = 64 * 1024;
+    std::ofstream(path, std::ios::binary) << std::string(kSize, 'x');
+    const auto file = brightroom::MappedFile::Open(path);
+    ASSERT_NE(file, nullptr);
+    ASSERT_EQ(file->Size(), kSize);
+    uint8_t last = 0;
+    EXPECT_TRUE(file->GuardedRead([&] { last = *static_cast<volatile uint8_t*>(file->Data() + kSize - 1); }));
+    EXPECT_EQ(last, 'x');
+
+    std::filesystem::resize_file(path, 0);
+    // Drops the pages already read, which a private mapping would otherwise keep
+    file->Release();
+#ifndef _WIN32
+    EXPECT_FALSE(file->GuardedRead([&] { last = *static_cast<volatile uint8_t*>(file->Data() + kSize - 1); }));
+#endif
+    // The guard is gone once the read returns
+    EXPECT_TRUE(file->GuardedRead([] {}));
+}
+
+}  // namespace
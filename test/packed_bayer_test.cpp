@@ -0,0 +1,90 @@
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+#include "PackedBayer.h"
+
+namespace {
+
+auto Packed(const std::vector<uint16_t>& samples, int width, int height, int bits) -> brightroom::RawFile {
+    brightroom::RawFile raw;
+    raw.width = width;
+    raw.height = height;
+    raw.bits = bits;
+    raw.row_bytes = brightroom::PackedRowBytes(width, bits);
+    raw.packed = std::make_shared<const brightroom::PackedBayerData>(
+        brightroom::PackBayer(samples.data(), width, width, height, bits));
+    return raw;
+}
+
+TEST(PackedBayerTest, BitsFitLargestValue) {
+    EXPECT_EQ(brightroom::PackedBits(0), 12);
+    EXPECT_EQ(brightroom::PackedBits(4095), 12);
+    EXPECT_EQ(brightroom::PackedBits(4096), 14);
+    EXPECT_EQ(brightroom::PackedBits(16383), 14);
+    EXPECT_EQ(brightroom::PackedBits(16384), 16);
+    EXPECT_EQ(brightroom::PackedBits(65535), 16);
+}
+
+TEST(PackedBayerTest, RoundTripsEveryBitDepth) {
+    std::mt19937 generator(7);
+    // Odd widths end rows in the middle of a byte
+    for (int bits : {12, 14, 16}) {
+        for (int width : {1, 2, 3, 7, 64, 101}) {
+            const int height = 5;
+            std::uniform_int_distribution<int> value(0, (1 << bits) - 1);
+            std::vector<uint16_t> samples(static_cast<size_t>(width) * height);
+            for (auto& sample : samples) {
+                sample = static_cast<uint16_t>(value(generator));
+            }
+            samples.back() = static_cast<uint16_t>((1 << bits) - 1);
+
+            const auto raw = Packed(samples, width, height, bits);
+            EXPECT_EQ(raw.packed->size(), raw.row_bytes * height + brightroom::RawFile::kPackedPadding);
+            std::vector<uint16_t> unpacked(samples.size());
+            brightroom::UnpackBayerRows(raw, 0, height, unpacked.data(), width);
+            EXPECT_EQ(unpacked, samples) << bits << " bits, width " << width;
+        }
+    }
+}
+
+TEST(PackedBayerTest, UnpacksRowRangeWithStride) {
+    constexpr int kWidth = 9;
+    constexpr int kHeight = 6;
+    std::vector<uint16_t> samples(kWidth * kHeight);
+    for (size_t i = 0; i < samples.size(); ++i) {
+        samples[i] = static_cast<uint16_t>(i * 97 % 4096);
+    }
+    const auto raw = Packed(samples, kWidth, kHeight, 12);
+
+    constexpr int kStride = 16;
+    std::vector<uint16_t> rows(2 * kStride, 0xffff);
+    brightroom::UnpackBayerRows(raw, 3, 2, rows.data(), kStride);
+    for (int y = 0; y < 2; ++y) {
+        for (int x = 0; x < kWidth; ++x) {
+            EXPECT_EQ(rows[y * kStride + x], samples[(y + 3) * kWidth + x]);
+        }
+        EXPECT_EQ(rows[y * kStride + kWidth], 0xffff);
+    }
+}
+
+// Blocks of rows packed in any order, as CreateRawFile packs them in parallel, give the bytes of PackBayer
+TEST(PackedBayerTest, PacksRowBlocksIndependently) {
+    constexpr int kWidth = 11;  // Rows end in the middle of a byte
+    constexpr int kHeight = 7;
+    constexpr int kStride = 13;
+    std::vector<uint16_t> samples(kStride * kHeight);
+    for (size_t i = 0; i < samples.size(); ++i) {
+        samples[i] = static_cast<uint16_t>(i * 193 % 16384);
+    }
+    for (int bits : {14, 16}) {
+        const auto expected = brightroom::PackBayer(samples.data(), kStride, kWidth, kHeight, bits);
+        brightroom::PackedBayerData packed(expected.size());
+        brightroom::PackBayerRows(samples.data(), kStride, kWidth, bits, 3, 4, packed);
+        brightroom::PackBayerRows(samples.data(), kStride, kWidth, bits, 0, 3, packed);
+        EXPECT_EQ(packed, expected) << bits << " bits";
+    }
+}
+
+}  // namespace
@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+#include <array>
+#include "ColorMatrix.h"
+#include "HalideRawPipeline.h"
+#include "ProcessGraph.h"
+#include "SyntheticRaw.h"
+
+namespace {
+
+using brightroom::ProcessGraph;
+
+TEST(ProcessGraphTest, FoldedMatrixMatchesSequentialStages) {
+    brightroom::testing::SyntheticRaw synthetic(2, 2);
+    const auto& raw = synthetic.File();
+    constexpr float kExposure = 2.5f;
+    const auto matrix = brightroom::FoldColorMatrix(raw, kExposure);
+
+    const std::array<float, 3> camera{0.3f, 0.55f, 0.2f};
+    const auto wb = brightroom::WhiteBalanceFactors(raw);
+    std::array<float, 3> exposed{};
+    for (int j = 0; j < 3; j++) {
+        exposed[j] = camera[j] * wb[j] * kExposure;
+    }
+    for (int i = 0; i < 3; i++) {
+        float srgb = 0.0f;
+        float folded = 0.0f;
+        for (int j = 0; j < 3; j++) {
+            srgb += raw.rgb_cam[i][j] * exposed[j];
+            folded += matrix[i][j] * camera[j];
+        }
+        EXPECT_NEAR(folded, srgb, 1e-5f) << i;
+    }
+    const float luminance = 0.2126f * exposed[0] + 0.7152f * exposed[1] + 0.0722f * exposed[2];
+    EXPECT_NEAR(matrix[3][0] * camera[0] + matrix[3][1] * camera[1] + matrix[3][2] * camera[2], luminance, 1e-5f);
+}
+
+TEST(ProcessGraphTest, RerunsFromFirstStageReadingChangedParameter) {
+    ProcessGraph graph;
+    const brightroom::StageSource source{1, false, {0, 0, 640, 480}, 1};
+    brightroom::Parameters parameters{};
+    EXPECT_EQ(graph.FirstDirtyStage(source, parameters), ProcessGraph::kLinear);
+    graph.MarkClean(source, parameters);
+    EXPECT_EQ(graph.FirstDirtyStage(source, parameters), ProcessGraph::kStages.size());
+
+    auto saturated = parameters;
+    saturated.saturation = 1.4f;
+    EXPECT_EQ(graph.FirstDirtyStage(source, saturated), ProcessGraph::kDisplay);
+    auto exposed = saturated;
+    exposed.exposure = 1.2f;
+    EXPECT_EQ(graph.FirstDirtyStage(source, exposed), ProcessGraph::kLinear);
+    auto adjusted = parameters;
+    adjusted.adjustments = {{brightroom::AdjustmentKind::kGamma, 2.2f}};
+    EXPECT_EQ(graph.FirstDirtyStage(source, adjusted), ProcessGraph::kDisplay);
+
+    auto moved = source;
+    moved.region.x = 64;
+    EXPECT_EQ(graph.FirstDirtyStage(moved, parameters), ProcessGraph::kLinear);
+    auto next_image = source;
+    next_image.image = 2;
+    EXPECT_EQ(graph.FirstDirtyStage(next_image, parameters), ProcessGraph::kLinear);
+
+    graph.Invalidate();
+    EXPECT_EQ(graph.FirstDirtyStage(source, parameters), ProcessGraph::kLinear);
+}
+
+TEST(ProcessGraphTest, SaturationEditSkipsLinearStage) {
+    brightroom::testing::SyntheticRaw raw(640, 480);
+    brightroom::HalideRawPipeline pipeline;
+    pipeline.Preprocess(raw.File());
+    ASSERT_TRUE(pipeline.Process(raw.File(), brightroom::Parameters{}).has_value());
+
+    brightroom::Parameters saturated{};
+    saturated.saturation = 1.5f;
+    const auto edited = pipeline.Process(raw.File(), saturated);
+    ASSERT_TRUE(edited.has_value());
+    EXPECT_EQ(pipeline.LastProcessTelemetry().StageDuration("linear").count(), 0);
+    EXPECT_GT(pipeline.LastProcessTelemetry().StageDuration("display").count(), 0);
+
+    // Same pixels as rendering the edit from scratch
+    brightroom::HalideRawPipeline fresh;
+    fresh.Preprocess(raw.File());
+    const auto expected = fresh.Process(raw.File(), saturated);
+    ASSERT_TRUE(expected.has_value());
+    EXPECT_EQ(*edited->pixels, *expected->pixels);
+
+    saturated.exposure = 1.3f;
+    ASSERT_TRUE(pipeline.Process(raw.File(), saturated).has_value());
+    EXPECT_GT(pipeline.LastProcessTelemetry().StageDuration("linear").count(), 0);
+}
+
+}  // namespace
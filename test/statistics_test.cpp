@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+#include <array>
+#include <cstdint>
+#include "HalideRawPipeline.h"
+#include "SyntheticRaw.h"
+
+namespace {
+
+using brightroom::ImageStatistics;
+
+// Histogram of the rendered pixels computed on the host, channel 3 uses the generator's luma weights
+auto HostHistogram(const brightroom::RgbImage& image) -> ImageStatistics {
+    ImageStatistics statistics;
+    const auto& pixels = *image.pixels;
+    for (size_t i = 0; i + 2 < pixels.size(); i += 3) {
+        const int red = pixels[i];
+        const int green = pixels[i + 1];
+        const int blue = pixels[i + 2];
+        statistics.histogram[ImageStatistics::kRed][red]++;
+        statistics.histogram[ImageStatistics::kGreen][green]++;
+        statistics.histogram[ImageStatistics::kBlue][blue]++;
+        statistics.histogram[ImageStatistics::kLuma][(54 * red + 183 * green + 19 * blue + 128) >> 8]++;
+        statistics.pixels++;
+    }
+    return statistics;
+}
+
+TEST(StatisticsTest, MatchesRenderedPixels) {
+    brightroom::testing::SyntheticRaw raw(1536, 1024);
+    brightroom::HalideRawPipeline pipeline;
+    pipeline.Preprocess(raw.File());
+
+    // Bright enough that part of the frame clips
+    brightroom::Parameters parameters{};
+    parameters.exposure = 4.0f;
+    brightroom::Viewport viewport{};
+    viewport.compute_statistics = true;
+    auto image = pipeline.Process(raw.File(), parameters, viewport);
+    ASSERT_TRUE(image.has_value());
+    const auto& statistics = pipeline.LastStatistics();
+    ASSERT_TRUE(statistics.has_value());
+
+    const auto expected = HostHistogram(*image);
+    EXPECT_EQ(statistics->pixels, static_cast<uint64_t>(image->width) * image->height);
+    EXPECT_EQ(statistics->pixels, expected.pixels);
+    for (int channel = 0; channel < 4; channel++) {
+        EXPECT_EQ(statistics->histogram[channel], expected.histogram[channel]) << "channel " << channel;
+    }
+    EXPECT_GT(statistics->HighlightClipped(ImageStatistics::kRed), 0u);
+}
+
+TEST(StatisticsTest, RegionAndDownscale) {
+    brightroom::testing::SyntheticRaw raw(1536, 1024);
+    brightroom::HalideRawPipeline pipeline;
+    pipeline.Preprocess(raw.File());
+
+    brightroom::Viewport viewport{{300, 200, 640, 480}, 2, true};
+    auto image = pipeline.Process(raw.File(), brightroom::Parameters{}, viewport);
+    ASSERT_TRUE(image.has_value());
+    const auto& statistics = pipeline.LastStatistics();
+    ASSERT_TRUE(statistics.has_value());
+
+    const auto expected = HostHistogram(*image);
+    EXPECT_EQ(statistics->pixels, expected.pixels);
+    for (int channel = 0; channel < 4; channel++) {
+        EXPECT_EQ(statistics->histogram[channel], expected.histogram[channel]) << "channel " << channel;
+    }
+}
+
+TEST(StatisticsTest, OnlyWhenRequested) {
+    brightroom::testing::SyntheticRaw raw(256, 256);
+    brightroom::HalideRawPipeline pipeline;
+    pipeline.Preprocess(raw.File());
+
+    brightroom::Viewport viewport{};
+    viewport.compute_statistics = true;
+    ASSERT_TRUE(pipeline.Process(raw.File(), brightroom::Parameters{}, viewport).has_value());
+    EXPECT_TRUE(pipeline.LastStatistics().has_value());
+
+    ASSERT_TRUE(pipeline.Process(raw.File(), brightroom::Parameters{}).has_value());
+    EXPECT_FALSE(pipeline.LastStatistics().has_value());
+}
+
+}  // namespace
@@ -0,0 +1,56 @@
+#include <gtest/gtest.h>
+#include "HalideRawPipeline.h"
+#include "SyntheticRaw.h"
+#include "Telemetry.h"
+
+namespace {
+
+TEST(TelemetryTest, StageDurationSumsRepeatedStages) {
+    brightroom::PipelineTelemetry telemetry;
+    telemetry.stages = {{"process", std::chrono::nanoseconds{10}},
+                        {"setup", std::chrono::nanoseconds{5}},
+                        {"process", std::chrono::nanoseconds{20}}};
+    EXPECT_EQ(telemetry.StageDuration("process"), std::chrono::nanoseconds{30});
+    EXPECT_EQ(telemetry.StageDuration("setup"), std::chrono::nanoseconds{5});
+    EXPECT_EQ(telemetry.StageDuration("missing"), std::chrono::nanoseconds{0});
+}
+
+TEST(TelemetryTest, PipelineReportsStagesAllocationsAndThreads) {
+    constexpr int kWidth = 640;
+    constexpr int kHeight = 480;
+    brightroom::testing::SyntheticRaw raw(kWidth, kHeight);
+    brightroom::HalideRawPipeline pipeline(brightroom::IntermediateFormat::kFloat32);
+
+    pipeline.Preprocess(raw.File());
+    const auto& preprocess = pipeline.LastPreprocessTelemetry();
+    EXPECT_GT(preprocess.StageDuration("demosaic").count(), 0);
+    EXPECT_GT(preprocess.StageDuration("unpack").count(), 0);
+    // The unpacked 16-bit input and the demosaiced output
+    EXPECT_EQ(preprocess.bytes_allocated, size_t{kWidth} * kHeight * (sizeof(uint16_t) + 3 * sizeof(float)));
+    EXPECT_GT(preprocess.threads, 0);
+    EXPECT_GE(preprocess.total, preprocess.StageDuration("demosaic"));
+
+    ASSERT_TRUE(pipeline.Process(raw.File(), brightroom::Parameters{}).has_value());
+    const auto& process = pipeline.LastProcessTelemetry();
+    EXPECT_GT(process.StageDuration("linear").count(), 0);
+    EXPECT_GT(process.StageDuration("display").count(), 0);
+    // The output and the linear sRGB kept for the next edit
+    EXPECT_GE(process.bytes_allocated, size_t{kWidth} * kHeight * (3 + 3 * sizeof(float)));
+    EXPECT_GE(process.total, process.StageDuration("setup") + process.StageDuration("linear") +
+                                 process.StageDuration("display"));
+
+    // The second render reuses the output buffer, the linear sRGB and the baked tone curve
+    ASSERT_TRUE(pipeline.Process(raw.File(), brightroom::Parameters{}).has_value());
+    EXPECT_EQ(pipeline.LastProcessTelemetry().bytes_allocated, 0u);
+    EXPECT_EQ(pipeline.LastProcessTelemetry().StageDuration("tone_curve").count(), 0);
+    EXPECT_EQ(pipeline.LastProcessTelemetry().StageDuration("linear").count(), 0);
+}
+
+TEST(TelemetryTest, HalideThreadCountReportsTheLastSetCount) {
+    brightroom::SetHalideThreadCount(3);
+    EXPECT_EQ(brightroom::HalideThreadCount(), 3);
+    brightroom::SetHalideThreadCount(1);
+    EXPECT_EQ(brightroom::HalideThreadCount(), 1);
+}
+
+}  // namespace
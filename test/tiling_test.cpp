@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+#include <cstddef>
+#include "Tiling.h"
+
+namespace {
+
+using brightroom::Demosaic;
+using brightroom::PlanTiles;
+
+// A 100 MP frame in f32, whose demosaic alone takes 1.2 GB
+constexpr int kWidth = 11648;
+constexpr int kHeight = 8736;
+
+TEST(TilingTest, HaloCoversStencil) {
+    EXPECT_EQ(brightroom::DemosaicHalo(Demosaic::kBilinear), 1);
+    EXPECT_EQ(brightroom::DemosaicHalo(Demosaic::kMalvarHeCutler), 2);
+    EXPECT_EQ(brightroom::DemosaicHalo(Demosaic::kRcd), 10);
+}
+
+TEST(TilingTest, PlanFitsWorkingSet) {
+    for (size_t limit : {size_t{256} << 20, size_t{64} << 20, size_t{16} << 20}) {
+        const auto plan = PlanTiles(kWidth, kHeight, Demosaic::kRcd, 4, 1, 0, 16, limit);
+        EXPECT_LE(plan.working_set, limit) << limit;
+        EXPECT_TRUE(plan.within_limit) << limit;
+        EXPECT_EQ(plan.halo, 10);
+        EXPECT_EQ(plan.concurrency, 16);
+        EXPECT_GE(plan.tile_width, brightroom::kMinTileSize);
+        EXPECT_LE(plan.tile_width, brightroom::kMaxTileSize);
+    }
+}
+
+TEST(TilingTest, SmallerLimitGivesSmallerTiles) {
+    const auto large = PlanTiles(kWidth, kHeight, Demosaic::kBilinear, 4, 2, 0, 8, size_t{1} << 30);
+    const auto small = PlanTiles(kWidth, kHeight, Demosaic::kBilinear, 4, 2, 0, 8, size_t{8} << 20);
+    EXPECT_EQ(large.tile_width, brightroom::kMaxTileSize);
+    EXPECT_LT(small.tile_width, large.tile_width);
+    EXPECT_LT(small.working_set, large.working_set);
+}
+
+TEST(TilingTest, UnreachableLimitIsReported) {
+    const auto plan = PlanTiles(kWidth, kHeight, Demosaic::kBilinear, 4, 1, 0, 4, 1024);
+    EXPECT_EQ(plan.tile_width, brightroom::kMinTileSize);
+    EXPECT_EQ(plan.tile_height, brightroom::kMinTileSize);
+    EXPECT_EQ(plan.concurrency, 1);
+    EXPECT_GT(plan.working_set, 1024u);
+    EXPECT_FALSE(plan.within_limit);
+}
+
+TEST(TilingTest, FewerConcurrentTilesBeforeGivingUp) {
+    const auto smallest = PlanTiles(kWidth, kHeight, Demosaic::kBilinear, 4, 1, 0, 1, 1024);
+    // Room for four more tiles of intermediates, and the scratch of the one strip each of them is demosaiced in
+    const size_t tile_bytes = size_t{brightroom::kMinTileSize} * brightroom::kMinTileSize * 3 * 4 + smallest.scratch;
+    const auto plan =
+        PlanTiles(kWidth, kHeight, Demosaic::kBilinear, 4, 1, 0, 64, smallest.working_set + 4 * tile_bytes);
+    EXPECT_EQ(plan.tile_width, brightroom::kMinTileSize);
+    EXPECT_EQ(plan.concurrency, 5);
+    EXPECT_TRUE(plan.within_limit);
+}
+
+TEST(TilingTest, TilesAndConcurrencyFollowSmallFrames) {
+    const auto plan = PlanTiles(300, 200, Demosaic::kBilinear, 4, 1, 0, 16, size_t{1} << 30);
+    EXPECT_EQ(plan.tile_width, 300);
+    EXPECT_EQ(plan.tile_height, 200);
+    // One column of tiles leaves nothing to render in parallel
+    EXPECT_EQ(plan.concurrency, 1);
+}
+
+// The packed sensor data stays in memory for the whole export, and leaves less room for the tiles
+TEST(TilingTest, SensorDataCountsTowardsWorkingSet) {
+    constexpr size_t kLimit = size_t{256} << 20;
+    const auto without = PlanTiles(kWidth, kHeight, Demosaic::kBilinear, 4, 1, 0, 8, kLimit);
+    ASSERT_EQ(without.tile_width, brightroom::kMaxTileSize);
+    // Just too much for the largest tiles
+    const size_t sensor_bytes = kLimit - without.working_set + 1;
+    const auto with = PlanTiles(kWidth, kHeight, Demosaic::kBilinear, 4, 1, sensor_bytes, 8, kLimit);
+    EXPECT_TRUE(with.within_limit);
+    EXPECT_LT(with.tile_width, without.tile_width);
+    EXPECT_GE(with.working_set, sensor_bytes + with.scratch);
+}
+
+// RCD keeps a dozen planes per strip where the other engines keep one, and one strip per thread is in flight
+TEST(TilingTest, ScratchFollowsEngineAndThreads) {
+    const auto bilinear = PlanTiles(kWidth, kHeight, Demosaic::kBilinear, 4, 1, 0, 8, size_t{1} << 30);
+    const auto rcd = PlanTiles(kWidth, kHeight, Demosaic::kRcd, 4, 1, 0, 8, size_t{1} << 30);
+    ASSERT_EQ(bilinear.tile_width, rcd.tile_width);
+    EXPECT_GT(rcd.scratch, 10 * bilinear.scratch);
+    const auto one_thread = PlanTiles(kWidth, kHeight, Demosaic::kRcd, 4, 1, 0, 1, size_t{1} << 30);
+    EXPECT_EQ(rcd.scratch, 8 * one_thread.scratch);
+}
+
+}  // namespace
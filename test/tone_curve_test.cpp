@@ -0,0 +1,54 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include "HalideRawPipeline.h"
+#include "SyntheticRaw.h"
+#include "ToneCurve.h"
+
+namespace {
+
+TEST(ToneCurveTest, BakedCurveMatchesGammaAndContrast) {
+    std::vector<float> curve(brightroom::kToneCurveSize);
+    const float contrast_factor = 1.5f;
+    brightroom::BakeToneCurve(contrast_factor, curve);
+
+    EXPECT_FLOAT_EQ(curve.front(), 0.0f);
+    EXPECT_FLOAT_EQ(curve.back(), 1.0f);
+    // Sample i holds the input (i / (size - 1))^2
+    const size_t middle_index = (curve.size() - 1) / 2;
+    const float root = static_cast<float>(middle_index) / static_cast<float>(curve.size() - 1);
+    const float gamma_corrected = std::pow(root * root, 1.0f / 2.2f);
+    EXPECT_NEAR(curve[middle_index], std::clamp((gamma_corrected - 0.5f) * contrast_factor + 0.5f, 0.0f, 1.0f),
+                1e-6f);
+    EXPECT_TRUE(std::is_sorted(curve.begin(), curve.end()));
+}
+
+// The baked curve renders the same image as the analytic path. brightroom_bench's Process benchmark compares their
+// speed, with lut:0 and lut:1.
+TEST(ToneCurveTest, LookupTableMatchesAnalyticPath) {
+    brightroom::testing::SyntheticRaw raw(1536, 1024);
+    brightroom::Parameters parameters{};
+    parameters.contrast = 1.2f;
+
+    auto render = [&](brightroom::ToneCurveMode mode) {
+        brightroom::HalideRawPipeline pipeline(brightroom::IntermediateFormat::kFloat32, mode);
+        pipeline.Preprocess(raw.File());
+        return pipeline.Process(raw.File(), parameters);
+    };
+    const auto expected = render(brightroom::ToneCurveMode::kAnalytic);
+    const auto actual = render(brightroom::ToneCurveMode::kLookupTable);
+    ASSERT_TRUE(expected.has_value());
+    ASSERT_TRUE(actual.has_value());
+    ASSERT_EQ(expected->pixels->size(), actual->pixels->size());
+
+    int max_difference = 0;
+    for (size_t i = 0; i < expected->pixels->size(); ++i) {
+        max_difference = std::max(max_difference, std::abs(static_cast<int>((*expected->pixels)[i]) -
+                                                           static_cast<int>((*actual->pixels)[i])));
+    }
+    EXPECT_LE(max_difference, 1);
+}
+
+}  // namespace
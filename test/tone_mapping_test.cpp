@@ -0,0 +1,58 @@
+#include <gtest/gtest.h>
+#include "HalideRawPipeline.h"
+#include "SyntheticRaw.h"
+
+namespace {
+
+auto MeanLuma(const brightroom::RgbImage& image) -> double {
+    const auto& pixels = *image.pixels;
+    double sum = 0.0;
+    for (size_t i = 0; i + 2 < pixels.size(); i += 3) {
+        sum += 0.2126 * pixels[i] + 0.7152 * pixels[i + 1] + 0.0722 * pixels[i + 2];
+    }
+    return sum / static_cast<double>(pixels.size() / 3);
+}
+
+auto Render(brightroom::IRawPipeline& pipeline, const brightroom::RawFile& raw, float exposure, float key) -> double {
+    brightroom::Parameters parameters{};
+    parameters.exposure = exposure;
+    parameters.tone_mapping_key = key;
+    auto image = pipeline.Process(raw, parameters);
+    EXPECT_TRUE(image.has_value());
+    return image ? MeanLuma(*image) : 0.0;
+}
+
+TEST(ToneMappingTest, LogAverageIsMeasuredOncePerImage) {
+    brightroom::testing::SyntheticRaw raw(1536, 1024);
+    brightroom::HalideRawPipeline pipeline;
+    pipeline.Preprocess(raw.File(), brightroom::PreprocessMode::kPreview);
+    EXPECT_GT(pipeline.LastPreprocessTelemetry().StageDuration("statistics").count(), 0);
+
+    // The preview's measurement carries over to the full-resolution demosaic
+    pipeline.Preprocess(raw.File(), brightroom::PreprocessMode::kAddFullResolution);
+    EXPECT_EQ(pipeline.LastPreprocessTelemetry().StageDuration("statistics").count(), 0);
+    EXPECT_GT(Render(pipeline, raw.File(), 1.0f, 0.18f), 0.0);
+}
+
+TEST(ToneMappingTest, KeySetsBrightness) {
+    brightroom::testing::SyntheticRaw raw(1536, 1024);
+    brightroom::HalideRawPipeline pipeline;
+    pipeline.Preprocess(raw.File());
+    EXPECT_LT(Render(pipeline, raw.File(), 1.0f, 0.09f), Render(pipeline, raw.File(), 1.0f, 0.36f));
+}
+
+TEST(ToneMappingTest, NormalizesSceneBrightness) {
+    brightroom::testing::SyntheticRaw raw(1536, 1024);
+    // The same scene two stops darker
+    auto dark = raw.File();
+    dark.white *= 4;
+    brightroom::HalideRawPipeline pipeline;
+    brightroom::HalideRawPipeline dark_pipeline;
+    pipeline.Preprocess(raw.File());
+    dark_pipeline.Preprocess(dark);
+
+    EXPECT_GT(Render(pipeline, raw.File(), 1.0f, 0.0f) - Render(dark_pipeline, dark, 1.0f, 0.0f), 20.0);
+    EXPECT_NEAR(Render(pipeline, raw.File(), 1.0f, 0.18f), Render(dark_pipeline, dark, 1.0f, 0.18f), 2.0);
+}
+
+}  // namespace